@@ -35,6 +35,10 @@ uint8_t nonces[RADIOLIB_LORAWAN_NONCES_BUF_SIZE];
 // EEPROM store pro permanentno schovani nonces
 Preferences store;
 
+// uplinks and their results are recorded, or the results are taken from a recording
+TraceRecorder* trace_recorder = nullptr;
+TracePlayer*   trace_player   = nullptr;
+
 /**
  * Saves the nonces to persistent storage.
  *
@@ -231,6 +235,51 @@ int16_t lora_activate() {
     return state;
 }
 
+/**
+ * Record every uplink and its result, or replay the results of a recording
+ * instead of using the radio
+ *
+ * @param recorder  nullptr to not record
+ * @param player    nullptr to use the radio
+ */
+void lora_set_trace(TraceRecorder* recorder, TracePlayer* player) {
+    trace_recorder = recorder;
+    trace_player   = player;
+}
+
+/**
+ * Next recorded result. The recorded uplink before it is compared with the
+ * current one, so a change of the payload encoding shows up in a replay.
+ *
+ * @param data_up
+ * @param data_up_len
+ * @param data_down      [out]
+ * @param data_down_len  [out]
+ * @return recorded state, RADIOLIB_ERR_UNKNOWN at the end of the trace
+ */
+int16_t lora_replay(uint8_t* data_up, size_t data_up_len, uint8_t* data_down, size_t* data_down_len) {
+    static TraceEvent event;
+    int16_t           state;
+
+    while (trace_player->next(&event)) {
+        if (event.source != TRACE_SOURCE_LORA) {
+            continue;
+        }
+        if (event.kind == TRACE_LORA_UPLINK
+            && (event.len != data_up_len || memcmp(event.data, data_up, data_up_len) != 0)) {
+            M5.Display.println("Uplink differs from the trace");
+        }
+        if (event.kind == TRACE_LORA_RESULT && event.len >= sizeof(state)
+            && event.len - sizeof(state) <= RADIOLIB_LORAWAN_MAX_DOWNLINK_SIZE) {
+            memcpy(&state, event.data, sizeof(state));
+            *data_down_len = event.len - sizeof(state);
+            memcpy(data_down, event.data + sizeof(state), *data_down_len);
+            return state;
+        }
+    }
+    return RADIOLIB_ERR_UNKNOWN;
+}
+
 /**
  * Sends uplink payload and (if handler defined and downlink data available)
  * calls a downlink payload handler.
@@ -248,8 +297,19 @@ int16_t lora_send_receive(uint8_t* data_up, size_t data_up_len, void (*callback)
     LoRaWANEvent_t event_up;
     LoRaWANEvent_t event_down;
 
+    if (trace_recorder != nullptr) {
+        trace_recorder->record(TRACE_SOURCE_LORA, TRACE_LORA_UPLINK, data_up, data_up_len);
+    }
+
     // perform an uplink
-    state = node.sendReceive(data_up, data_up_len, 1, data_down, &data_down_len, false, &event_up, &event_down);
+    if (trace_player != nullptr) {
+        state = lora_replay(data_up, data_up_len, data_down, &data_down_len);
+    } else {
+        state = node.sendReceive(data_up, data_up_len, 1, data_down, &data_down_len, false, &event_up, &event_down);
+    }
+    if (trace_recorder != nullptr) {
+        trace_recorder->record(TRACE_SOURCE_LORA, TRACE_LORA_RESULT, &state, sizeof(state), data_down, data_down_len);
+    }
 
     if (state < RADIOLIB_ERR_NONE) {
         debug(F("data upload"), state);
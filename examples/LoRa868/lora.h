@@ -5,10 +5,12 @@
 #ifndef CORES3SE_ARDUINO_LORA_H
 #define CORES3SE_ARDUINO_LORA_H
 
+#include <Trace.h>
 
 int16_t lora_activate();
 void    lora_save_session();
 int16_t lora_send_receive(uint8_t* data_up, size_t data_up_len, void (*callback)(uint8_t*, size_t)) ;
 void lora_sleep();
+void lora_set_trace(TraceRecorder* recorder, TracePlayer* player);
 
 #endif //CORES3SE_ARDUINO_LORA_H
@@ -33,13 +33,16 @@
 #include <M5UnitUnified.h>
 #include <M5UnitUnifiedENV.h>
 #include <RadioLib.h>
+#include <SD.h>
 #include <WiFi.h>
 
 #include "main.h"
 
 #include <BMP280.h>
+#include <SensorFilter.h>
 
 #include "lora.h"
+#include "uplink.h"
 #include "utils.h"
 
 extern RTC_DATA_ATTR uint16_t bootCount;
@@ -55,16 +58,74 @@ m5::unit::UnitENV4 unitENV4;
 auto&              sht40  = unitENV4.sht40;
 auto&              bmp280 = unitENV4.bmp280;
 
+// configured on the first boot, constant initialized so a wakeup keeps the history
+RTC_DATA_ATTR SensorFilter temperature_filter;
+RTC_DATA_ATTR SensorFilter humidity_filter;
+RTC_DATA_ATTR SensorFilter pressure_filter;
+
+#ifdef TRACE_RECORD
+TraceRecorder recorder;
+#endif
+#ifdef TRACE_REPLAY
+// position in the trace, kept across deep sleep
+TracePlayer           player;
+RTC_DATA_ATTR long    trace_offset = 0;
+RTC_DATA_ATTR int64_t trace_time   = 0;
+#endif
+
+#if defined(TRACE_RECORD) || defined(TRACE_REPLAY)
 /**
- * Calculate altitude based on the pressure
+ * Mount the card and open the trace, a replay continues where the previous
+ * wakeup stopped
  *
- * @param pressure  atmospherical pressure
- * @param seaLvhPa  pressure for the see level
+ * @return false if there is no card or no trace to replay
+ */
+bool trace_begin() {
+    if (!SD.begin(TRACE_SD_CS, SPI, 25000000)) {
+        return false;
+    }
+#ifdef TRACE_RECORD
+    // real time clock, it keeps running in deep sleep
+    if (!recorder.open(TRACE_FILE, CLOCK_REALTIME)) {
+        return false;
+    }
+    lora_set_trace(&recorder, nullptr);
+#else
+    if (!player.open(TRACE_FILE) || (trace_offset > 0 && !player.seek(trace_offset, trace_time))) {
+        return false;
+    }
+    lora_set_trace(nullptr, &player);
+#endif
+    return true;
+}
+#endif
+
+/**
+ * Current values of the ENV unit, or the next recorded ones on replay
  *
- * @return altitude in meters
+ * @param env  [out]
+ * @return false at the end of the trace
  */
-float calculate_altitude(const float pressure, const float seaLvhPa = 1013.25f) {
-    return 44330.f * (1.0f - pow((pressure / 100.f) / seaLvhPa, 0.1903f));
+bool read_env(TraceEnv* env) {
+#ifdef TRACE_REPLAY
+    static TraceEvent event;
+    while (player.next(&event)) {
+        if (event.source == TRACE_SOURCE_ENV && event.kind == TRACE_ENV_READING && event.len == sizeof(*env)) {
+            memcpy(env, event.data, sizeof(*env));
+            return true;
+        }
+    }
+    return false;
+#else
+    env->temperature     = sht40.temperature();
+    env->humidity        = sht40.humidity();
+    env->pressure        = bmp280.pressure();
+    env->bmp_temperature = bmp280.temperature();
+#ifdef TRACE_RECORD
+    recorder.record(TRACE_SOURCE_ENV, TRACE_ENV_READING, env, sizeof(*env));
+#endif
+    return true;
+#endif
 }
 
 /**
@@ -95,11 +156,19 @@ void deepsleep(uint32_t seconds) {
     // give the user a chance to read the display
     vTaskDelay(2000 / portTICK_PERIOD_MS);
 
+#ifdef TRACE_RECORD
+    recorder.close();
+#endif
+#ifdef TRACE_REPLAY
+    trace_offset = player.tell();
+    trace_time   = player.now();
+#else
     // put LoRa into the sleep mode
     lora_sleep();
 
     // put sensor into the sleep mode
     bmp280.writePowerMode(m5::unit::bmp280::PowerMode::Sleep);
+#endif
 
     M5.Display.sleep();
     M5.Display.waitDisplay();
@@ -200,6 +269,16 @@ void setup() {
 
     print_wakeup_reason();
 
+#if defined(TRACE_RECORD) || defined(TRACE_REPLAY)
+    if (!trace_begin()) {
+        M5.Display.println("Trace not available");
+    }
+#endif
+
+#ifdef TRACE_REPLAY
+    // no unit and no radio, the readings and the uplink results come from the trace
+    state = RADIOLIB_LORAWAN_SESSION_RESTORED;
+#else
     auto pin_num_sda = M5.getPin(m5::pin_name_t::port_a_sda);
     auto pin_num_scl = M5.getPin(m5::pin_name_t::port_a_scl);
 
@@ -224,79 +303,65 @@ void setup() {
     sht40.update(true);
     bmp280.update(true);
 
-    while (!(sht40.updated() )) {
-        sht40.update(true);
-        delay(500);
-    }
-
-    while (!(bmp280.updated() )) {
-        bmp280.update(true);
-        delay(500);
+    while (!sht40.updated() || !bmp280.updated()) {
+        delay(ENV_POLL_TIME);
+        if (!sht40.updated()) {
+            sht40.update(true);
+        }
+        if (!bmp280.updated()) {
+            bmp280.update(true);
+        }
     }
 
     state = lora_activate();
+#endif
 
     if (state == RADIOLIB_LORAWAN_NEW_SESSION || state == RADIOLIB_LORAWAN_SESSION_RESTORED) {
-        uint8_t uplink_buff[52];
-        uint8_t uplink_buff_size = 0;
+        uint8_t      uplink_buff[UPLINK_MAX_SIZE];
+        size_t       uplink_buff_size;
+        UplinkPower  power;
+        UplinkValues values;
 
         // prepare payload
-        bool    bat_ischarging = M5.Power.isCharging();
-        int16_t bat_vol        = M5.Power.getBatteryVoltage(); // 0 .. 4095 voltage in millivolt
-        int32_t bat_level      = M5.Power.getBatteryLevel();   // 0 .. 100  voltage percent
-        int16_t vbus_vol       = M5.Power.getVBUSVoltage();    // 0 .. 4095 voltage in millivolt, -1 if not applicable
-        float   temp           = 0.0f;
-        float   humi           = 0.0f;
-        float   pressure       = 0.0f;
-        float   pressure_hpa   = 0.0f;
-        float   altitude       = 0.0f;
-        float   ttemp          = 0.0f;
-
-
-
-        temp         = sht40.temperature();
-        humi         = sht40.humidity();
-        pressure     = bmp280.pressure();
-        ttemp        = bmp280.temperature();
-        altitude     = calculate_altitude(pressure);
-        pressure_hpa = pressure / 100.0f;
-
-        M5.Display.fillRect(0, 0, 320, 60, TFT_BLACK);
+        power.charging      = M5.Power.isCharging();
+        power.battery_mv    = M5.Power.getBatteryVoltage(); // 0 .. 4095 voltage in millivolt
+        power.battery_level = M5.Power.getBatteryLevel();   // 0 .. 100  voltage percent
+        power.vbus_mv       = M5.Power.getVBUSVoltage();    // 0 .. 4095 voltage in millivolt, -1 if not applicable
+
+        TraceEnv env;
+        if (!read_env(&env)) {
+            M5.Display.println("End of the trace");
+            while (true) {
+                m5::utility::delay(10000);
+            }
+        }
+
+        if (temperature_filter.stages() == 0 &&
+            (!temperature_filter.configure(ENV_FILTER) || !humidity_filter.configure(ENV_FILTER) ||
+             !pressure_filter.configure(ENV_FILTER))) {
+            M5.Display.println("Invalid ENV_FILTER");
+        }
+        uplink_values(&env, &temperature_filter, &humidity_filter, &pressure_filter, &values);
+
+        M5.Display.fillRect(0, 0, 320, 70, TFT_BLACK);
         M5.Display.setCursor(0, 0);
-        M5.Display.printf(">Temperature: %.1f\n", temp);
-        M5.Display.printf(">Humidity:    %.1f\n", humi);
-        M5.Display.printf(">Pressure:    %.1f\n", pressure_hpa);
-        M5.Display.printf(">Altitude:    %.1f\n", altitude);
-        M5.Display.printf(">BMP280 temp: %.1f\n", ttemp);
+        M5.Display.printf(">Temperature: %.1f\n", values.temperature);
+        M5.Display.printf(">Humidity:    %.1f\n", values.humidity);
+        M5.Display.printf(">Dew point:   %.1f\n", values.dew_point);
+        M5.Display.printf(">Pressure:    %.1f\n", values.pressure_hpa);
+        M5.Display.printf(">Altitude:    %.1f\n", values.altitude);
+        M5.Display.printf(">BMP280 temp: %.1f\n", values.bmp_temperature);
         M5.Display.println();
 
-        uplink_buff[uplink_buff_size++] = bat_ischarging ? 1 : 0;
-        uplink_buff[uplink_buff_size++] = bat_vol >> 8;
-        uplink_buff[uplink_buff_size++] = bat_vol & 0xFF;
-        uplink_buff[uplink_buff_size++] = bat_level & 0xFF;
-        uplink_buff[uplink_buff_size++] = vbus_vol == -1 ? 0x00 : vbus_vol >> 8;
-        uplink_buff[uplink_buff_size++] = vbus_vol == -1 ? 0x00 : vbus_vol & 0xFF;
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&temp)[3];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&temp)[2];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&temp)[1];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&temp)[0];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&humi)[3];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&humi)[2];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&humi)[1];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&humi)[0];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&pressure_hpa)[3];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&pressure_hpa)[2];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&pressure_hpa)[1];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&pressure_hpa)[0];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&altitude)[3];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&altitude)[2];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&altitude)[1];
-        uplink_buff[uplink_buff_size++] = ((uint8_t*)&altitude)[0];
+        uplink_buff_size = uplink_encode(&power, &values, uplink_buff);
 
         lora_send_receive(uplink_buff, uplink_buff_size, downlink_handler);
+#ifndef TRACE_REPLAY
+        // a replay never activates the node, its session buffer is not valid
         lora_save_session();
+#endif
 
-        deepsleep(TIME_TO_SLEEP);
+        deepsleep(SLEEP_TIME);
     } else {
         M5.Display.clear(TFT_RED);
         M5.Display.setCursor(0, 0);
@@ -3,6 +3,21 @@
 
 #define TIME_TO_SLEEP  15 * 60         // sleep time in seconds (15 minutes)
 
+// ENV readings and uplinks are recorded (-DTRACE_RECORD) to the SD card or
+// replayed (-DTRACE_REPLAY) from it without the unit and the radio; a replay
+// with TRACE_REPLAY=0 wakes up after 1 s instead of TIME_TO_SLEEP
+#define TRACE_FILE   "/sd/lora.trc"
+#define TRACE_SD_CS  GPIO_NUM_4
+
+#if defined(TRACE_REPLAY) && TRACE_REPLAY == 0
+#define SLEEP_TIME   1
+#else
+#define SLEEP_TIME   TIME_TO_SLEEP
+#endif
+
+// the ENV unit is polled every ENV_POLL_TIME ms until both sensors have a reading
+#define ENV_POLL_TIME 20
+
 // first you have to set your radio model and pin configuration
 //
 #define CONFIG_LORA_NSS  GPIO_NUM_0
@@ -0,0 +1,70 @@
+//
+// ENV values and uplink payload, shared by the node and the host replay test.
+//
+
+#include <math.h>
+#include <EnvMath.h>
+
+#include "uplink.h"
+
+/**
+ * @param filter
+ * @param value
+ * @param scale  raw units per unit of value
+ * @return filtered value
+ */
+static float filtered(SensorFilter* filter, float value, float scale) {
+    return filter->update((int32_t)lroundf(value * scale)) / scale;
+}
+
+// big endian float
+static size_t put_float(uint8_t* buffer, float value) {
+    for (uint8_t i = 0; i < 4; i++) {
+        buffer[i] = ((uint8_t*)&value)[3 - i];
+    }
+    return 4;
+}
+
+/**
+ * Filter one ENV reading and derive the altitude and the dew point. The
+ * filters run in 0.01 °C, 0.01 %RH and Pa.
+ *
+ * @param env
+ * @param temperature  filter of the SHT40 temperature
+ * @param humidity     filter of the SHT40 humidity
+ * @param pressure     filter of the BMP280 pressure
+ * @param values       [out]
+ */
+void uplink_values(const TraceEnv* env, SensorFilter* temperature, SensorFilter* humidity, SensorFilter* pressure,
+                   UplinkValues* values) {
+    float pa = filtered(pressure, env->pressure, 1);
+
+    values->temperature     = filtered(temperature, env->temperature, 100);
+    values->humidity        = filtered(humidity, env->humidity, 100);
+    values->pressure_hpa    = pa / 100.0f;
+    values->altitude        = env_altitude(pa);
+    values->dew_point       = env_dew_point(values->temperature, values->humidity);
+    values->bmp_temperature = env->bmp_temperature;
+}
+
+/**
+ * @param power
+ * @param values
+ * @param buffer  [out] UPLINK_MAX_SIZE bytes
+ * @return payload length
+ */
+size_t uplink_encode(const UplinkPower* power, const UplinkValues* values, uint8_t* buffer) {
+    size_t len = 0;
+
+    buffer[len++] = power->charging ? 1 : 0;
+    buffer[len++] = power->battery_mv >> 8;
+    buffer[len++] = power->battery_mv & 0xFF;
+    buffer[len++] = power->battery_level & 0xFF;
+    buffer[len++] = power->vbus_mv == -1 ? 0x00 : power->vbus_mv >> 8;
+    buffer[len++] = power->vbus_mv == -1 ? 0x00 : power->vbus_mv & 0xFF;
+    len += put_float(&buffer[len], values->temperature);
+    len += put_float(&buffer[len], values->humidity);
+    len += put_float(&buffer[len], values->pressure_hpa);
+    len += put_float(&buffer[len], values->altitude);
+    return len;
+}
@@ -0,0 +1,45 @@
+//
+// ENV values and uplink payload, shared by the node and the host replay test.
+//
+
+#ifndef CORES3SE_ARDUINO_UPLINK_H
+#define CORES3SE_ARDUINO_UPLINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SensorFilter.h>
+#include <Trace.h>
+
+// filter of the uplink values in 0.01 °C, 0.01 %RH and Pa, one sample per
+// wakeup, the history is kept in RTC memory across deep sleep. A single
+// outlier is dropped, the second one in a row is taken as a step: with the
+// default run of the stage a real step would wait three wakeups (45 min).
+#ifndef ENV_FILTER
+#define ENV_FILTER "outlier:4:50:1"
+#endif
+
+#define UPLINK_MAX_SIZE   52
+// battery and VBUS come first, they are not part of the recorded readings
+#define UPLINK_ENV_OFFSET 6
+
+struct UplinkPower {
+    bool    charging;
+    int16_t battery_mv;       // 0 .. 4095
+    int32_t battery_level;    // 0 .. 100 %
+    int16_t vbus_mv;          // -1 if not applicable
+};
+
+struct UplinkValues {
+    float temperature;        // °C, filtered
+    float humidity;           // %RH, filtered
+    float pressure_hpa;       // filtered
+    float altitude;           // m
+    float dew_point;          // °C
+    float bmp_temperature;    // °C
+};
+
+void   uplink_values(const TraceEnv* env, SensorFilter* temperature, SensorFilter* humidity, SensorFilter* pressure,
+                     UplinkValues* values);
+size_t uplink_encode(const UplinkPower* power, const UplinkValues* values, uint8_t* buffer);
+
+#endif //CORES3SE_ARDUINO_UPLINK_H
@@ -0,0 +1,130 @@
+//
+// Alarm rules on registry points, compiled into a per-point table.
+//
+
+#ifndef M5STACK_ALARM_ENGINE_H
+#define M5STACK_ALARM_ENGINE_H
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+
+#define ALARM_MAX_RULES 16384
+
+/*
+ * Meaning of the rule fields per type, values in registry units:
+ *
+ *   HIGH       value > limit raises, value < limit - hysteresis clears
+ *   LOW        value < limit raises, value > limit + hysteresis clears
+ *   ROC        |change| per window_ms > limit raises, < limit - hysteresis clears;
+ *              the change is taken against a sample at least window_ms old
+ *   STUCK      no change larger than limit for window_ms raises, a change clears
+ *   COMM_LOSS  bad quality (Modbus error) raises, the next good value clears
+ *
+ * A raising condition must hold for delay_ms before the alarm becomes active.
+ */
+enum AlarmType : uint8_t {
+    ALARM_HIGH = 0,
+    ALARM_LOW,
+    ALARM_ROC,
+    ALARM_STUCK,
+    ALARM_COMM_LOSS,
+};
+
+enum AlarmAction : uint8_t {
+    ALARM_ACTION_NONE   = 0x00,
+    ALARM_ACTION_BUZZER = 0x01,
+    ALARM_ACTION_RELAY  = 0x02,     // relay on while active
+    ALARM_ACTION_UPLINK = 0x04,
+};
+
+struct AlarmRule {
+    uint16_t point;
+    uint8_t  type;            // AlarmType
+    uint8_t  actions;         // AlarmAction bits
+    int32_t  limit;
+    int32_t  hysteresis;
+    uint32_t delay_ms;
+    uint32_t window_ms;       // ROC, STUCK
+    uint8_t  relay;           // ALARM_ACTION_RELAY
+};
+
+struct AlarmEvent {
+    uint16_t rule;            // index in the rule list passed to compile()
+    uint16_t point;
+    uint8_t  type;
+    uint8_t  actions;
+    uint8_t  relay;
+    bool     active;          // raised or cleared
+    int32_t  value;
+    int64_t  time;
+};
+
+struct AlarmBenchmark {
+    uint32_t rules;
+    uint32_t samples;
+    int64_t  indexed_nsec;    // per point table
+    int64_t  scan_nsec;       // all rules checked for every sample, for comparison
+};
+
+// runs in the task that updated the point, with the engine locked
+typedef std::function<void(const AlarmEvent& event)> AlarmHandler;
+
+/**
+ * compile() sorts the rules by point and stores them as one flat array with
+ * an offset table (CSR), so a sample is checked only against the rules of
+ * its point. Thresholds for raising and clearing are precomputed. Rule
+ * state is kept in a parallel array.
+ */
+class AlarmEngine {
+    struct Compiled {
+        int32_t  raise;
+        int32_t  clear;
+        uint32_t delay;
+        uint32_t window;
+        uint16_t rule;
+        uint16_t point;
+        uint8_t  type;
+        uint8_t  actions;
+        uint8_t  relay;
+    };
+
+    struct State {
+        int64_t since;        // condition changed, INT64_MIN = stable
+        int64_t ref_time;     // ROC, STUCK reference sample
+        int64_t next_time;    // ROC, next reference once it is window_ms old
+        int32_t ref_value;
+        int32_t next_value;
+        bool    has_ref;
+        bool    has_next;
+        bool    active;
+    };
+
+    Compiled*    _rules;
+    State*       _state;
+    uint32_t*    _first;      // _first[p] .. _first[p + 1] are the rules of point p
+    uint16_t     _count;
+    uint16_t     _points;
+    uint16_t     _active;
+    AlarmHandler _handler;
+    std::mutex   _lock;
+
+    bool check(const Compiled* rule, State* state, int32_t value, bool good, int64_t time);
+    void release();
+
+public:
+    AlarmEngine();
+    ~AlarmEngine();
+
+    bool     compile(const AlarmRule* rules, uint16_t count, uint16_t points);
+    void     onAlarm(AlarmHandler handler);
+    void     evaluate(uint16_t point, int32_t value, bool good, int64_t time);
+
+    uint16_t size();
+    uint16_t active();
+    bool     isActive(uint16_t rule);
+
+    static void benchmark(uint16_t rules, uint16_t points, uint32_t samples, AlarmBenchmark* result);
+};
+
+#endif // M5STACK_ALARM_ENGINE_H
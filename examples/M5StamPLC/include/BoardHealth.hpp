@@ -0,0 +1,70 @@
+//
+// StamPLC board telemetry: INA226 supply voltage/current and LM75 temperature.
+//
+
+#ifndef M5STACK_BOARD_HEALTH_H
+#define M5STACK_BOARD_HEALTH_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <functional>
+
+#include "SensorRegistry.hpp"
+
+#define INA226_ADDR           0x40
+#define LM75_ADDR             0x48
+#define BOARD_I2C_FREQ        400000
+
+// board specific, check against the schematic of the board revision
+#ifndef INA226_ALERT_PIN
+#define INA226_ALERT_PIN      GPIO_NUM_11
+#endif
+#ifndef LM75_OS_PIN
+#define LM75_OS_PIN           GPIO_NUM_12
+#endif
+#ifndef INA226_SHUNT_MOHM
+#define INA226_SHUNT_MOHM     10
+#endif
+
+#define BOARD_PERIOD          1000    // sampling period in milliseconds
+#define BOARD_MAX_CURRENT     2000    // over-current alert in mA
+#define BOARD_MAX_TEMPERATURE 700     // over-temperature alert in tenths of °C
+#define BOARD_TEMP_HYSTERESIS 50      // tenths of °C
+#define BOARD_TASK_STACK      4096
+#define BOARD_TASK_PRIORITY   2
+
+enum BoardAlert : uint8_t {
+    BOARD_ALERT_CURRENT     = 0x01,
+    BOARD_ALERT_TEMPERATURE = 0x02,
+};
+
+typedef std::function<void(uint8_t alerts)> BoardAlertHandler;
+
+class BoardHealth {
+    SensorRegistry*   _registry;
+    PointHandle       _voltage_point;
+    PointHandle       _current_point;
+    PointHandle       _temperature_point;
+    TaskHandle_t      _task;
+    BoardAlertHandler _alert_handler;
+    std::atomic<uint8_t> _alerts{0};
+
+    bool writeRegister16(uint8_t addr, uint8_t reg, uint16_t value);
+    bool readRegister16(uint8_t addr, uint8_t reg, uint16_t* value);
+    void configure();
+    void sample();
+
+    static void IRAM_ATTR currentIsr(void* arg);
+    static void IRAM_ATTR temperatureIsr(void* arg);
+    static void samplerTask(void* arg);
+
+public:
+    explicit BoardHealth(SensorRegistry* registry);
+
+    void         begin(int core = tskNO_AFFINITY);
+    void         onAlert(BoardAlertHandler handler);
+    uint8_t      getAlerts();
+    TaskHandle_t getTask();
+};
+
+#endif // M5STACK_BOARD_HEALTH_H
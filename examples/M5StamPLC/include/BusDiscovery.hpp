@@ -0,0 +1,59 @@
+//
+// Modbus RTU bus discovery and device fingerprinting.
+//
+
+#ifndef M5STACK_BUS_DISCOVERY_H
+#define M5STACK_BUS_DISCOVERY_H
+
+#include <Arduino.h>
+#include <freertos/semphr.h>
+
+#include "M5Modbus.hpp"
+
+#define DISCOVERY_FIRST_ADDR   1
+#define DISCOVERY_LAST_ADDR    247
+#define DISCOVERY_QUEUED       32      // probes waiting in the RTU client queue, sent one at a time
+#define DISCOVERY_TURNAROUND   15      // slave processing time allowed in milliseconds
+#define DISCOVERY_MAX_DEVICES  32
+
+/**
+ * Register map of a known device type. A device matches when the registers
+ * can be read and every value is within [min, max].
+ */
+struct DeviceFingerprint {
+    const char* name;
+    uint8_t     function;       // READ_HOLD_REGISTER or READ_INPUT_REGISTER
+    uint16_t    reg;
+    uint8_t     count;          // at most 4 registers
+    int16_t     min[4];
+    int16_t     max[4];
+};
+
+struct DiscoveredDevice {
+    uint8_t                  address;
+    uint32_t                 baudrate;
+    const DeviceFingerprint* type;      // nullptr = unknown device
+};
+
+class BusDiscovery {
+    M5Modbus*         _modbus;
+    SemaphoreHandle_t _slots;
+    SemaphoreHandle_t _done;
+    uint8_t           _answered[(DISCOVERY_LAST_ADDR + 8) / 8];
+    uint16_t          _outstanding;
+    portMUX_TYPE      _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    void     probeFinished(uint32_t token, bool answered);
+    uint16_t scanBaudrate(uint32_t baud, DiscoveredDevice* devices, uint16_t found, uint16_t max);
+    const DeviceFingerprint* fingerprint(uint8_t addr);
+
+public:
+    explicit BusDiscovery(M5Modbus* modbus);
+    ~BusDiscovery();
+
+    uint16_t scan(const uint32_t* baudrates, uint8_t count, DiscoveredDevice* devices, uint16_t max);
+
+    static uint32_t probeTimeout(uint32_t baud);
+};
+
+#endif // M5STACK_BUS_DISCOVERY_H
@@ -0,0 +1,48 @@
+//
+// Passive RS485 Modbus RTU bus sniffer.
+//
+
+#ifndef M5STACK_BUS_SNIFFER_H
+#define M5STACK_BUS_SNIFFER_H
+
+#include <Arduino.h>
+#include <freertos/ringbuf.h>
+
+#include "SnifferDecoder.hpp"
+
+#define SNIFFER_RING_SIZE      8192   // frames waiting for the writer task
+#define SNIFFER_TASK_STACK     4096
+#define SNIFFER_TASK_PRIORITY  2
+// UART RX timeout in character times, below t1.5 so that a slave answering
+// right after the request is read separately, the decoder joins the parts
+// of a frame again
+#define SNIFFER_RX_TIMEOUT     1
+
+class BusSniffer {
+    HardwareSerial*   _serial;
+    Print*            _sink;
+    RingbufHandle_t   _ring;
+    TaskHandle_t      _writer;
+    uint32_t          _baudrate;
+    uint32_t          _config;
+    uint32_t          _dropped;
+    SnifferDecoder    _decoder;
+
+    void        onReceive();
+    void        onFrame(const SnifferRecord& record, const uint8_t* frame);
+    static void writerTask(void* arg);
+
+public:
+    BusSniffer(HardwareSerial* serial, uint32_t baud, uint32_t config = SERIAL_8N1);
+    ~BusSniffer();
+
+    void begin(Print* sink, int8_t rx_pin, int8_t rede_pin);
+    void end();
+
+    uint32_t getFrames();
+    uint32_t getCrcErrors();
+    uint32_t getDropped();
+    bool     getSlaveStats(uint8_t addr, SnifferSlaveStats* stats);
+};
+
+#endif // M5STACK_BUS_SNIFFER_H
@@ -0,0 +1,36 @@
+//
+// CAN bus backend interface: TWAI on the StamPLC, SocketCAN on Linux.
+//
+
+#ifndef M5STACK_CAN_BACKEND_H
+#define M5STACK_CAN_BACKEND_H
+
+#include <stdint.h>
+
+#define CAN_MAX_PAYLOAD    8
+#define CANFD_MAX_PAYLOAD  64
+
+/**
+ * CAN or CAN FD frame with an extended (29 bit) identifier
+ */
+struct CanFrame {
+    uint32_t id;
+    uint8_t  len;
+    uint8_t  data[CANFD_MAX_PAYLOAD];
+};
+
+class CanBackend {
+public:
+    virtual ~CanBackend() {}
+
+    virtual bool    send(const CanFrame& frame, uint32_t timeout_ms) = 0;
+    virtual bool    receive(CanFrame* frame, uint32_t timeout_ms) = 0;
+
+    // accept only frames with (frame.id & mask) == (id & mask), in hardware where possible
+    virtual bool    setFilter(uint32_t id, uint32_t mask) = 0;
+
+    // CAN_MAX_PAYLOAD, or CANFD_MAX_PAYLOAD if the bus runs CAN FD
+    virtual uint8_t maxPayload() = 0;
+};
+
+#endif // M5STACK_CAN_BACKEND_H
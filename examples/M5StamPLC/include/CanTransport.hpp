@@ -0,0 +1,100 @@
+//
+// Sensor point transport over CAN with batched frames.
+//
+
+#ifndef M5STACK_CAN_TRANSPORT_H
+#define M5STACK_CAN_TRANSPORT_H
+
+#include <stdint.h>
+#include <functional>
+
+#include "CanBackend.hpp"
+
+/*
+ * Extended identifier layout:
+ *
+ *   28..24  message type
+ *   23..16  node id of the sender
+ *   15..0   point index of the first value in the frame
+ *
+ * The payload is a run of little endian values for the points first,
+ * first + 1, ... CAN_TYPE_POINTS frames carry int16 values (4 in a classic
+ * frame, up to 32 in CAN FD), CAN_TYPE_POINTS32 frames int32 values (2, up
+ * to 16). A transport sends one of the two, a receiver decodes both. Values
+ * outside the range of an int16 transport are clamped and counted in
+ * CanStats::tx_clamped.
+ */
+#define CAN_TYPE_POINTS     0x01
+#define CAN_TYPE_POINTS32   0x03
+#define CAN_TYPE_MASK       0x1D      // both point types
+
+#define CAN_ID(type, node, point)  (((uint32_t)(type) << 24) | ((uint32_t)(node) << 16) | (point))
+#define CAN_ID_TYPE(id)            (((id) >> 24) & 0x1F)
+#define CAN_ID_NODE(id)            (((id) >> 16) & 0xFF)
+#define CAN_ID_POINT(id)           ((id) & 0xFFFF)
+
+#define CAN_NODE_ANY        0xFFFF    // listen() to all nodes
+
+#define CAN_VALUE_INVALID   INT16_MIN          // point has bad quality
+#define CAN_VALUE_SKIP      (INT16_MIN + 1)    // gap or padding, no point
+#define CAN_VALUE32_INVALID INT32_MIN
+#define CAN_VALUE32_SKIP    (INT32_MIN + 1)
+
+#define CAN_BATCH_FRAMES    64        // frames queued before an implicit flush
+#define CAN_TX_TIMEOUT      10        // ms per frame
+
+struct CanStats {
+    uint32_t tx_frames;
+    uint32_t tx_points;
+    uint32_t tx_bytes;        // payload
+    uint32_t tx_errors;       // frames not accepted by the backend
+    uint32_t tx_clamped;      // values outside the int16 range
+    uint32_t rx_frames;
+    uint32_t rx_points;
+};
+
+struct CanBenchmark {
+    uint32_t points;          // per round
+    uint32_t rounds;
+    uint32_t frames;          // sent in total
+    uint32_t received;        // points decoded by the receiver
+    int64_t  total_nsec;
+};
+
+// node, point index, value; valid is false for CAN_VALUE_INVALID
+typedef std::function<void(uint8_t node, uint16_t point, int32_t value, bool valid)> CanPointHandler;
+
+/**
+ * Point values are queued and packed into as few frames as possible: runs of
+ * consecutive points share a frame, small gaps are filled with CAN_VALUE_SKIP.
+ * Frames are sent on flush(), so one batch is handed to the backend at once.
+ */
+class CanTransport {
+    CanBackend* _backend;
+    uint8_t     _node;
+    uint8_t     _width;           // bytes per value, 2 or 4
+    uint8_t     _slots;           // values per frame
+    CanFrame    _batch[CAN_BATCH_FRAMES];
+    uint16_t    _batched;
+    uint16_t    _open;            // values in the last frame of the batch
+    CanStats    _stats;
+
+    void     closeFrame();
+    void     decode(const CanFrame& frame, const CanPointHandler& handler);
+
+public:
+    CanTransport(CanBackend* backend, uint8_t node, bool wide = false);
+
+    bool     listen(uint16_t node);
+
+    void     queue(uint16_t point, int32_t value, bool valid);
+    uint16_t flush();
+    uint16_t poll(const CanPointHandler& handler, uint32_t timeout_ms);
+
+    void     getStats(CanStats* stats);
+    void     resetStats();
+
+    static void benchmark(CanBackend* tx, CanBackend* rx, uint16_t points, uint32_t rounds, CanBenchmark* result);
+};
+
+#endif // M5STACK_CAN_TRANSPORT_H
@@ -0,0 +1,143 @@
+//
+// Site configuration: text file compiled into a binary image loaded in place.
+//
+
+#ifndef M5STACK_CONFIG_IMAGE_H
+#define M5STACK_CONFIG_IMAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Text format, one section per line, values are numbers (0x.. for hex),
+ * bare words or "quoted strings":
+ *
+ *   # comment
+ *   bus     baudrate=9600 format=8N1 timeout=1000 poll=5000
+ *   sensor  id=0 address=2 name=S-0 description="Hall"
+ *   point   name=P-1 address=3 function=4 register=0x0010 scale=10 description="Flow"
+ *   lora    dev_eui=70B3D57ED0000001 join_eui=0000000000000000 app_key=<32 hex> nwk_key=<32 hex>
+ *
+ * Image layout, little endian: ConfigHeader, sensors, points, string pool.
+ * Strings are offsets into the pool, offset 0 is the empty string. Sensor
+ * ids are unique. The CRC
+ * covers the whole image with the crc field set to 0; source_crc is the CRC
+ * of the text the image was compiled from. tools/plcconf.py writes the same
+ * image on a PC.
+ */
+#define CONFIG_MAGIC       "PCF1"
+#define CONFIG_VERSION     1
+#define CONFIG_MAX_SENSORS 16
+#define CONFIG_MAX_POINTS  4096
+
+// value ranges, checked by compile() and again by load()
+#define CONFIG_MAX_BAUDRATE 921600
+#define CONFIG_MAX_TIMEOUT  60000       // ms
+#define CONFIG_MAX_POLL     86400000    // ms
+#define CONFIG_MAX_ADDRESS  247
+#define CONFIG_MAX_FUNCTION 4
+#define CONFIG_MAX_SCALE    10000
+
+// used when the bus line is missing, same as MODBUS_TIMEOUT and POLL_INTERVAL
+#define CONFIG_DEFAULT_BAUDRATE 9600
+#define CONFIG_DEFAULT_TIMEOUT  1000
+#define CONFIG_DEFAULT_POLL     5000
+
+struct __attribute__((packed)) ConfigBus {
+    uint32_t baudrate;
+    uint8_t  data_bits;
+    uint8_t  parity;          // 'N', 'E', 'O'
+    uint8_t  stop_bits;
+    uint8_t  reserved;
+    uint32_t timeout;         // ms
+    uint32_t poll_interval;   // ms
+};
+
+struct __attribute__((packed)) ConfigLora {
+    uint8_t enabled;
+    uint8_t reserved[3];
+    uint8_t dev_eui[8];       // MSB first, as printed
+    uint8_t join_eui[8];
+    uint8_t app_key[16];
+    uint8_t nwk_key[16];
+};
+
+struct __attribute__((packed)) ConfigHeader {
+    char       magic[4];
+    uint16_t   version;
+    uint16_t   crc;
+    uint32_t   size;          // whole image
+    uint16_t   source_crc;
+    uint16_t   sensor_count;
+    uint16_t   point_count;
+    uint16_t   reserved;
+    uint32_t   sensors;       // offsets from the start of the image
+    uint32_t   points;
+    uint32_t   strings;
+    ConfigBus  bus;
+    ConfigLora lora;
+};
+
+struct __attribute__((packed)) ConfigSensor {
+    uint8_t  id;
+    uint8_t  address;
+    uint16_t reserved;
+    uint32_t name;            // string offsets
+    uint32_t description;
+};
+
+struct __attribute__((packed)) ConfigPoint {
+    uint32_t name;
+    uint32_t description;
+    uint16_t reg;
+    uint16_t scale;
+    uint8_t  address;
+    uint8_t  function;        // Modbus function code
+    uint16_t reserved;
+};
+
+struct ConfigError {
+    uint16_t    line;         // 0 = not a syntax error
+    const char* message;
+};
+
+struct ConfigBenchmark {
+    uint16_t points;
+    size_t   text_bytes;
+    size_t   image_bytes;
+    int64_t  compile_nsec;
+    int64_t  load_nsec;
+};
+
+/**
+ * The image is validated once by load() and then read through pointers into
+ * the buffer, nothing is copied or parsed at boot.
+ */
+class ConfigImage {
+    uint8_t*            _data;
+    size_t              _size;
+    const ConfigHeader* _header;
+
+public:
+    ConfigImage();
+    ~ConfigImage();
+
+    static uint8_t* compile(const char* text, size_t len, size_t* size, ConfigError* error);
+
+    bool load(uint8_t* data, size_t len, ConfigError* error);
+    void unload();
+    bool loaded();
+
+    uint16_t            sourceCrc();
+    const ConfigBus*    bus();
+    const ConfigLora*   lora();
+    uint16_t            sensors();
+    const ConfigSensor* sensor(uint16_t i);
+    uint16_t            points();
+    const ConfigPoint*  point(uint16_t i);
+    const char*         string(uint32_t offset);
+
+    static void benchmark(uint16_t points, ConfigBenchmark* result);
+};
+
+#endif // M5STACK_CONFIG_IMAGE_H
@@ -0,0 +1,68 @@
+//
+// Fixed-point PID loops with time-proportional relay outputs.
+//
+
+#ifndef M5STACK_CONTROL_LOOP_H
+#define M5STACK_CONTROL_LOOP_H
+
+#include <stdint.h>
+
+#include "ScanEngine.hpp"
+
+#define CONTROL_LOOPS       8
+#define CONTROL_OUTPUT_MAX  1000        // output in per mille
+#define CONTROL_Q           16          // gains are Q16.16 fixed point
+#define CONTROL_ONE         (1L << CONTROL_Q)
+
+/**
+ * Loop configuration. The process value is an input register in tenths
+ * (e.g. a Sensor temperature), gains convert tenths to per mille of output.
+ */
+struct ControlConfig {
+    uint8_t  reg;               // process value register
+    uint8_t  relay;             // relay driven by the loop
+    int16_t  setpoint;          // tenths
+    int32_t  kp;                // Q16.16, per mille per tenth
+    int32_t  ki;                // Q16.16, per mille per tenth and second
+    int32_t  kd;                // Q16.16, per mille per tenth per second
+    uint32_t period;            // PID period in milliseconds
+    uint32_t window;            // time-proportional window in milliseconds
+    uint32_t min_on;            // shortest relay on time in milliseconds
+    uint32_t min_off;           // shortest relay off time in milliseconds
+};
+
+/**
+ * Loop state and execution time of the PID step in nanoseconds
+ */
+struct ControlState {
+    int16_t  pv;
+    int16_t  pv_prev;
+    int64_t  integral;          // Q16.16 per mille
+    int16_t  output;            // per mille
+    uint32_t on_time;           // relay on time in the current window
+    uint32_t executions;
+    uint32_t last_nsec;
+    uint32_t max_nsec;
+};
+
+class ControlExecutor {
+    ControlConfig _config[CONTROL_LOOPS];
+    ControlState  _state[CONTROL_LOOPS];
+    int64_t       _next[CONTROL_LOOPS];     // next PID step in milliseconds
+    int64_t       _window_start[CONTROL_LOOPS];
+    uint8_t       _count;
+
+    void step(uint8_t loop, const ProcessImage& image);
+    bool relayState(uint8_t loop, int64_t now);
+
+public:
+    ControlExecutor();
+
+    int8_t add(const ControlConfig& config);
+    void   setSetpoint(uint8_t loop, int16_t setpoint);
+    void   run(ProcessImage& image, int64_t now);
+    bool   getState(uint8_t loop, ControlState* state);
+    uint8_t size();
+};
+
+#endif // M5STACK_CONTROL_LOOP_H
@@ -0,0 +1,43 @@
+//
+// MQTT backend for the esp-mqtt client of ESP-IDF.
+//
+
+#ifndef M5STACK_ESP_MQTT_BACKEND_H
+#define M5STACK_ESP_MQTT_BACKEND_H
+
+#ifdef ESP_PLATFORM
+
+#include <atomic>
+#include <mqtt_client.h>
+
+#include "MqttBackend.hpp"
+
+#define MQTT_BUFFER_SIZE 2048
+
+/**
+ * Publishes are only queued in the outbox of the client and sent by its task,
+ * so publish() never blocks on the network. The client reconnects by itself
+ * and sends the messages of the outbox again, only the ones that expire in
+ * the outbox are reported as lost.
+ */
+class EspMqttBackend : public MqttBackend {
+    esp_mqtt_client_handle_t _client;
+    std::atomic<bool>        _connected{false};
+
+    static void event(void* arg, esp_event_base_t base, int32_t id, void* data);
+
+public:
+    EspMqttBackend();
+    ~EspMqttBackend() override;
+
+    bool begin(const char* uri, const char* client_id);
+    void end();
+
+    int  publish(const char* topic, const uint8_t* data, size_t len) override;
+    bool connected() override;
+    void poll(uint32_t timeout_ms) override;
+};
+
+#endif // ESP_PLATFORM
+
+#endif // M5STACK_ESP_MQTT_BACKEND_H
@@ -0,0 +1,68 @@
+//
+// Event-driven main loop: handlers run on task notifications and timers.
+//
+
+#ifndef M5STACK_EVENT_LOOP_H
+#define M5STACK_EVENT_LOOP_H
+
+#include <Arduino.h>
+#include <functional>
+#include <freertos/timers.h>
+
+// one task notification bit per event
+#define EVENT_MAX_HANDLERS 16
+// tasks listed by printTaskStats()
+#define EVENT_MAX_TASKS    32
+
+typedef std::function<void()> EventHandler;
+
+struct EventStats {
+    const char* name;
+    uint32_t    runs;
+    uint64_t    busy_usec;    // time spent in the handler
+    uint32_t    max_usec;
+};
+
+/**
+ * The loop task blocks in xTaskNotifyWait() until an event is posted by a
+ * timer, another task or an interrupt, and then runs the handlers of all
+ * posted events. Nothing polls, so the core is idle (or in light sleep, see
+ * enableLightSleep()) whenever no event is pending.
+ */
+class EventLoop {
+    struct Timer {
+        EventLoop* loop;
+        uint8_t    event;
+    };
+
+    TaskHandle_t  _task;
+    uint8_t       _count;
+    EventHandler  _handlers[EVENT_MAX_HANDLERS];
+    TimerHandle_t _timers[EVENT_MAX_HANDLERS];
+    Timer         _timer_args[EVENT_MAX_HANDLERS];
+    EventStats    _stats[EVENT_MAX_HANDLERS];
+    int64_t       _stats_start;
+
+    static void timerCallback(TimerHandle_t timer);
+
+public:
+    EventLoop();
+
+    void    begin();
+    int8_t  add(const char* name, EventHandler handler);
+    int8_t  every(const char* name, uint32_t period_ms, EventHandler handler);
+
+    void    post(uint8_t event);
+    void    postFromISR(uint8_t event);
+    void    dispatch(TickType_t timeout = portMAX_DELAY);
+
+    // CPU utilization
+    uint8_t getStats(EventStats* stats, uint8_t max);
+    void    printStats(Print* out);
+    void    printTaskStats(Print* out);
+    void    resetStats();
+
+    static bool enableLightSleep(uint32_t max_mhz, uint32_t min_mhz);
+};
+
+#endif // M5STACK_EVENT_LOOP_H
@@ -0,0 +1,116 @@
+//
+// Heap guard of the static allocation mode (-DPLC_STATIC_ALLOC).
+//
+// In this mode the objects of the example come from StaticPool and the
+// tables are sized at compile time, so they take no heap after setup().
+// The guard is armed at the end of setup(); from then on a heap allocation in
+// a watched task, or anywhere inside a HeapDeny scope, is a violation and
+// aborts with a backtrace of the allocation (HEAP_GUARD_ABORT 0 only counts
+// it). Library calls that allocate by design (eModbus requests, the esp-mqtt
+// outbox, long Serial.printf lines) still use the heap at run time; they run
+// in a HeapAllow scope and are counted in HeapGuardStats.
+//
+// Allocations are seen through the ESP-IDF heap hooks when the framework is
+// built with CONFIG_HEAP_USE_HOOKS, otherwise through the linker with
+// -DHEAP_GUARD_WRAP -Wl,--wrap=malloc -Wl,--wrap=calloc -Wl,--wrap=realloc.
+// Without either, only the free heap is reported.
+//
+
+#ifndef M5STACK_HEAP_GUARD_H
+#define M5STACK_HEAP_GUARD_H
+
+#include <Arduino.h>
+#include <atomic>
+
+// tasks with a watch or a scope
+#define HEAP_GUARD_TASKS 12
+
+#ifndef HEAP_GUARD_ABORT
+#define HEAP_GUARD_ABORT 1
+#endif
+
+struct HeapGuardStats {
+    uint32_t    violations;
+    uint32_t    last_size;      // bytes of the last violating allocation
+    const char* last_task;
+    uint32_t    free_bytes;
+    uint32_t    armed_free;     // free heap when the guard was armed
+    uint32_t    lowest_free;    // since boot
+    uint32_t    allowed;        // allocations in a HeapAllow scope since armed
+    uint32_t    allowed_bytes;  // wraps after 4 GiB
+};
+
+#ifdef PLC_STATIC_ALLOC
+
+class HeapGuard {
+public:
+    struct Slot {
+        TaskHandle_t task;
+        bool         watched;
+        uint16_t     allow;
+        uint16_t     deny;
+    };
+
+private:
+    static Slot          _slots[HEAP_GUARD_TASKS];
+    static volatile bool _armed;
+    static uint32_t      _violations;
+    static uint32_t      _last_size;
+    static TaskHandle_t  _last_task;
+    static uint32_t      _armed_free;
+
+    // any task may allocate under HeapAllow at the same time; 32 bit
+    // atomics stay lock-free inside the allocator
+    static std::atomic<uint32_t> _allowed;
+    static std::atomic<uint32_t> _allowed_bytes;
+
+public:
+    static Slot* slot(TaskHandle_t task, bool create);
+
+    static void watch(TaskHandle_t task);
+    static void arm();
+    static bool armed();
+    static void getStats(HeapGuardStats* stats);
+
+    // called by the allocator hook
+    static void allocated(size_t size);
+};
+
+/**
+ * Heap allocations of the current task are allowed while in scope
+ */
+class HeapAllow {
+    HeapGuard::Slot* _slot;
+
+public:
+    HeapAllow();
+    ~HeapAllow();
+};
+
+/**
+ * Heap allocations of the current task are violations while in scope, even
+ * if the task is not watched
+ */
+class HeapDeny {
+    HeapGuard::Slot* _slot;
+
+public:
+    HeapDeny();
+    ~HeapDeny();
+};
+
+#else
+
+class HeapAllow {
+public:
+    HeapAllow() {}
+};
+
+class HeapDeny {
+public:
+    HeapDeny() {}
+};
+
+#endif // PLC_STATIC_ALLOC
+
+#endif // M5STACK_HEAP_GUARD_H
@@ -0,0 +1,91 @@
+//
+// Interrupt-driven capture of the StamPLC digital inputs.
+//
+
+#ifndef M5STACK_INPUT_CAPTURE_H
+#define M5STACK_INPUT_CAPTURE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+#include "SpscQueue.hpp"
+
+#define INPUT_CHANNELS            8
+
+// interrupt line and I2C address of the input expander (PI4IOE5V6408).
+// begin() checks both on the board: the chip must answer with its
+// manufacturer id and INT must be high once its status is cleared, otherwise
+// the inputs stay polled by the scan.
+#ifndef INPUT_INT_PIN
+#define INPUT_INT_PIN             GPIO_NUM_14
+#endif
+#ifndef INPUT_EXPANDER_ADDR
+#define INPUT_EXPANDER_ADDR       0x44
+#endif
+#define INPUT_EXPANDER_ID         0x01
+#define INPUT_EXPANDER_ID_MASK    0xE0    // manufacturer id, bits 7..5
+#define INPUT_EXPANDER_ID_VALUE   0xA0
+#define INPUT_EXPANDER_INT_MASK   0x11
+#define INPUT_EXPANDER_INT_STATUS 0x13
+
+#define INPUT_DEBOUNCE            10      // default debounce in milliseconds
+#define INPUT_QUEUE_SIZE          256
+#define INPUT_TASK_STACK          4096
+#define INPUT_TASK_PRIORITY       6
+
+enum InputEdge : uint8_t {
+    INPUT_FALLING = 0,
+    INPUT_RISING  = 1,
+};
+
+struct InputEvent {
+    uint8_t         channel;
+    InputEdge       edge;
+    struct timespec time;       // time of the interrupt of the first raw transition
+};
+
+/**
+ * Pulse counter and frequency of one channel, rising edges only
+ */
+struct InputPulses {
+    uint32_t count;
+    uint32_t period_usec;       // between the last two rising edges, 0 = unknown
+    float    frequency;         // Hz, 0 = unknown
+};
+
+class InputCapture {
+    SpscQueue<InputEvent, INPUT_QUEUE_SIZE> _events;
+
+    TaskHandle_t  _task;
+    portMUX_TYPE  _lock = portMUX_INITIALIZER_UNLOCKED;
+    uint8_t       _raw;
+    uint8_t       _stable;
+    uint8_t       _pending;                              // channels waiting for debounce
+    uint16_t      _debounce[INPUT_CHANNELS];             // milliseconds
+    int64_t       _changed_usec[INPUT_CHANNELS];         // first raw transition
+    int64_t       _rising_usec[INPUT_CHANNELS];
+    InputPulses   _pulses[INPUT_CHANNELS];
+    uint32_t      _overflows;
+
+    uint8_t     readRaw();
+    void        sample(int64_t changed_usec);
+    void        accept(uint8_t channel, bool level, int64_t usec);
+    TickType_t  nextDeadline();
+    static void isr(void* arg);
+    static void captureTask(void* arg);
+
+public:
+    InputCapture();
+
+    bool begin(int core = tskNO_AFFINITY);
+
+    void         setDebounce(uint8_t channel, uint16_t msec);
+    uint8_t      getInputs();
+    bool         nextEvent(InputEvent* event);
+    void         getPulses(uint8_t channel, InputPulses* pulses);
+    void         resetPulses(uint8_t channel);
+    uint32_t     getOverflows();
+    TaskHandle_t getTask();
+};
+
+#endif // M5STACK_INPUT_CAPTURE_H
@@ -0,0 +1,48 @@
+//
+// Block storage for SampleLogger: a file on the SD card or on the host.
+//
+
+#ifndef M5STACK_LOG_SINK_H
+#define M5STACK_LOG_SINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define LOG_SECTOR 512
+
+class LogSink {
+public:
+    virtual ~LogSink() {}
+
+    // len is always a multiple of LOG_SECTOR
+    virtual bool write(const uint8_t* data, size_t len) = 0;
+    virtual bool sync() = 0;
+
+    // existing content, lets SampleLogger continue a log after a restart
+    virtual uint64_t size() { return 0; }
+    virtual bool     read(uint64_t, uint8_t*, size_t) { return false; }
+};
+
+/**
+ * Unbuffered stdio file. On the StamPLC the SD card is mounted in the VFS
+ * at "/sd", so the same sink writes to the card and to a host file in tests.
+ */
+class FileLogSink : public LogSink {
+    FILE* _file;
+
+public:
+    FileLogSink();
+    ~FileLogSink() override;
+
+    bool open(const char* path);
+    void close();
+
+    bool write(const uint8_t* data, size_t len) override;
+    bool sync() override;
+
+    uint64_t size() override;
+    bool     read(uint64_t offset, uint8_t* data, size_t len) override;
+};
+
+#endif // M5STACK_LOG_SINK_H
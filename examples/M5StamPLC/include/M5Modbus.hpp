@@ -5,6 +5,14 @@
 #include <Arduino.h>
 #include <M5Unified.hpp>
 #include <ModbusClientRTU.h>
+#include <atomic>
+#include <mutex>
+#include <Trace.h>
+#include "StaticPool.hpp"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
 
 #ifndef M5STACK_MODBUS_H
 #define M5STACK_MODBUS_H
@@ -14,18 +22,81 @@
 #define TX_PIN   GPIO_NUM_0
 #define REDE_PIN GPIO_NUM_46
 
+// highest baud rate accepted for the PWR-485 port
+#ifndef MODBUS_MAX_BAUDRATE
+#define MODBUS_MAX_BAUDRATE 921600
+#endif
+
+// default response timeout in milliseconds
+#define MODBUS_TIMEOUT       1000
+// response timeout used by the autobaud probes in milliseconds
+#define MODBUS_PROBE_TIMEOUT 100
+
+// UART receive interrupts: the FIFO threshold limits interrupts during long
+// frames, the RX timeout (in character times) fires when the line goes idle
+// at the end of a frame. The timeout is raised to t3.5 when that is longer,
+// up to the limit of the UART.
+#define MODBUS_RX_FIFO_FULL   64
+#define MODBUS_RX_TIMEOUT     4
+#define MODBUS_RX_TIMEOUT_MAX 100
+
+// RTU worker task, -1 = any core
+#define MODBUS_TASK_CORE     -1
+#define MODBUS_TASK_PRIORITY 6
+
+/**
+ * Serial line settings detected by M5Modbus::autobaud()
+ */
+struct M5ModbusLine {
+    uint32_t baudrate;
+    uint32_t config;    // SERIAL_8N1, SERIAL_8E1, ...
+};
+
+/**
+ * ModbusClientRTU with access to its worker task
+ */
+class M5ModbusClientRTU : public ModbusClientRTU {
+public:
+    explicit M5ModbusClientRTU(int8_t rts_pin) : ModbusClientRTU(rts_pin) {}
+
+    TaskHandle_t getWorker() { return worker; }
+};
+
 class M5Modbus {
-    ModbusClientRTU* _MB;
-    HardwareSerial*  _serial;
+    M5ModbusClientRTU* _MB;
+    HardwareSerial*    _serial;
+
+    StaticPool<M5ModbusClientRTU> _client;
 
 protected:
     uint16_t _rx_pin;
     uint16_t _tx_pin;
     uint16_t _rede_pin;
     uint32_t _baudrate;
+    uint32_t _config;
+    uint32_t _timeout;
+    uint8_t  _rx_fifo_full;
+    uint8_t  _rx_timeout;
+    int      _task_core;
+    uint32_t _task_priority;
+    MBOnData  _data_handler;
+    MBOnError _error_handler;
+    std::mutex _handler_lock;     // held while a handler runs or is replaced
+    TraceRecorder* _recorder;
+
+    // keeps the UART out of light sleep while requests are pending
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_handle_t _pm_lock;
+#endif
+    std::atomic<uint32_t> _awake{0};
+
+    void startLine();
+    void stayAwake();
+    void allowSleep();
+    void reconfigure(uint32_t baud, uint32_t config);
 
 public:
-    M5Modbus(HardwareSerial* serial = nullptr, uint16_t baud = 9600);
+    M5Modbus(HardwareSerial* serial = nullptr, uint32_t baud = 9600, uint32_t config = SERIAL_8N1);
     ~M5Modbus();
 
     void  begin();
@@ -33,6 +104,30 @@ public:
     ModbusMessage syncRequest(ModbusMessage msg, uint32_t token);
     void  handleData(ModbusMessage response, uint32_t token);
     void  handleError(Error error, uint32_t token);
+    void  onResponse(MBOnData data, MBOnError error);
+    void  swapResponse(MBOnData& data, MBOnError& error);
+    uint32_t pendingRequests();
+
+    // responses and errors are appended to the trace before the handlers run
+    void setRecorder(TraceRecorder* recorder);
+
+    // serial line settings
+    bool     setBaudrate(uint32_t baud, uint32_t config = SERIAL_8N1);
+    uint32_t getBaudrate();
+    uint32_t getConfig();
+    void     setTimeout(uint32_t timeout);
+    uint32_t getTimeout();
+    bool     autobaud(uint8_t addr, M5ModbusLine* line, uint16_t reg = 0x0000);
+
+    // receive interrupts and worker task, call before begin()
+    void setRxInterrupts(uint8_t fifo_full, uint8_t timeout);
+    void setTask(int core, uint32_t priority);
+
+    // Modbus RTU timing in microseconds
+    static uint32_t charTime(uint32_t baud);
+    static uint32_t interCharTimeout(uint32_t baud);
+    static uint32_t interFrameDelay(uint32_t baud);
+    static uint8_t  rxTimeout(uint32_t baud, uint8_t chars = MODBUS_RX_TIMEOUT);
 };
 
 #endif // M5STACK_MODBUS_H
@@ -0,0 +1,51 @@
+//
+// Modbus RTU/TCP server exposing the StamPLC shadow image.
+//
+
+#ifndef M5STACK_MODBUS_SERVER_H
+#define M5STACK_MODBUS_SERVER_H
+
+#include <Arduino.h>
+#include <ModbusServerRTU.h>
+#include <ModbusServerWiFi.h>
+
+#include "ShadowImage.hpp"
+#include "StaticPool.hpp"
+
+#define MODBUS_SERVER_TIMEOUT     2000   // RTU server / TCP client idle timeout in milliseconds
+#define MODBUS_SERVER_TCP_PORT    502
+#define MODBUS_SERVER_TCP_CLIENTS 4
+
+/**
+ * Register map (all addresses 0-based):
+ *
+ * - coils 0..3             relays, FC 01 / 05 / 15
+ * - discrete inputs 0..7   digital inputs, FC 02
+ * - input registers 0..63  sensor values, FC 04, see SHADOW_REGISTERS_PER_SENSOR
+ */
+class M5ModbusServer {
+    ModbusServerRTU*  _rtu;
+    ModbusServerWiFi* _tcp;
+    ShadowImage*      _image;
+    uint8_t           _server_id;
+
+    StaticPool<ModbusServerRTU>  _rtu_pool;
+    StaticPool<ModbusServerWiFi> _tcp_pool;
+
+    void          registerWorkers(ModbusServer* server);
+    ModbusMessage readCoils(ModbusMessage request);
+    ModbusMessage readDiscreteInputs(ModbusMessage request);
+    ModbusMessage readInputRegisters(ModbusMessage request);
+    ModbusMessage writeCoil(ModbusMessage request);
+    ModbusMessage writeCoils(ModbusMessage request);
+    ModbusMessage readBits(ModbusMessage request, uint8_t bits, uint8_t count);
+
+public:
+    M5ModbusServer(ShadowImage* image, uint8_t server_id = 1);
+    ~M5ModbusServer();
+
+    void beginRTU(HardwareSerial* serial, uint32_t baud, int8_t rede_pin, int8_t rx_pin, int8_t tx_pin);
+    void beginTCP(uint16_t port = MODBUS_SERVER_TCP_PORT);
+};
+
+#endif // M5STACK_MODBUS_SERVER_H
@@ -8,7 +8,34 @@
 #include <Arduino.h>
 #include <M5StamPLC.h>
 
+#include "AlarmEngine.hpp"
+#include "BoardHealth.hpp"
+#include "BusDiscovery.hpp"
+#include "BusSniffer.hpp"
+#include "CanTransport.hpp"
+#include "ConfigImage.hpp"
+#include "ControlLoop.hpp"
+#include "EspMqttBackend.hpp"
+#include "EventLoop.hpp"
+#include "HeapGuard.hpp"
+#include "InputCapture.hpp"
 #include "M5Modbus.hpp"
+#include "M5ModbusServer.hpp"
+#include "ModbusFrame.h"
+#include "MqttPublisher.hpp"
+#include "PlcProgram.hpp"
+#include "Relay.hpp"
+#include "SampleLogger.hpp"
+#include "ScanEngine.hpp"
 #include "Sensor.hpp"
+#include "SensorRegistry.hpp"
+#include "SeriesCodec.hpp"
+#include "ShadowImage.hpp"
+#include "StaticPool.hpp"
+#include "Storage.hpp"
+#include "Timespec.h"
+#include "Trace.h"
+#include "TrendStore.hpp"
+#include "TwaiBackend.hpp"
 
 #endif //M5STACK_MAIN_HPP
\ No newline at end of file
@@ -0,0 +1,74 @@
+/**
+ * \file ModbusFrame.h
+ *
+ * Modbus RTU frame codec and CRC-16/Modbus.
+ */
+
+#ifndef MODBUS_FRAME_H
+#define MODBUS_FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MODBUS_RTU_MIN_FRAME      4     // address, function code, CRC
+#define MODBUS_RTU_MAX_FRAME      256
+#define MODBUS_RTU_EXCEPTION_LEN  5
+#define MODBUS_CRC_INIT           0xFFFF
+
+// on the ESP32 keep the CRC tables in DRAM and the CRC loop in IRAM,
+// so that it does not stall on flash cache misses
+#if defined(ESP_PLATFORM) && !defined(MODBUS_CRC_NO_IRAM)
+#include <esp_attr.h>
+#define MODBUS_CRC_ATTR   IRAM_ATTR
+#define MODBUS_TABLE_ATTR DRAM_ATTR
+#else
+#define MODBUS_CRC_ATTR
+#define MODBUS_TABLE_ATTR
+#endif
+
+typedef enum {
+    MODBUS_FRAME_OK = 0,
+    MODBUS_FRAME_TOO_SHORT,
+    MODBUS_FRAME_TOO_LONG,
+    MODBUS_FRAME_WRONG_ADDRESS,
+    MODBUS_FRAME_WRONG_LENGTH,
+    MODBUS_FRAME_CRC_ERROR,
+} ModbusFrameStatus;
+
+/**
+ * Decoded RTU frame, pdu points into the receive buffer
+ */
+typedef struct {
+    uint8_t        address;
+    uint8_t        function;
+    const uint8_t *pdu;       // data after the function code
+    size_t         pdu_len;
+} ModbusRtuFrame;
+
+/**
+ * CRC timing measured by modbus_crc_benchmark()
+ */
+typedef struct {
+    int64_t bitwise_nsec;
+    int64_t bytewise_nsec;
+    int64_t sliced_nsec;
+    size_t  bytes;            // total bytes processed by each variant
+} ModbusCrcBenchmark;
+
+// CRC-16/Modbus
+uint16_t modbus_crc16(const uint8_t *data, size_t len);
+uint16_t modbus_crc16_update(uint16_t crc, const uint8_t *data, size_t len);
+uint16_t modbus_crc16_bytewise(const uint8_t *data, size_t len);
+uint16_t modbus_crc16_bitwise(const uint8_t *data, size_t len);
+
+// RTU frames
+size_t modbus_rtu_encode(uint8_t *buf, size_t size, uint8_t address, uint8_t function,
+                         const uint8_t *pdu, size_t pdu_len);
+size_t modbus_rtu_response_length(const uint8_t *buf, size_t len);
+size_t modbus_rtu_request_length(const uint8_t *buf, size_t len);
+ModbusFrameStatus modbus_rtu_decode(const uint8_t *buf, size_t len, uint8_t address, ModbusRtuFrame *frame);
+ModbusFrameStatus modbus_rtu_decode_request(const uint8_t *buf, size_t len, ModbusRtuFrame *frame);
+
+void modbus_crc_benchmark(size_t frame_len, uint32_t rounds, ModbusCrcBenchmark *result);
+
+#endif /* MODBUS_FRAME_H */
@@ -0,0 +1,41 @@
+//
+// MQTT client backend interface: esp-mqtt on the StamPLC, a plain socket client on Linux.
+//
+
+#ifndef M5STACK_MQTT_BACKEND_H
+#define M5STACK_MQTT_BACKEND_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+// called from the client task on the StamPLC, from poll() on Linux
+typedef std::function<void(bool connected)> MqttConnectHandler;
+typedef std::function<void(int msg_id)>     MqttAckHandler;
+
+// msg_id of a lost handler call for all messages awaiting their PUBACK
+#define MQTT_ID_ALL -1
+
+class MqttBackend {
+protected:
+    MqttConnectHandler _connect_handler;
+    MqttAckHandler     _ack_handler;
+    MqttAckHandler     _lost_handler;
+
+public:
+    virtual ~MqttBackend() {}
+
+    // QoS 1 publish without waiting for the PUBACK, returns the message id or -1
+    virtual int  publish(const char* topic, const uint8_t* data, size_t len) = 0;
+    virtual bool connected() = 0;
+
+    // process network input for at most timeout_ms, backends with their own task just wait
+    virtual void poll(uint32_t timeout_ms) = 0;
+
+    void onConnect(MqttConnectHandler handler) { _connect_handler = handler; }
+    void onAck(MqttAckHandler handler) { _ack_handler = handler; }
+    // messages the backend gave up on without a PUBACK, they are not sent again
+    void onLost(MqttAckHandler handler) { _lost_handler = handler; }
+};
+
+#endif // M5STACK_MQTT_BACKEND_H
@@ -0,0 +1,149 @@
+//
+// Batched MQTT telemetry with store-and-forward during broker outages.
+//
+
+#ifndef M5STACK_MQTT_PUBLISHER_H
+#define M5STACK_MQTT_PUBLISHER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+#include "MqttBackend.hpp"
+#include "MqttSpill.hpp"
+#include "SpscQueue.hpp"
+
+/*
+ * Payload of one batch, little endian:
+ *
+ *   MqttBatchHeader
+ *   count * MqttBatchRecord
+ *
+ * A message holds all points queued since the previous flush(). The sequence
+ * number lets the consumer drop the duplicates QoS 1 may deliver.
+ */
+#define MQTT_BATCH_VERSION   1
+#define MQTT_BATCH_MAX       MQTT_SPILL_PAYLOAD
+#define MQTT_VALUE_INVALID   INT32_MIN     // point has bad quality
+
+#define MQTT_MAX_INFLIGHT    8             // QoS 1 publishes awaiting the PUBACK
+#define MQTT_DRAIN_RATE      5             // spilled messages per second after a reconnect
+#define MQTT_TOPIC_MAX       64
+#define MQTT_EVENT_QUEUE     64            // backend events between two flush() / drain() calls
+
+struct __attribute__((packed)) MqttBatchHeader {
+    uint8_t  version;
+    uint8_t  node;
+    uint16_t count;
+    uint32_t seq;
+    int64_t  time;            // ms, when the batch was closed
+};
+
+struct __attribute__((packed)) MqttBatchRecord {
+    uint16_t point;
+    int32_t  value;
+};
+
+#define MQTT_BATCH_POINTS ((MQTT_BATCH_MAX - sizeof(MqttBatchHeader)) / sizeof(MqttBatchRecord))
+
+struct MqttStats {
+    uint32_t messages;        // handed to the backend, including drained ones
+    uint32_t bytes;           // payload
+    uint32_t points;
+    uint32_t acked;
+    uint32_t spilled;         // written to the spill ring
+    uint32_t drained;         // published from the spill ring
+    uint32_t dropped;         // lost: no spill ring, or it overflowed
+    uint32_t reconnects;
+    uint32_t backlog;         // messages waiting in the spill ring
+    uint16_t inflight;
+    uint16_t max_inflight;
+};
+
+struct MqttBenchmark {
+    uint16_t points;          // per message
+    uint32_t messages;
+    uint32_t bytes;
+    uint8_t  window;          // publishes in flight
+    int64_t  total_nsec;      // until the last PUBACK
+};
+
+/**
+ * A message awaiting its PUBACK. The copy is kept so it can be spilled if
+ * the connection drops first.
+ */
+struct MqttInflight {
+    int      id;              // -1 = free
+    uint16_t len;
+    uint8_t  data[MQTT_BATCH_MAX];
+};
+
+/**
+ * PUBACK, lost message or connection change, passed from the backend task
+ */
+struct MqttEvent {
+    uint8_t type;
+    int     id;
+};
+
+/**
+ * Points are queued into a batch that is published as one QoS 1 message on
+ * flush(). Up to the window size of messages are in flight at once, so the
+ * throughput does not depend on the broker round trip. A message that cannot
+ * be published, or that the backend reports as lost, goes to the spill ring.
+ * After a reconnect the ring is drained at a limited rate next to the live
+ * batches, so the backlog does not starve them.
+ *
+ * The backend calls its handlers from its own task while holding its own
+ * lock, and publish() takes that lock too. The handlers therefore only push
+ * events into a lock-free queue, which is applied under the mutex of the
+ * publisher by the next flush(), drain() or getStats().
+ */
+class MqttPublisher {
+    MqttBackend* _backend;
+    MqttSpill*   _spill;
+    char         _topic[MQTT_TOPIC_MAX];
+    uint8_t      _batch[MQTT_BATCH_MAX];
+    uint16_t     _count;
+    uint8_t      _node;
+    uint32_t     _seq;
+    uint8_t      _window;
+    uint32_t     _drain_rate;
+    int64_t      _drain_time;
+    uint32_t     _drain_budget;
+    MqttInflight _inflight[MQTT_MAX_INFLIGHT];
+    MqttStats    _stats;
+    std::mutex   _mutex;
+
+    SpscQueue<MqttEvent, MQTT_EVENT_QUEUE> _events;
+    std::atomic<bool>                      _overflow{false};
+
+    MqttInflight* freeSlot();
+    bool          send(MqttInflight* slot, const uint8_t* data, uint16_t len);
+    void          store(const uint8_t* data, uint16_t len);
+    void          closeBatch();
+    void          drainSpill();
+    void          post(uint8_t type, int id);
+    void          applyEvents();
+    void          acked(int id);
+    void          lost(int id);
+    void          connectionChanged(bool connected);
+
+public:
+    MqttPublisher(MqttBackend* backend, MqttSpill* spill, const char* topic, uint8_t node);
+    ~MqttPublisher();
+
+    void setWindow(uint8_t window);
+    void setDrainRate(uint32_t messages_per_second);
+
+    void queue(uint16_t point, int32_t value, bool valid);
+    void flush();
+    void drain();
+
+    void getStats(MqttStats* stats);
+
+    static void benchmark(MqttBackend* backend, uint16_t points, uint32_t messages, uint8_t window,
+                          MqttBenchmark* result);
+};
+
+#endif // M5STACK_MQTT_PUBLISHER_H
@@ -0,0 +1,53 @@
+//
+// Ring of unsent MQTT messages in a file on the SD card.
+//
+
+#ifndef M5STACK_MQTT_SPILL_H
+#define M5STACK_MQTT_SPILL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define MQTT_SPILL_SLOT  1024      // bytes per message slot in the file
+#define MQTT_SPILL_MAGIC 0x534D    // "MS"
+
+struct __attribute__((packed)) MqttSpillHeader {
+    uint16_t magic;           // 0 = slot free
+    uint16_t len;
+    uint32_t seq;             // slot = seq % slots
+};
+
+#define MQTT_SPILL_PAYLOAD (MQTT_SPILL_SLOT - sizeof(MqttSpillHeader))
+
+/**
+ * Fixed size slots indexed by a running sequence number, so a message is
+ * written and freed with one seek each. The queue survives a reboot: open()
+ * finds the oldest and newest valid slot. When the ring is full the oldest
+ * message is overwritten.
+ */
+class MqttSpill {
+    FILE*    _file;
+    uint16_t _slots;
+    uint32_t _head;           // seq of the oldest message
+    uint32_t _tail;           // seq of the next message
+    uint32_t _dropped;
+
+    bool readHeader(uint16_t slot, MqttSpillHeader* header);
+
+public:
+    MqttSpill();
+    ~MqttSpill();
+
+    bool open(const char* path, uint16_t slots);
+    void close();
+
+    bool     push(const uint8_t* data, uint16_t len);
+    uint16_t peek(uint8_t* data);
+    void     pop();
+
+    uint32_t size();
+    uint32_t dropped();
+};
+
+#endif // M5STACK_MQTT_SPILL_H
@@ -0,0 +1,107 @@
+//
+// Bytecode interpreter for PLC logic (instruction list style).
+//
+
+#ifndef M5STACK_PLC_PROGRAM_H
+#define M5STACK_PLC_PROGRAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PLC_MAGIC        "PLC1"
+#define PLC_MAX_INSTR    8192
+#define PLC_STACK_DEPTH  16
+
+// bit areas
+#define PLC_INPUTS       8
+#define PLC_OUTPUTS      4
+#define PLC_MARKERS      256
+#define PLC_TIMERS       64
+#define PLC_REGISTERS    64
+
+enum PlcArea : uint8_t {
+    PLC_AREA_NONE = 0,
+    PLC_AREA_I,         // digital inputs
+    PLC_AREA_Q,         // relays
+    PLC_AREA_M,         // markers
+    PLC_AREA_T,         // timer done bits
+    PLC_AREA_R,         // input registers (sensor values)
+};
+
+enum PlcOpcode : uint8_t {
+    PLC_END = 0,
+    PLC_LD,             // acc = bit
+    PLC_LDN,            // acc = !bit
+    PLC_AND,            // acc &= bit
+    PLC_ANDN,           // acc &= !bit
+    PLC_OR,             // acc |= bit
+    PLC_ORN,            // acc |= !bit
+    PLC_NOT,            // acc = !acc
+    PLC_ST,             // bit = acc
+    PLC_STN,            // bit = !acc
+    PLC_SET,            // if acc: bit = 1
+    PLC_RST,            // if acc: bit = 0
+    PLC_PUSH,           // push acc
+    PLC_ANDP,           // acc = pop & acc
+    PLC_ORP,            // acc = pop | acc
+    PLC_GT,             // acc = register > arg
+    PLC_LT,             // acc = register < arg
+    PLC_EQ,             // acc = register == arg
+    PLC_TON,            // on-delay timer, arg = preset in ms, acc = done
+    PLC_OPCODES
+};
+
+/**
+ * Instruction as stored in a program file (8 bytes, little endian)
+ */
+struct __attribute__((packed)) PlcInstr {
+    uint8_t  op;
+    uint8_t  area;
+    uint16_t index;
+    int32_t  arg;
+};
+
+/**
+ * Instruction after loading: dispatch address and operands are resolved
+ */
+struct PlcOp {
+    const void* handler;
+    uint8_t*    bit;
+    int16_t*    reg;
+    uint32_t*   elapsed;    // timer accumulator
+    int32_t     arg;
+};
+
+struct PlcBenchmark {
+    uint32_t instructions;    // per scan
+    uint32_t scans;
+    int64_t  total_nsec;
+    int64_t  worst_nsec;      // slowest scan
+};
+
+class PlcProgram {
+    PlcOp*   _code;
+    uint16_t _count;
+    uint8_t  _bits[PLC_INPUTS + PLC_OUTPUTS + PLC_MARKERS + PLC_TIMERS];
+    int16_t  _regs[PLC_REGISTERS];
+    uint32_t _elapsed[PLC_TIMERS];
+
+    uint8_t* bitAddress(uint8_t area, uint16_t index);
+    bool     validate(const PlcInstr* instr, uint16_t count);
+    void     run(uint32_t dt, bool resolve);
+
+public:
+    PlcProgram();
+    ~PlcProgram();
+
+    bool     load(const uint8_t* data, size_t len);
+    void     unload();
+    bool     loaded();
+    uint16_t size();
+
+    uint8_t  execute(uint8_t inputs, uint8_t outputs, const uint16_t* registers, uint32_t dt);
+
+    static void benchmark(uint16_t rungs, uint32_t scans, PlcBenchmark* result);
+};
+
+#endif // M5STACK_PLC_PROGRAM_H
@@ -7,6 +7,13 @@
 
 #include <Arduino.h>
 
+#define RELAY_COUNT 4
+
+/**
+ * All relays share one shadow register. Reads are served from RAM and
+ * changes are staged first; commit() writes the whole output image to the
+ * I/O expander in a single transaction, so staged relays switch together.
+ */
 class Relay {
 
 protected:
@@ -14,6 +21,12 @@ protected:
     String   _name;
     String   _description;
 
+    static portMUX_TYPE _lock;
+    static uint8_t      _current;   // state of the expander outputs
+    static uint8_t      _staged;    // state after the next commit()
+
+    static SemaphoreHandle_t ioMutex();
+
 public:
     Relay();
     ~Relay();
@@ -22,12 +35,24 @@ public:
     Relay(uint8_t id);
     Relay(uint8_t id, String name, String description);
 
-    // actions
+    // actions, applied immediately
     void switchOn();
     void switchOff();
     void toggle();
     bool isOn();
     bool isOff();
+
+    // staged actions, applied by commit()
+    void stage(bool on);
+    void stageToggle();
+
+    // output image of all relays, bit n = relay n
+    static void    load();
+    static void    stageAll(uint8_t states);
+    static void    stageMask(uint8_t states, uint8_t mask);
+    static uint8_t getStaged();
+    static uint8_t getState();
+    static bool    commit();
 };
 
 
@@ -0,0 +1,115 @@
+//
+// Double-buffered binary sample logger.
+//
+
+#ifndef M5STACK_SAMPLE_LOGGER_H
+#define M5STACK_SAMPLE_LOGGER_H
+
+#include <stdint.h>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "LogSink.hpp"
+
+/*
+ * The log is a sequence of LOG_SECTOR byte blocks. Data blocks hold up to
+ * LOG_RECORDS_PER_BLOCK records with times relative to the block base time.
+ * After every LOG_INDEX_INTERVAL data blocks an index block lists their base
+ * times, so a reader finds a time by reading only every
+ * (LOG_INDEX_INTERVAL + 1)-th block. See tools/samplelog.py. A log that is
+ * opened again continues the numbering and the index group of its last block.
+ */
+#define LOG_MAGIC           0x474C    // "LG"
+#define LOG_BLOCK_DATA      1
+#define LOG_BLOCK_INDEX     2
+
+#define LOG_BUFFER_BLOCKS   8         // blocks per ping-pong buffer, written at once
+#define LOG_FLUSH_INTERVAL  10000     // ms, partially filled buffers are written after this
+#define LOG_TASK_STACK      4096
+#define LOG_TASK_PRIORITY   3
+
+struct __attribute__((packed)) LogBlockHeader {
+    uint16_t magic;
+    uint8_t  type;
+    uint8_t  count;           // records or index entries
+    uint32_t seq;             // block number in the file
+    int64_t  base_ms;         // data: time of the first record
+};
+
+struct __attribute__((packed)) LogRecord {
+    uint32_t offset_ms;       // from base_ms
+    uint16_t point;
+    uint8_t  quality;
+    uint8_t  reserved;
+    int32_t  value;
+};
+
+#define LOG_RECORDS_PER_BLOCK ((LOG_SECTOR - sizeof(LogBlockHeader)) / sizeof(LogRecord))
+#define LOG_INDEX_INTERVAL    ((LOG_SECTOR - sizeof(LogBlockHeader)) / sizeof(int64_t))
+
+struct LogStats {
+    uint32_t records;
+    uint32_t dropped;         // both buffers full
+    uint32_t blocks;          // written, index blocks included
+    uint32_t flushes;
+    uint32_t errors;          // failed writes
+    uint64_t bytes;
+    uint64_t flush_usec;      // time spent in writes
+    uint32_t max_flush_usec;  // worst single flush
+};
+
+/**
+ * log() appends records to the active buffer. When it is full, the buffers
+ * are swapped and the flush thread writes the full one in a single
+ * multi-sector write while the other one fills. Records are dropped only if
+ * a buffer fills before the previous one has been written.
+ */
+class SampleLogger {
+    LogSink* _sink;
+
+    uint8_t         _buffers[2][LOG_BUFFER_BLOCKS * LOG_SECTOR] __attribute__((aligned(4)));
+    uint8_t         _active;
+    uint16_t        _filled;            // closed blocks in the active buffer
+    LogBlockHeader* _block;             // open block, nullptr if none
+    bool            _flushing;          // the other buffer is being written
+    uint16_t        _flush_blocks;
+    bool            _flush_requested;
+    uint32_t        _swaps;             // buffers handed to the flush thread
+    uint32_t        _written;           // buffers written, in the same order
+
+    // flush thread only
+    uint32_t _seq;
+    int64_t  _index[LOG_INDEX_INTERVAL];
+    uint16_t _indexed;
+
+    std::mutex              _lock;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::thread             _thread;
+    bool                    _running;
+    LogStats                _stats;
+
+    void resume();
+    bool openBlock(int64_t time);
+    void closeBlock();
+    void swap();
+    void run();
+    void writeBlocks(uint8_t* buffer, uint16_t count);
+    bool writeIndex();
+
+public:
+    explicit SampleLogger(LogSink* sink);
+    ~SampleLogger();
+
+    void begin();
+    void end();
+
+    bool log(uint16_t point, int32_t value, uint8_t quality, int64_t time_ms);
+    void flush();
+
+    void getStats(LogStats* stats);
+    void resetStats();
+};
+
+#endif // M5STACK_SAMPLE_LOGGER_H
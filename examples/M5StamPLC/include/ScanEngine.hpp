@@ -0,0 +1,71 @@
+//
+// Fixed-cycle PLC scan: inputs -> user logic -> outputs.
+//
+
+#ifndef M5STACK_SCAN_ENGINE_H
+#define M5STACK_SCAN_ENGINE_H
+
+#include <Arduino.h>
+#include <functional>
+
+#include "InputCapture.hpp"
+#include "Relay.hpp"
+#include "ShadowImage.hpp"
+
+#define SCAN_CYCLE          10     // default cycle in milliseconds
+#define SCAN_TASK_STACK     4096
+#define SCAN_TASK_PRIORITY  5
+
+/**
+ * Process image seen by the user logic during one scan
+ */
+struct ProcessImage {
+    uint8_t  inputs;                              // bit n = digital input n
+    uint8_t  outputs;                             // bit n = relay n, written after the logic
+    uint16_t registers[SHADOW_INPUT_REGISTERS];   // sensor values merged from the poll path
+    uint32_t scan;                                // scan counter
+};
+
+/**
+ * Scan timing in microseconds
+ */
+struct ScanStats {
+    uint32_t scans;
+    uint32_t overruns;      // scans that did not finish within the cycle
+    uint32_t last_usec;     // execution time of the last scan
+    uint32_t max_usec;
+    uint32_t jitter_usec;   // largest deviation of a scan start from its schedule
+    uint64_t sum_usec;
+};
+
+typedef std::function<void(ProcessImage& image)> ScanLogic;
+
+class ScanEngine {
+    ShadowImage*      _shadow;
+    InputCapture*     _capture;
+    ScanLogic         _logic;
+    uint32_t          _cycle;
+    TaskHandle_t      _task;
+    ProcessImage      _image;
+    ScanStats         _stats;
+    portMUX_TYPE      _lock = portMUX_INITIALIZER_UNLOCKED;
+
+    uint8_t     readInputs();
+    void        scan();
+    void        account(int64_t start, int64_t scheduled, int64_t end);
+    static void scanTask(void* arg);
+
+public:
+    ScanEngine(ShadowImage* shadow, uint32_t cycle = SCAN_CYCLE);
+
+    void begin(ScanLogic logic, int core = tskNO_AFFINITY);
+    void setInputCapture(InputCapture* capture);
+    void end();
+
+    uint32_t     getCycle();
+    TaskHandle_t getTask();
+    void         getStats(ScanStats* stats);
+    void         resetStats();
+};
+
+#endif // M5STACK_SCAN_ENGINE_H
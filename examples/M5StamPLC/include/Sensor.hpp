@@ -10,52 +10,71 @@
 // polling interval 5 seconds
 #define POLL_INTERVAL 5000
 
+// longer names and descriptions are truncated
+#define SENSOR_NAME_MAX        24
+#define SENSOR_DESCRIPTION_MAX 48
+
+#include "SensorRegistry.hpp"
+
 class M5Modbus;
+class ShadowImage;
 
 class Sensor {
 protected:
     uint8_t   _id;
-    String    _name;
-    String    _description;
+    char      _name[SENSOR_NAME_MAX];
+    char      _description[SENSOR_DESCRIPTION_MAX];
     M5Modbus* _modbus;
     uint8_t   _modbus_address;
-    uint64_t  _last_poll_time;
+
+    // published values
+    ShadowImage*    _image;
+    SensorRegistry* _registry;
+    PointHandle     _temperature_point;
+    PointHandle     _humidity_point;
 
     // sensor values
     int16_t  _temperature;
     uint16_t _humidity;
 
-    // this method executes the poll in the separate thread
-    void doPoll();
-
 public:
     // constructors
     Sensor();
-    explicit Sensor(uint8_t id, M5Modbus* modbus, uint8_t addr, String name, String description);
+    explicit Sensor(uint8_t id, M5Modbus* modbus, uint8_t addr, const char* name, const char* description);
 
-    // method for sensor value(s) update
-    void poll();
+    // method for sensor value(s) update, the request token is the sensor id
+    bool poll();
+    bool handleData(const ModbusMessage& rsp, uint32_t token, int64_t time);
+    bool handleError(Error error, uint32_t token, int64_t time);
 
     // Modbus messages - make it virtual in the real world
     ModbusMessage createModbusMessage();
-    void          parseModbusMessage(ModbusMessage msg);
+    void          parseModbusMessage(const ModbusMessage& msg, int64_t time);
 
     // setters/getters
     uint8_t  getId();
-    String   getName();
-    String   getDescription();
+    const char* getName();
+    const char* getDescription();
     uint8_t  getModbusAddress();
     int16_t  getTemperature();
     uint16_t getHumidity();
     float    getTemperatureF();
     float    getHumidityF();
 
-    void setName(String name);
-    void setDescription(String description);
+    // registry points, POINT_INVALID before setRegistry()
+    PointHandle getTemperaturePoint();
+    PointHandle getHumidityPoint();
+
+    void setName(const char* name);
+    void setDescription(const char* description);
     void setId(uint8_t id);
     void setModbusAddress(uint8_t addr);
     void setTemperature(int16_t temp);
     void setHumidity(uint16_t hum);
+
+    // publish values to the Modbus server image and the registry
+    void setShadowImage(ShadowImage* image);
+    void setRegistry(SensorRegistry* registry);
 };
 
 #endif // M5STACK_SENSOR_H
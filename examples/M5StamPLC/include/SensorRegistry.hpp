@@ -0,0 +1,95 @@
+//
+// Registry of sensor points with struct-of-arrays storage.
+//
+
+#ifndef M5STACK_SENSOR_REGISTRY_H
+#define M5STACK_SENSOR_REGISTRY_H
+
+#include <Arduino.h>
+#include <SensorFilter.h>
+#include <atomic>
+#include <functional>
+
+#define REGISTRY_MAX_POINTS 512
+#define REGISTRY_NAME_POOL  8192     // bytes for all interned names and descriptions
+
+typedef uint16_t PointHandle;
+
+#define POINT_INVALID 0xFFFF
+
+enum PointQuality : uint8_t {
+    QUALITY_NONE = 0,       // never updated
+    QUALITY_GOOD,
+    QUALITY_BAD,            // last read failed, value is the last good one
+};
+
+/**
+ * Called after every value or quality change, outside of the registry lock
+ */
+typedef std::function<void(PointHandle point, int32_t value, PointQuality quality, int64_t time)> PointUpdateHandler;
+
+/**
+ * Consistent copy of the hot values of a range of points
+ */
+struct PointSnapshot {
+    int32_t      value;
+    int64_t      time;      // milliseconds
+    PointQuality quality;
+};
+
+/**
+ * Points are identified by their index. Metadata (names, bus addresses,
+ * scales) is written once at setup, the hot values are written by the poll
+ * paths. Each field lives in its own contiguous array, so iterating over the
+ * values of all points touches only the value arrays and never allocates.
+ *
+ * Writers are serialized by a spinlock, readers take snapshots under a
+ * sequence counter and retry if a write overlapped.
+ */
+class SensorRegistry {
+    // metadata
+    uint16_t _name[REGISTRY_MAX_POINTS];          // offsets into _pool
+    uint16_t _description[REGISTRY_MAX_POINTS];
+    uint8_t  _address[REGISTRY_MAX_POINTS];       // Modbus address
+    uint16_t _scale[REGISTRY_MAX_POINTS];         // value / scale = engineering unit
+    SensorFilter* _filter[REGISTRY_MAX_POINTS];   // applied by update(), nullptr for raw values
+
+    // hot values
+    int32_t      _value[REGISTRY_MAX_POINTS];
+    int64_t      _time[REGISTRY_MAX_POINTS];
+    PointQuality _quality[REGISTRY_MAX_POINTS];
+
+    char                  _pool[REGISTRY_NAME_POOL];
+    uint16_t              _pool_used;
+    uint16_t              _count;
+    std::atomic<uint32_t> _seq{0};
+    portMUX_TYPE          _lock = portMUX_INITIALIZER_UNLOCKED;
+    PointUpdateHandler    _update_handler;
+
+    uint16_t intern(const char* str);
+
+public:
+    SensorRegistry();
+
+    PointHandle add(const char* name, const char* description, uint8_t address, uint16_t scale);
+    PointHandle find(const char* name);
+    uint16_t    size();
+
+    // metadata
+    const char* getName(PointHandle point);
+    const char* getDescription(PointHandle point);
+    uint8_t     getAddress(PointHandle point);
+    uint16_t    getScale(PointHandle point);
+    void        setFilter(PointHandle point, SensorFilter* filter);
+
+    // values
+    void         update(PointHandle point, int32_t value, int64_t time);
+    void         setQuality(PointHandle point, PointQuality quality, int64_t time);
+    int32_t      getValue(PointHandle point);
+    PointQuality getQuality(PointHandle point);
+    uint16_t     snapshot(PointHandle first, uint16_t count, PointSnapshot* out);
+
+    void onUpdate(PointUpdateHandler handler);
+};
+
+#endif // M5STACK_SENSOR_REGISTRY_H
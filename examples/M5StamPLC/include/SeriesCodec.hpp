@@ -0,0 +1,91 @@
+//
+// Gorilla-style compression of (timestamp, value) series.
+//
+
+#ifndef M5STACK_SERIES_CODEC_H
+#define M5STACK_SERIES_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Block layout, little endian:
+ *
+ *   uint16  count
+ *   int64   time of the first sample (ms)
+ *   int32   value of the first sample
+ *   int32   time from the first to the second sample (ms), 0 if it does not fit
+ *   bits    count - 1 samples, MSB first
+ *
+ * Every following sample is a timestamp delta-of-delta and a value delta,
+ * both zig-zag encoded in a prefix bucket. The delta-of-delta of the second
+ * sample is taken against the delta in the header, so a regular cadence
+ * costs one bit there as well instead of the 68 bits of a 5 s delta:
+ *
+ *   time   '0' | '10' + 7 | '110' + 9 | '1110' + 12 | '1111' + 64 bits
+ *   value  '0' | '10' + 4 | '110' + 8 | '1110' + 12 | '1111' + 32 bits
+ *
+ * A sample every 5 s with a few ms of jitter costs 1..10 bits of time. The
+ * values are fixed point integers (e.g. tenths of a degree), where a delta
+ * is smaller than the XOR of two floats, so the value is delta encoded.
+ * Blocks do not depend on each other and decode on their own.
+ */
+#define SERIES_HEADER      18
+#define SERIES_MAX_SAMPLE  13         // bytes, worst case of one sample
+
+struct SeriesBenchmark {
+    uint32_t samples;
+    uint32_t blocks;
+    size_t   raw_bytes;           // 12 bytes per sample
+    size_t   compressed_bytes;
+    int64_t  encode_nsec;
+    int64_t  decode_nsec;
+};
+
+class SeriesEncoder {
+    uint8_t* _block;
+    size_t   _capacity;
+    size_t   _pos;
+    uint64_t _acc;
+    uint8_t  _bits;
+    uint16_t _count;
+    int64_t  _time;
+    int64_t  _delta;
+    int32_t  _value;
+
+    void writeBits(uint64_t bits, uint8_t count);
+
+public:
+    SeriesEncoder(uint8_t* block, size_t capacity);
+
+    void     reset();
+    bool     append(int64_t time, int32_t value);
+    size_t   finish();
+    uint16_t count();
+    size_t   size();
+
+    static void benchmark(uint32_t samples, size_t block_size, SeriesBenchmark* result);
+};
+
+class SeriesDecoder {
+    const uint8_t* _block;
+    size_t         _len;
+    size_t         _pos;
+    uint64_t       _acc;
+    uint8_t        _bits;
+    uint16_t       _count;
+    uint16_t       _read;
+    int64_t        _time;
+    int64_t        _delta;
+    int32_t        _value;
+
+    uint64_t readBits(uint8_t count);
+
+public:
+    SeriesDecoder(const uint8_t* block, size_t len);
+
+    uint16_t count();
+    bool     next(int64_t* time, int32_t* value);
+};
+
+#endif // M5STACK_SERIES_CODEC_H
@@ -0,0 +1,52 @@
+//
+// In-RAM image of the PLC I/O and sensor values served to Modbus masters.
+//
+
+#ifndef M5STACK_SHADOW_IMAGE_H
+#define M5STACK_SHADOW_IMAGE_H
+
+#include <Arduino.h>
+#include <functional>
+
+#define SHADOW_COILS            4     // relays
+#define SHADOW_DISCRETE_INPUTS  8     // opto-isolated inputs
+#define SHADOW_INPUT_REGISTERS  64    // sensor values
+
+// input registers per Sensor: temperature, humidity
+#define SHADOW_REGISTERS_PER_SENSOR 2
+
+// receives the complete coil image after a master write, bit n = coil n
+typedef std::function<void(uint8_t coils)> CoilWriteHandler;
+
+/**
+ * The image is written by the scan and poll paths and read by the Modbus
+ * server. All accesses are short copies inside a critical section, so a master
+ * request is answered without touching I2C or RS485.
+ */
+class ShadowImage {
+    portMUX_TYPE     _lock = portMUX_INITIALIZER_UNLOCKED;
+    uint8_t          _coils;
+    uint8_t          _inputs;
+    uint16_t         _registers[SHADOW_INPUT_REGISTERS];
+    CoilWriteHandler _coil_handler;
+
+public:
+    ShadowImage();
+
+    // scan and poll paths
+    void setCoils(uint8_t coils);
+    void setInputs(uint8_t inputs);
+    void setRegister(uint16_t reg, uint16_t value);
+    void setRegisters(uint16_t reg, const uint16_t* values, uint16_t count);
+
+    // Modbus server
+    uint8_t getCoils();
+    uint8_t getInputs();
+    bool    getRegisters(uint16_t reg, uint16_t* values, uint16_t count);
+    void    writeCoil(uint8_t coil, bool state);
+    void    writeCoils(uint8_t first, uint8_t count, uint8_t states);
+
+    void onCoilWrite(CoilWriteHandler handler);
+};
+
+#endif // M5STACK_SHADOW_IMAGE_H
@@ -0,0 +1,102 @@
+//
+// Frame splitting, timestamps and response times of the bus sniffer.
+//
+
+#ifndef M5STACK_SNIFFER_DECODER_H
+#define M5STACK_SNIFFER_DECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+#include <mutex>
+
+#include "ModbusFrame.h"
+
+#define SNIFFER_MAGIC          "MBS1"
+#define SNIFFER_VERSION        1
+#define SNIFFER_MAX_ADDRESS    247      // highest slave address with response statistics
+#define SNIFFER_RESPONSE_LIMIT 1000000  // longest request->response pairing in microseconds
+
+// record flags
+#define SNIFFER_FLAG_CRC_OK    0x01
+#define SNIFFER_FLAG_RESPONSE  0x02
+
+/**
+ * Capture file layout, all values little endian:
+ *
+ *   header  : "MBS1", uint32 baud, uint32 serial config, int64 start (usec since epoch)
+ *   record  : uint32 delta (usec since previous frame start), uint8 flags, uint16 length, length bytes
+ */
+struct __attribute__((packed)) SnifferHeader {
+    char     magic[4];
+    uint32_t baudrate;
+    uint32_t config;
+    int64_t  start_usec;
+};
+
+struct __attribute__((packed)) SnifferRecord {
+    uint32_t delta_usec;
+    uint8_t  flags;
+    uint16_t length;
+};
+
+/**
+ * Response time statistics of one slave, in microseconds
+ */
+struct SnifferSlaveStats {
+    uint32_t responses;
+    uint32_t min_usec;
+    uint32_t max_usec;
+    uint64_t sum_usec;
+};
+
+typedef std::function<void(const SnifferRecord& record, const uint8_t* frame)> SnifferFrameHandler;
+
+/**
+ * Splits the received bytes into frames by the length the header of a
+ * request or a response implies, so a slave answering right after the
+ * request still gets its own frame and response time. The bytes of one
+ * receive() are taken as sent back to back, the start of every frame is
+ * counted back from the end of the last byte in character times. A frame
+ * whose length cannot be known (unknown function code, damaged header) ends
+ * at a t3.5 silence.
+ */
+class SnifferDecoder {
+    SnifferFrameHandler _handler;
+    uint32_t            _char_usec;
+    uint32_t            _silence_usec;
+
+    // bytes waiting for the rest of their frame
+    uint8_t             _buf[MODBUS_RTU_MAX_FRAME];
+    size_t              _len;
+    int64_t             _start;         // start of _buf[0]
+    int64_t             _end;           // end of the last byte received
+    int64_t             _last_start;
+
+    // pending request waiting for its response
+    uint8_t             _req_address;
+    uint8_t             _req_function;
+    int64_t             _req_end;
+
+    uint32_t            _frames;
+    uint32_t            _crc_errors;
+    std::mutex          _lock;
+    SnifferSlaveStats   _stats[SNIFFER_MAX_ADDRESS + 1];
+
+    void split(bool silence);
+    void emit(size_t len, bool request, bool response);
+    void matchResponse(bool request, bool response, int64_t start, int64_t end, uint8_t* flags);
+
+public:
+    SnifferDecoder(uint32_t char_usec, uint32_t silence_usec, const SnifferFrameHandler& handler);
+
+    void begin(int64_t start_usec);
+    void receive(const uint8_t* data, size_t len, int64_t end_usec);
+    void flush();
+
+    uint32_t getFrames();
+    uint32_t getCrcErrors();
+    bool     getSlaveStats(uint8_t addr, SnifferSlaveStats* stats);
+};
+
+#endif // M5STACK_SNIFFER_DECODER_H
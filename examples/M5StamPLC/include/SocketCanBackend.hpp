@@ -0,0 +1,31 @@
+//
+// CAN backend for Linux SocketCAN, e.g. a vcan interface for tests.
+//
+
+#ifndef M5STACK_SOCKETCAN_BACKEND_H
+#define M5STACK_SOCKETCAN_BACKEND_H
+
+#ifdef __linux__
+
+#include "CanBackend.hpp"
+
+class SocketCanBackend : public CanBackend {
+    int  _socket;
+    bool _fd;
+
+public:
+    SocketCanBackend();
+    ~SocketCanBackend() override;
+
+    bool begin(const char* ifname, bool fd);
+    void end();
+
+    bool    send(const CanFrame& frame, uint32_t timeout_ms) override;
+    bool    receive(CanFrame* frame, uint32_t timeout_ms) override;
+    bool    setFilter(uint32_t id, uint32_t mask) override;
+    uint8_t maxPayload() override;
+};
+
+#endif // __linux__
+
+#endif // M5STACK_SOCKETCAN_BACKEND_H
@@ -0,0 +1,54 @@
+//
+// Minimal MQTT 3.1.1 client over a TCP socket, for tests on Linux against a local broker.
+//
+
+#ifndef M5STACK_SOCKET_MQTT_BACKEND_H
+#define M5STACK_SOCKET_MQTT_BACKEND_H
+
+#ifdef __linux__
+
+#include "MqttBackend.hpp"
+
+#define MQTT_KEEPALIVE          60      // s
+#define MQTT_RECONNECT_INTERVAL 2000    // ms
+#define MQTT_RX_BUFFER          512
+
+/**
+ * Only what the publisher needs: CONNECT, QoS 1 PUBLISH, PUBACK and
+ * keepalive. Runs in the thread that calls poll(), which also reconnects
+ * after a lost connection. Without a session, messages awaiting their PUBACK
+ * are reported as lost with the connection.
+ */
+class SocketMqttBackend : public MqttBackend {
+    int      _socket;
+    bool     _connected;
+    bool     _lost;             // reported by the next poll()
+    char     _host[64];
+    uint16_t _port;
+    char     _client_id[32];
+    uint16_t _next_id;
+    int64_t  _last_tx;
+    int64_t  _last_attempt;
+    uint8_t  _rx[MQTT_RX_BUFFER];
+    size_t   _rx_len;
+
+    bool connect();
+    void disconnect();
+    bool sendAll(const uint8_t* data, size_t len);
+    void receive();
+
+public:
+    SocketMqttBackend();
+    ~SocketMqttBackend() override;
+
+    bool begin(const char* host, uint16_t port, const char* client_id);
+    void end();
+
+    int  publish(const char* topic, const uint8_t* data, size_t len) override;
+    bool connected() override;
+    void poll(uint32_t timeout_ms) override;
+};
+
+#endif // __linux__
+
+#endif // M5STACK_SOCKET_MQTT_BACKEND_H
@@ -0,0 +1,57 @@
+//
+// Lock-free single producer / single consumer queue.
+//
+
+#ifndef M5STACK_SPSC_QUEUE_H
+#define M5STACK_SPSC_QUEUE_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Fixed-size ring of N - 1 usable slots. One task (or ISR) pushes, one task
+ * pops; neither side ever blocks or takes a lock.
+ *
+ * @tparam T  element type, copied in and out
+ * @tparam N  capacity + 1, power of two
+ */
+template <typename T, uint32_t N>
+class SpscQueue {
+    static_assert((N & (N - 1)) == 0, "N must be a power of two");
+
+    T                     _items[N];
+    std::atomic<uint32_t> _head{0};     // next slot to write
+    std::atomic<uint32_t> _tail{0};     // next slot to read
+
+public:
+    bool push(const T& item) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        uint32_t next = (head + 1) & (N - 1);
+        if (next == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T* item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *item = _items[tail];
+        _tail.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+    uint32_t size() {
+        return (_head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire)) & (N - 1);
+    }
+};
+
+#endif // M5STACK_SPSC_QUEUE_H
@@ -0,0 +1,59 @@
+//
+// Fixed number of objects created at boot, on the heap or in static storage.
+//
+
+#ifndef M5STACK_STATIC_POOL_H
+#define M5STACK_STATIC_POOL_H
+
+#include <stdint.h>
+#include <new>
+#include <utility>
+
+/**
+ * Up to N objects of type T. With -DPLC_STATIC_ALLOC the objects are built
+ * in storage reserved inside the pool, so their memory is fixed at link time;
+ * otherwise create() is a plain new. The pool is meant for objects created
+ * once at boot: a destroyed object does not free its slot.
+ */
+template <typename T, uint16_t N = 1>
+class StaticPool {
+#ifdef PLC_STATIC_ALLOC
+    alignas(T) uint8_t _slots[N][sizeof(T)];
+#endif
+    uint16_t _used;
+
+public:
+    StaticPool() : _used(0) {}
+
+    /**
+     * @param args  constructor arguments
+     * @return the new object, nullptr if all N slots are used
+     */
+    template <typename... Args>
+    T* create(Args&&... args) {
+        if (_used >= N) {
+            return nullptr;
+        }
+#ifdef PLC_STATIC_ALLOC
+        return new (_slots[_used++]) T(std::forward<Args>(args)...);
+#else
+        _used++;
+        return new T(std::forward<Args>(args)...);
+#endif
+    }
+
+    void destroy(T* obj) {
+        if (obj == nullptr) {
+            return;
+        }
+#ifdef PLC_STATIC_ALLOC
+        obj->~T();
+#else
+        delete obj;
+#endif
+    }
+
+    uint16_t used() { return _used; }
+};
+
+#endif // M5STACK_STATIC_POOL_H
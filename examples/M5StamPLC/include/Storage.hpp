@@ -0,0 +1,26 @@
+//
+// microSD card of the StamPLC.
+//
+
+#ifndef M5STACK_STORAGE_H
+#define M5STACK_STORAGE_H
+
+#include <Arduino.h>
+#include <SD.h>
+
+// values for M5StamPLC
+#ifndef SD_SCK_PIN
+#define SD_SCK_PIN  GPIO_NUM_7
+#define SD_MISO_PIN GPIO_NUM_9
+#define SD_MOSI_PIN GPIO_NUM_8
+#define SD_CS_PIN   GPIO_NUM_10
+#endif
+
+#define SD_FREQUENCY 20000000
+
+bool     storage_begin();
+bool     storage_ready();
+uint8_t* storage_read(const char* path, size_t* len);
+bool     storage_write(const char* path, const uint8_t* data, size_t len);
+
+#endif // M5STACK_STORAGE_H
@@ -0,0 +1,90 @@
+//
+// Multi-resolution min/max/avg history of registry points in fixed memory.
+//
+
+#ifndef M5STACK_TREND_STORE_H
+#define M5STACK_TREND_STORE_H
+
+#include <stdint.h>
+#include <mutex>
+
+/*
+ * Resolutions and their ring capacities:
+ *
+ *   1 s   x 60   1 minute
+ *   1 min x 120  2 hours
+ *   1 h   x 168  1 week
+ *   1 day x 62   2 months
+ *
+ * 410 buckets of 24 bytes, about 9.6 kB per point.
+ */
+#define TREND_LEVELS  4
+#define TREND_BUCKETS (60 + 120 + 168 + 62)
+
+struct TrendBucket {
+    int64_t  sum;
+    uint32_t number;          // time / period of the level
+    int32_t  min;
+    int32_t  max;
+    uint32_t count;           // 0 = empty
+};
+
+/**
+ * Aggregate over [time, time + period)
+ */
+struct TrendSample {
+    int64_t  time;            // ms
+    int32_t  min;
+    int32_t  max;
+    int32_t  avg;
+    uint32_t count;
+};
+
+/**
+ * History of one tracked point
+ */
+struct TrendSeries {
+    uint16_t    point;
+    int64_t     newest;           // ms, latest sample
+    TrendBucket buckets[TREND_BUCKETS];
+};
+
+/**
+ * Every sample updates the current bucket of each resolution, a constant
+ * amount of work. A bucket is recycled when its ring slot is reached by a
+ * newer bucket number, so gaps in the data cost nothing. The series are
+ * provided by StaticTrendStore.
+ */
+class TrendStore {
+    TrendSeries* _series;
+    uint8_t      _capacity;
+    uint8_t      _count;
+    std::mutex   _lock;
+
+    TrendSeries* find(uint16_t point);
+    bool         covers(const TrendSeries* series, uint8_t level, int64_t from);
+    uint8_t      selectLevel(const TrendSeries* series, int64_t from, int64_t step);
+
+protected:
+    TrendStore(TrendSeries* series, uint8_t capacity);
+
+public:
+    bool     track(uint16_t point);
+    void     add(uint16_t point, int32_t value, int64_t time_ms);
+    uint16_t query(uint16_t point, int64_t from, int64_t to, uint16_t max, TrendSample* out);
+
+    static int64_t period(uint8_t level);
+};
+
+/**
+ * TrendStore with room for N points, about 9.6 kB each
+ */
+template <uint8_t N>
+class StaticTrendStore : public TrendStore {
+    TrendSeries _storage[N];
+
+public:
+    StaticTrendStore() : TrendStore(_storage, N), _storage() {}
+};
+
+#endif // M5STACK_TREND_STORE_H
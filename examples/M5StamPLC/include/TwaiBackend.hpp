@@ -0,0 +1,47 @@
+//
+// CAN backend for the ESP32 TWAI controller (PWR-CAN port of the StamPLC).
+//
+
+#ifndef M5STACK_TWAI_BACKEND_H
+#define M5STACK_TWAI_BACKEND_H
+
+#ifdef ESP_PLATFORM
+
+#include <driver/twai.h>
+
+#include "CanBackend.hpp"
+
+// values for M5StamPLC, check against the schematic of the board revision
+#ifndef CAN_TX_PIN
+#define CAN_TX_PIN  GPIO_NUM_42
+#endif
+#ifndef CAN_RX_PIN
+#define CAN_RX_PIN  GPIO_NUM_43
+#endif
+
+#define TWAI_QUEUE_LEN 32
+
+class TwaiBackend : public CanBackend {
+    uint32_t _bitrate;
+    uint32_t _filter_id;
+    uint32_t _filter_mask;
+    bool     _running;
+
+    bool start();
+    void stop();
+
+public:
+    TwaiBackend();
+    ~TwaiBackend() override;
+
+    bool begin(uint32_t bitrate);
+
+    bool    send(const CanFrame& frame, uint32_t timeout_ms) override;
+    bool    receive(CanFrame* frame, uint32_t timeout_ms) override;
+    bool    setFilter(uint32_t id, uint32_t mask) override;
+    uint8_t maxPayload() override;
+};
+
+#endif // ESP_PLATFORM
+
+#endif // M5STACK_TWAI_BACKEND_H
@@ -0,0 +1,282 @@
+//
+// Alarm rules on registry points, compiled into a per-point table.
+//
+
+#include <string.h>
+#include "AlarmEngine.hpp"
+#include "Timespec.h"
+
+#define SINCE_NONE INT64_MIN
+
+AlarmEngine::AlarmEngine() {
+    _rules  = nullptr;
+    _state  = nullptr;
+    _first  = nullptr;
+    _count  = 0;
+    _points = 0;
+    _active = 0;
+}
+
+AlarmEngine::~AlarmEngine() {
+    release();
+}
+
+void AlarmEngine::release() {
+    delete[] _rules;
+    delete[] _state;
+    delete[] _first;
+    _rules  = nullptr;
+    _state  = nullptr;
+    _first  = nullptr;
+    _count  = 0;
+    _points = 0;
+    _active = 0;
+}
+
+/**
+ * Replace the rule table, all alarms start inactive
+ *
+ * @param rules   rule list, AlarmEvent::rule refers to its indexes
+ * @param count   up to ALARM_MAX_RULES
+ * @param points  registered points, rules of other points are invalid
+ * @return false if a rule is invalid
+ */
+bool AlarmEngine::compile(const AlarmRule* rules, uint16_t count, uint16_t points) {
+    std::lock_guard<std::mutex> guard(_lock);
+    release();
+    if (count > ALARM_MAX_RULES) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (rules[i].point >= points || rules[i].type > ALARM_COMM_LOSS || rules[i].hysteresis < 0
+            || ((rules[i].type == ALARM_ROC || rules[i].type == ALARM_STUCK) && rules[i].window_ms == 0)) {
+            return false;
+        }
+    }
+
+    _rules  = new Compiled[count];
+    _state  = new State[count];
+    _first  = new uint32_t[points + 1];
+    _count  = count;
+    _points = points;
+
+    // counting sort by point keeps the rules of a point in their list order
+    memset(_first, 0, (points + 1) * sizeof(uint32_t));
+    for (uint16_t i = 0; i < count; i++) {
+        _first[rules[i].point + 1]++;
+    }
+    for (uint16_t p = 0; p < points; p++) {
+        _first[p + 1] += _first[p];
+    }
+
+    uint32_t* next = new uint32_t[points];
+    memcpy(next, _first, points * sizeof(uint32_t));
+    for (uint16_t i = 0; i < count; i++) {
+        const AlarmRule* rule = &rules[i];
+        Compiled*        c    = &_rules[next[rule->point]++];
+
+        c->raise   = rule->limit;
+        c->clear   = rule->type == ALARM_LOW ? rule->limit + rule->hysteresis : rule->limit - rule->hysteresis;
+        c->delay   = rule->delay_ms;
+        c->window  = rule->window_ms;
+        c->rule    = i;
+        c->point   = rule->point;
+        c->type    = rule->type;
+        c->actions = rule->actions;
+        c->relay   = rule->relay;
+    }
+    delete[] next;
+
+    for (uint16_t i = 0; i < count; i++) {
+        _state[i] = {SINCE_NONE, 0, 0, 0, 0, false, false, false};
+    }
+    return true;
+}
+
+/**
+ * @param handler  called when an alarm is raised or cleared
+ */
+void AlarmEngine::onAlarm(AlarmHandler handler) {
+    std::lock_guard<std::mutex> guard(_lock);
+    _handler = handler;
+}
+
+/**
+ * Evaluate the condition of one rule for a new sample
+ *
+ * @return true if the alarm condition holds
+ */
+bool AlarmEngine::check(const Compiled* rule, State* state, int32_t value, bool good, int64_t time) {
+    if (rule->type == ALARM_COMM_LOSS) {
+        return !good;
+    }
+    if (!good) {
+        // a value that was not read changes nothing
+        return state->active;
+    }
+
+    switch (rule->type) {
+        case ALARM_HIGH:
+            return state->active ? value >= rule->clear : value > rule->raise;
+
+        case ALARM_LOW:
+            return state->active ? value <= rule->clear : value < rule->raise;
+
+        case ALARM_ROC: {
+            // the reference is between window and about twice the window old,
+            // so a change is never extrapolated from closely spaced samples
+            if (!state->has_ref) {
+                state->ref_value = value;
+                state->ref_time  = time;
+                state->has_ref   = true;
+                return state->active;
+            }
+            if (state->has_next && time - state->next_time >= rule->window) {
+                state->ref_value = state->next_value;
+                state->ref_time  = state->next_time;
+                state->has_next  = false;
+            }
+            if (!state->has_next) {
+                state->next_value = value;
+                state->next_time  = time;
+                state->has_next   = true;
+            }
+
+            int64_t dt = time - state->ref_time;
+            if (dt < rule->window) {
+                return state->active;
+            }
+            int64_t change = (int64_t)value - state->ref_value;
+            int64_t rate   = (change < 0 ? -change : change) * rule->window / dt;
+            return state->active ? rate >= rule->clear : rate > rule->raise;
+        }
+
+        case ALARM_STUCK: {
+            int64_t change = (int64_t)value - state->ref_value;
+            if (!state->has_ref || change > rule->raise || -change > rule->raise) {
+                state->ref_value = value;
+                state->ref_time  = time;
+                state->has_ref   = true;
+            }
+            return time - state->ref_time >= rule->window;
+        }
+    }
+    return false;
+}
+
+/**
+ * Check a new sample against the rules of its point, called from the
+ * registry update hook
+ *
+ * @param point
+ * @param value
+ * @param good   false for a failed read
+ * @param time   ms
+ */
+void AlarmEngine::evaluate(uint16_t point, int32_t value, bool good, int64_t time) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (point >= _points) {
+        return;
+    }
+
+    for (uint32_t i = _first[point]; i < _first[point + 1]; i++) {
+        const Compiled* rule  = &_rules[i];
+        State*          state = &_state[i];
+        bool            cond  = check(rule, state, value, good, time);
+
+        if (cond == state->active) {
+            state->since = SINCE_NONE;
+            continue;
+        }
+        if (state->since == SINCE_NONE) {
+            state->since = time;
+        }
+        // raising waits for the delay, clearing is immediate (the hysteresis
+        // already keeps it from chattering)
+        if (cond && time - state->since < rule->delay) {
+            continue;
+        }
+
+        state->active = cond;
+        state->since  = SINCE_NONE;
+        _active += cond ? 1 : -1;
+
+        if (_handler) {
+            _handler({rule->rule, rule->point, rule->type, rule->actions, rule->relay, cond, value, time});
+        }
+    }
+}
+
+uint16_t AlarmEngine::size() {
+    return _count;
+}
+
+/**
+ * @return number of active alarms
+ */
+uint16_t AlarmEngine::active() {
+    return _active;
+}
+
+/**
+ * @param rule  index in the rule list passed to compile()
+ */
+bool AlarmEngine::isActive(uint16_t rule) {
+    std::lock_guard<std::mutex> guard(_lock);
+    for (uint16_t i = 0; i < _count; i++) {
+        if (_rules[i].rule == rule) {
+            return _state[i].active;
+        }
+    }
+    return false;
+}
+
+/**
+ * Cost of evaluate() per sample with the rules spread evenly over the
+ * points, compared to checking every rule against every sample
+ *
+ * @param rules    e.g. 10000
+ * @param points
+ * @param samples
+ * @param result   [out]
+ */
+void AlarmEngine::benchmark(uint16_t rules, uint16_t points, uint32_t samples, AlarmBenchmark* result) {
+    AlarmRule*  list   = new AlarmRule[rules];
+    AlarmEngine engine;
+    uint32_t    seed   = 0x12345678;
+    uint32_t    events = 0;
+
+    for (uint16_t i = 0; i < rules; i++) {
+        uint8_t type = i % 4;   // HIGH, LOW, ROC, STUCK
+        list[i]      = {(uint16_t)(i % points), type, ALARM_ACTION_UPLINK, 250 + (int32_t)(i % 50), 5, 1000, 60000, 0};
+    }
+    engine.compile(list, rules, points);
+    engine.onAlarm([&events](const AlarmEvent&) { events++; });
+
+    int64_t start = timespec_now_to_nsec();
+    for (uint32_t s = 0; s < samples; s++) {
+        seed = seed * 1103515245 + 12345;
+        engine.evaluate((seed >> 8) % points, 200 + (seed >> 20) % 100, true, s * 10);
+    }
+    result->indexed_nsec = timespec_now_to_nsec() - start;
+
+    // the same conditions without the index
+    start = timespec_now_to_nsec();
+    for (uint32_t s = 0; s < samples; s++) {
+        seed = seed * 1103515245 + 12345;
+        uint16_t point = (seed >> 8) % points;
+        int32_t  value = 200 + (seed >> 20) % 100;
+        std::lock_guard<std::mutex> guard(engine._lock);
+        for (uint32_t i = 0; i < engine._count; i++) {
+            if (engine._rules[i].point == point) {
+                engine.check(&engine._rules[i], &engine._state[i], value, true, s * 10);
+            }
+        }
+    }
+    result->scan_nsec = timespec_now_to_nsec() - start;
+
+    result->rules   = rules;
+    result->samples = samples;
+    delete[] list;
+}
@@ -0,0 +1,193 @@
+//
+// StamPLC board telemetry: INA226 supply voltage/current and LM75 temperature.
+//
+// Both chips convert continuously on their own: the INA226 averages 16
+// samples of shunt and bus voltage, the LM75 always converts. The sampler
+// task wakes once per period, checks the INA226 conversion-ready flag and
+// reads all result registers back to back, so the I2C bus is used once per
+// period and only when there is a new result. Limits are programmed into the
+// chips; over-current and over-temperature are signalled on the ALERT/OS pins
+// and handled by interrupt instead of comparing every sample.
+//
+
+#include <BoardHealth.hpp>
+#include <M5StamPLC.h>
+#include "Timespec.h"
+
+// INA226 registers
+#define INA226_CONFIG      0x00
+#define INA226_BUS_VOLTAGE 0x02
+#define INA226_CURRENT     0x04
+#define INA226_CALIBRATION 0x05
+#define INA226_MASK_ENABLE 0x06
+#define INA226_ALERT_LIMIT 0x07
+
+// AVG = 16, VBUSCT = VSHCT = 1.1 ms, shunt and bus continuous
+#define INA226_CONFIG_CONT 0x4527
+#define INA226_SOL         0x8000       // alert on shunt over-voltage
+#define INA226_CVRF        0x0008       // conversion ready
+#define INA226_CURRENT_LSB 100          // uA per bit
+
+// LM75 registers
+#define LM75_TEMP          0x00
+#define LM75_CONF          0x01
+#define LM75_THYST         0x02
+#define LM75_TOS           0x03
+#define LM75_CONF_INT      0x02         // OS in interrupt mode, active low
+
+BoardHealth::BoardHealth(SensorRegistry* registry) {
+    _registry = registry;
+    _task     = nullptr;
+
+    _voltage_point     = registry->add("BOARD.V", "Supply voltage [V]", 0, 1000);
+    _current_point     = registry->add("BOARD.I", "Supply current [A]", 0, 1000);
+    _temperature_point = registry->add("BOARD.T", "Board temperature [C]", 0, 10);
+}
+
+bool BoardHealth::writeRegister16(uint8_t addr, uint8_t reg, uint16_t value) {
+    uint8_t data[2] = {(uint8_t)(value >> 8), (uint8_t)(value & 0xFF)};
+    return M5.In_I2C.writeRegister(addr, reg, data, sizeof(data), BOARD_I2C_FREQ);
+}
+
+bool BoardHealth::readRegister16(uint8_t addr, uint8_t reg, uint16_t* value) {
+    uint8_t data[2];
+    if (!M5.In_I2C.readRegister(addr, reg, data, sizeof(data), BOARD_I2C_FREQ)) {
+        return false;
+    }
+    *value = (data[0] << 8) | data[1];
+    return true;
+}
+
+/**
+ * Continuous averaging mode and alert limits for both chips
+ */
+void BoardHealth::configure() {
+    // current in 100 uA steps: CAL = 0.00512 / (current_lsb * shunt)
+    uint16_t calibration = 5120000UL / (INA226_CURRENT_LSB * INA226_SHUNT_MOHM);
+    // shunt voltage limit, 2.5 uV per bit
+    uint16_t shunt_limit = (uint32_t)BOARD_MAX_CURRENT * INA226_SHUNT_MOHM * 10 / 25;
+
+    writeRegister16(INA226_ADDR, INA226_CONFIG, INA226_CONFIG_CONT);
+    writeRegister16(INA226_ADDR, INA226_CALIBRATION, calibration);
+    writeRegister16(INA226_ADDR, INA226_ALERT_LIMIT, shunt_limit);
+    writeRegister16(INA226_ADDR, INA226_MASK_ENABLE, INA226_SOL);
+
+    // LM75 limits are 9 bit, 0.5 °C per bit, left aligned
+    int16_t tos   = BOARD_MAX_TEMPERATURE / 5;
+    int16_t thyst = (BOARD_MAX_TEMPERATURE - BOARD_TEMP_HYSTERESIS) / 5;
+    M5.In_I2C.writeRegister8(LM75_ADDR, LM75_CONF, LM75_CONF_INT, BOARD_I2C_FREQ);
+    writeRegister16(LM75_ADDR, LM75_TOS, tos << 7);
+    writeRegister16(LM75_ADDR, LM75_THYST, thyst << 7);
+}
+
+void BoardHealth::sample() {
+    uint16_t mask;
+    uint16_t bus;
+    int16_t  current;
+    uint16_t temp;
+    int64_t  now = timespec_now_to_msec();
+
+    // reading the mask register also clears the INA226 alert latch
+    if (readRegister16(INA226_ADDR, INA226_MASK_ENABLE, &mask) && (mask & INA226_CVRF)) {
+        if (readRegister16(INA226_ADDR, INA226_BUS_VOLTAGE, &bus)
+            && readRegister16(INA226_ADDR, INA226_CURRENT, (uint16_t*)&current)) {
+            // bus voltage 1.25 mV per bit, published in mV and mA
+            _registry->update(_voltage_point, (int32_t)bus * 5 / 4, now);
+            _registry->update(_current_point, (int32_t)current * INA226_CURRENT_LSB / 1000, now);
+        } else {
+            _registry->setQuality(_voltage_point, QUALITY_BAD, now);
+            _registry->setQuality(_current_point, QUALITY_BAD, now);
+        }
+    }
+
+    // reading the temperature clears the LM75 OS output in interrupt mode
+    if (readRegister16(LM75_ADDR, LM75_TEMP, &temp)) {
+        _registry->update(_temperature_point, ((int16_t)temp >> 7) * 5, now);
+    } else {
+        _registry->setQuality(_temperature_point, QUALITY_BAD, now);
+    }
+}
+
+void IRAM_ATTR BoardHealth::currentIsr(void* arg) {
+    BoardHealth* board = (BoardHealth*)arg;
+    BaseType_t   woken = pdFALSE;
+    board->_alerts.fetch_or(BOARD_ALERT_CURRENT);
+    vTaskNotifyGiveFromISR(board->_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void IRAM_ATTR BoardHealth::temperatureIsr(void* arg) {
+    BoardHealth* board = (BoardHealth*)arg;
+    BaseType_t   woken = pdFALSE;
+    board->_alerts.fetch_or(BOARD_ALERT_TEMPERATURE);
+    vTaskNotifyGiveFromISR(board->_task, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * Samples once per period; an alert interrupt wakes it early, so the
+ * handler sees the reading that raised the alert
+ */
+void BoardHealth::samplerTask(void* arg) {
+    BoardHealth* board  = (BoardHealth*)arg;
+    TickType_t   period = pdMS_TO_TICKS(BOARD_PERIOD);
+    TickType_t   next   = xTaskGetTickCount() + period;
+
+    for (;;) {
+        TickType_t now  = xTaskGetTickCount();
+        int32_t    wait = (int32_t)(next - now);
+        if (wait < -(int32_t)period) {
+            next = now;
+            wait = 0;
+        }
+
+        // a notification is an alert, it does not move the periodic schedule
+        if (ulTaskNotifyTake(pdTRUE, wait > 0 ? wait : 0) == 0) {
+            next += period;
+        }
+
+        board->sample();
+
+        uint8_t alerts = board->_alerts.exchange(0);
+        if (alerts && board->_alert_handler) {
+            board->_alert_handler(alerts);
+        }
+    }
+}
+
+/**
+ * Configure both chips and start sampling, call after M5StamPLC.begin()
+ *
+ * @param core  core of the sampler task
+ */
+void BoardHealth::begin(int core) {
+    configure();
+
+    xTaskCreatePinnedToCore(samplerTask, "board", BOARD_TASK_STACK, this, BOARD_TASK_PRIORITY, &_task, core);
+
+    pinMode(INA226_ALERT_PIN, INPUT_PULLUP);
+    pinMode(LM75_OS_PIN, INPUT_PULLUP);
+    attachInterruptArg(INA226_ALERT_PIN, currentIsr, this, FALLING);
+    attachInterruptArg(LM75_OS_PIN, temperatureIsr, this, FALLING);
+}
+
+/**
+ * @param handler  called from the sampler task with the raised BoardAlert bits
+ */
+void BoardHealth::onAlert(BoardAlertHandler handler) {
+    _alert_handler = handler;
+}
+
+/**
+ * @return alerts raised and not yet handled
+ */
+uint8_t BoardHealth::getAlerts() {
+    return _alerts;
+}
+
+/**
+ * @return the sampler task, nullptr before begin()
+ */
+TaskHandle_t BoardHealth::getTask() {
+    return _task;
+}
@@ -0,0 +1,142 @@
+//
+// Modbus RTU bus discovery and device fingerprinting.
+//
+// A naive scan sends one request per address and waits for the default
+// timeout, 247 s per baud rate. Here the timeout is derived from the frame
+// times at the scanned baud rate and up to DISCOVERY_QUEUED probes wait in
+// the queue of the RTU client. RTU allows one request on the bus at a time,
+// so the probes are still sent one after another; the queue only lets the
+// worker send the next probe right after the previous one is answered or
+// timed out, without a round trip through the calling task.
+//
+
+#include <BusDiscovery.hpp>
+
+// probe request and response: read one holding register
+#define PROBE_REQUEST_LEN  8
+#define PROBE_RESPONSE_LEN 7
+
+static const DeviceFingerprint KNOWN_DEVICES[] = {
+    // CWT-THxxS temperature and humidity sensor: humidity, temperature in tenths
+    {"CWT-THxxS", READ_HOLD_REGISTER, 0x0000, 2, {0, -400}, {1000, 1250}},
+};
+
+BusDiscovery::BusDiscovery(M5Modbus* modbus) {
+    _modbus      = modbus;
+    _slots       = xSemaphoreCreateCounting(DISCOVERY_QUEUED, DISCOVERY_QUEUED);
+    _done        = xSemaphoreCreateBinary();
+    _outstanding = 0;
+}
+
+BusDiscovery::~BusDiscovery() {
+    vSemaphoreDelete(_slots);
+    vSemaphoreDelete(_done);
+}
+
+/**
+ * Shortest safe response timeout at a baud rate: request and response frame
+ * times, the silent intervals and the slave turnaround time
+ *
+ * @param baud
+ * @return timeout in milliseconds
+ */
+uint32_t BusDiscovery::probeTimeout(uint32_t baud) {
+    uint32_t usec = (PROBE_REQUEST_LEN + PROBE_RESPONSE_LEN) * M5Modbus::charTime(baud)
+                    + 2 * M5Modbus::interFrameDelay(baud);
+    return (usec + USEC_PER_MILLISEC - 1) / USEC_PER_MILLISEC + DISCOVERY_TURNAROUND;
+}
+
+/**
+ * Probe callback from the RTU worker. Exception responses count as answers,
+ * the slave exists even if it has no register 0.
+ */
+void BusDiscovery::probeFinished(uint32_t token, bool answered) {
+    portENTER_CRITICAL(&_lock);
+    if (answered) {
+        _answered[token / 8] |= 1 << (token % 8);
+    }
+    bool last = --_outstanding == 0;
+    portEXIT_CRITICAL(&_lock);
+
+    xSemaphoreGive(_slots);
+    if (last) {
+        xSemaphoreGive(_done);
+    }
+}
+
+/**
+ * Read the known register maps and return the first one that matches
+ */
+const DeviceFingerprint* BusDiscovery::fingerprint(uint8_t addr) {
+    for (const DeviceFingerprint& fp : KNOWN_DEVICES) {
+        ModbusMessage rsp = _modbus->syncRequest(ModbusMessage(addr, fp.function, fp.reg, fp.count), addr);
+        if (rsp.getError() != SUCCESS || rsp.size() != 3 + 2 * fp.count) {
+            continue;
+        }
+
+        bool match = true;
+        for (uint8_t i = 0; i < fp.count && match; i++) {
+            int16_t value;
+            rsp.get(3 + 2 * i, value);
+            match = value >= fp.min[i] && value <= fp.max[i];
+        }
+        if (match) {
+            return &fp;
+        }
+    }
+    return nullptr;
+}
+
+uint16_t BusDiscovery::scanBaudrate(uint32_t baud, DiscoveredDevice* devices, uint16_t found, uint16_t max) {
+    memset(_answered, 0, sizeof(_answered));
+    _outstanding = DISCOVERY_LAST_ADDR - DISCOVERY_FIRST_ADDR + 1;
+
+    _modbus->setBaudrate(baud, _modbus->getConfig());
+    _modbus->setTimeout(probeTimeout(baud));
+
+    for (uint16_t addr = DISCOVERY_FIRST_ADDR; addr <= DISCOVERY_LAST_ADDR; addr++) {
+        xSemaphoreTake(_slots, portMAX_DELAY);
+        if (_modbus->addRequest(ModbusMessage(addr, READ_HOLD_REGISTER, 0x0000, 1), addr) != SUCCESS) {
+            probeFinished(addr, false);
+        }
+    }
+    xSemaphoreTake(_done, portMAX_DELAY);
+
+    for (uint16_t addr = DISCOVERY_FIRST_ADDR; addr <= DISCOVERY_LAST_ADDR && found < max; addr++) {
+        if (_answered[addr / 8] & (1 << (addr % 8))) {
+            devices[found].address  = addr;
+            devices[found].baudrate = baud;
+            devices[found].type     = fingerprint(addr);
+            found++;
+        }
+    }
+    return found;
+}
+
+/**
+ * Scan addresses 1..247 at every given baud rate with the current parity.
+ * The client keeps the last scanned baud rate, the timeout and the response
+ * handlers are restored. The handlers are swapped under the handler lock of
+ * the client, so the worker never runs a handler while it is replaced.
+ *
+ * @param baudrates  candidate baud rates
+ * @param count      number of baud rates
+ * @param devices    [out] responding devices
+ * @param max        capacity of devices
+ * @return number of devices found
+ */
+uint16_t BusDiscovery::scan(const uint32_t* baudrates, uint8_t count, DiscoveredDevice* devices, uint16_t max) {
+    uint32_t timeout = _modbus->getTimeout();
+    uint16_t found   = 0;
+
+    MBOnData  data  = [this](ModbusMessage, uint32_t token) { this->probeFinished(token, true); };
+    MBOnError error = [this](Error err, uint32_t token) { this->probeFinished(token, err < TIMEOUT); };
+
+    _modbus->swapResponse(data, error);
+    for (uint8_t i = 0; i < count && found < max; i++) {
+        found = scanBaudrate(baudrates[i], devices, found, max);
+    }
+    _modbus->swapResponse(data, error);
+    _modbus->setTimeout(timeout);
+    return found;
+}
@@ -0,0 +1,147 @@
+//
+// Passive RS485 Modbus RTU bus sniffer.
+//
+// The transceiver is held in receive mode and the UART TX pin is not used, so
+// the sniffer never disturbs the bus. The UART RX timeout is shorter than any
+// gap between frames: every read ends at a gap, and SnifferDecoder splits and
+// joins the bytes into frames by their length. The end of a read is known
+// from the time of the timeout, the start of every frame is counted back from
+// it in character times.
+//
+
+#include <BusSniffer.hpp>
+#include <M5Modbus.hpp>
+#include "Timespec.h"
+
+BusSniffer::BusSniffer(HardwareSerial* serial, uint32_t baud, uint32_t config)
+    : _decoder(M5Modbus::charTime(baud), M5Modbus::interFrameDelay(baud),
+               [this](const SnifferRecord& record, const uint8_t* frame) { this->onFrame(record, frame); }) {
+    _serial   = serial;
+    _baudrate = baud;
+    _config   = config;
+    _sink     = nullptr;
+    _ring     = nullptr;
+    _writer   = nullptr;
+    _dropped  = 0;
+}
+
+BusSniffer::~BusSniffer() {
+    end();
+}
+
+/**
+ * Start capturing. The capture header is written to the sink immediately,
+ * frames are written by a background task.
+ *
+ * @param sink      Serial, SD file, ...
+ * @param rx_pin
+ * @param rede_pin  RS485 direction pin, held in receive mode
+ */
+void BusSniffer::begin(Print* sink, int8_t rx_pin, int8_t rede_pin) {
+    _sink = sink;
+
+    SnifferHeader header;
+    memcpy(header.magic, SNIFFER_MAGIC, sizeof(header.magic));
+    header.baudrate   = _baudrate;
+    header.config     = _config;
+    header.start_usec = timespec_now_to_usec();
+    _sink->write((const uint8_t*)&header, sizeof(header));
+    _decoder.begin(header.start_usec);
+
+    _ring = xRingbufferCreate(SNIFFER_RING_SIZE, RINGBUF_TYPE_NOSPLIT);
+    xTaskCreate(writerTask, "sniffer", SNIFFER_TASK_STACK, this, SNIFFER_TASK_PRIORITY, &_writer);
+
+    pinMode(rede_pin, OUTPUT);
+    digitalWrite(rede_pin, LOW);
+
+    _serial->setRxBufferSize(2 * MODBUS_RTU_MAX_FRAME);
+    _serial->begin(_baudrate, _config, rx_pin, -1);
+    _serial->setRxFIFOFull(MODBUS_RX_FIFO_FULL);
+    _serial->setRxTimeout(SNIFFER_RX_TIMEOUT);
+    _serial->onReceive([this]() { this->onReceive(); }, true);
+}
+
+void BusSniffer::end() {
+    if (_ring == nullptr) {
+        return;
+    }
+    _serial->onReceive(NULL);
+    _serial->end();
+    vTaskDelete(_writer);
+    vRingbufferDelete(_ring);
+    _ring   = nullptr;
+    _writer = nullptr;
+}
+
+/**
+ * RX timeout callback, runs in the UART event task. The bytes available now
+ * ended SNIFFER_RX_TIMEOUT character times ago, bytes arriving while they are
+ * read are left for the next timeout.
+ */
+void BusSniffer::onReceive() {
+    uint8_t  chunk[MODBUS_RTU_MAX_FRAME];
+    uint32_t char_time = M5Modbus::charTime(_baudrate);
+    int64_t  end       = timespec_now_to_usec() - SNIFFER_RX_TIMEOUT * char_time;
+    size_t   pending   = _serial->available();
+
+    while (pending > 0) {
+        size_t len = _serial->read(chunk, pending < sizeof(chunk) ? pending : sizeof(chunk));
+        if (len == 0) {
+            break;
+        }
+        pending -= len;
+        _decoder.receive(chunk, len, end - (int64_t)pending * char_time);
+    }
+}
+
+/**
+ * A frame of the decoder goes to the writer task
+ *
+ * @param record
+ * @param frame
+ */
+void BusSniffer::onFrame(const SnifferRecord& record, const uint8_t* frame) {
+    uint8_t item[sizeof(SnifferRecord) + MODBUS_RTU_MAX_FRAME];
+
+    memcpy(item, &record, sizeof(record));
+    memcpy(item + sizeof(record), frame, record.length);
+    if (xRingbufferSend(_ring, item, sizeof(SnifferRecord) + record.length, 0) != pdTRUE) {
+        _dropped++;
+    }
+}
+
+void BusSniffer::writerTask(void* arg) {
+    BusSniffer* sniffer = (BusSniffer*)arg;
+    for (;;) {
+        size_t   size;
+        uint8_t* item = (uint8_t*)xRingbufferReceive(sniffer->_ring, &size, portMAX_DELAY);
+        if (item != nullptr) {
+            sniffer->_sink->write(item, size);
+            vRingbufferReturnItem(sniffer->_ring, item);
+        }
+    }
+}
+
+uint32_t BusSniffer::getFrames() {
+    return _decoder.getFrames();
+}
+
+uint32_t BusSniffer::getCrcErrors() {
+    return _decoder.getCrcErrors();
+}
+
+/**
+ * @return frames lost because the sink could not keep up
+ */
+uint32_t BusSniffer::getDropped() {
+    return _dropped;
+}
+
+/**
+ * @param addr   slave address 1..SNIFFER_MAX_ADDRESS
+ * @param stats  [out] response time statistics
+ * @return false if no response of the slave has been seen yet
+ */
+bool BusSniffer::getSlaveStats(uint8_t addr, SnifferSlaveStats* stats) {
+    return _decoder.getSlaveStats(addr, stats);
+}
@@ -0,0 +1,243 @@
+//
+// Sensor point transport over CAN with batched frames.
+//
+
+#include <string.h>
+#include "CanTransport.hpp"
+#include "Timespec.h"
+
+// CAN FD payload lengths above 8 bytes
+static const uint8_t fd_lengths[] = {12, 16, 20, 24, 32, 48, 64};
+
+static uint8_t fd_length(uint8_t len) {
+    if (len <= CAN_MAX_PAYLOAD) {
+        return len;
+    }
+    for (uint8_t valid : fd_lengths) {
+        if (len <= valid) {
+            return valid;
+        }
+    }
+    return CANFD_MAX_PAYLOAD;
+}
+
+static void put_value(CanFrame* frame, uint8_t width, uint16_t slot, int32_t value) {
+    uint8_t* data = &frame->data[width * slot];
+    for (uint8_t i = 0; i < width; i++) {
+        data[i] = (uint32_t)value >> (8 * i);
+    }
+}
+
+/**
+ * @param backend  TWAI, SocketCAN, ...
+ * @param node     id of this node, sent in every frame
+ * @param wide     int32 values, for points that do not fit an int16 (e.g. mV
+ *                 above 32.7 V), at half the values per frame
+ */
+CanTransport::CanTransport(CanBackend* backend, uint8_t node, bool wide) {
+    _backend = backend;
+    _node    = node;
+    _width   = wide ? 4 : 2;
+    _slots   = backend->maxPayload() / _width;
+    _batched = 0;
+    _open    = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Receive only point frames, from one node or from all of them. The filter is
+ * set in the CAN controller, other traffic never reaches the CPU.
+ *
+ * @param node  node id or CAN_NODE_ANY
+ */
+bool CanTransport::listen(uint16_t node) {
+    if (node == CAN_NODE_ANY) {
+        return _backend->setFilter(CAN_ID(CAN_TYPE_POINTS, 0, 0), CAN_ID(CAN_TYPE_MASK, 0, 0));
+    }
+    return _backend->setFilter(CAN_ID(CAN_TYPE_POINTS, node, 0), CAN_ID(CAN_TYPE_MASK, 0xFF, 0));
+}
+
+/**
+ * Add a value to the batch. Points should be queued in ascending order to
+ * pack well. Without wide values, values outside the int16 range are clamped
+ * and counted in tx_clamped.
+ *
+ * @param point  point index
+ * @param value
+ * @param valid  false sends CAN_VALUE_INVALID
+ */
+void CanTransport::queue(uint16_t point, int32_t value, bool valid) {
+    int32_t max     = _width == 2 ? INT16_MAX : INT32_MAX;
+    int32_t min     = _width == 2 ? CAN_VALUE_SKIP + 1 : CAN_VALUE32_SKIP + 1;
+    int32_t encoded = _width == 2 ? CAN_VALUE_INVALID : CAN_VALUE32_INVALID;
+    if (valid) {
+        encoded = value > max ? max : value < min ? min : value;
+        if (encoded != value) {
+            _stats.tx_clamped++;
+        }
+    }
+    int32_t skip = _width == 2 ? CAN_VALUE_SKIP : CAN_VALUE32_SKIP;
+
+    // append to the open frame if the point follows within its free slots
+    if (_open > 0) {
+        CanFrame* frame = &_batch[_batched - 1];
+        uint16_t  first = CAN_ID_POINT(frame->id);
+        if (point >= first + _open && point < first + _slots) {
+            while (first + _open < point) {
+                put_value(frame, _width, _open++, skip);
+            }
+            put_value(frame, _width, _open++, encoded);
+            _stats.tx_points++;
+            if (_open == _slots) {
+                closeFrame();
+            }
+            return;
+        }
+        closeFrame();
+    }
+
+    if (_batched == CAN_BATCH_FRAMES) {
+        flush();
+    }
+    CanFrame* frame = &_batch[_batched++];
+    frame->id = CAN_ID(_width == 2 ? CAN_TYPE_POINTS : CAN_TYPE_POINTS32, _node, point);
+    put_value(frame, _width, 0, encoded);
+    _open = 1;
+    _stats.tx_points++;
+    if (_open == _slots) {
+        closeFrame();
+    }
+}
+
+void CanTransport::closeFrame() {
+    CanFrame* frame = &_batch[_batched - 1];
+    uint8_t   len   = fd_length(_width * _open);
+
+    while (_width * _open < len) {
+        put_value(frame, _width, _open++, _width == 2 ? CAN_VALUE_SKIP : CAN_VALUE32_SKIP);
+    }
+    frame->len = len;
+    _open      = 0;
+}
+
+/**
+ * Send all queued frames
+ *
+ * @return number of frames accepted by the backend
+ */
+uint16_t CanTransport::flush() {
+    uint16_t sent = 0;
+
+    if (_open > 0) {
+        closeFrame();
+    }
+    for (uint16_t i = 0; i < _batched; i++) {
+        if (_backend->send(_batch[i], CAN_TX_TIMEOUT)) {
+            _stats.tx_bytes += _batch[i].len;
+            sent++;
+        } else {
+            _stats.tx_errors++;
+        }
+    }
+    _stats.tx_frames += sent;
+    _batched = 0;
+    return sent;
+}
+
+/**
+ * Receive and decode all pending frames
+ *
+ * @param handler     called for every received point
+ * @param timeout_ms  wait for the first frame
+ * @return number of frames received
+ */
+uint16_t CanTransport::poll(const CanPointHandler& handler, uint32_t timeout_ms) {
+    CanFrame frame;
+    uint16_t frames = 0;
+
+    while (_backend->receive(&frame, frames == 0 ? timeout_ms : 0)) {
+        uint8_t type = CAN_ID_TYPE(frame.id);
+        if (type == CAN_TYPE_POINTS || type == CAN_TYPE_POINTS32) {
+            decode(frame, handler);
+        }
+        frames++;
+    }
+    _stats.rx_frames += frames;
+    return frames;
+}
+
+void CanTransport::decode(const CanFrame& frame, const CanPointHandler& handler) {
+    uint8_t  node  = CAN_ID_NODE(frame.id);
+    uint16_t first = CAN_ID_POINT(frame.id);
+
+    if (CAN_ID_TYPE(frame.id) == CAN_TYPE_POINTS32) {
+        for (uint8_t slot = 0; slot < frame.len / 4; slot++) {
+            const uint8_t* data  = &frame.data[4 * slot];
+            int32_t        value = (int32_t)(data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24));
+            if (value != CAN_VALUE32_SKIP) {
+                handler(node, first + slot, value, value != CAN_VALUE32_INVALID);
+                _stats.rx_points++;
+            }
+        }
+        return;
+    }
+
+    for (uint8_t slot = 0; slot < frame.len / 2; slot++) {
+        int16_t value = (int16_t)(frame.data[2 * slot] | (frame.data[2 * slot + 1] << 8));
+        if (value != CAN_VALUE_SKIP) {
+            handler(node, first + slot, value, value != CAN_VALUE_INVALID);
+            _stats.rx_points++;
+        }
+    }
+}
+
+void CanTransport::getStats(CanStats* stats) {
+    *stats = _stats;
+}
+
+void CanTransport::resetStats() {
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Throughput of queue() + flush() for a block of consecutive points. With a
+ * receiver (e.g. a second SocketCAN socket on the same vcan interface) every
+ * round is also decoded on the other side.
+ *
+ * @param tx      sending backend
+ * @param rx      receiving backend or nullptr
+ * @param points  points per round
+ * @param rounds
+ * @param result  [out]
+ */
+void CanTransport::benchmark(CanBackend* tx, CanBackend* rx, uint16_t points, uint32_t rounds, CanBenchmark* result) {
+    CanTransport sender(tx, 1);
+    CanTransport* receiver = rx != nullptr ? new CanTransport(rx, 2) : nullptr;
+    uint32_t     received = 0;
+
+    if (receiver != nullptr) {
+        receiver->listen(1);
+    }
+
+    int64_t start = timespec_now_to_nsec();
+    for (uint32_t r = 0; r < rounds; r++) {
+        for (uint16_t p = 0; p < points; p++) {
+            sender.queue(p, (int32_t)(r + p), true);
+        }
+        sender.flush();
+        if (receiver != nullptr) {
+            uint32_t expected = received + points;
+            while (received < expected && receiver->poll([&received](uint8_t, uint16_t, int32_t, bool) {
+                received++;
+            }, 100) > 0) {
+            }
+        }
+    }
+
+    result->points     = points;
+    result->rounds     = rounds;
+    result->frames     = sender._stats.tx_frames;
+    result->received   = received;
+    result->total_nsec = timespec_now_to_nsec() - start;
+    delete receiver;
+}
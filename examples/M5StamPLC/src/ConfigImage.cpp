@@ -0,0 +1,490 @@
+//
+// Site configuration: text file compiled into a binary image loaded in place.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "ConfigImage.hpp"
+#include "ModbusFrame.h"
+#include "Timespec.h"
+
+namespace {
+
+/**
+ * Image under construction
+ */
+struct Builder {
+    ConfigHeader              header;
+    std::vector<ConfigSensor> sensors;
+    std::vector<ConfigPoint>  points;
+    std::vector<char>         strings;
+
+    Builder() : strings(1, '\0') {
+        memset(&header, 0, sizeof(header));
+        header.bus.baudrate      = CONFIG_DEFAULT_BAUDRATE;
+        header.bus.data_bits     = 8;
+        header.bus.parity        = 'N';
+        header.bus.stop_bits     = 1;
+        header.bus.timeout       = CONFIG_DEFAULT_TIMEOUT;
+        header.bus.poll_interval = CONFIG_DEFAULT_POLL;
+    }
+
+    uint32_t addString(const std::string& str) {
+        if (str.empty()) {
+            return 0;
+        }
+        uint32_t offset = strings.size();
+        strings.insert(strings.end(), str.begin(), str.end());
+        strings.push_back('\0');
+        return offset;
+    }
+};
+
+/**
+ * Line tokenizer: a section word followed by key=value pairs
+ */
+struct Line {
+    const char* p;
+    const char* end;
+
+    void skipSpace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+            p++;
+        }
+    }
+
+    bool atEnd() {
+        skipSpace();
+        return p == end || *p == '#';
+    }
+
+    std::string word() {
+        const char* start = p;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '=') {
+            p++;
+        }
+        return std::string(start, p - start);
+    }
+
+    bool pair(std::string* key, std::string* value) {
+        *key = word();
+        if (key->empty() || p == end || *p != '=') {
+            return false;
+        }
+        p++;
+        if (p < end && *p == '"') {
+            const char* start = ++p;
+            while (p < end && *p != '"') {
+                p++;
+            }
+            if (p == end) {
+                return false;
+            }
+            *value = std::string(start, p++ - start);
+            return true;
+        }
+        *value = word();
+        return !value->empty();
+    }
+};
+
+bool parse_number(const std::string& str, uint32_t max, uint32_t* out) {
+    char*         end;
+    unsigned long value = strtoul(str.c_str(), &end, 0);
+    if (str.empty() || *end != '\0' || value > max) {
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+bool parse_hex(const std::string& str, uint8_t* out, size_t len) {
+    if (str.size() != 2 * len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char* end;
+        char  byte[3] = {str[2 * i], str[2 * i + 1], '\0'};
+        out[i]        = strtoul(byte, &end, 16);
+        if (*end != '\0') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The ranges compile() accepts, load() rejects an image outside them
+ */
+bool valid_bus(const ConfigBus* bus) {
+    return bus->baudrate > 0 && bus->baudrate <= CONFIG_MAX_BAUDRATE && bus->data_bits >= 5 && bus->data_bits <= 8
+        && (bus->parity == 'N' || bus->parity == 'E' || bus->parity == 'O') && bus->stop_bits >= 1
+        && bus->stop_bits <= 2 && bus->timeout > 0 && bus->timeout <= CONFIG_MAX_TIMEOUT && bus->poll_interval > 0
+        && bus->poll_interval <= CONFIG_MAX_POLL;
+}
+
+bool valid_sensor(const ConfigSensor* sensor) {
+    return sensor->address > 0 && sensor->address <= CONFIG_MAX_ADDRESS;
+}
+
+bool valid_point(const ConfigPoint* point) {
+    return point->address <= CONFIG_MAX_ADDRESS && point->function > 0 && point->function <= CONFIG_MAX_FUNCTION
+        && point->scale > 0 && point->scale <= CONFIG_MAX_SCALE;
+}
+
+// "8N1", "8E1", "7O2", ...
+bool parse_format(const std::string& str, ConfigBus* bus) {
+    if (str.size() != 3 || str[0] < '5' || str[0] > '8' || (str[1] != 'N' && str[1] != 'E' && str[1] != 'O')
+        || (str[2] != '1' && str[2] != '2')) {
+        return false;
+    }
+    bus->data_bits = str[0] - '0';
+    bus->parity    = str[1];
+    bus->stop_bits = str[2] - '0';
+    return true;
+}
+
+/**
+ * @return error message, nullptr if the line is valid
+ */
+const char* parse_line(Line* line, Builder* b) {
+    std::string section = line->word();
+    std::string key;
+    std::string value;
+    uint32_t    n;
+
+    if (section == "bus") {
+        ConfigBus* bus = &b->header.bus;
+        while (!line->atEnd()) {
+            if (!line->pair(&key, &value)) {
+                return "expected key=value";
+            }
+            if (key == "baudrate" && parse_number(value, CONFIG_MAX_BAUDRATE, &n) && n > 0) {
+                bus->baudrate = n;
+            } else if (key == "format" && parse_format(value, bus)) {
+            } else if (key == "timeout" && parse_number(value, CONFIG_MAX_TIMEOUT, &n) && n > 0) {
+                bus->timeout = n;
+            } else if (key == "poll" && parse_number(value, CONFIG_MAX_POLL, &n) && n > 0) {
+                bus->poll_interval = n;
+            } else {
+                return "invalid bus setting";
+            }
+        }
+        return nullptr;
+    }
+
+    if (section == "sensor") {
+        if (b->sensors.size() == CONFIG_MAX_SENSORS) {
+            return "too many sensors";
+        }
+        ConfigSensor sensor = {0, 0, 0, 0, 0};
+        bool         addr   = false;
+        while (!line->atEnd()) {
+            if (!line->pair(&key, &value)) {
+                return "expected key=value";
+            }
+            if (key == "id" && parse_number(value, 255, &n)) {
+                sensor.id = n;
+            } else if (key == "address" && parse_number(value, CONFIG_MAX_ADDRESS, &n) && n > 0) {
+                sensor.address = n;
+                addr           = true;
+            } else if (key == "name") {
+                sensor.name = b->addString(value);
+            } else if (key == "description") {
+                sensor.description = b->addString(value);
+            } else {
+                return "invalid sensor setting";
+            }
+        }
+        if (!addr) {
+            return "sensor without address";
+        }
+        for (const ConfigSensor& other : b->sensors) {
+            if (other.id == sensor.id) {
+                return "duplicate sensor id";
+            }
+        }
+        b->sensors.push_back(sensor);
+        return nullptr;
+    }
+
+    if (section == "point") {
+        if (b->points.size() == CONFIG_MAX_POINTS) {
+            return "too many points";
+        }
+        ConfigPoint point = {0, 0, 0, 1, 0, 3, 0};
+        while (!line->atEnd()) {
+            if (!line->pair(&key, &value)) {
+                return "expected key=value";
+            }
+            if (key == "name") {
+                point.name = b->addString(value);
+            } else if (key == "description") {
+                point.description = b->addString(value);
+            } else if (key == "address" && parse_number(value, CONFIG_MAX_ADDRESS, &n) && n > 0) {
+                point.address = n;
+            } else if (key == "function" && parse_number(value, CONFIG_MAX_FUNCTION, &n) && n > 0) {
+                point.function = n;
+            } else if (key == "register" && parse_number(value, 0xFFFF, &n)) {
+                point.reg = n;
+            } else if (key == "scale" && parse_number(value, CONFIG_MAX_SCALE, &n) && n > 0) {
+                point.scale = n;
+            } else {
+                return "invalid point setting";
+            }
+        }
+        if (point.name == 0) {
+            return "point without name";
+        }
+        b->points.push_back(point);
+        return nullptr;
+    }
+
+    if (section == "lora") {
+        ConfigLora* lora = &b->header.lora;
+        while (!line->atEnd()) {
+            if (!line->pair(&key, &value)) {
+                return "expected key=value";
+            }
+            if (!((key == "dev_eui" && parse_hex(value, lora->dev_eui, 8))
+                  || (key == "join_eui" && parse_hex(value, lora->join_eui, 8))
+                  || (key == "app_key" && parse_hex(value, lora->app_key, 16))
+                  || (key == "nwk_key" && parse_hex(value, lora->nwk_key, 16)))) {
+                return "invalid lora setting";
+            }
+        }
+        lora->enabled = 1;
+        return nullptr;
+    }
+
+    return "unknown section";
+}
+
+} // namespace
+
+ConfigImage::ConfigImage() {
+    _data   = nullptr;
+    _size   = 0;
+    _header = nullptr;
+}
+
+ConfigImage::~ConfigImage() {
+    unload();
+}
+
+/**
+ * Compile a text configuration into an image
+ *
+ * @param text   configuration text, not NUL terminated
+ * @param len
+ * @param size   [out] image size
+ * @param error  [out] line and message if the text is invalid
+ * @return image to be released with delete[], nullptr on error
+ */
+uint8_t* ConfigImage::compile(const char* text, size_t len, size_t* size, ConfigError* error) {
+    Builder     b;
+    const char* p    = text;
+    const char* end  = text + len;
+    uint16_t    line = 0;
+
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        Line        l   = {p, eol != nullptr ? eol : end};
+        line++;
+
+        if (!l.atEnd()) {
+            const char* message = parse_line(&l, &b);
+            if (message != nullptr) {
+                *error = {line, message};
+                return nullptr;
+            }
+        }
+        p = l.end + 1;
+    }
+
+    ConfigHeader* h = &b.header;
+    memcpy(h->magic, CONFIG_MAGIC, sizeof(h->magic));
+    h->version      = CONFIG_VERSION;
+    h->source_crc   = modbus_crc16((const uint8_t*)text, len);
+    h->sensor_count = b.sensors.size();
+    h->point_count  = b.points.size();
+    h->sensors      = sizeof(ConfigHeader);
+    h->points       = h->sensors + b.sensors.size() * sizeof(ConfigSensor);
+    h->strings      = h->points + b.points.size() * sizeof(ConfigPoint);
+    h->size         = h->strings + b.strings.size();
+
+    uint8_t* image = new uint8_t[h->size];
+    memcpy(image, h, sizeof(ConfigHeader));
+    memcpy(image + h->sensors, b.sensors.data(), b.sensors.size() * sizeof(ConfigSensor));
+    memcpy(image + h->points, b.points.data(), b.points.size() * sizeof(ConfigPoint));
+    memcpy(image + h->strings, b.strings.data(), b.strings.size());
+
+    uint16_t crc = modbus_crc16(image, h->size);
+    memcpy(image + offsetof(ConfigHeader, crc), &crc, sizeof(crc));
+
+    *size  = h->size;
+    *error = {0, nullptr};
+    return image;
+}
+
+/**
+ * Validate an image and use it in place
+ *
+ * @param data   image, released with delete[] by the ConfigImage
+ * @param len
+ * @param error  [out] reason if the image is rejected, the buffer is released then
+ * @return false if the image is damaged, of another version or holds values
+ *         compile() would not accept
+ */
+bool ConfigImage::load(uint8_t* data, size_t len, ConfigError* error) {
+    unload();
+    *error = {0, nullptr};
+
+    const ConfigHeader* h = (const ConfigHeader*)data;
+    if (len < sizeof(ConfigHeader) || memcmp(h->magic, CONFIG_MAGIC, sizeof(h->magic)) != 0) {
+        error->message = "not a configuration image";
+    } else if (h->version != CONFIG_VERSION) {
+        error->message = "unsupported version";
+    } else if (h->size != len) {
+        error->message = "wrong size";
+    } else {
+        uint16_t crc = h->crc;
+        memset(data + offsetof(ConfigHeader, crc), 0, sizeof(crc));
+        bool crc_ok = modbus_crc16(data, len) == crc;
+        memcpy(data + offsetof(ConfigHeader, crc), &crc, sizeof(crc));
+
+        if (!crc_ok) {
+            error->message = "CRC error";
+        } else if (h->sensor_count > CONFIG_MAX_SENSORS || h->point_count > CONFIG_MAX_POINTS
+                   || h->sensors != sizeof(ConfigHeader)
+                   || h->points != h->sensors + h->sensor_count * sizeof(ConfigSensor)
+                   || h->strings != h->points + h->point_count * sizeof(ConfigPoint)
+                   || h->strings >= len || data[len - 1] != '\0') {
+            error->message = "invalid layout";
+        }
+    }
+    if (error->message != nullptr) {
+        delete[] data;
+        return false;
+    }
+
+    _data   = data;
+    _size   = len;
+    _header = h;
+
+    // string offsets and values are checked once here, so string() can trust
+    // the offsets and an image written by another tool or damaged before its
+    // CRC was computed cannot bring settings that compile() would reject
+    uint32_t pool = len - h->strings;
+    if (!valid_bus(&h->bus)) {
+        error->message = "invalid bus setting";
+    }
+    for (uint16_t i = 0; i < h->sensor_count && error->message == nullptr; i++) {
+        if (sensor(i)->name >= pool || sensor(i)->description >= pool) {
+            error->message = "invalid string";
+        } else if (!valid_sensor(sensor(i))) {
+            error->message = "invalid sensor setting";
+        }
+        for (uint16_t j = 0; j < i; j++) {
+            if (sensor(j)->id == sensor(i)->id) {
+                error->message = "duplicate sensor id";
+            }
+        }
+    }
+    for (uint16_t i = 0; i < h->point_count && error->message == nullptr; i++) {
+        if (point(i)->name >= pool || point(i)->description >= pool) {
+            error->message = "invalid string";
+        } else if (!valid_point(point(i))) {
+            error->message = "invalid point setting";
+        }
+    }
+    if (error->message != nullptr) {
+        unload();
+        return false;
+    }
+    return true;
+}
+
+void ConfigImage::unload() {
+    delete[] _data;
+    _data   = nullptr;
+    _size   = 0;
+    _header = nullptr;
+}
+
+bool ConfigImage::loaded() {
+    return _header != nullptr;
+}
+
+/**
+ * @return CRC of the text the image was compiled from, to detect a changed text
+ */
+uint16_t ConfigImage::sourceCrc() {
+    return _header->source_crc;
+}
+
+const ConfigBus* ConfigImage::bus() {
+    return &_header->bus;
+}
+
+/**
+ * @return LoRaWAN keys, enabled is 0 if the text had no lora line
+ */
+const ConfigLora* ConfigImage::lora() {
+    return &_header->lora;
+}
+
+uint16_t ConfigImage::sensors() {
+    return _header->sensor_count;
+}
+
+const ConfigSensor* ConfigImage::sensor(uint16_t i) {
+    return (const ConfigSensor*)(_data + _header->sensors) + i;
+}
+
+uint16_t ConfigImage::points() {
+    return _header->point_count;
+}
+
+const ConfigPoint* ConfigImage::point(uint16_t i) {
+    return (const ConfigPoint*)(_data + _header->points) + i;
+}
+
+const char* ConfigImage::string(uint32_t offset) {
+    return (const char*)_data + _header->strings + offset;
+}
+
+/**
+ * Compile and load a configuration with the given number of points
+ *
+ * @param points
+ * @param result  [out]
+ */
+void ConfigImage::benchmark(uint16_t points, ConfigBenchmark* result) {
+    std::string text = "bus baudrate=19200 format=8E1 timeout=500 poll=2000\n"
+                       "sensor id=0 address=2 name=S-0 description=\"Hall\"\n";
+    char        line[128];
+    for (uint16_t i = 0; i < points; i++) {
+        snprintf(line, sizeof(line), "point name=P-%u address=%u function=4 register=0x%04X scale=10 description=\"Point %u\"\n",
+                 i, 1 + i % 247, i, i);
+        text += line;
+    }
+
+    ConfigError error;
+    size_t      size;
+    int64_t     start = timespec_now_to_nsec();
+    uint8_t*    image = compile(text.data(), text.size(), &size, &error);
+    result->compile_nsec = timespec_now_to_nsec() - start;
+
+    ConfigImage config;
+    start = timespec_now_to_nsec();
+    config.load(image, size, &error);
+    result->load_nsec = timespec_now_to_nsec() - start;
+
+    result->points      = config.loaded() ? config.points() : 0;
+    result->text_bytes  = text.size();
+    result->image_bytes = size;
+}
@@ -0,0 +1,150 @@
+//
+// Fixed-point PID loops with time-proportional relay outputs.
+//
+// The executor is called from the scan. Every loop runs its PID step on its
+// own fixed period: the next step is scheduled from the previous deadline,
+// not from the time the step actually ran, so the period does not drift with
+// the scan. The output (per mille) is turned into a relay on time within a
+// fixed window, honouring the minimum on and off times of the load.
+//
+
+#include <string.h>
+#include "ControlLoop.hpp"
+#include "Timespec.h"
+
+ControlExecutor::ControlExecutor() {
+    _count = 0;
+    memset(_config, 0, sizeof(_config));
+    memset(_state, 0, sizeof(_state));
+    memset(_next, 0, sizeof(_next));
+    memset(_window_start, 0, sizeof(_window_start));
+}
+
+/**
+ * @param config
+ * @return loop number, -1 if the table is full or the config is invalid
+ */
+int8_t ControlExecutor::add(const ControlConfig& config) {
+    if (_count >= CONTROL_LOOPS || config.period == 0 || config.window == 0
+        || config.reg >= SHADOW_INPUT_REGISTERS || config.relay >= RELAY_COUNT) {
+        return -1;
+    }
+    _config[_count] = config;
+    memset(&_state[_count], 0, sizeof(ControlState));
+    _next[_count]         = 0;
+    _window_start[_count] = 0;
+    return _count++;
+}
+
+void ControlExecutor::setSetpoint(uint8_t loop, int16_t setpoint) {
+    if (loop < _count) {
+        _config[loop].setpoint = setpoint;
+    }
+}
+
+uint8_t ControlExecutor::size() {
+    return _count;
+}
+
+/**
+ * One PID step. The integral is clamped to the output range (anti-windup)
+ * and the derivative acts on the process value, so setpoint changes do not
+ * kick the output.
+ */
+void ControlExecutor::step(uint8_t loop, const ProcessImage& image) {
+    const ControlConfig* c = &_config[loop];
+    ControlState*        s = &_state[loop];
+
+    s->pv_prev = s->executions ? s->pv : (int16_t)image.registers[c->reg];
+    s->pv      = (int16_t)image.registers[c->reg];
+
+    int32_t error = c->setpoint - s->pv;
+
+    s->integral += (int64_t)c->ki * error * c->period / MSEC_PER_SEC;
+    if (s->integral < 0) {
+        s->integral = 0;
+    } else if (s->integral > (int64_t)CONTROL_OUTPUT_MAX << CONTROL_Q) {
+        s->integral = (int64_t)CONTROL_OUTPUT_MAX << CONTROL_Q;
+    }
+
+    int64_t derivative = (int64_t)(s->pv - s->pv_prev) * MSEC_PER_SEC / c->period;
+    int64_t output     = ((int64_t)c->kp * error + s->integral - (int64_t)c->kd * derivative) >> CONTROL_Q;
+
+    if (output < 0) {
+        output = 0;
+    } else if (output > CONTROL_OUTPUT_MAX) {
+        output = CONTROL_OUTPUT_MAX;
+    }
+    s->output = output;
+}
+
+/**
+ * Time-proportional output: the relay is on for output per mille of every
+ * window. On times shorter than min_on are dropped, off times shorter than
+ * min_off are merged into a full on window.
+ */
+bool ControlExecutor::relayState(uint8_t loop, int64_t now) {
+    const ControlConfig* c = &_config[loop];
+    ControlState*        s = &_state[loop];
+
+    if (now - _window_start[loop] >= c->window) {
+        _window_start[loop] += c->window;
+        if (now - _window_start[loop] >= c->window) {
+            _window_start[loop] = now;
+        }
+
+        uint32_t on_time = (uint64_t)c->window * s->output / CONTROL_OUTPUT_MAX;
+        if (on_time < c->min_on) {
+            on_time = 0;
+        } else if (c->window - on_time < c->min_off) {
+            on_time = c->window;
+        }
+        s->on_time = on_time;
+    }
+    return now - _window_start[loop] < s->on_time;
+}
+
+/**
+ * Run the due PID steps and update the relay outputs, called once per scan
+ *
+ * @param image  process image, relay bits of the loops are overwritten
+ * @param now    monotonic time in milliseconds
+ */
+void ControlExecutor::run(ProcessImage& image, int64_t now) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_next[i] == 0) {
+            _next[i]         = now;
+            _window_start[i] = now;
+        }
+
+        if (now >= _next[i]) {
+            int64_t start = timespec_now_to_nsec();
+            step(i, image);
+            uint32_t nsec = timespec_now_to_nsec() - start;
+
+            ControlState* s = &_state[i];
+            s->executions++;
+            s->last_nsec = nsec;
+            if (nsec > s->max_nsec) {
+                s->max_nsec = nsec;
+            }
+
+            // keep the period exact, skip steps that were missed entirely
+            _next[i] += _config[i].period;
+            if (_next[i] <= now) {
+                _next[i] = now + _config[i].period;
+            }
+        }
+
+        uint8_t mask  = 1 << _config[i].relay;
+        image.outputs = relayState(i, now) ? image.outputs | mask : image.outputs & ~mask;
+    }
+}
+
+bool ControlExecutor::getState(uint8_t loop, ControlState* state) {
+    if (loop >= _count) {
+        return false;
+    }
+    *state = _state[loop];
+    return true;
+}
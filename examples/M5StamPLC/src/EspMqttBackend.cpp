@@ -0,0 +1,97 @@
+//
+// MQTT backend for the esp-mqtt client of ESP-IDF.
+//
+
+#ifdef ESP_PLATFORM
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "EspMqttBackend.hpp"
+
+EspMqttBackend::EspMqttBackend() {
+    _client = nullptr;
+}
+
+EspMqttBackend::~EspMqttBackend() {
+    end();
+}
+
+/**
+ * @param uri        e.g. "mqtt://192.168.1.10:1883"
+ * @param client_id
+ * @return false if the client cannot be started, a missing broker is not an error
+ */
+bool EspMqttBackend::begin(const char* uri, const char* client_id) {
+    esp_mqtt_client_config_t config = {};
+
+    end();
+    config.broker.address.uri    = uri;
+    config.credentials.client_id = client_id;
+    config.buffer.size           = MQTT_BUFFER_SIZE;
+
+    _client = esp_mqtt_client_init(&config);
+    if (_client == nullptr) {
+        return false;
+    }
+    esp_mqtt_client_register_event(_client, MQTT_EVENT_ANY, event, this);
+    if (esp_mqtt_client_start(_client) != ESP_OK) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void EspMqttBackend::end() {
+    if (_client != nullptr) {
+        esp_mqtt_client_stop(_client);
+        esp_mqtt_client_destroy(_client);
+        _client    = nullptr;
+        _connected = false;
+    }
+}
+
+void EspMqttBackend::event(void* arg, esp_event_base_t base, int32_t id, void* data) {
+    EspMqttBackend*         self = (EspMqttBackend*)arg;
+    esp_mqtt_event_handle_t e    = (esp_mqtt_event_handle_t)data;
+
+    switch ((esp_mqtt_event_id_t)id) {
+    case MQTT_EVENT_CONNECTED:
+    case MQTT_EVENT_DISCONNECTED:
+        self->_connected = id == MQTT_EVENT_CONNECTED;
+        if (self->_connect_handler) {
+            self->_connect_handler(self->_connected);
+        }
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        if (self->_ack_handler) {
+            self->_ack_handler(e->msg_id);
+        }
+        break;
+    case MQTT_EVENT_DELETED:
+        if (self->_lost_handler) {
+            self->_lost_handler(e->msg_id);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+int EspMqttBackend::publish(const char* topic, const uint8_t* data, size_t len) {
+    if (!_connected) {
+        return -1;
+    }
+    // store = true: queued in the outbox and sent by the client task
+    return esp_mqtt_client_enqueue(_client, topic, (const char*)data, len, 1, 0, true);
+}
+
+bool EspMqttBackend::connected() {
+    return _connected;
+}
+
+void EspMqttBackend::poll(uint32_t timeout_ms) {
+    vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+}
+
+#endif // ESP_PLATFORM
@@ -0,0 +1,215 @@
+//
+// Event-driven main loop: handlers run on task notifications and timers.
+//
+// Automatic light sleep needs CONFIG_PM_ENABLE and
+// CONFIG_FREERTOS_USE_TICKLESS_IDLE; the per task CPU utilization needs
+// configGENERATE_RUN_TIME_STATS. Without them the loop still blocks when idle
+// and reports the busy time of its own handlers.
+//
+
+#include <EventLoop.hpp>
+#include "Timespec.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+EventLoop::EventLoop() {
+    _task        = nullptr;
+    _count       = 0;
+    _stats_start = 0;
+    memset(_timers, 0, sizeof(_timers));
+    memset(_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Bind the loop to the calling task, call from setup(). Arduino runs setup()
+ * and loop() in the same task.
+ */
+void EventLoop::begin() {
+    _task        = xTaskGetCurrentTaskHandle();
+    _stats_start = timespec_now_to_usec();
+}
+
+/**
+ * @param name     shown in the statistics
+ * @param handler  runs in the loop task
+ * @return event number for post(), -1 if all events are used
+ */
+int8_t EventLoop::add(const char* name, EventHandler handler) {
+    if (_count == EVENT_MAX_HANDLERS) {
+        return -1;
+    }
+    _handlers[_count]   = handler;
+    _stats[_count].name = name;
+    return _count++;
+}
+
+/**
+ * Periodic event, driven by a FreeRTOS software timer
+ *
+ * @param name
+ * @param period_ms
+ * @param handler
+ * @return event number, -1 if all events are used
+ */
+int8_t EventLoop::every(const char* name, uint32_t period_ms, EventHandler handler) {
+    int8_t event = add(name, handler);
+    if (event < 0) {
+        return -1;
+    }
+    _timer_args[event] = {this, (uint8_t)event};
+    _timers[event]     = xTimerCreate(name, pdMS_TO_TICKS(period_ms), pdTRUE, &_timer_args[event], timerCallback);
+    xTimerStart(_timers[event], portMAX_DELAY);
+    return event;
+}
+
+void EventLoop::timerCallback(TimerHandle_t timer) {
+    Timer* arg = (Timer*)pvTimerGetTimerID(timer);
+    arg->loop->post(arg->event);
+}
+
+/**
+ * Schedule an event from another task. Posting a pending event again runs
+ * its handler only once.
+ */
+void EventLoop::post(uint8_t event) {
+    xTaskNotify(_task, 1UL << event, eSetBits);
+}
+
+void IRAM_ATTR EventLoop::postFromISR(uint8_t event) {
+    BaseType_t woken = pdFALSE;
+    xTaskNotifyFromISR(_task, 1UL << event, eSetBits, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * Wait for events and run their handlers, call from loop()
+ *
+ * @param timeout  ticks to wait for the first event
+ */
+void EventLoop::dispatch(TickType_t timeout) {
+    uint32_t pending = 0;
+    if (xTaskNotifyWait(0, UINT32_MAX, &pending, timeout) != pdTRUE) {
+        return;
+    }
+
+    for (uint8_t event = 0; event < _count; event++) {
+        if (!(pending & (1UL << event))) {
+            continue;
+        }
+        int64_t start = timespec_now_to_usec();
+        _handlers[event]();
+        uint32_t usec = timespec_now_to_usec() - start;
+
+        EventStats* stats = &_stats[event];
+        stats->runs++;
+        stats->busy_usec += usec;
+        if (usec > stats->max_usec) {
+            stats->max_usec = usec;
+        }
+    }
+}
+
+/**
+ * @param stats  [out] statistics of every event since the last reset
+ * @param max
+ * @return number of events
+ */
+uint8_t EventLoop::getStats(EventStats* stats, uint8_t max) {
+    uint8_t count = _count < max ? _count : max;
+    memcpy(stats, _stats, count * sizeof(EventStats));
+    return count;
+}
+
+/**
+ * Busy time of each event handler as a share of the wall time since the last
+ * reset
+ */
+void EventLoop::printStats(Print* out) {
+    int64_t elapsed = timespec_now_to_usec() - _stats_start;
+    if (elapsed <= 0) {
+        return;
+    }
+    for (uint8_t event = 0; event < _count; event++) {
+        const EventStats* stats = &_stats[event];
+        out->printf("  %-10s %6u runs %6.2f %% max %u us\n", stats->name, stats->runs,
+                    100.0 * stats->busy_usec / elapsed, stats->max_usec);
+    }
+}
+
+/**
+ * CPU utilization of every FreeRTOS task since the previous call. The
+ * idle tasks show the headroom of each core.
+ */
+void EventLoop::printTaskStats(Print* out) {
+#if configGENERATE_RUN_TIME_STATS
+    static TaskStatus_t tasks[EVENT_MAX_TASKS];
+    static uint32_t     last_counters[EVENT_MAX_TASKS];
+    static UBaseType_t  last_numbers[EVENT_MAX_TASKS];
+    static uint32_t     last_total;
+    static UBaseType_t  last_count;
+    uint32_t            total;
+
+    UBaseType_t count = uxTaskGetSystemState(tasks, EVENT_MAX_TASKS, &total);
+    uint32_t    span  = total - last_total;
+    if (span == 0) {
+        return;
+    }
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        uint32_t previous = 0;
+        for (UBaseType_t j = 0; j < last_count; j++) {
+            if (last_numbers[j] == tasks[i].xTaskNumber) {
+                previous = last_counters[j];
+                break;
+            }
+        }
+        // the total counts the time of one core, the tasks of both cores add up to 200 %
+        out->printf("  %-16s %6.2f %%\n", tasks[i].pcTaskName, 100.0 * (tasks[i].ulRunTimeCounter - previous) / span);
+    }
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        last_counters[i] = tasks[i].ulRunTimeCounter;
+        last_numbers[i]  = tasks[i].xTaskNumber;
+    }
+    last_count = count;
+    last_total = total;
+#else
+    out->println("  task statistics need configGENERATE_RUN_TIME_STATS");
+#endif
+}
+
+void EventLoop::resetStats() {
+    for (uint8_t event = 0; event < _count; event++) {
+        const char* name = _stats[event].name;
+        memset(&_stats[event], 0, sizeof(EventStats));
+        _stats[event].name = name;
+    }
+    _stats_start = timespec_now_to_usec();
+}
+
+/**
+ * Let the power management scale the CPU clock and enter light sleep when all
+ * tasks are blocked. Drivers that must stay awake (the Modbus UART while a
+ * request is pending) hold a power management lock.
+ *
+ * @param max_mhz  CPU clock when busy
+ * @param min_mhz  CPU clock when idle
+ * @return false if the firmware is built without power management
+ */
+bool EventLoop::enableLightSleep(uint32_t max_mhz, uint32_t min_mhz) {
+#ifdef CONFIG_PM_ENABLE
+#if ESP_IDF_VERSION_MAJOR >= 5
+    esp_pm_config_t config;
+#else
+    esp_pm_config_esp32s3_t config;
+#endif
+    config.max_freq_mhz       = max_mhz;
+    config.min_freq_mhz       = min_mhz;
+    config.light_sleep_enable = true;
+    return esp_pm_configure(&config) == ESP_OK;
+#else
+    return false;
+#endif
+}
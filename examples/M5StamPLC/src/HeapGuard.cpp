@@ -0,0 +1,177 @@
+//
+// Heap guard of the static allocation mode, see HeapGuard.hpp.
+//
+
+#include <HeapGuard.hpp>
+
+#ifdef PLC_STATIC_ALLOC
+
+#include <esp_heap_caps.h>
+
+HeapGuard::Slot HeapGuard::_slots[HEAP_GUARD_TASKS];
+volatile bool   HeapGuard::_armed;
+uint32_t        HeapGuard::_violations;
+uint32_t        HeapGuard::_last_size;
+TaskHandle_t    HeapGuard::_last_task;
+uint32_t        HeapGuard::_armed_free;
+
+std::atomic<uint32_t> HeapGuard::_allowed;
+std::atomic<uint32_t> HeapGuard::_allowed_bytes;
+
+static portMUX_TYPE slots_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Per-task state. Only the task itself changes its counters, so a slot needs
+ * the lock only when it is claimed.
+ *
+ * @param task
+ * @param create  claim a free slot if the task has none
+ * @return nullptr if the task has no slot (and all of them are taken)
+ */
+HeapGuard::Slot* HeapGuard::slot(TaskHandle_t task, bool create) {
+    for (Slot& s : _slots) {
+        if (s.task == task) {
+            return &s;
+        }
+    }
+    if (!create) {
+        return nullptr;
+    }
+
+    Slot* found = nullptr;
+    portENTER_CRITICAL(&slots_lock);
+    for (Slot& s : _slots) {
+        if (s.task == task || s.task == nullptr) {
+            s.task = task;
+            found  = &s;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&slots_lock);
+    return found;
+}
+
+/**
+ * Every allocation of the task is checked once the guard is armed
+ *
+ * @param task
+ */
+void HeapGuard::watch(TaskHandle_t task) {
+    Slot* s = slot(task, true);
+    if (s != nullptr) {
+        s->watched = true;
+    }
+}
+
+/**
+ * Call at the end of setup()
+ */
+void HeapGuard::arm() {
+    _armed_free = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    _armed      = true;
+}
+
+bool HeapGuard::armed() {
+    return _armed;
+}
+
+void HeapGuard::getStats(HeapGuardStats* stats) {
+    stats->violations    = _violations;
+    stats->last_size     = _last_size;
+    stats->last_task     = _last_task != nullptr ? pcTaskGetName(_last_task) : "";
+    stats->free_bytes    = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    stats->armed_free    = _armed_free;
+    stats->lowest_free   = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    stats->allowed       = _allowed.load(std::memory_order_relaxed);
+    stats->allowed_bytes = _allowed_bytes.load(std::memory_order_relaxed);
+}
+
+/**
+ * Runs inside the allocator: no locks, no allocation, no output
+ *
+ * @param size
+ */
+void HeapGuard::allocated(size_t size) {
+    if (!_armed || xPortInIsrContext()) {
+        return;
+    }
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    Slot*        s    = slot(task, false);
+    if (s != nullptr && s->allow > 0) {
+        // what the libraries still take at run time
+        _allowed.fetch_add(1, std::memory_order_relaxed);
+        _allowed_bytes.fetch_add(size, std::memory_order_relaxed);
+        return;
+    }
+    if (s == nullptr || (!s->watched && s->deny == 0)) {
+        return;
+    }
+
+    _violations++;
+    _last_size = size;
+    _last_task = task;
+#if HEAP_GUARD_ABORT
+    abort();
+#endif
+}
+
+HeapAllow::HeapAllow() {
+    _slot = HeapGuard::slot(xTaskGetCurrentTaskHandle(), true);
+    if (_slot != nullptr) {
+        _slot->allow++;
+    }
+}
+
+HeapAllow::~HeapAllow() {
+    if (_slot != nullptr) {
+        _slot->allow--;
+    }
+}
+
+HeapDeny::HeapDeny() {
+    _slot = HeapGuard::slot(xTaskGetCurrentTaskHandle(), true);
+    if (_slot != nullptr) {
+        _slot->deny++;
+    }
+}
+
+HeapDeny::~HeapDeny() {
+    if (_slot != nullptr) {
+        _slot->deny--;
+    }
+}
+
+#if CONFIG_HEAP_USE_HOOKS
+
+extern "C" void esp_heap_trace_alloc_hook(void*, size_t size, uint32_t) {
+    HeapGuard::allocated(size);
+}
+
+#elif defined(HEAP_GUARD_WRAP)
+
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size) {
+    HeapGuard::allocated(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    HeapGuard::allocated(count * size);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    HeapGuard::allocated(size);
+    return __real_realloc(ptr, size);
+}
+}
+
+#else
+#error "PLC_STATIC_ALLOC needs CONFIG_HEAP_USE_HOOKS or -DHEAP_GUARD_WRAP"
+#endif
+
+#endif // PLC_STATIC_ALLOC
@@ -0,0 +1,255 @@
+//
+// Interrupt-driven capture of the StamPLC digital inputs.
+//
+// The input expander pulls its INT line low on every input change. The ISR
+// takes the time of the interrupt and passes it to the capture task with the
+// notification, the task reads the inputs over I2C, debounces every channel
+// in software and queues the accepted edges with that time, so the
+// scheduling latency of the task does not add to it. Without changes the task
+// stays blocked and the inputs are not read at all.
+//
+// INT stays low until the interrupt status of the expander is read, so the
+// line is level triggered: the ISR masks itself and the task unmasks it after
+// the status has been cleared. A low level also wakes the chip from light
+// sleep, which an edge interrupt would not.
+//
+
+#include <InputCapture.hpp>
+#include <M5StamPLC.h>
+#include <driver/gpio.h>
+#include <esp_timer.h>
+#include "Timespec.h"
+
+#ifdef CONFIG_PM_ENABLE
+#include <esp_sleep.h>
+#endif
+
+InputCapture::InputCapture() {
+    _task      = nullptr;
+    _raw       = 0;
+    _stable    = 0;
+    _pending   = 0;
+    _overflows = 0;
+    for (uint8_t i = 0; i < INPUT_CHANNELS; i++) {
+        _debounce[i]     = INPUT_DEBOUNCE;
+        _changed_usec[i] = 0;
+        _rising_usec[i]  = 0;
+    }
+    memset(_pulses, 0, sizeof(_pulses));
+}
+
+/**
+ * Enable the expander interrupt and start the capture task, call after
+ * M5StamPLC.begin()
+ *
+ * @param core  core of the capture task
+ * @return false if the expander or its INT line is not found, the inputs
+ *         must then be read by polling
+ */
+bool InputCapture::begin(int core) {
+    uint8_t id;
+
+    if (!M5.In_I2C.readRegister(INPUT_EXPANDER_ADDR, INPUT_EXPANDER_ID, &id, 1, 400000)
+        || (id & INPUT_EXPANDER_ID_MASK) != INPUT_EXPANDER_ID_VALUE) {
+        return false;
+    }
+    M5.In_I2C.readRegister8(INPUT_EXPANDER_ADDR, INPUT_EXPANDER_INT_STATUS, 400000);
+    pinMode(INPUT_INT_PIN, INPUT_PULLUP);
+    if (digitalRead(INPUT_INT_PIN) == LOW) {
+        return false;
+    }
+
+    _raw    = readRaw();
+    _stable = _raw;
+
+    // unmask the change interrupt of all inputs
+    M5.In_I2C.writeRegister8(INPUT_EXPANDER_ADDR, INPUT_EXPANDER_INT_MASK, 0x00, 400000);
+
+    xTaskCreatePinnedToCore(captureTask, "inputs", INPUT_TASK_STACK, this, INPUT_TASK_PRIORITY, &_task, core);
+
+    attachInterruptArg(INPUT_INT_PIN, isr, this, ONLOW);
+#ifdef CONFIG_PM_ENABLE
+    gpio_wakeup_enable(INPUT_INT_PIN, GPIO_INTR_LOW_LEVEL);
+    esp_sleep_enable_gpio_wakeup();
+#endif
+    return true;
+}
+
+uint8_t InputCapture::readRaw() {
+    uint8_t inputs = 0;
+    for (uint8_t i = 0; i < INPUT_CHANNELS; i++) {
+        inputs |= M5StamPLC.readPlcInput(i) << i;
+    }
+    return inputs;
+}
+
+/**
+ * The notification value is the low 32 bits of esp_timer_get_time() at the
+ * interrupt, the task extends it again (the wrap takes 71 minutes)
+ */
+void IRAM_ATTR InputCapture::isr(void* arg) {
+    InputCapture* capture = (InputCapture*)arg;
+    BaseType_t    woken   = pdFALSE;
+    gpio_intr_disable(INPUT_INT_PIN);
+    xTaskNotifyFromISR(capture->_task, (uint32_t)esp_timer_get_time(), eSetValueWithOverwrite, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+/**
+ * Read the inputs and advance the debounce of every channel. A channel is
+ * accepted once its new level has been stable for the debounce time; a
+ * bounce back to the old level cancels it.
+ *
+ * @param changed_usec  time of the interrupt, the start of a new transition
+ */
+void InputCapture::sample(int64_t changed_usec) {
+    int64_t now = timespec_now_to_usec();
+
+    // clear INT before reading, a change after this point asserts it again
+    M5.In_I2C.readRegister8(INPUT_EXPANDER_ADDR, INPUT_EXPANDER_INT_STATUS, 400000);
+    uint8_t raw = readRaw();
+
+    for (uint8_t i = 0; i < INPUT_CHANNELS; i++) {
+        uint8_t mask = 1 << i;
+        if ((raw ^ _raw) & mask) {
+            if ((raw ^ _stable) & mask) {
+                _pending |= mask;
+                _changed_usec[i] = changed_usec;
+            } else {
+                _pending &= ~mask;
+            }
+        }
+        if ((_pending & mask) && now - _changed_usec[i] >= _debounce[i] * USEC_PER_MILLISEC) {
+            _pending &= ~mask;
+            accept(i, raw & mask, _changed_usec[i]);
+        }
+    }
+    _raw = raw;
+}
+
+void InputCapture::accept(uint8_t channel, bool level, int64_t usec) {
+    InputEvent event;
+    event.channel = channel;
+    event.edge    = level ? INPUT_RISING : INPUT_FALLING;
+    timespec_from_usec(&event.time, usec);
+
+    portENTER_CRITICAL(&_lock);
+    _stable = level ? _stable | (1 << channel) : _stable & ~(1 << channel);
+    if (level) {
+        InputPulses* p = &_pulses[channel];
+        p->count++;
+        if (_rising_usec[channel] != 0) {
+            p->period_usec = usec - _rising_usec[channel];
+            p->frequency   = p->period_usec ? (float)USEC_PER_SEC / p->period_usec : 0.0f;
+        }
+        _rising_usec[channel] = usec;
+    }
+    portEXIT_CRITICAL(&_lock);
+
+    if (!_events.push(event)) {
+        _overflows++;
+    }
+}
+
+/**
+ * @return ticks until the earliest debounce expires, portMAX_DELAY if none is pending
+ */
+TickType_t InputCapture::nextDeadline() {
+    if (_pending == 0) {
+        return portMAX_DELAY;
+    }
+
+    int64_t now  = timespec_now_to_usec();
+    int64_t next = INT64_MAX;
+    for (uint8_t i = 0; i < INPUT_CHANNELS; i++) {
+        if (_pending & (1 << i)) {
+            int64_t deadline = _changed_usec[i] + _debounce[i] * USEC_PER_MILLISEC;
+            if (deadline < next) {
+                next = deadline;
+            }
+        }
+    }
+
+    int64_t msec = (next - now + USEC_PER_MILLISEC - 1) / USEC_PER_MILLISEC;
+    return msec > 0 ? pdMS_TO_TICKS(msec) : 1;
+}
+
+void InputCapture::captureTask(void* arg) {
+    InputCapture* capture = (InputCapture*)arg;
+    for (;;) {
+        uint32_t irq;
+        bool     notified = xTaskNotifyWait(0, 0, &irq, capture->nextDeadline()) == pdTRUE;
+
+        // interrupt time on the Timespec clock, a deadline wake has none
+        int64_t now     = esp_timer_get_time();
+        int64_t changed = timespec_now_to_usec();
+        if (notified) {
+            changed -= (uint32_t)now - irq;
+        }
+        capture->sample(changed);
+        gpio_intr_enable(INPUT_INT_PIN);
+    }
+}
+
+/**
+ * @param channel  0..7
+ * @param msec     time the new level must be stable, 0 disables debouncing
+ */
+void InputCapture::setDebounce(uint8_t channel, uint16_t msec) {
+    if (channel < INPUT_CHANNELS) {
+        _debounce[channel] = msec;
+    }
+}
+
+/**
+ * @return debounced inputs, bit n = input n
+ */
+uint8_t InputCapture::getInputs() {
+    portENTER_CRITICAL(&_lock);
+    uint8_t inputs = _stable;
+    portEXIT_CRITICAL(&_lock);
+    return inputs;
+}
+
+/**
+ * Take the oldest edge from the queue, only one consumer task is allowed
+ *
+ * @param event  [out]
+ * @return false if the queue is empty
+ */
+bool InputCapture::nextEvent(InputEvent* event) {
+    return _events.pop(event);
+}
+
+void InputCapture::getPulses(uint8_t channel, InputPulses* pulses) {
+    if (channel >= INPUT_CHANNELS) {
+        return;
+    }
+    portENTER_CRITICAL(&_lock);
+    *pulses = _pulses[channel];
+    portEXIT_CRITICAL(&_lock);
+}
+
+void InputCapture::resetPulses(uint8_t channel) {
+    if (channel >= INPUT_CHANNELS) {
+        return;
+    }
+    portENTER_CRITICAL(&_lock);
+    memset(&_pulses[channel], 0, sizeof(InputPulses));
+    _rising_usec[channel] = 0;
+    portEXIT_CRITICAL(&_lock);
+}
+
+/**
+ * @return events lost because the queue was full
+ */
+uint32_t InputCapture::getOverflows() {
+    return _overflows;
+}
+
+/**
+ * @return the capture task, nullptr before begin()
+ */
+TaskHandle_t InputCapture::getTask() {
+    return _task;
+}
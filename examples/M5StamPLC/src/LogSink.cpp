@@ -0,0 +1,73 @@
+//
+// Block storage for SampleLogger: a file on the SD card or on the host.
+//
+
+#include <unistd.h>
+#include "LogSink.hpp"
+
+FileLogSink::FileLogSink() {
+    _file = nullptr;
+}
+
+FileLogSink::~FileLogSink() {
+    close();
+}
+
+/**
+ * Open for appending, earlier blocks stay readable. A file cut short by a power loss is padded to the next
+ * sector, so all following writes stay sector aligned.
+ *
+ * @param path  e.g. "/sd/samples.bin"
+ */
+bool FileLogSink::open(const char* path) {
+    close();
+    _file = fopen(path, "a+b");
+    if (_file == nullptr) {
+        return false;
+    }
+    // whole sectors go straight to the file system, no copy in a stdio buffer
+    setvbuf(_file, nullptr, _IONBF, 0);
+
+    fseek(_file, 0, SEEK_END);
+    long tail = ftell(_file) % LOG_SECTOR;
+    if (tail != 0) {
+        static const uint8_t zeros[LOG_SECTOR] = {0};
+        fwrite(zeros, 1, LOG_SECTOR - tail, _file);
+    }
+    return true;
+}
+
+void FileLogSink::close() {
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool FileLogSink::write(const uint8_t* data, size_t len) {
+    return _file != nullptr && fwrite(data, 1, len, _file) == len;
+}
+
+bool FileLogSink::sync() {
+    return _file != nullptr && fflush(_file) == 0 && fsync(fileno(_file)) == 0;
+}
+
+uint64_t FileLogSink::size() {
+    if (_file == nullptr || fseek(_file, 0, SEEK_END) != 0) {
+        return 0;
+    }
+    long len = ftell(_file);
+    return len > 0 ? len : 0;
+}
+
+/**
+ * Writes append regardless of the read position
+ */
+bool FileLogSink::read(uint64_t offset, uint8_t* data, size_t len) {
+    if (_file == nullptr || fseek(_file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    bool ok = fread(data, 1, len, _file) == len;
+    fseek(_file, 0, SEEK_END);
+    return ok;
+}
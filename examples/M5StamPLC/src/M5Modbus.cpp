@@ -6,30 +6,90 @@
  */
 
 #include "M5Modbus.hpp"
+#include "HeapGuard.hpp"
+
+// candidate serial settings tried by autobaud(), fastest first
+static const uint32_t AUTOBAUD_RATES[]   = {921600, 460800, 230400, 115200, 57600, 38400, 19200, 9600, 4800, 2400};
+static const uint32_t AUTOBAUD_CONFIGS[] = {SERIAL_8N1, SERIAL_8E1, SERIAL_8O1, SERIAL_8N2};
 
 /**
  *
- * @param baud
+ * @param serial  serial port connected to the RS485 transceiver
+ * @param baud    baud rate, up to MODBUS_MAX_BAUDRATE
+ * @param config  data bits, parity and stop bits (SERIAL_8N1, SERIAL_8E1, ...)
  */
-M5Modbus::M5Modbus(HardwareSerial* serial, uint16_t baud) {
+M5Modbus::M5Modbus(HardwareSerial* serial, uint32_t baud, uint32_t config) {
 
     _serial   = serial;
-    _baudrate = baud;
-    _MB       = new ModbusClientRTU(REDE_PIN);
+    _baudrate = baud > MODBUS_MAX_BAUDRATE ? MODBUS_MAX_BAUDRATE : baud;
+    _config   = config;
+    _timeout  = MODBUS_TIMEOUT;
+    _rx_pin   = RX_PIN;
+    _tx_pin   = TX_PIN;
+    _rede_pin = REDE_PIN;
+
+    _rx_fifo_full  = MODBUS_RX_FIFO_FULL;
+    _rx_timeout    = MODBUS_RX_TIMEOUT;
+    _task_core     = MODBUS_TASK_CORE;
+    _task_priority = MODBUS_TASK_PRIORITY;
+    _recorder      = nullptr;
 
+    _MB = _client.create(REDE_PIN);
+
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "modbus", &_pm_lock);
+#endif
 }
 
 M5Modbus::~M5Modbus() {
-    delete _MB;
+    _client.destroy(_MB);
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_delete(_pm_lock);
+#endif
+}
+
+/**
+ * The UART loses received bytes in light sleep, so the chip stays awake from
+ * a request until its response or error. Counted, one call per request.
+ */
+void M5Modbus::stayAwake() {
+    _awake++;
+#ifdef CONFIG_PM_ENABLE
+    esp_pm_lock_acquire(_pm_lock);
+#endif
+}
+
+void M5Modbus::allowSleep() {
+    uint32_t awake = _awake.load();
+    while (awake > 0 && !_awake.compare_exchange_weak(awake, awake - 1)) {
+    }
+#ifdef CONFIG_PM_ENABLE
+    if (awake > 0) {
+        esp_pm_lock_release(_pm_lock);
+    }
+#endif
 }
 
 /**
- * Received data handler.
+ * Received data handler. The response is moved on, not copied, and
+ * everything behind the handler runs without the heap (see HeapGuard.hpp).
  *
  * @param response
  * @param token
  */
 void M5Modbus::handleData(ModbusMessage response, uint32_t token) {
+    allowSleep();
+    if (_recorder != nullptr) {
+        _recorder->record(TRACE_SOURCE_MODBUS, TRACE_MODBUS_RESPONSE, &token, sizeof(token), response.data(),
+                          response.size());
+    }
+    std::unique_lock<std::mutex> guard(_handler_lock);
+    if (_data_handler) {
+        HeapDeny deny;
+        _data_handler(std::move(response), token);
+        return;
+    }
+    guard.unlock();
     Serial.println("Modbus data received");
 }
 
@@ -39,36 +99,135 @@ void M5Modbus::handleData(ModbusMessage response, uint32_t token) {
  * @param token
  */
 void M5Modbus::handleError(Error error, uint32_t token) {
+    allowSleep();
+    if (_recorder != nullptr) {
+        uint8_t code = error;
+        _recorder->record(TRACE_SOURCE_MODBUS, TRACE_MODBUS_ERROR, &token, sizeof(token), &code, sizeof(code));
+    }
+    std::unique_lock<std::mutex> guard(_handler_lock);
+    if (_error_handler) {
+        HeapDeny deny;
+        _error_handler(error, token);
+        return;
+    }
+    guard.unlock();
     Serial.println("Modbus error received");
 }
 
+/**
+ * Handlers for the responses of addRequest(), they run in the RTU worker task.
+ * The handlers are replaced under the handler lock, so they can be changed
+ * while requests are queued; a handler must not call onResponse() itself.
+ *
+ * @param data   called for every valid response
+ * @param error  called for timeouts, CRC errors and exception responses
+ */
+void M5Modbus::onResponse(MBOnData data, MBOnError error) {
+    swapResponse(data, error);
+}
+
+/**
+ * Exchange the response handlers with the given ones, e.g. to install
+ * temporary handlers and put the previous ones back afterwards. The swap
+ * does not allocate.
+ *
+ * @param data   [in, out] new data handler, receives the previous one
+ * @param error  [in, out] new error handler, receives the previous one
+ */
+void M5Modbus::swapResponse(MBOnData& data, MBOnError& error) {
+    std::lock_guard<std::mutex> guard(_handler_lock);
+    _data_handler.swap(data);
+    _error_handler.swap(error);
+}
+
+/**
+ * Capture the bus traffic for a later replay, nullptr stops the capture
+ *
+ * @param recorder
+ */
+void M5Modbus::setRecorder(TraceRecorder* recorder) {
+    _recorder = recorder;
+}
+
+/**
+ * @return number of requests waiting in the addRequest() queue
+ */
+uint32_t M5Modbus::pendingRequests() {
+    return _MB->pendingRequests();
+}
+
 /**
  * Initialization
  */
 void M5Modbus::begin() {
 
     _MB->onDataHandler([this](ModbusMessage rsp, uint32_t token) {
-        this->handleData(rsp, token);
+        this->handleData(std::move(rsp), token);
     });
 
     _MB->onErrorHandler([this](Error err, uint32_t token) {
         this->handleError(err, token);
     });
 
-    _MB->setTimeout(1000);
+    _MB->setTimeout(_timeout);
+
+    RTUutils::prepareHardwareSerial(*_serial);
+
+    startLine();
+}
+
+/**
+ * Open the serial line and start the RTU worker.
+ *
+ * The UART moves received bytes out of its FIFO when the FIFO threshold is
+ * reached or when the line stays idle for the RX timeout, so a complete
+ * response reaches the Serial buffer with a single interrupt at the end of
+ * the frame. The eModbus worker still polls that buffer, it is not woken by
+ * the interrupt.
+ */
+void M5Modbus::startLine() {
+    _serial->begin(_baudrate, _config, _rx_pin, _tx_pin);
+    _serial->setRxFIFOFull(_rx_fifo_full);
+    _serial->setRxTimeout(rxTimeout(_baudrate, _rx_timeout));
+
+    _MB->begin(*_serial, _task_core, interFrameDelay(_baudrate));
+
+    // ModbusClientRTU creates the worker with a fixed priority
+    vTaskPrioritySet(_MB->getWorker(), _task_priority);
+}
+
+/**
+ * Restart the serial line and the RTU worker with new line settings.
+ * Requests still in the queue are dropped.
+ *
+ * @param baud
+ * @param config
+ */
+void M5Modbus::reconfigure(uint32_t baud, uint32_t config) {
+    _MB->end();
+    _serial->end();
 
-    RTUutils::prepareHardwareSerial(*_serial);;
+    // dropped requests never get a response
+    while (_awake.load() > 0) {
+        allowSleep();
+    }
 
-    _serial->begin(_baudrate, SERIAL_8N1, RX_PIN, TX_PIN);
+    _baudrate = baud;
+    _config   = config;
 
-    _MB->begin(*_serial);
+    startLine();
 }
 
 /**
  * Send request - non blocking
  */
 Error M5Modbus::addRequest(ModbusMessage msg, uint32_t token) {
-    return _MB->addRequest(msg, token);
+    stayAwake();
+    Error err = _MB->addRequest(msg, token);
+    if (err != SUCCESS) {
+        allowSleep();
+    }
+    return err;
 }
 
 /**
@@ -78,5 +237,166 @@ Error M5Modbus::addRequest(ModbusMessage msg, uint32_t token) {
  * @return
  */
 ModbusMessage M5Modbus::syncRequest(ModbusMessage msg, uint32_t token) {
-    return _MB->syncRequest(msg, token);
+    stayAwake();
+    ModbusMessage rsp = _MB->syncRequest(msg, token);
+    allowSleep();
+    return rsp;
+}
+
+/**
+ * Change the line settings of a running client
+ *
+ * @param baud    baud rate, up to MODBUS_MAX_BAUDRATE
+ * @param config  data bits, parity and stop bits
+ * @return false if the baud rate is out of range
+ */
+bool M5Modbus::setBaudrate(uint32_t baud, uint32_t config) {
+    if (baud == 0 || baud > MODBUS_MAX_BAUDRATE) {
+        return false;
+    }
+    reconfigure(baud, config);
+    return true;
+}
+
+uint32_t M5Modbus::getBaudrate() {
+    return _baudrate;
+}
+
+uint32_t M5Modbus::getConfig() {
+    return _config;
+}
+
+/**
+ * Response timeout
+ *
+ * @param timeout  in milliseconds
+ */
+void M5Modbus::setTimeout(uint32_t timeout) {
+    _timeout = timeout;
+    _MB->setTimeout(_timeout);
+}
+
+uint32_t M5Modbus::getTimeout() {
+    return _timeout;
+}
+
+/**
+ * Find the baud rate and parity of a slave. Every candidate setting is probed
+ * with a single register read and a short timeout, fastest rates first. Any
+ * well-formed answer counts, including Modbus exception responses.
+ *
+ * The client is left configured with the detected settings, or with the
+ * original ones if the slave did not answer at all.
+ *
+ * @param addr  slave address
+ * @param line  [out] detected settings
+ * @param reg   holding register used for the probe
+ * @return true if the slave answered
+ */
+bool M5Modbus::autobaud(uint8_t addr, M5ModbusLine* line, uint16_t reg) {
+    uint32_t baud    = _baudrate;
+    uint32_t config  = _config;
+    uint32_t timeout = _timeout;
+
+    _MB->setTimeout(MODBUS_PROBE_TIMEOUT);
+
+    for (uint32_t b : AUTOBAUD_RATES) {
+        if (b > MODBUS_MAX_BAUDRATE) {
+            continue;
+        }
+        for (uint32_t c : AUTOBAUD_CONFIGS) {
+            reconfigure(b, c);
+            ModbusMessage rsp = _MB->syncRequest(ModbusMessage(addr, READ_HOLD_REGISTER, reg, 1), addr);
+            // exception codes are below TIMEOUT, communication errors above
+            if (rsp.getError() < TIMEOUT) {
+                line->baudrate = b;
+                line->config   = c;
+                _MB->setTimeout(timeout);
+                return true;
+            }
+        }
+    }
+
+    reconfigure(baud, config);
+    _MB->setTimeout(timeout);
+    return false;
+}
+
+/**
+ * Time to transmit one RTU character (start, 8 data, parity or 2nd stop, stop)
+ *
+ * @param baud
+ * @return character time in microseconds
+ */
+uint32_t M5Modbus::charTime(uint32_t baud) {
+    return (11UL * 1000000UL + baud - 1) / baud;
+}
+
+/**
+ * Maximum gap between two characters of one frame (t1.5). The Modbus
+ * specification fixes it at 750 us for baud rates above 19200.
+ *
+ * @param baud
+ * @return t1.5 in microseconds
+ */
+uint32_t M5Modbus::interCharTimeout(uint32_t baud) {
+    if (baud > 19200) {
+        return 750;
+    }
+    return (3 * charTime(baud) + 1) / 2;
+}
+
+/**
+ * Minimum silent interval between two frames (t3.5). The Modbus
+ * specification fixes it at 1750 us for baud rates above 19200.
+ *
+ * @param baud
+ * @return t3.5 in microseconds
+ */
+uint32_t M5Modbus::interFrameDelay(uint32_t baud) {
+    if (baud > 19200) {
+        return 1750;
+    }
+    return (7 * charTime(baud) + 1) / 2;
+}
+
+/**
+ * RX timeout of the UART in character times. It must not be shorter than
+ * t3.5, otherwise a gap allowed inside a frame (up to 750 us above 19200 Bd,
+ * several character times) ends the read in the middle of the frame.
+ *
+ * @param baud
+ * @param chars  configured timeout in character times
+ * @return chars, at least t3.5, at most MODBUS_RX_TIMEOUT_MAX
+ */
+uint8_t M5Modbus::rxTimeout(uint32_t baud, uint8_t chars) {
+    uint32_t t35 = (interFrameDelay(baud) + charTime(baud) - 1) / charTime(baud);
+    if (t35 < chars) {
+        t35 = chars;
+    }
+    return t35 < MODBUS_RX_TIMEOUT_MAX ? t35 : MODBUS_RX_TIMEOUT_MAX;
+}
+
+/**
+ * UART receive interrupt settings
+ *
+ * @param fifo_full  number of bytes in the RX FIFO that raise an interrupt (1..127)
+ * @param timeout    idle time in character times that raises an interrupt,
+ *                   raised to t3.5 if shorter
+ */
+void M5Modbus::setRxInterrupts(uint8_t fifo_full, uint8_t timeout) {
+    _rx_fifo_full = fifo_full;
+    _rx_timeout   = timeout;
+}
+
+/**
+ * Placement of the RTU worker task. Pin it away from the Arduino loop()
+ * core (ARDUINO_RUNNING_CORE) to keep response latency independent of it.
+ *
+ * @param core      0, 1 or -1 for no affinity
+ * @param priority  FreeRTOS priority
+ */
+void M5Modbus::setTask(int core, uint32_t priority) {
+    _task_core     = core;
+    _task_priority = priority;
 }
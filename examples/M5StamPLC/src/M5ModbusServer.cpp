@@ -0,0 +1,177 @@
+//
+// Modbus RTU/TCP server exposing the StamPLC shadow image.
+//
+
+#include <M5ModbusServer.hpp>
+#include <M5Modbus.hpp>
+
+/**
+ * @param image      shadow image served to the masters
+ * @param server_id  Modbus address of the StamPLC
+ */
+M5ModbusServer::M5ModbusServer(ShadowImage* image, uint8_t server_id) {
+    _image     = image;
+    _server_id = server_id;
+    _rtu       = nullptr;
+    _tcp       = nullptr;
+}
+
+M5ModbusServer::~M5ModbusServer() {
+    _rtu_pool.destroy(_rtu);
+    _tcp_pool.destroy(_tcp);
+}
+
+/**
+ * Serve the image on a serial line. The PWR-485 port can only be used when the
+ * StamPLC is not the bus master at the same time.
+ *
+ * @param serial
+ * @param baud
+ * @param rede_pin  RS485 direction pin
+ * @param rx_pin
+ * @param tx_pin
+ */
+void M5ModbusServer::beginRTU(HardwareSerial* serial, uint32_t baud, int8_t rede_pin, int8_t rx_pin, int8_t tx_pin) {
+    _rtu = _rtu_pool.create(MODBUS_SERVER_TIMEOUT, rede_pin);
+    registerWorkers(_rtu);
+
+    RTUutils::prepareHardwareSerial(*serial);
+    serial->begin(baud, SERIAL_8N1, rx_pin, tx_pin);
+
+    _rtu->begin(*serial, -1, M5Modbus::interFrameDelay(baud));
+}
+
+/**
+ * Serve the image over Modbus TCP, WiFi must be connected already
+ *
+ * @param port
+ */
+void M5ModbusServer::beginTCP(uint16_t port) {
+    _tcp = _tcp_pool.create();
+    registerWorkers(_tcp);
+    _tcp->start(port, MODBUS_SERVER_TCP_CLIENTS, MODBUS_SERVER_TIMEOUT);
+}
+
+void M5ModbusServer::registerWorkers(ModbusServer* server) {
+    server->registerWorker(_server_id, READ_COIL, [this](ModbusMessage request) {
+        return this->readCoils(request);
+    });
+    server->registerWorker(_server_id, READ_DISCR_INPUT, [this](ModbusMessage request) {
+        return this->readDiscreteInputs(request);
+    });
+    server->registerWorker(_server_id, READ_INPUT_REGISTER, [this](ModbusMessage request) {
+        return this->readInputRegisters(request);
+    });
+    server->registerWorker(_server_id, WRITE_COIL, [this](ModbusMessage request) {
+        return this->writeCoil(request);
+    });
+    server->registerWorker(_server_id, WRITE_MULT_COILS, [this](ModbusMessage request) {
+        return this->writeCoils(request);
+    });
+}
+
+/**
+ * Answer FC 01 / 02 from a bit field of the image
+ *
+ * @param request
+ * @param bits   current states, bit n = coil/input n
+ * @param count  number of coils/inputs in the image
+ */
+ModbusMessage M5ModbusServer::readBits(ModbusMessage request, uint8_t bits, uint8_t count) {
+    ModbusMessage response;
+    uint16_t      addr = 0;
+    uint16_t      qty  = 0;
+
+    request.get(2, addr);
+    request.get(4, qty);
+
+    if (qty == 0 || addr + qty > count) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+        return response;
+    }
+
+    // at most 8 bits, always fits in a single data byte
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)1);
+    response.add((uint8_t)((bits >> addr) & ((1 << qty) - 1)));
+    return response;
+}
+
+ModbusMessage M5ModbusServer::readCoils(ModbusMessage request) {
+    return readBits(request, _image->getCoils(), SHADOW_COILS);
+}
+
+ModbusMessage M5ModbusServer::readDiscreteInputs(ModbusMessage request) {
+    return readBits(request, _image->getInputs(), SHADOW_DISCRETE_INPUTS);
+}
+
+ModbusMessage M5ModbusServer::readInputRegisters(ModbusMessage request) {
+    ModbusMessage response;
+    uint16_t      addr = 0;
+    uint16_t      qty  = 0;
+    uint16_t      values[SHADOW_INPUT_REGISTERS];
+
+    request.get(2, addr);
+    request.get(4, qty);
+
+    if (qty == 0 || !_image->getRegisters(addr, values, qty)) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+        return response;
+    }
+
+    response.add(request.getServerID(), request.getFunctionCode(), (uint8_t)(qty * 2));
+    for (uint16_t i = 0; i < qty; i++) {
+        response.add(values[i]);
+    }
+    return response;
+}
+
+ModbusMessage M5ModbusServer::writeCoil(ModbusMessage request) {
+    ModbusMessage response;
+    uint16_t      addr  = 0;
+    uint16_t      value = 0;
+
+    request.get(2, addr);
+    request.get(4, value);
+
+    if (addr >= SHADOW_COILS) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+        return response;
+    }
+    if (value != 0x0000 && value != 0xFF00) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+        return response;
+    }
+
+    _image->writeCoil(addr, value == 0xFF00);
+
+    // the normal response is an echo of the request
+    return request;
+}
+
+ModbusMessage M5ModbusServer::writeCoils(ModbusMessage request) {
+    ModbusMessage response;
+    uint16_t      addr  = 0;
+    uint16_t      qty   = 0;
+    uint8_t       bytes = 0;
+    uint8_t       bits  = 0;
+
+    request.get(2, addr);
+    request.get(4, qty);
+    request.get(6, bytes);
+    request.get(7, bits);
+
+    if (qty == 0 || addr + qty > SHADOW_COILS) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_ADDRESS);
+        return response;
+    }
+    if (bytes != 1) {
+        response.setError(request.getServerID(), request.getFunctionCode(), ILLEGAL_DATA_VALUE);
+        return response;
+    }
+
+    // all coils of the request switch together
+    _image->writeCoils(addr, qty, bits);
+
+    response.add(request.getServerID(), request.getFunctionCode(), addr, qty);
+    return response;
+}
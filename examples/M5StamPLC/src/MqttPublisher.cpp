@@ -0,0 +1,318 @@
+//
+// Batched MQTT telemetry with store-and-forward during broker outages.
+//
+
+#include <string.h>
+#include <stdio.h>
+#include "MqttPublisher.hpp"
+#include "Timespec.h"
+
+enum MqttEventType : uint8_t {
+    MQTT_ON_ACK = 0,
+    MQTT_ON_LOST,
+    MQTT_ON_CONNECT,
+    MQTT_ON_DISCONNECT,
+};
+
+/**
+ * @param backend  connected or connecting MQTT client
+ * @param spill    ring for messages the broker did not take, nullptr to drop them
+ * @param topic    e.g. "stamplc/1/points"
+ * @param node     sender id written into every batch
+ */
+MqttPublisher::MqttPublisher(MqttBackend* backend, MqttSpill* spill, const char* topic, uint8_t node) {
+    _backend      = backend;
+    _spill        = spill;
+    _count        = 0;
+    _node         = node;
+    _seq          = 0;
+    _window       = MQTT_MAX_INFLIGHT;
+    _drain_rate   = MQTT_DRAIN_RATE;
+    _drain_time   = timespec_now_to_msec();
+    _drain_budget = 0;
+    snprintf(_topic, sizeof(_topic), "%s", topic);
+    memset(&_stats, 0, sizeof(_stats));
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        _inflight[i].id = -1;
+    }
+
+    _backend->onAck([this](int id) { post(MQTT_ON_ACK, id); });
+    _backend->onLost([this](int id) { post(MQTT_ON_LOST, id); });
+    _backend->onConnect([this](bool connected) {
+        post(connected ? MQTT_ON_CONNECT : MQTT_ON_DISCONNECT, 0);
+    });
+}
+
+MqttPublisher::~MqttPublisher() {
+    _backend->onAck(nullptr);
+    _backend->onLost(nullptr);
+    _backend->onConnect(nullptr);
+}
+
+/**
+ * @param window  publishes in flight, 1 waits for every PUBACK
+ */
+void MqttPublisher::setWindow(uint8_t window) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _window = window < 1 ? 1 : window > MQTT_MAX_INFLIGHT ? MQTT_MAX_INFLIGHT : window;
+}
+
+void MqttPublisher::setDrainRate(uint32_t messages_per_second) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _drain_rate = messages_per_second;
+}
+
+/**
+ * Add a point to the current batch, a full batch is published right away
+ *
+ * @param point
+ * @param value
+ * @param valid  false sends MQTT_VALUE_INVALID
+ */
+void MqttPublisher::queue(uint16_t point, int32_t value, bool valid) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_count == MQTT_BATCH_POINTS) {
+        closeBatch();
+    }
+    MqttBatchRecord* record = (MqttBatchRecord*)(_batch + sizeof(MqttBatchHeader)) + _count++;
+    record->point = point;
+    record->value = valid ? value : MQTT_VALUE_INVALID;
+}
+
+/**
+ * Publish the current batch and drain the spill ring
+ */
+void MqttPublisher::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    applyEvents();
+    closeBatch();
+    drainSpill();
+}
+
+/**
+ * Apply the PUBACKs and drain the spill ring. Call about once a second, the
+ * drain rate is spent in whole seconds.
+ */
+void MqttPublisher::drain() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    applyEvents();
+    drainSpill();
+}
+
+void MqttPublisher::closeBatch() {
+    if (_count == 0) {
+        return;
+    }
+    MqttBatchHeader* header = (MqttBatchHeader*)_batch;
+    header->version = MQTT_BATCH_VERSION;
+    header->node    = _node;
+    header->count   = _count;
+    header->seq     = _seq++;
+    header->time    = timespec_now_to_msec();
+
+    uint16_t len = sizeof(MqttBatchHeader) + _count * sizeof(MqttBatchRecord);
+    _stats.points += _count;
+    _count = 0;
+
+    // live data goes first, the backlog only uses what is left of the window
+    MqttInflight* slot = freeSlot();
+    if (slot == nullptr || !send(slot, _batch, len)) {
+        store(_batch, len);
+    }
+}
+
+MqttInflight* MqttPublisher::freeSlot() {
+    if (!_backend->connected() || _stats.inflight >= _window) {
+        return nullptr;
+    }
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (_inflight[i].id < 0) {
+            return &_inflight[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Hand a message to the backend and keep a copy until the PUBACK
+ */
+bool MqttPublisher::send(MqttInflight* slot, const uint8_t* data, uint16_t len) {
+    if (slot->data != data) {
+        memcpy(slot->data, data, len);
+    }
+    int id = _backend->publish(_topic, slot->data, len);
+    if (id < 0) {
+        return false;
+    }
+    slot->id  = id;
+    slot->len = len;
+    _stats.messages++;
+    _stats.bytes += len;
+    _stats.inflight++;
+    if (_stats.inflight > _stats.max_inflight) {
+        _stats.max_inflight = _stats.inflight;
+    }
+    return true;
+}
+
+void MqttPublisher::store(const uint8_t* data, uint16_t len) {
+    if (_spill != nullptr && _spill->push(data, len)) {
+        _stats.spilled++;
+    } else {
+        _stats.dropped++;
+    }
+}
+
+/**
+ * Publish spilled messages within the drain budget and the free window
+ */
+void MqttPublisher::drainSpill() {
+    if (_spill == nullptr || _spill->size() == 0) {
+        _drain_budget = 0;
+        return;
+    }
+
+    int64_t  now    = timespec_now_to_msec();
+    uint64_t credit = (uint64_t)(now - _drain_time) * _drain_rate / 1000;
+    if (credit > 0) {
+        _drain_budget = credit + _drain_budget > _drain_rate ? _drain_rate : credit + _drain_budget;
+        _drain_time   = now;
+    }
+
+    MqttInflight* slot;
+    while (_drain_budget > 0 && (slot = freeSlot()) != nullptr) {
+        uint16_t len = _spill->peek(slot->data);
+        if (len == 0 || !send(slot, slot->data, len)) {
+            break;
+        }
+        // the copy in the slot is spilled again if the PUBACK never comes
+        _spill->pop();
+        _stats.drained++;
+        _drain_budget--;
+    }
+}
+
+/**
+ * Called by the backend, must not take the mutex
+ */
+void MqttPublisher::post(uint8_t type, int id) {
+    if (!_events.push({type, id})) {
+        _overflow = true;
+    }
+}
+
+/**
+ * Events in the order of the backend, the mutex is held. After an overflow
+ * the state of the messages in flight is unknown, they are spilled and
+ * may arrive twice.
+ */
+void MqttPublisher::applyEvents() {
+    MqttEvent event;
+    while (_events.pop(&event)) {
+        switch (event.type) {
+        case MQTT_ON_ACK:
+            acked(event.id);
+            break;
+        case MQTT_ON_LOST:
+            lost(event.id);
+            break;
+        default:
+            connectionChanged(event.type == MQTT_ON_CONNECT);
+            break;
+        }
+    }
+    if (_overflow.exchange(false)) {
+        lost(MQTT_ID_ALL);
+    }
+}
+
+void MqttPublisher::acked(int id) {
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (_inflight[i].id == id) {
+            _inflight[i].id = -1;
+            _stats.inflight--;
+            _stats.acked++;
+            return;
+        }
+    }
+}
+
+/**
+ * The backend will not send the message again, keep it in the spill ring
+ *
+ * @param id  message id or MQTT_ID_ALL
+ */
+void MqttPublisher::lost(int id) {
+    for (uint8_t i = 0; i < MQTT_MAX_INFLIGHT; i++) {
+        if (_inflight[i].id >= 0 && (id == MQTT_ID_ALL || _inflight[i].id == id)) {
+            store(_inflight[i].data, _inflight[i].len);
+            _inflight[i].id = -1;
+            _stats.inflight--;
+        }
+    }
+}
+
+/**
+ * Messages in flight stay in their slots over a reconnect, the backend
+ * either sends them again or reports them as lost. Spilling them here as
+ * well would publish them twice.
+ */
+void MqttPublisher::connectionChanged(bool connected) {
+    if (connected) {
+        _stats.reconnects++;
+        _drain_time   = timespec_now_to_msec();
+        _drain_budget = 0;
+    }
+}
+
+void MqttPublisher::getStats(MqttStats* stats) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    applyEvents();
+    *stats         = _stats;
+    stats->backlog = _spill != nullptr ? _spill->size() : 0;
+    if (_spill != nullptr) {
+        stats->dropped += _spill->dropped();
+    }
+}
+
+/**
+ * Publish full batches as fast as the window allows and wait for all PUBACKs
+ *
+ * @param backend   connected backend
+ * @param points    per message, at most MQTT_BATCH_POINTS
+ * @param messages
+ * @param window    publishes in flight
+ * @param result    [out]
+ */
+void MqttPublisher::benchmark(MqttBackend* backend, uint16_t points, uint32_t messages, uint8_t window,
+                              MqttBenchmark* result) {
+    MqttPublisher publisher(backend, nullptr, "stamplc/benchmark", 0);
+    MqttStats     stats;
+    publisher.setWindow(window);
+
+    int64_t start = timespec_now_to_nsec();
+    for (uint32_t m = 0; m < messages; m++) {
+        // wait for room in the window instead of dropping
+        do {
+            publisher.getStats(&stats);
+            if (stats.inflight >= publisher._window) {
+                backend->poll(1);
+            }
+        } while (stats.inflight >= publisher._window && backend->connected());
+
+        for (uint16_t p = 0; p < points; p++) {
+            publisher.queue(p, (int32_t)(m + p), true);
+        }
+        publisher.flush();
+    }
+    do {
+        publisher.getStats(&stats);
+        backend->poll(1);
+    } while (stats.inflight > 0 && backend->connected());
+
+    result->points     = points;
+    result->messages   = stats.acked;
+    result->bytes      = stats.bytes;
+    result->window     = window;
+    result->total_nsec = timespec_now_to_nsec() - start;
+}
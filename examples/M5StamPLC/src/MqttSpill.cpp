@@ -0,0 +1,151 @@
+//
+// Ring of unsent MQTT messages in a file on the SD card.
+//
+
+#include <string.h>
+#include "MqttSpill.hpp"
+
+MqttSpill::MqttSpill() {
+    _file    = nullptr;
+    _slots   = 0;
+    _head    = 0;
+    _tail    = 0;
+    _dropped = 0;
+}
+
+MqttSpill::~MqttSpill() {
+    close();
+}
+
+/**
+ * Open or create the ring file and recover the queued messages
+ *
+ * @param path   e.g. "/sd/mqtt.spl"
+ * @param slots  capacity in messages, must not change between boots
+ */
+bool MqttSpill::open(const char* path, uint16_t slots) {
+    close();
+    _file = fopen(path, "r+b");
+    if (_file == nullptr) {
+        _file = fopen(path, "w+b");
+    }
+    if (_file == nullptr || slots == 0) {
+        close();
+        return false;
+    }
+    // every push and pop goes to the card right away
+    setvbuf(_file, nullptr, _IONBF, 0);
+    _slots = slots;
+
+    // valid slots hold a contiguous run of sequence numbers
+    MqttSpillHeader header;
+    bool            found = false;
+    for (uint16_t slot = 0; slot < _slots; slot++) {
+        if (!readHeader(slot, &header) || header.seq % _slots != slot) {
+            continue;
+        }
+        if (!found || (int32_t)(header.seq - _head) < 0) {
+            _head = header.seq;
+        }
+        if (!found || (int32_t)(header.seq + 1 - _tail) > 0) {
+            _tail = header.seq + 1;
+        }
+        found = true;
+    }
+    if (!found || _tail - _head > _slots) {
+        _head = 0;
+        _tail = 0;
+    }
+    return true;
+}
+
+void MqttSpill::close() {
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+    _head = 0;
+    _tail = 0;
+}
+
+bool MqttSpill::readHeader(uint16_t slot, MqttSpillHeader* header) {
+    return fseek(_file, (long)slot * MQTT_SPILL_SLOT, SEEK_SET) == 0
+           && fread(header, sizeof(*header), 1, _file) == 1 && header->magic == MQTT_SPILL_MAGIC
+           && header->len <= MQTT_SPILL_PAYLOAD;
+}
+
+/**
+ * Append a message, the oldest one is dropped if the ring is full
+ *
+ * @param data
+ * @param len   at most MQTT_SPILL_PAYLOAD
+ * @return false if the message could not be written
+ */
+bool MqttSpill::push(const uint8_t* data, uint16_t len) {
+    if (_file == nullptr || len > MQTT_SPILL_PAYLOAD) {
+        return false;
+    }
+    if (_tail - _head == _slots) {
+        _head++;
+        _dropped++;
+    }
+
+    uint8_t          slot[MQTT_SPILL_SLOT];
+    MqttSpillHeader* header = (MqttSpillHeader*)slot;
+    header->magic = MQTT_SPILL_MAGIC;
+    header->len   = len;
+    header->seq   = _tail;
+    memcpy(slot + sizeof(MqttSpillHeader), data, len);
+
+    if (fseek(_file, (long)(_tail % _slots) * MQTT_SPILL_SLOT, SEEK_SET) != 0
+        || fwrite(slot, sizeof(MqttSpillHeader) + len, 1, _file) != 1) {
+        return false;
+    }
+    _tail++;
+    return true;
+}
+
+/**
+ * Copy the oldest message without removing it
+ *
+ * @param data  [out] at least MQTT_SPILL_PAYLOAD bytes
+ * @return message length, 0 if the ring is empty
+ */
+uint16_t MqttSpill::peek(uint8_t* data) {
+    MqttSpillHeader header;
+    while (_head != _tail) {
+        if (readHeader(_head % _slots, &header) && header.seq == _head
+            && fread(data, header.len, 1, _file) == 1) {
+            return header.len;
+        }
+        // unreadable slot, e.g. cut off by a power loss
+        _head++;
+        _dropped++;
+    }
+    return 0;
+}
+
+/**
+ * Free the oldest message after it was handed to the broker
+ */
+void MqttSpill::pop() {
+    if (_head == _tail) {
+        return;
+    }
+    uint16_t free = 0;
+    if (fseek(_file, (long)(_head % _slots) * MQTT_SPILL_SLOT, SEEK_SET) == 0) {
+        fwrite(&free, sizeof(free), 1, _file);
+    }
+    _head++;
+}
+
+uint32_t MqttSpill::size() {
+    return _tail - _head;
+}
+
+/**
+ * @return messages lost because the ring was full or a slot was damaged
+ */
+uint32_t MqttSpill::dropped() {
+    return _dropped;
+}
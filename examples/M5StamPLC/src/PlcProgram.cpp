@@ -0,0 +1,322 @@
+//
+// Bytecode interpreter for PLC logic (instruction list style).
+//
+// Programs are compiled on the host by tools/plcc.py into a flat list of
+// 8-byte instructions. The instructions use a boolean accumulator and a small
+// stack for nested rungs, like IEC 61131-3 instruction list.
+//
+// At load time every instruction is validated and turned into a PlcOp with
+// its operand already resolved into a pointer into the bit or register
+// image. The dispatch address of the opcode is resolved too, so the
+// interpreter loop is direct-threaded code: every handler ends with a
+// computed goto to the next handler, without a switch or bounds checks.
+//
+
+#include <string.h>
+#include "PlcProgram.hpp"
+#include "Timespec.h"
+
+#define BIT_I 0
+#define BIT_Q (BIT_I + PLC_INPUTS)
+#define BIT_M (BIT_Q + PLC_OUTPUTS)
+#define BIT_T (BIT_M + PLC_MARKERS)
+
+PlcProgram::PlcProgram() {
+    _code  = nullptr;
+    _count = 0;
+    unload();
+}
+
+PlcProgram::~PlcProgram() {
+    unload();
+}
+
+void PlcProgram::unload() {
+    delete[] _code;
+    _code  = nullptr;
+    _count = 0;
+    memset(_bits, 0, sizeof(_bits));
+    memset(_regs, 0, sizeof(_regs));
+    memset(_elapsed, 0, sizeof(_elapsed));
+}
+
+bool PlcProgram::loaded() {
+    return _code != nullptr;
+}
+
+/**
+ * @return number of instructions including the final END
+ */
+uint16_t PlcProgram::size() {
+    return _count;
+}
+
+uint8_t* PlcProgram::bitAddress(uint8_t area, uint16_t index) {
+    switch (area) {
+        case PLC_AREA_I: return index < PLC_INPUTS  ? &_bits[BIT_I + index] : nullptr;
+        case PLC_AREA_Q: return index < PLC_OUTPUTS ? &_bits[BIT_Q + index] : nullptr;
+        case PLC_AREA_M: return index < PLC_MARKERS ? &_bits[BIT_M + index] : nullptr;
+        case PLC_AREA_T: return index < PLC_TIMERS  ? &_bits[BIT_T + index] : nullptr;
+        default:         return nullptr;
+    }
+}
+
+/**
+ * Check opcodes, operand ranges and stack depth, so that the interpreter
+ * needs no runtime checks
+ */
+bool PlcProgram::validate(const PlcInstr* instr, uint16_t count) {
+    int depth = 0;
+
+    if (count == 0 || count > PLC_MAX_INSTR || instr[count - 1].op != PLC_END) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        const PlcInstr* in = &instr[i];
+        switch (in->op) {
+            case PLC_END:
+                if (i != count - 1) {
+                    return false;
+                }
+                break;
+            case PLC_NOT:
+                break;
+            case PLC_PUSH:
+                if (++depth > PLC_STACK_DEPTH) {
+                    return false;
+                }
+                break;
+            case PLC_ANDP:
+            case PLC_ORP:
+                if (--depth < 0) {
+                    return false;
+                }
+                break;
+            case PLC_GT:
+            case PLC_LT:
+            case PLC_EQ:
+                if (in->area != PLC_AREA_R || in->index >= PLC_REGISTERS) {
+                    return false;
+                }
+                break;
+            case PLC_TON:
+                if (in->area != PLC_AREA_T || in->index >= PLC_TIMERS || in->arg < 0) {
+                    return false;
+                }
+                break;
+            case PLC_ST:
+            case PLC_STN:
+            case PLC_SET:
+            case PLC_RST:
+                // inputs are read only
+                if (in->area == PLC_AREA_I || bitAddress(in->area, in->index) == nullptr) {
+                    return false;
+                }
+                break;
+            default:
+                if (in->op >= PLC_OPCODES || bitAddress(in->area, in->index) == nullptr) {
+                    return false;
+                }
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Load a compiled program. The previous program is kept if the new one is
+ * invalid.
+ *
+ * @param data  program file: "PLC1", uint16 count, count * PlcInstr
+ * @param len   file length
+ * @return false if the program is malformed
+ */
+bool PlcProgram::load(const uint8_t* data, size_t len) {
+    uint16_t count;
+
+    if (len < 6 || memcmp(data, PLC_MAGIC, 4) != 0) {
+        return false;
+    }
+    memcpy(&count, data + 4, sizeof(count));
+    if (len != 6 + count * sizeof(PlcInstr)) {
+        return false;
+    }
+
+    const PlcInstr* instr = (const PlcInstr*)(data + 6);
+    if (!validate(instr, count)) {
+        return false;
+    }
+
+    unload();
+    _code  = new PlcOp[count];
+    _count = count;
+
+    for (uint16_t i = 0; i < count; i++) {
+        PlcOp* op   = &_code[i];
+        op->handler = (const void*)(uintptr_t)instr[i].op;
+        op->bit     = bitAddress(instr[i].area, instr[i].index);
+        op->reg     = instr[i].area == PLC_AREA_R ? &_regs[instr[i].index] : nullptr;
+        op->elapsed = instr[i].area == PLC_AREA_T ? &_elapsed[instr[i].index] : nullptr;
+        op->arg     = instr[i].arg;
+    }
+    run(0, true);
+    return true;
+}
+
+/**
+ * Interpreter. With resolve set, the opcode numbers stored in the handler
+ * fields are replaced by the addresses of the handlers; the labels are only
+ * visible inside this function.
+ *
+ * @param dt       time since the previous scan in milliseconds
+ * @param resolve  resolve dispatch addresses instead of running
+ */
+void PlcProgram::run(uint32_t dt, bool resolve) {
+    static const void* const dispatch[PLC_OPCODES] = {
+        &&op_end, &&op_ld, &&op_ldn, &&op_and, &&op_andn, &&op_or, &&op_orn, &&op_not,
+        &&op_st, &&op_stn, &&op_set, &&op_rst, &&op_push, &&op_andp, &&op_orp,
+        &&op_gt, &&op_lt, &&op_eq, &&op_ton,
+    };
+
+    if (resolve) {
+        for (uint16_t i = 0; i < _count; i++) {
+            _code[i].handler = dispatch[(uintptr_t)_code[i].handler];
+        }
+        return;
+    }
+
+    const PlcOp* pc = _code;
+    uint8_t      acc = 0;
+    uint8_t      stack[PLC_STACK_DEPTH];
+    uint8_t      sp = 0;
+
+#define NEXT goto *(++pc)->handler
+
+    goto *pc->handler;
+
+op_ld:   acc = *pc->bit;                    NEXT;
+op_ldn:  acc = !*pc->bit;                   NEXT;
+op_and:  acc &= *pc->bit;                   NEXT;
+op_andn: acc &= !*pc->bit;                  NEXT;
+op_or:   acc |= *pc->bit;                   NEXT;
+op_orn:  acc |= !*pc->bit;                  NEXT;
+op_not:  acc = !acc;                        NEXT;
+op_st:   *pc->bit = acc;                    NEXT;
+op_stn:  *pc->bit = !acc;                   NEXT;
+op_set:  if (acc) *pc->bit = 1;             NEXT;
+op_rst:  if (acc) *pc->bit = 0;             NEXT;
+op_push: stack[sp++] = acc;                 NEXT;
+op_andp: acc &= stack[--sp];                NEXT;
+op_orp:  acc |= stack[--sp];                NEXT;
+op_gt:   acc = *pc->reg > pc->arg;          NEXT;
+op_lt:   acc = *pc->reg < pc->arg;          NEXT;
+op_eq:   acc = *pc->reg == pc->arg;         NEXT;
+op_ton:
+    if (acc) {
+        if (*pc->elapsed < (uint32_t)pc->arg) {
+            *pc->elapsed += dt;
+        }
+        acc = *pc->elapsed >= (uint32_t)pc->arg;
+    } else {
+        *pc->elapsed = 0;
+    }
+    *pc->bit = acc;
+    NEXT;
+
+#undef NEXT
+
+op_end:
+    return;
+}
+
+/**
+ * Run one scan of the program
+ *
+ * @param inputs     bit n = digital input n
+ * @param outputs    relay image before the scan, bit n = relay n
+ * @param registers  PLC_REGISTERS sensor values
+ * @param dt         time since the previous scan in milliseconds
+ * @return relay image after the scan
+ */
+uint8_t PlcProgram::execute(uint8_t inputs, uint8_t outputs, const uint16_t* registers, uint32_t dt) {
+    if (_code == nullptr) {
+        return outputs;
+    }
+
+    for (uint8_t i = 0; i < PLC_INPUTS; i++) {
+        _bits[BIT_I + i] = (inputs >> i) & 1;
+    }
+    for (uint8_t i = 0; i < PLC_OUTPUTS; i++) {
+        _bits[BIT_Q + i] = (outputs >> i) & 1;
+    }
+    memcpy(_regs, registers, sizeof(_regs));
+
+    run(dt, false);
+
+    outputs = 0;
+    for (uint8_t i = 0; i < PLC_OUTPUTS; i++) {
+        outputs |= _bits[BIT_Q + i] << i;
+    }
+    return outputs;
+}
+
+/**
+ * Time a synthetic program of 1 + rungs * 8 instructions. Every rung loads
+ * an input, combines markers and a register comparison, runs a timer and
+ * stores a marker; the last rung drives a relay.
+ *
+ * @param rungs   number of rungs
+ * @param scans   number of scans to time
+ * @param result  [out]
+ */
+void PlcProgram::benchmark(uint16_t rungs, uint32_t scans, PlcBenchmark* result) {
+    uint16_t  count = rungs * 8 + 1;
+    size_t    len   = 6 + count * sizeof(PlcInstr);
+    uint8_t*  file  = new uint8_t[len];
+    PlcInstr* in    = (PlcInstr*)(file + 6);
+    uint16_t  regs[PLC_REGISTERS];
+
+    memcpy(file, PLC_MAGIC, 4);
+    memcpy(file + 4, &count, sizeof(count));
+    for (uint16_t r = 0; r < rungs; r++) {
+        *in++ = {PLC_LD,   PLC_AREA_I, (uint16_t)(r % PLC_INPUTS), 0};
+        *in++ = {PLC_AND,  PLC_AREA_M, (uint16_t)(r % PLC_MARKERS), 0};
+        *in++ = {PLC_ORN,  PLC_AREA_M, (uint16_t)((r + 1) % PLC_MARKERS), 0};
+        *in++ = {PLC_PUSH, PLC_AREA_NONE, 0, 0};
+        *in++ = {PLC_GT,   PLC_AREA_R, (uint16_t)(r % PLC_REGISTERS), 100};
+        *in++ = {PLC_ANDP, PLC_AREA_NONE, 0, 0};
+        *in++ = {PLC_TON,  PLC_AREA_T, (uint16_t)(r % PLC_TIMERS), 50};
+        if (r == rungs - 1) {
+            *in++ = {PLC_ST, PLC_AREA_Q, 0, 0};
+        } else {
+            *in++ = {PLC_ST, PLC_AREA_M, (uint16_t)((r + 2) % PLC_MARKERS), 0};
+        }
+    }
+    *in = {PLC_END, PLC_AREA_NONE, 0, 0};
+
+    PlcProgram program;
+    program.load(file, len);
+    delete[] file;
+
+    for (uint16_t i = 0; i < PLC_REGISTERS; i++) {
+        regs[i] = i * 7;
+    }
+
+    result->instructions = count;
+    result->scans        = scans;
+    result->total_nsec   = 0;
+    result->worst_nsec   = 0;
+
+    uint8_t outputs = 0;
+    for (uint32_t s = 0; s < scans; s++) {
+        int64_t start = timespec_now_to_nsec();
+        outputs = program.execute(s & 0xFF, outputs, regs, 10);
+        int64_t nsec = timespec_now_to_nsec() - start;
+
+        result->total_nsec += nsec;
+        if (nsec > result->worst_nsec) {
+            result->worst_nsec = nsec;
+        }
+    }
+}
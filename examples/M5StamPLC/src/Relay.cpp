@@ -5,6 +5,10 @@
 #include <Relay.hpp>
 #include <M5StamPLC.h>
 
+portMUX_TYPE Relay::_lock    = portMUX_INITIALIZER_UNLOCKED;
+uint8_t      Relay::_current = 0;
+uint8_t      Relay::_staged  = 0;
+
 // default relay
 Relay::Relay() {
     _id = 0;
@@ -24,7 +28,8 @@ Relay::Relay(uint8_t i, String n, String d) {
 
 // actions
 void Relay::switchOn() {
-    M5StamPLC.writePlcRelay(_id, true);
+    stage(true);
+    commit();
 }
 
 Relay::~Relay() {
@@ -32,17 +37,124 @@ Relay::~Relay() {
 }
 
 void Relay::switchOff() {
-    M5StamPLC.writePlcRelay(_id, false);
+    stage(false);
+    commit();
 }
 
 void Relay::toggle() {
-    isOn() ? switchOff() : switchOn();
+    stageToggle();
+    commit();
 }
 
 bool Relay::isOn() {
-    return M5StamPLC.readPlcRelay(_id);
+    return getState() & (1 << _id);
 }
 
 bool Relay::isOff() {
     return !isOn();
 }
+
+// staged actions
+void Relay::stage(bool on) {
+    portENTER_CRITICAL(&_lock);
+    _staged = on ? _staged | (1 << _id) : _staged & ~(1 << _id);
+    portEXIT_CRITICAL(&_lock);
+}
+
+void Relay::stageToggle() {
+    portENTER_CRITICAL(&_lock);
+    _staged ^= 1 << _id;
+    portEXIT_CRITICAL(&_lock);
+}
+
+/**
+ * Initialize the shadow register from the expander, call once after
+ * M5StamPLC.begin()
+ */
+void Relay::load() {
+    uint8_t states = 0;
+    for (uint8_t i = 0; i < RELAY_COUNT; i++) {
+        states |= M5StamPLC.readPlcRelay(i) << i;
+    }
+    portENTER_CRITICAL(&_lock);
+    _current = states;
+    _staged  = states;
+    portEXIT_CRITICAL(&_lock);
+}
+
+/**
+ * Stage a complete output image
+ *
+ * @param states  bit n = relay n
+ */
+void Relay::stageAll(uint8_t states) {
+    portENTER_CRITICAL(&_lock);
+    _staged = states & ((1 << RELAY_COUNT) - 1);
+    portEXIT_CRITICAL(&_lock);
+}
+
+/**
+ * Stage only some relays, the others keep what is staged for them
+ *
+ * @param states  bit n = relay n
+ * @param mask    relays to stage
+ */
+void Relay::stageMask(uint8_t states, uint8_t mask) {
+    portENTER_CRITICAL(&_lock);
+    _staged = (_staged & ~mask) | (states & mask & ((1 << RELAY_COUNT) - 1));
+    portEXIT_CRITICAL(&_lock);
+}
+
+uint8_t Relay::getStaged() {
+    portENTER_CRITICAL(&_lock);
+    uint8_t states = _staged;
+    portEXIT_CRITICAL(&_lock);
+    return states;
+}
+
+/**
+ * @return committed output image, bit n = relay n
+ */
+uint8_t Relay::getState() {
+    portENTER_CRITICAL(&_lock);
+    uint8_t states = _current;
+    portEXIT_CRITICAL(&_lock);
+    return states;
+}
+
+/**
+ * Serializes commits, the spinlock cannot be held during the I2C write
+ */
+SemaphoreHandle_t Relay::ioMutex() {
+    static StaticSemaphore_t buffer;
+    static SemaphoreHandle_t mutex = xSemaphoreCreateMutexStatic(&buffer);
+    return mutex;
+}
+
+/**
+ * Write the staged output image to the expander. Nothing is sent when no
+ * relay changed. The write and the update of the shadow register happen
+ * under one mutex, so concurrent commits reach the expander in the order
+ * of their shadow updates.
+ *
+ * @return true if the expander was written
+ */
+bool Relay::commit() {
+    xSemaphoreTake(ioMutex(), portMAX_DELAY);
+
+    portENTER_CRITICAL(&_lock);
+    uint8_t staged  = _staged;
+    bool    changed = staged != _current;
+    portEXIT_CRITICAL(&_lock);
+
+    if (changed) {
+        M5StamPLC.writePlcAllRelay(staged);
+
+        portENTER_CRITICAL(&_lock);
+        _current = staged;
+        portEXIT_CRITICAL(&_lock);
+    }
+
+    xSemaphoreGive(ioMutex());
+    return changed;
+}
@@ -0,0 +1,275 @@
+//
+// Double-buffered binary sample logger.
+//
+
+#include <string.h>
+#include "SampleLogger.hpp"
+#include "Timespec.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_pthread.h>
+#endif
+
+SampleLogger::SampleLogger(LogSink* sink) {
+    _sink            = sink;
+    _active          = 0;
+    _filled          = 0;
+    _block           = nullptr;
+    _flushing        = false;
+    _flush_blocks    = 0;
+    _flush_requested = false;
+    _swaps           = 0;
+    _written         = 0;
+    _seq             = 0;
+    _indexed         = 0;
+    _running         = false;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+SampleLogger::~SampleLogger() {
+    end();
+}
+
+/**
+ * Start the flush thread
+ */
+void SampleLogger::begin() {
+    resume();
+#ifdef ESP_PLATFORM
+    esp_pthread_cfg_t cfg = esp_pthread_get_default_config();
+    cfg.stack_size  = LOG_TASK_STACK;
+    cfg.prio        = LOG_TASK_PRIORITY;
+    cfg.thread_name = "logger";
+    esp_pthread_set_cfg(&cfg);
+#endif
+    _running = true;
+    _thread  = std::thread(&SampleLogger::run, this);
+}
+
+/**
+ * Continue the block numbering of the sink content. The base times of the
+ * data blocks after the last index block are read back, so the next index
+ * block lands where the reader expects it. A padded block of a power loss
+ * repeats the previous time.
+ */
+void SampleLogger::resume() {
+    uint64_t blocks = _sink->size() / LOG_SECTOR;
+    int64_t  base   = 0;
+
+    _seq     = blocks;
+    _indexed = blocks % (LOG_INDEX_INTERVAL + 1);
+    for (uint16_t i = 0; i < _indexed; i++) {
+        LogBlockHeader header;
+        if (_sink->read((blocks - _indexed + i) * LOG_SECTOR, (uint8_t*)&header, sizeof(header))
+            && header.magic == LOG_MAGIC && header.type == LOG_BLOCK_DATA) {
+            base = header.base_ms;
+        }
+        _index[i] = base;
+    }
+}
+
+/**
+ * Write everything logged so far and stop the flush thread
+ */
+void SampleLogger::end() {
+    if (!_running) {
+        return;
+    }
+    flush();
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _running = false;
+    }
+    _wake.notify_one();
+    _thread.join();
+}
+
+/**
+ * Append a record, called from any task
+ *
+ * @param point    registry point
+ * @param value
+ * @param quality  PointQuality
+ * @param time_ms
+ * @return false if the record was dropped
+ */
+bool SampleLogger::log(uint16_t point, int32_t value, uint8_t quality, int64_t time_ms) {
+    std::lock_guard<std::mutex> guard(_lock);
+
+    // records must fit the 32 bit offset from the base time of their block
+    if (_block != nullptr && (_block->count == LOG_RECORDS_PER_BLOCK || time_ms < _block->base_ms
+                              || time_ms - _block->base_ms > UINT32_MAX)) {
+        closeBlock();
+    }
+    if (_block == nullptr && !openBlock(time_ms)) {
+        _stats.dropped++;
+        return false;
+    }
+
+    LogRecord* record = (LogRecord*)((uint8_t*)(_block + 1) + _block->count * sizeof(LogRecord));
+    record->offset_ms = time_ms - _block->base_ms;
+    record->point     = point;
+    record->quality   = quality;
+    record->reserved  = 0;
+    record->value     = value;
+    _block->count++;
+    _stats.records++;
+    return true;
+}
+
+bool SampleLogger::openBlock(int64_t time) {
+    if (_filled == LOG_BUFFER_BLOCKS) {
+        if (_flushing) {
+            return false;
+        }
+        swap();
+    }
+    _block = (LogBlockHeader*)&_buffers[_active][_filled * LOG_SECTOR];
+    memset(_block, 0, LOG_SECTOR);
+    _block->magic   = LOG_MAGIC;
+    _block->type    = LOG_BLOCK_DATA;
+    _block->base_ms = time;
+    return true;
+}
+
+void SampleLogger::closeBlock() {
+    _block = nullptr;
+    _filled++;
+}
+
+/**
+ * Hand the active buffer to the flush thread, the lock is held and the other
+ * buffer is free
+ */
+void SampleLogger::swap() {
+    _flush_blocks = _filled;
+    _flushing     = true;
+    _active ^= 1;
+    _filled       = 0;
+    _swaps++;
+    _wake.notify_one();
+}
+
+void SampleLogger::run() {
+    std::unique_lock<std::mutex> lock(_lock);
+    while (_running) {
+        _wake.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL), [this]() {
+            return _flushing || _flush_requested || !_running;
+        });
+        if (!_flushing) {
+            // timeout or flush(): write the partially filled buffer
+            _flush_requested = false;
+            if (_block != nullptr) {
+                closeBlock();
+            }
+            if (_filled == 0) {
+                _done.notify_all();
+                continue;
+            }
+            swap();
+        }
+
+        uint8_t* buffer = _buffers[_active ^ 1];
+        uint16_t count  = _flush_blocks;
+        uint32_t swaps  = _swaps;
+        lock.unlock();
+        writeBlocks(buffer, count);
+        lock.lock();
+
+        _flushing = false;
+        _written  = swaps;
+        _done.notify_all();
+    }
+}
+
+/**
+ * Write the closed blocks of a buffer, inserting index blocks. Runs in the
+ * flush thread without the lock, log() only touches the other buffer.
+ */
+void SampleLogger::writeBlocks(uint8_t* buffer, uint16_t count) {
+    int64_t  start  = timespec_now_to_usec();
+    uint16_t first  = 0;
+    bool     ok     = true;
+    uint32_t blocks = 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        LogBlockHeader* block = (LogBlockHeader*)&buffer[i * LOG_SECTOR];
+        block->seq = _seq++;
+        _index[_indexed++] = block->base_ms;
+
+        if (_indexed == LOG_INDEX_INTERVAL) {
+            ok &= _sink->write(&buffer[first * LOG_SECTOR], (i + 1 - first) * LOG_SECTOR);
+            ok &= writeIndex();
+            blocks += i + 2 - first;
+            first = i + 1;
+        }
+    }
+    if (first < count) {
+        ok &= _sink->write(&buffer[first * LOG_SECTOR], (count - first) * LOG_SECTOR);
+        blocks += count - first;
+    }
+    ok &= _sink->sync();
+
+    uint32_t usec = timespec_now_to_usec() - start;
+
+    std::lock_guard<std::mutex> guard(_lock);
+    _stats.flushes++;
+    _stats.blocks += blocks;
+    _stats.bytes += (uint64_t)blocks * LOG_SECTOR;
+    _stats.flush_usec += usec;
+    if (usec > _stats.max_flush_usec) {
+        _stats.max_flush_usec = usec;
+    }
+    if (!ok) {
+        _stats.errors++;
+    }
+}
+
+bool SampleLogger::writeIndex() {
+    uint8_t         block[LOG_SECTOR] __attribute__((aligned(4)));
+    LogBlockHeader* header = (LogBlockHeader*)block;
+
+    memset(block, 0, sizeof(block));
+    header->magic   = LOG_MAGIC;
+    header->type    = LOG_BLOCK_INDEX;
+    header->count   = _indexed;
+    header->seq     = _seq++;
+    header->base_ms = _index[0];
+    memcpy(header + 1, _index, _indexed * sizeof(int64_t));
+    _indexed = 0;
+    return _sink->write(block, LOG_SECTOR);
+}
+
+/**
+ * Write all records logged so far and wait until they are on the card.
+ * Records logged by other tasks meanwhile are not waited for: the records of
+ * the call are in the buffer being written and in the active buffer, which
+ * the flush thread hands over next, so the wait ends once that buffer is
+ * written even if log() keeps filling the buffers.
+ */
+void SampleLogger::flush() {
+    std::unique_lock<std::mutex> lock(_lock);
+    if (!_running) {
+        return;
+    }
+    uint32_t target = _swaps + (_block != nullptr || _filled > 0 ? 1 : 0);
+    if (_written == target) {
+        return;
+    }
+    _flush_requested = true;
+    _wake.notify_one();
+    _done.wait(lock, [this, target]() { return (int32_t)(_written - target) >= 0 || !_running; });
+}
+
+/**
+ * @param stats  [out] sustained write rate is bytes / flush_usec
+ */
+void SampleLogger::getStats(LogStats* stats) {
+    std::lock_guard<std::mutex> guard(_lock);
+    *stats = _stats;
+}
+
+void SampleLogger::resetStats() {
+    std::lock_guard<std::mutex> guard(_lock);
+    memset(&_stats, 0, sizeof(_stats));
+}
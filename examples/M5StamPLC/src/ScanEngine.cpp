@@ -0,0 +1,153 @@
+//
+// Fixed-cycle PLC scan: inputs -> user logic -> outputs.
+//
+// Every cycle the scan task reads the digital inputs into the process image,
+// merges the latest sensor values and Modbus coil writes, runs the user logic
+// and commits the output image to the relays in one transaction. Between
+// cycles the task is blocked in vTaskDelayUntil(), so the core is idle.
+//
+
+#include <ScanEngine.hpp>
+#include <M5StamPLC.h>
+#include "Timespec.h"
+
+/**
+ * @param shadow  image shared with the Modbus server and the sensors
+ * @param cycle   scan cycle in milliseconds
+ */
+ScanEngine::ScanEngine(ShadowImage* shadow, uint32_t cycle) {
+    _shadow  = shadow;
+    _capture = nullptr;
+    _cycle   = cycle;
+    _task    = nullptr;
+    memset(&_image, 0, sizeof(_image));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Start the scan task
+ *
+ * @param logic  user logic, called once per cycle
+ * @param core   core of the scan task
+ */
+void ScanEngine::begin(ScanLogic logic, int core) {
+    _logic = logic;
+    xTaskCreatePinnedToCore(scanTask, "scan", SCAN_TASK_STACK, this, SCAN_TASK_PRIORITY, &_task, core);
+}
+
+void ScanEngine::end() {
+    if (_task != nullptr) {
+        vTaskDelete(_task);
+        _task = nullptr;
+    }
+}
+
+/**
+ * Take the inputs from the debounced image of an InputCapture instead of
+ * reading the expander in every scan
+ *
+ * @param capture
+ */
+void ScanEngine::setInputCapture(InputCapture* capture) {
+    _capture = capture;
+}
+
+uint8_t ScanEngine::readInputs() {
+    if (_capture != nullptr) {
+        return _capture->getInputs();
+    }
+
+    uint8_t inputs = 0;
+    for (uint8_t i = 0; i < SHADOW_DISCRETE_INPUTS; i++) {
+        inputs |= M5StamPLC.readPlcInput(i) << i;
+    }
+    return inputs;
+}
+
+void ScanEngine::scan() {
+    // input image, async values and outputs requested by Modbus masters
+    uint8_t staged = Relay::getStaged();
+    _image.inputs  = readInputs();
+    _image.outputs = staged;
+    _shadow->getRegisters(0, _image.registers, SHADOW_INPUT_REGISTERS);
+
+    if (_logic) {
+        _logic(_image);
+    }
+
+    // output image, only the relays changed by the logic: a coil write staged
+    // by a master during the logic has been acknowledged and must survive
+    Relay::stageMask(_image.outputs, _image.outputs ^ staged);
+    Relay::commit();
+
+    _shadow->setInputs(_image.inputs);
+    _shadow->setCoils(Relay::getState());
+    _image.scan++;
+}
+
+void ScanEngine::account(int64_t start, int64_t scheduled, int64_t end) {
+    uint32_t usec   = end - start;
+    int64_t  jitter = start - scheduled;
+    if (jitter < 0) {
+        jitter = -jitter;
+    }
+
+    portENTER_CRITICAL(&_lock);
+    _stats.scans++;
+    _stats.last_usec = usec;
+    _stats.sum_usec += usec;
+    if (usec > _stats.max_usec) {
+        _stats.max_usec = usec;
+    }
+    if (jitter > _stats.jitter_usec) {
+        _stats.jitter_usec = jitter;
+    }
+    if (usec > _cycle * USEC_PER_MILLISEC) {
+        _stats.overruns++;
+    }
+    portEXIT_CRITICAL(&_lock);
+}
+
+void ScanEngine::scanTask(void* arg) {
+    ScanEngine* engine    = (ScanEngine*)arg;
+    TickType_t  wake      = xTaskGetTickCount();
+    TickType_t  period    = pdMS_TO_TICKS(engine->_cycle);
+    int64_t     scheduled = timespec_now_to_usec();
+
+    for (;;) {
+        int64_t start = timespec_now_to_usec();
+        engine->scan();
+        engine->account(start, scheduled, timespec_now_to_usec());
+
+        // an overrun restarts the schedule instead of running late scans back to back
+        if (xTaskDelayUntil(&wake, period) == pdFALSE) {
+            wake      = xTaskGetTickCount();
+            scheduled = timespec_now_to_usec();
+        } else {
+            scheduled += engine->_cycle * USEC_PER_MILLISEC;
+        }
+    }
+}
+
+uint32_t ScanEngine::getCycle() {
+    return _cycle;
+}
+
+/**
+ * @return the scan task, nullptr before begin()
+ */
+TaskHandle_t ScanEngine::getTask() {
+    return _task;
+}
+
+void ScanEngine::getStats(ScanStats* stats) {
+    portENTER_CRITICAL(&_lock);
+    *stats = _stats;
+    portEXIT_CRITICAL(&_lock);
+}
+
+void ScanEngine::resetStats() {
+    portENTER_CRITICAL(&_lock);
+    memset(&_stats, 0, sizeof(_stats));
+    portEXIT_CRITICAL(&_lock);
+}
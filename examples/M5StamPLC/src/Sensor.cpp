@@ -4,8 +4,9 @@
 
 #include <M5Modbus.hpp>
 #include <Sensor.hpp>
+#include <ShadowImage.hpp>
+#include "HeapGuard.hpp"
 #include "Timespec.h"
-#include <thread>
 
 void print_now() {
     struct timespec ts;
@@ -15,34 +16,39 @@ void print_now() {
     Serial.printf("%s\n", str);
 }
 
-Sensor::Sensor(uint8_t id, M5Modbus* modbus, uint8_t addr, String name, String description) {
+/**
+ * @param id           request token and shadow image slot
+ * @param modbus
+ * @param addr         Modbus address
+ * @param name         "S-<id>" if empty
+ * @param description  "Sensor #<id>" if empty
+ */
+Sensor::Sensor(uint8_t id, M5Modbus* modbus, uint8_t addr, const char* name, const char* description) {
     _id = id;
-    if (name.length() == 0) {
-        name = "S-" + String(_id);
-    }
-    if (description.length() == 0) {
-        description = "Sensor #" + String(_id);
-    }
-    _name           = name;
-    _description    = description;
+    setName(name);
+    setDescription(description);
     _modbus_address = addr;
     _modbus         = modbus;
     _temperature    = 0;
     _humidity       = 0;
+    _image          = nullptr;
+    _registry       = nullptr;
 
-    _last_poll_time = timespec_now_to_msec();
+    _temperature_point = POINT_INVALID;
+    _humidity_point    = POINT_INVALID;
 }
 
-void Sensor::poll() {
-    int64_t now = timespec_now_to_msec();
-    if (_last_poll_time + POLL_INTERVAL <= now) {
-        std::thread t(&Sensor::doPoll, this);
-        t.detach();
-        Serial.printf("Polling sensor %s\n", getDescription().c_str());
-        Serial.printf("  Temperature: %3.1f\n", getTemperatureF());
-        Serial.printf("  Humidity: %3.1f\n", getHumidityF());
-        _last_poll_time = timespec_now_to_msec();
-    }
+/**
+ * Queue a read of the sensor values, the response is delivered to
+ * handleData() or handleError() by the Modbus worker task. Called every
+ * POLL_INTERVAL by the event loop.
+ *
+ * @return false if the request queue of the client is full
+ */
+bool Sensor::poll() {
+    // eModbus keeps requests on the heap
+    HeapAllow allow;
+    return _modbus->addRequest(createModbusMessage(), _id) == SUCCESS;
 }
 
 uint16_t Sensor::getHumidity() {
@@ -53,10 +59,35 @@ int16_t Sensor::getTemperature() {
     return _temperature;
 }
 
-void Sensor::doPoll() {
-    ModbusMessage req = createModbusMessage();
-    ModbusMessage rsp = _modbus->syncRequest(req, _id);
-    parseModbusMessage(rsp);
+/**
+ * @param rsp
+ * @param token  token of the request
+ * @param time   time of the response in milliseconds, the recorded one on replay
+ * @return false if the response belongs to another request
+ */
+bool Sensor::handleData(const ModbusMessage& rsp, uint32_t token, int64_t time) {
+    if (token != _id) {
+        return false;
+    }
+    parseModbusMessage(rsp, time);
+    return true;
+}
+
+/**
+ * @param error
+ * @param token  token of the request
+ * @param time   time of the error in milliseconds
+ * @return false if the error belongs to another request
+ */
+bool Sensor::handleError(Error error, uint32_t token, int64_t time) {
+    if (token != _id) {
+        return false;
+    }
+    if (_registry != nullptr) {
+        _registry->setQuality(_temperature_point, QUALITY_BAD, time);
+        _registry->setQuality(_humidity_point, QUALITY_BAD, time);
+    }
+    return true;
 }
 
 float Sensor::getHumidityF() {
@@ -67,6 +98,14 @@ float Sensor::getTemperatureF() {
     return _temperature / 10.0f;
 }
 
+PointHandle Sensor::getTemperaturePoint() {
+    return _temperature_point;
+}
+
+PointHandle Sensor::getHumidityPoint() {
+    return _humidity_point;
+}
+
 void Sensor::setId(uint8_t id) {
     _id = id;
 }
@@ -75,8 +114,12 @@ uint8_t Sensor::getId() {
     return _id;
 }
 
-void Sensor::setName(String name) {
-    _name = name;
+void Sensor::setName(const char* name) {
+    if (name == nullptr || name[0] == '\0') {
+        snprintf(_name, sizeof(_name), "S-%u", _id);
+    } else {
+        snprintf(_name, sizeof(_name), "%s", name);
+    }
 }
 
 void Sensor::setHumidity(uint16_t humidity) {
@@ -87,21 +130,19 @@ void Sensor::setTemperature(int16_t temperature) {
     _temperature = temperature;
 }
 
-String Sensor::getName() {
-    if (_name.length() == 0) {
-        return "S-" + String(_id);
-    }
+const char* Sensor::getName() {
     return _name;
 }
 
-void Sensor::setDescription(String description) {
-    _description = description;
+void Sensor::setDescription(const char* description) {
+    if (description == nullptr || description[0] == '\0') {
+        snprintf(_description, sizeof(_description), "Sensor #%u", _id);
+    } else {
+        snprintf(_description, sizeof(_description), "%s", description);
+    }
 }
 
-String Sensor::getDescription() {
-    if (_description.length() == 0) {
-        return "Sensor #" + String(_id);
-    }
+const char* Sensor::getDescription() {
     return _description;
 }
 
@@ -117,7 +158,46 @@ ModbusMessage Sensor::createModbusMessage() {
     return ModbusMessage( _modbus_address, READ_HOLD_REGISTER, 0x0000, 0x02);
 }
 
-void Sensor::parseModbusMessage(ModbusMessage msg) {
+void Sensor::parseModbusMessage(const ModbusMessage& msg, int64_t time) {
     msg.get(3, _humidity);
     msg.get(5, _temperature);
+
+    if (_image != nullptr) {
+        uint16_t values[SHADOW_REGISTERS_PER_SENSOR] = {(uint16_t)_temperature, _humidity};
+        _image->setRegisters(_id * SHADOW_REGISTERS_PER_SENSOR, values, SHADOW_REGISTERS_PER_SENSOR);
+    }
+
+    if (_registry != nullptr) {
+        _registry->update(_temperature_point, _temperature, time);
+        _registry->update(_humidity_point, _humidity, time);
+    }
+}
+
+/**
+ * Publish every parsed value into the shadow image, starting at input
+ * register id * SHADOW_REGISTERS_PER_SENSOR
+ *
+ * @param image
+ */
+void Sensor::setShadowImage(ShadowImage* image) {
+    _image = image;
+}
+
+/**
+ * Register the sensor values as points "<name>.T" and "<name>.H" (tenths)
+ * and publish every parsed value into the registry
+ *
+ * @param registry
+ */
+void Sensor::setRegistry(SensorRegistry* registry) {
+    char name[SENSOR_NAME_MAX + 2];
+    char desc[SENSOR_DESCRIPTION_MAX + 12];
+
+    _registry = registry;
+    snprintf(name, sizeof(name), "%s.T", _name);
+    snprintf(desc, sizeof(desc), "%s temperature", _description);
+    _temperature_point = registry->add(name, desc, _modbus_address, 10);
+    snprintf(name, sizeof(name), "%s.H", _name);
+    snprintf(desc, sizeof(desc), "%s humidity", _description);
+    _humidity_point = registry->add(name, desc, _modbus_address, 10);
 }
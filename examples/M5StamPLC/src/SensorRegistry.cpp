@@ -0,0 +1,213 @@
+//
+// Registry of sensor points with struct-of-arrays storage.
+//
+
+#include <SensorRegistry.hpp>
+#include "Timespec.h"
+
+SensorRegistry::SensorRegistry() {
+    _pool_used = 1;     // offset 0 is the empty string
+    _pool[0]   = '\0';
+    _count     = 0;
+}
+
+/**
+ * Store a string once, equal strings share their storage
+ *
+ * @return offset in the pool, 0 (empty string) if the pool is full
+ */
+uint16_t SensorRegistry::intern(const char* str) {
+    if (str == nullptr || *str == '\0') {
+        return 0;
+    }
+
+    for (uint16_t offset = 1; offset < _pool_used; offset += strlen(&_pool[offset]) + 1) {
+        if (strcmp(&_pool[offset], str) == 0) {
+            return offset;
+        }
+    }
+
+    size_t len = strlen(str) + 1;
+    if (_pool_used + len > REGISTRY_NAME_POOL) {
+        return 0;
+    }
+    uint16_t offset = _pool_used;
+    memcpy(&_pool[offset], str, len);
+    _pool_used += len;
+    return offset;
+}
+
+/**
+ * Register a point, call during setup
+ *
+ * @param name         unique short name
+ * @param description
+ * @param address      Modbus address of the device, 0 if not on the bus
+ * @param scale        value / scale is the engineering unit, e.g. 10 for tenths
+ * @return handle, POINT_INVALID if the registry is full
+ */
+PointHandle SensorRegistry::add(const char* name, const char* description, uint8_t address, uint16_t scale) {
+    if (_count >= REGISTRY_MAX_POINTS) {
+        return POINT_INVALID;
+    }
+
+    PointHandle point = _count;
+    _name[point]        = intern(name);
+    _description[point] = intern(description);
+    _address[point]     = address;
+    _scale[point]       = scale ? scale : 1;
+    _filter[point]      = nullptr;
+    _value[point]       = 0;
+    _time[point]        = 0;
+    _quality[point]     = QUALITY_NONE;
+    _count++;
+    return point;
+}
+
+PointHandle SensorRegistry::find(const char* name) {
+    for (PointHandle point = 0; point < _count; point++) {
+        if (strcmp(&_pool[_name[point]], name) == 0) {
+            return point;
+        }
+    }
+    return POINT_INVALID;
+}
+
+uint16_t SensorRegistry::size() {
+    return _count;
+}
+
+const char* SensorRegistry::getName(PointHandle point) {
+    return point < _count ? &_pool[_name[point]] : "";
+}
+
+const char* SensorRegistry::getDescription(PointHandle point) {
+    return point < _count ? &_pool[_description[point]] : "";
+}
+
+uint8_t SensorRegistry::getAddress(PointHandle point) {
+    return point < _count ? _address[point] : 0;
+}
+
+uint16_t SensorRegistry::getScale(PointHandle point) {
+    return point < _count ? _scale[point] : 1;
+}
+
+/**
+ * Filter the values of a point before they are stored, call during setup.
+ * The filter keeps the history of the point, so every point needs its own.
+ *
+ * @param point
+ * @param filter  nullptr stores the raw values
+ */
+void SensorRegistry::setFilter(PointHandle point, SensorFilter* filter) {
+    if (point < _count) {
+        _filter[point] = filter;
+    }
+}
+
+/**
+ * Store a new good value
+ *
+ * @param point
+ * @param value  raw value, passed through the filter of the point if any
+ * @param time   sample time in milliseconds
+ */
+void SensorRegistry::update(PointHandle point, int32_t value, int64_t time) {
+    if (point >= _count) {
+        return;
+    }
+    // a point has a single writer, the filter needs no lock
+    if (_filter[point] != nullptr) {
+        value = _filter[point]->update(value);
+    }
+    portENTER_CRITICAL(&_lock);
+    _seq.fetch_add(1, std::memory_order_acq_rel);
+    _value[point]   = value;
+    _time[point]    = time;
+    _quality[point] = QUALITY_GOOD;
+    _seq.fetch_add(1, std::memory_order_release);
+    portEXIT_CRITICAL(&_lock);
+
+    if (_update_handler) {
+        _update_handler(point, value, QUALITY_GOOD, time);
+    }
+}
+
+/**
+ * Change the quality, the value keeps its sample time. A bad quality resets
+ * the filter of the point, the first value after an outage is not compared
+ * with the history from before it.
+ *
+ * @param point
+ * @param quality
+ * @param time     time of the change in milliseconds, passed to the update handler
+ */
+void SensorRegistry::setQuality(PointHandle point, PointQuality quality, int64_t time) {
+    if (point >= _count) {
+        return;
+    }
+    if (quality == QUALITY_BAD && _filter[point] != nullptr) {
+        _filter[point]->reset();
+    }
+    portENTER_CRITICAL(&_lock);
+    _seq.fetch_add(1, std::memory_order_acq_rel);
+    _quality[point] = quality;
+    int32_t value   = _value[point];
+    _seq.fetch_add(1, std::memory_order_release);
+    portEXIT_CRITICAL(&_lock);
+
+    if (_update_handler) {
+        _update_handler(point, value, quality, time);
+    }
+}
+
+int32_t SensorRegistry::getValue(PointHandle point) {
+    return point < _count ? _value[point] : 0;
+}
+
+PointQuality SensorRegistry::getQuality(PointHandle point) {
+    return point < _count ? _quality[point] : QUALITY_NONE;
+}
+
+/**
+ * Copy the values of a range of points, consistent across the whole range
+ *
+ * @param first  first point
+ * @param count  number of points
+ * @param out    [out] count snapshots
+ * @return number of points copied
+ */
+uint16_t SensorRegistry::snapshot(PointHandle first, uint16_t count, PointSnapshot* out) {
+    if (first >= _count) {
+        return 0;
+    }
+    if (count > _count - first) {
+        count = _count - first;
+    }
+
+    uint32_t seq;
+    do {
+        // an odd sequence means a write is in progress
+        while ((seq = _seq.load(std::memory_order_acquire)) & 1) {
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            out[i].value   = _value[first + i];
+            out[i].time    = _time[first + i];
+            out[i].quality = _quality[first + i];
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while (_seq.load(std::memory_order_relaxed) != seq);
+
+    return count;
+}
+
+/**
+ * Forward every update, e.g. to a logger. Set during setup, before the poll
+ * paths start.
+ *
+ * @param handler  runs in the task of the writer
+ */
+void SensorRegistry::onUpdate(PointUpdateHandler handler) {
+    _update_handler = handler;
+}
@@ -0,0 +1,322 @@
+//
+// Gorilla-style compression of (timestamp, value) series.
+//
+
+#include <string.h>
+#include "SeriesCodec.hpp"
+#include "Timespec.h"
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/**
+ * @param block     output buffer
+ * @param capacity  at least SERIES_HEADER bytes, 64..256 is a good block size
+ */
+SeriesEncoder::SeriesEncoder(uint8_t* block, size_t capacity) {
+    _block    = block;
+    _capacity = capacity;
+    reset();
+}
+
+/**
+ * Start a new block in the same buffer
+ */
+void SeriesEncoder::reset() {
+    _pos   = SERIES_HEADER;
+    _acc   = 0;
+    _bits  = 0;
+    _count = 0;
+    _time  = 0;
+    _delta = 0;
+    _value = 0;
+}
+
+/**
+ * @param bits   value in the low count bits
+ * @param count  1..64
+ */
+void SeriesEncoder::writeBits(uint64_t bits, uint8_t count) {
+    if (count > 32) {
+        writeBits(bits >> 32, count - 32);
+        count = 32;
+    }
+    _acc   = (_acc << count) | (bits & ((1ULL << count) - 1));
+    _bits += count;
+    while (_bits >= 8) {
+        _bits -= 8;
+        _block[_pos++] = _acc >> _bits;
+    }
+}
+
+/**
+ * Add a sample, times must not decrease
+ *
+ * @return false if the block is full, finish() it and start a new one
+ */
+bool SeriesEncoder::append(int64_t time, int32_t value) {
+    if (_count == UINT16_MAX || _pos + SERIES_MAX_SAMPLE + 1 > _capacity) {
+        return false;
+    }
+
+    if (_count == 0) {
+        memcpy(_block + 2, &time, sizeof(time));
+        memcpy(_block + 10, &value, sizeof(value));
+    } else {
+        // wraps like the decoder, any int64 times round trip
+        int64_t delta = (uint64_t)time - (uint64_t)_time;
+        if (_count == 1) {
+            int32_t first = delta >= INT32_MIN && delta <= INT32_MAX ? delta : 0;
+            memcpy(_block + 14, &first, sizeof(first));
+            _delta = first;
+        }
+        uint64_t dod = zigzag((uint64_t)delta - (uint64_t)_delta);
+        if (dod == 0) {
+            writeBits(0x0, 1);
+        } else if (dod < (1 << 7)) {
+            writeBits(0x2, 2);
+            writeBits(dod, 7);
+        } else if (dod < (1 << 9)) {
+            writeBits(0x6, 3);
+            writeBits(dod, 9);
+        } else if (dod < (1 << 12)) {
+            writeBits(0xE, 4);
+            writeBits(dod, 12);
+        } else {
+            writeBits(0xF, 4);
+            writeBits(dod, 64);
+        }
+        _delta = delta;
+
+        // wraps like the int32 arithmetic of the decoder
+        uint32_t diff = zigzag((int32_t)((uint32_t)value - (uint32_t)_value));
+        if (diff == 0) {
+            writeBits(0x0, 1);
+        } else if (diff < (1 << 4)) {
+            writeBits(0x2, 2);
+            writeBits(diff, 4);
+        } else if (diff < (1 << 8)) {
+            writeBits(0x6, 3);
+            writeBits(diff, 8);
+        } else if (diff < (1 << 12)) {
+            writeBits(0xE, 4);
+            writeBits(diff, 12);
+        } else {
+            writeBits(0xF, 4);
+            writeBits(diff, 32);
+        }
+    }
+
+    _time  = time;
+    _value = value;
+    _count++;
+    return true;
+}
+
+/**
+ * Write the header and pad the last byte
+ *
+ * @return block length in bytes
+ */
+size_t SeriesEncoder::finish() {
+    memcpy(_block, &_count, sizeof(_count));
+    return size();
+}
+
+uint16_t SeriesEncoder::count() {
+    return _count;
+}
+
+/**
+ * @return current block length, the last partial byte included
+ */
+size_t SeriesEncoder::size() {
+    if (_bits > 0) {
+        // keep the pending bits in the accumulator, append() continues after them
+        _block[_pos] = _acc << (8 - _bits);
+        return _pos + 1;
+    }
+    return _pos;
+}
+
+/**
+ * @param block  block written by SeriesEncoder
+ * @param len    block length
+ */
+SeriesDecoder::SeriesDecoder(const uint8_t* block, size_t len) {
+    _block = block;
+    _len   = len;
+    _pos   = SERIES_HEADER;
+    _acc   = 0;
+    _bits  = 0;
+    _count = 0;
+    _read  = 0;
+    _time  = 0;
+    _delta = 0;
+    _value = 0;
+    if (len >= SERIES_HEADER) {
+        memcpy(&_count, block, sizeof(_count));
+    }
+}
+
+uint16_t SeriesDecoder::count() {
+    return _count;
+}
+
+/**
+ * @param count  1..64
+ */
+uint64_t SeriesDecoder::readBits(uint8_t count) {
+    if (count > 32) {
+        uint64_t high = readBits(count - 32);
+        return (high << 32) | readBits(32);
+    }
+    while (_bits < count) {
+        // a truncated block reads as zeros, next() drops the sample
+        _acc   = (_acc << 8) | (_pos < _len ? _block[_pos] : 0);
+        _pos++;
+        _bits += 8;
+    }
+    _bits -= count;
+    return (_acc >> _bits) & ((1ULL << count) - 1);
+}
+
+/**
+ * @param time   [out]
+ * @param value  [out]
+ * @return false after the last sample
+ */
+bool SeriesDecoder::next(int64_t* time, int32_t* value) {
+    if (_read == _count) {
+        return false;
+    }
+
+    if (_read == 0) {
+        memcpy(&_time, _block + 2, sizeof(_time));
+        memcpy(&_value, _block + 10, sizeof(_value));
+    } else {
+        if (_read == 1) {
+            int32_t first;
+            memcpy(&first, _block + 14, sizeof(first));
+            _delta = first;
+        }
+        uint64_t dod = 0;
+        if (readBits(1) == 0) {
+            dod = 0;
+        } else if (readBits(1) == 0) {
+            dod = readBits(7);
+        } else if (readBits(1) == 0) {
+            dod = readBits(9);
+        } else if (readBits(1) == 0) {
+            dod = readBits(12);
+        } else {
+            dod = readBits(64);
+        }
+        _delta = (uint64_t)_delta + (uint64_t)unzigzag(dod);
+        _time  = (uint64_t)_time + (uint64_t)_delta;
+
+        uint32_t diff = 0;
+        if (readBits(1) == 0) {
+            diff = 0;
+        } else if (readBits(1) == 0) {
+            diff = readBits(4);
+        } else if (readBits(1) == 0) {
+            diff = readBits(8);
+        } else if (readBits(1) == 0) {
+            diff = readBits(12);
+        } else {
+            diff = readBits(32);
+        }
+        _value = (uint32_t)_value + (uint32_t)(int32_t)unzigzag(diff);
+
+        // the sample runs past the end of a truncated block
+        if (_pos > _len) {
+            _read = _count;
+            return false;
+        }
+    }
+
+    *time  = _time;
+    *value = _value;
+    _read++;
+    return true;
+}
+
+/**
+ * Compression ratio and speed on a synthetic sensor series: a sample every
+ * 5 s with up to +-3 ms jitter and a slow random walk of the value in tenths
+ *
+ * @param samples
+ * @param block_size  bytes per block
+ * @param result      [out]
+ */
+void SeriesEncoder::benchmark(uint32_t samples, size_t block_size, SeriesBenchmark* result) {
+    int64_t* times  = new int64_t[samples];
+    int32_t* values = new int32_t[samples];
+    uint8_t* blocks = new uint8_t[(size_t)samples * SERIES_MAX_SAMPLE + block_size];
+    size_t*  ends   = new size_t[samples + 1];
+    uint32_t seed   = 0x12345678;
+    int64_t  time   = 1760000000000LL;
+    int32_t  value  = 215;
+
+    for (uint32_t i = 0; i < samples; i++) {
+        seed = seed * 1103515245 + 12345;
+        time += 5000 + (int32_t)((seed >> 16) % 7) - 3;
+        seed = seed * 1103515245 + 12345;
+        // mostly unchanged, sometimes +-1, rarely +-2
+        uint32_t r = (seed >> 16) % 16;
+        value += r < 10 ? 0 : r < 13 ? 1 : r < 15 ? -1 : (r & 1 ? 2 : -2);
+        times[i]  = time;
+        values[i] = value;
+    }
+
+    // encode
+    uint32_t nblocks = 0;
+    size_t   total   = 0;
+    int64_t  start   = timespec_now_to_nsec();
+    SeriesEncoder encoder(blocks, block_size);
+    for (uint32_t i = 0; i < samples; i++) {
+        if (!encoder.append(times[i], values[i])) {
+            total += encoder.finish();
+            ends[nblocks++] = total;
+            encoder = SeriesEncoder(blocks + total, block_size);
+            encoder.append(times[i], values[i]);
+        }
+    }
+    total += encoder.finish();
+    ends[nblocks++] = total;
+    result->encode_nsec = timespec_now_to_nsec() - start;
+
+    // decode and verify
+    uint32_t decoded = 0;
+    size_t   begin   = 0;
+    start = timespec_now_to_nsec();
+    for (uint32_t b = 0; b < nblocks; b++) {
+        SeriesDecoder decoder(blocks + begin, ends[b] - begin);
+        int64_t t;
+        int32_t v;
+        while (decoder.next(&t, &v)) {
+            if (t != times[decoded] || v != values[decoded]) {
+                break;
+            }
+            decoded++;
+        }
+        begin = ends[b];
+    }
+    result->decode_nsec = timespec_now_to_nsec() - start;
+
+    result->samples          = decoded;
+    result->blocks           = nblocks;
+    result->raw_bytes        = (size_t)samples * (sizeof(int64_t) + sizeof(int32_t));
+    result->compressed_bytes = total;
+
+    delete[] times;
+    delete[] values;
+    delete[] blocks;
+    delete[] ends;
+}
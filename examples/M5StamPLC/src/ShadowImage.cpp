@@ -0,0 +1,123 @@
+//
+// In-RAM image of the PLC I/O and sensor values served to Modbus masters.
+//
+
+#include <ShadowImage.hpp>
+
+ShadowImage::ShadowImage() {
+    _coils  = 0;
+    _inputs = 0;
+    memset(_registers, 0, sizeof(_registers));
+}
+
+/**
+ * Relay states as last written to the I/O expander
+ *
+ * @param coils  bit n = relay n
+ */
+void ShadowImage::setCoils(uint8_t coils) {
+    portENTER_CRITICAL(&_lock);
+    _coils = coils;
+    portEXIT_CRITICAL(&_lock);
+}
+
+/**
+ * Digital input states as last read by the scan
+ *
+ * @param inputs  bit n = input n
+ */
+void ShadowImage::setInputs(uint8_t inputs) {
+    portENTER_CRITICAL(&_lock);
+    _inputs = inputs;
+    portEXIT_CRITICAL(&_lock);
+}
+
+void ShadowImage::setRegister(uint16_t reg, uint16_t value) {
+    setRegisters(reg, &value, 1);
+}
+
+/**
+ * Store a block of input registers atomically, e.g. all values of one sensor
+ *
+ * @param reg     first register
+ * @param values  register values
+ * @param count   number of registers, the block is dropped if it does not fit
+ */
+void ShadowImage::setRegisters(uint16_t reg, const uint16_t* values, uint16_t count) {
+    if (reg + count > SHADOW_INPUT_REGISTERS) {
+        return;
+    }
+    portENTER_CRITICAL(&_lock);
+    memcpy(&_registers[reg], values, count * sizeof(uint16_t));
+    portEXIT_CRITICAL(&_lock);
+}
+
+uint8_t ShadowImage::getCoils() {
+    portENTER_CRITICAL(&_lock);
+    uint8_t coils = _coils;
+    portEXIT_CRITICAL(&_lock);
+    return coils;
+}
+
+uint8_t ShadowImage::getInputs() {
+    portENTER_CRITICAL(&_lock);
+    uint8_t inputs = _inputs;
+    portEXIT_CRITICAL(&_lock);
+    return inputs;
+}
+
+/**
+ * Copy a consistent block of input registers
+ *
+ * @param reg     first register
+ * @param values  [out] register values
+ * @param count   number of registers
+ * @return false if the range is outside of the image
+ */
+bool ShadowImage::getRegisters(uint16_t reg, uint16_t* values, uint16_t count) {
+    if (reg + count > SHADOW_INPUT_REGISTERS) {
+        return false;
+    }
+    portENTER_CRITICAL(&_lock);
+    memcpy(values, &_registers[reg], count * sizeof(uint16_t));
+    portEXIT_CRITICAL(&_lock);
+    return true;
+}
+
+/**
+ * Coil write from a Modbus master. The image is updated immediately, the
+ * handler forwards the change to the relays.
+ *
+ * @param coil   relay number
+ * @param state  requested state
+ */
+void ShadowImage::writeCoil(uint8_t coil, bool state) {
+    writeCoils(coil, 1, state ? 1 : 0);
+}
+
+/**
+ * Write several coils at once, the handler is called once with the result
+ *
+ * @param first   first coil
+ * @param count   number of coils
+ * @param states  bit n = coil first + n
+ */
+void ShadowImage::writeCoils(uint8_t first, uint8_t count, uint8_t states) {
+    if (count == 0 || first + count > SHADOW_COILS) {
+        return;
+    }
+    uint8_t mask = ((1 << count) - 1) << first;
+
+    portENTER_CRITICAL(&_lock);
+    _coils      = (_coils & ~mask) | ((states << first) & mask);
+    uint8_t now = _coils;
+    portEXIT_CRITICAL(&_lock);
+
+    if (_coil_handler) {
+        _coil_handler(now);
+    }
+}
+
+void ShadowImage::onCoilWrite(CoilWriteHandler handler) {
+    _coil_handler = handler;
+}
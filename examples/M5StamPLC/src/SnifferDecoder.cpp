@@ -0,0 +1,206 @@
+//
+// Frame splitting, timestamps and response times of the bus sniffer, see
+// SnifferDecoder.hpp.
+//
+
+#include <string.h>
+#include "SnifferDecoder.hpp"
+
+/**
+ * @param char_usec     time of one character on the line
+ * @param silence_usec  t3.5, a gap this long ends any frame
+ * @param handler       called for every frame, in order
+ */
+SnifferDecoder::SnifferDecoder(uint32_t char_usec, uint32_t silence_usec, const SnifferFrameHandler& handler) {
+    _handler      = handler;
+    _char_usec    = char_usec;
+    _silence_usec = silence_usec;
+    begin(0);
+}
+
+/**
+ * Forget everything received so far
+ *
+ * @param start_usec  start of the capture, the delta of the first record is taken from it
+ */
+void SnifferDecoder::begin(int64_t start_usec) {
+    _len          = 0;
+    _start        = 0;
+    _end          = 0;
+    _last_start   = start_usec;
+    _req_address  = 0;
+    _req_function = 0;
+    _req_end      = 0;
+    _frames       = 0;
+    _crc_errors   = 0;
+
+    std::lock_guard<std::mutex> guard(_lock);
+    memset(_stats, 0, sizeof(_stats));
+}
+
+/**
+ * Bytes received back to back, e.g. everything read at one UART RX timeout
+ *
+ * @param data
+ * @param len
+ * @param end_usec  end of the last byte
+ */
+void SnifferDecoder::receive(const uint8_t* data, size_t len, int64_t end_usec) {
+    int64_t start = end_usec - (int64_t)len * _char_usec;
+
+    if (_len > 0 && start - _end >= _silence_usec) {
+        split(true);
+    }
+    while (len > 0) {
+        size_t take = MODBUS_RTU_MAX_FRAME - _len < len ? MODBUS_RTU_MAX_FRAME - _len : len;
+        if (_len == 0) {
+            _start = start;
+        }
+        memcpy(_buf + _len, data, take);
+        _len  += take;
+        data  += take;
+        len   -= take;
+        start += (int64_t)take * _char_usec;
+        _end   = start;
+        split(_len == MODBUS_RTU_MAX_FRAME);
+    }
+}
+
+/**
+ * The line is silent, the bytes still waiting are a frame
+ */
+void SnifferDecoder::flush() {
+    split(true);
+}
+
+/**
+ * Emit every complete frame at the head of the buffer. The layouts of
+ * requests and responses differ (FC03), so both lengths are tried and the
+ * CRC decides.
+ *
+ * @param silence  no more bytes of this frame will come
+ */
+void SnifferDecoder::split(bool silence) {
+    ModbusRtuFrame frame;
+
+    while (_len > 0) {
+        size_t request  = modbus_rtu_request_length(_buf, _len);
+        size_t response = modbus_rtu_response_length(_buf, _len);
+        bool   is_request =
+            request != 0 && request <= _len && modbus_rtu_decode_request(_buf, request, &frame) == MODBUS_FRAME_OK;
+        bool is_response =
+            response != 0 && response <= _len && modbus_rtu_decode(_buf, response, 0, &frame) == MODBUS_FRAME_OK;
+
+        if (is_request || is_response) {
+            size_t len = is_request ? request : response;
+            emit(len, is_request, is_response && response == len);
+            continue;
+        }
+        if (!silence && (request > _len || response > _len || (request == 0 && response == 0))) {
+            return;
+        }
+
+        // no frame fits the header: everything up to here is one frame, its CRC decides
+        emit(_len, modbus_rtu_decode_request(_buf, _len, &frame) == MODBUS_FRAME_OK,
+             modbus_rtu_decode(_buf, _len, 0, &frame) == MODBUS_FRAME_OK);
+    }
+}
+
+/**
+ * Pass the frame at the head of the buffer to the handler and remove it
+ *
+ * @param len
+ * @param request   the frame is a valid request
+ * @param response  the frame is a valid response
+ */
+void SnifferDecoder::emit(size_t len, bool request, bool response) {
+    int64_t start = _start;
+    int64_t end   = _end - (int64_t)(_len - len) * _char_usec;
+    uint8_t flags = 0;
+
+    if (request || response) {
+        flags |= SNIFFER_FLAG_CRC_OK;
+        matchResponse(request, response, start, end, &flags);
+    } else {
+        _crc_errors++;
+    }
+    _frames++;
+
+    SnifferRecord record;
+    record.delta_usec = start > _last_start ? start - _last_start : 0;
+    record.flags      = flags;
+    record.length     = len;
+    _last_start       = start;
+    _handler(record, _buf);
+
+    _len -= len;
+    memmove(_buf, _buf + len, _len);
+    _start = _end - (int64_t)_len * _char_usec;
+}
+
+/**
+ * Pair a valid frame with the previous one. A frame with the layout of a
+ * response, the same address and function code (or its exception code)
+ * shortly after a request is its response; a frame with the layout of a
+ * request is a new request. Response times are kept for slave addresses
+ * 1..SNIFFER_MAX_ADDRESS only.
+ *
+ * @param request   the frame is a valid request
+ * @param response  the frame is a valid response
+ * @param start
+ * @param end
+ * @param flags     [in, out]
+ */
+void SnifferDecoder::matchResponse(bool request, bool response, int64_t start, int64_t end, uint8_t* flags) {
+    uint8_t address  = _buf[0];
+    uint8_t function = _buf[1] & 0x7F;
+
+    if (response && _req_end != 0 && address == _req_address && function == _req_function
+        && start - _req_end < SNIFFER_RESPONSE_LIMIT) {
+        uint32_t usec = start > _req_end ? start - _req_end : 0;
+
+        if (address <= SNIFFER_MAX_ADDRESS) {
+            std::lock_guard<std::mutex> guard(_lock);
+            SnifferSlaveStats*          stats = &_stats[address];
+            if (stats->responses == 0 || usec < stats->min_usec) {
+                stats->min_usec = usec;
+            }
+            if (usec > stats->max_usec) {
+                stats->max_usec = usec;
+            }
+            stats->sum_usec += usec;
+            stats->responses++;
+        }
+
+        *flags |= SNIFFER_FLAG_RESPONSE;
+        _req_end = 0;
+        return;
+    }
+
+    // broadcasts are never answered, an unmatched response ends the wait
+    _req_address  = address;
+    _req_function = function;
+    _req_end      = request && address != 0 ? end : 0;
+}
+
+uint32_t SnifferDecoder::getFrames() {
+    return _frames;
+}
+
+uint32_t SnifferDecoder::getCrcErrors() {
+    return _crc_errors;
+}
+
+/**
+ * @param addr   slave address 1..SNIFFER_MAX_ADDRESS
+ * @param stats  [out] response time statistics
+ * @return false if no response of the slave has been seen yet
+ */
+bool SnifferDecoder::getSlaveStats(uint8_t addr, SnifferSlaveStats* stats) {
+    if (addr == 0 || addr > SNIFFER_MAX_ADDRESS) {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(_lock);
+    *stats = _stats[addr];
+    return stats->responses > 0;
+}
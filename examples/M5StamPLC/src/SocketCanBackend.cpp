@@ -0,0 +1,125 @@
+//
+// CAN backend for Linux SocketCAN, e.g. a vcan interface for tests:
+//
+//   ip link add dev vcan0 type vcan && ip link set vcan0 mtu 72 up
+//
+
+#ifdef __linux__
+
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include "SocketCanBackend.hpp"
+
+SocketCanBackend::SocketCanBackend() {
+    _socket = -1;
+    _fd     = false;
+}
+
+SocketCanBackend::~SocketCanBackend() {
+    end();
+}
+
+/**
+ * @param ifname  interface name, e.g. "vcan0"
+ * @param fd      use CAN FD frames, the interface MTU must be 72
+ * @return false if the interface does not exist or does not support CAN FD
+ */
+bool SocketCanBackend::begin(const char* ifname, bool fd) {
+    struct sockaddr_can addr;
+    struct ifreq        ifr;
+    int                 enable = 1;
+
+    end();
+    _socket = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    if (_socket < 0) {
+        return false;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+    if (ioctl(_socket, SIOCGIFINDEX, &ifr) < 0) {
+        end();
+        return false;
+    }
+
+    _fd = fd;
+    if (_fd && setsockopt(_socket, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable, sizeof(enable)) < 0) {
+        end();
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family  = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if (bind(_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        end();
+        return false;
+    }
+    return true;
+}
+
+void SocketCanBackend::end() {
+    if (_socket >= 0) {
+        close(_socket);
+        _socket = -1;
+    }
+}
+
+static bool wait_socket(int socket, short events, uint32_t timeout_ms) {
+    struct pollfd pfd = { socket, events, 0 };
+    return poll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & events);
+}
+
+bool SocketCanBackend::send(const CanFrame& frame, uint32_t timeout_ms) {
+    struct canfd_frame raw;
+    size_t             size = _fd ? CANFD_MTU : CAN_MTU;
+
+    if (frame.len > maxPayload() || !wait_socket(_socket, POLLOUT, timeout_ms)) {
+        return false;
+    }
+    memset(&raw, 0, sizeof(raw));
+    raw.can_id = (frame.id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    raw.len    = frame.len;
+    memcpy(raw.data, frame.data, frame.len);
+    return write(_socket, &raw, size) == (ssize_t)size;
+}
+
+bool SocketCanBackend::receive(CanFrame* frame, uint32_t timeout_ms) {
+    struct canfd_frame raw;
+
+    if (!wait_socket(_socket, POLLIN, timeout_ms)) {
+        return false;
+    }
+    ssize_t size = read(_socket, &raw, sizeof(raw));
+    if ((size != CAN_MTU && size != CANFD_MTU) || !(raw.can_id & CAN_EFF_FLAG) || (raw.can_id & CAN_RTR_FLAG)) {
+        return false;
+    }
+    frame->id  = raw.can_id & CAN_EFF_MASK;
+    frame->len = raw.len;
+    memcpy(frame->data, raw.data, raw.len);
+    return true;
+}
+
+/**
+ * The filter is applied in the kernel, frames that do not match are never
+ * copied to user space.
+ */
+bool SocketCanBackend::setFilter(uint32_t id, uint32_t mask) {
+    struct can_filter filter;
+    filter.can_id   = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+    filter.can_mask = (mask & CAN_EFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    return setsockopt(_socket, SOL_CAN_RAW, CAN_RAW_FILTER, &filter, sizeof(filter)) == 0;
+}
+
+uint8_t SocketCanBackend::maxPayload() {
+    return _fd ? CANFD_MAX_PAYLOAD : CAN_MAX_PAYLOAD;
+}
+
+#endif // __linux__
@@ -0,0 +1,269 @@
+//
+// Minimal MQTT 3.1.1 client over a TCP socket, for tests on Linux against a
+// local broker, e.g. mosquitto -p 1883.
+//
+
+#ifdef __linux__
+
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "SocketMqttBackend.hpp"
+#include "Timespec.h"
+
+#define MQTT_CONNECT   0x10
+#define MQTT_CONNACK   0x20
+#define MQTT_PUBLISH   0x30
+#define MQTT_PUBACK    0x40
+#define MQTT_PINGREQ   0xC0
+#define MQTT_PINGRESP  0xD0
+#define MQTT_QOS1      0x02
+
+// fixed header: packet type and variable length encoded remaining length
+static size_t put_header(uint8_t* out, uint8_t type, size_t remaining) {
+    size_t n = 0;
+    out[n++] = type;
+    do {
+        uint8_t byte = remaining & 0x7F;
+        remaining >>= 7;
+        out[n++] = byte | (remaining ? 0x80 : 0);
+    } while (remaining);
+    return n;
+}
+
+static size_t put_string(uint8_t* out, const char* str, size_t len) {
+    out[0] = len >> 8;
+    out[1] = len & 0xFF;
+    memcpy(out + 2, str, len);
+    return len + 2;
+}
+
+SocketMqttBackend::SocketMqttBackend() {
+    _socket       = -1;
+    _connected    = false;
+    _lost         = false;
+    _host[0]      = '\0';
+    _port         = 0;
+    _client_id[0] = '\0';
+    _next_id      = 0;
+    _last_tx      = 0;
+    _last_attempt = 0;
+    _rx_len       = 0;
+}
+
+SocketMqttBackend::~SocketMqttBackend() {
+    end();
+}
+
+/**
+ * @param host       broker name or address
+ * @param port       usually 1883
+ * @param client_id
+ * @return false if the broker cannot be reached now, poll() keeps trying
+ */
+bool SocketMqttBackend::begin(const char* host, uint16_t port, const char* client_id) {
+    end();
+    snprintf(_host, sizeof(_host), "%s", host);
+    snprintf(_client_id, sizeof(_client_id), "%s", client_id);
+    _port = port;
+    return connect();
+}
+
+void SocketMqttBackend::end() {
+    disconnect();
+    _lost    = false;
+    _host[0] = '\0';
+}
+
+bool SocketMqttBackend::connect() {
+    struct addrinfo  hints = {};
+    struct addrinfo* addr;
+    char             port[8];
+    int              enable = 1;
+
+    _last_attempt = timespec_now_to_msec();
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%u", _port);
+    if (getaddrinfo(_host, port, &hints, &addr) != 0) {
+        return false;
+    }
+
+    _socket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (_socket < 0 || ::connect(_socket, addr->ai_addr, addr->ai_addrlen) < 0) {
+        freeaddrinfo(addr);
+        disconnect();
+        return false;
+    }
+    freeaddrinfo(addr);
+
+    // publishes are pipelined, Nagle would hold them back until the previous PUBACK
+    setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    // clean session, no will, no credentials
+    uint8_t packet[64];
+    size_t  id_len    = strlen(_client_id);
+    size_t  remaining = 10 + 2 + id_len;
+    size_t  n         = put_header(packet, MQTT_CONNECT, remaining);
+    n += put_string(packet + n, "MQTT", 4);
+    packet[n++] = 4;        // protocol level 3.1.1
+    packet[n++] = 0x02;     // clean session
+    packet[n++] = MQTT_KEEPALIVE >> 8;
+    packet[n++] = MQTT_KEEPALIVE & 0xFF;
+    n += put_string(packet + n, _client_id, id_len);
+
+    _rx_len = 0;
+    if (!sendAll(packet, n)) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+void SocketMqttBackend::disconnect() {
+    if (_socket >= 0) {
+        close(_socket);
+        _socket = -1;
+    }
+    _lost      = _connected;
+    _connected = false;
+}
+
+bool SocketMqttBackend::sendAll(const uint8_t* data, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(_socket, data, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        len -= sent;
+    }
+    _last_tx = timespec_now_to_msec();
+    return true;
+}
+
+/**
+ * Read what is available and handle all complete packets
+ */
+void SocketMqttBackend::receive() {
+    ssize_t got = recv(_socket, _rx + _rx_len, sizeof(_rx) - _rx_len, MSG_DONTWAIT);
+    if (got <= 0) {
+        disconnect();
+        return;
+    }
+    _rx_len += got;
+
+    size_t pos = 0;
+    while (pos + 2 <= _rx_len) {
+        // the broker only sends short packets to a publisher
+        size_t length = _rx[pos + 1];
+        if (length & 0x80) {
+            disconnect();
+            return;
+        }
+        if (pos + 2 + length > _rx_len) {
+            break;
+        }
+        const uint8_t* p = _rx + pos;
+        switch (p[0] & 0xF0) {
+        case MQTT_CONNACK:
+            if (length == 2 && p[3] == 0) {
+                _connected = true;
+                if (_connect_handler) {
+                    _connect_handler(true);
+                }
+            } else {
+                disconnect();
+                return;
+            }
+            break;
+        case MQTT_PUBACK:
+            if (length == 2 && _ack_handler) {
+                _ack_handler((p[2] << 8) | p[3]);
+            }
+            break;
+        default:
+            break;
+        }
+        pos += 2 + length;
+    }
+    memmove(_rx, _rx + pos, _rx_len - pos);
+    _rx_len -= pos;
+}
+
+/**
+ * @return message id, -1 if not connected or the connection broke
+ */
+int SocketMqttBackend::publish(const char* topic, const uint8_t* data, size_t len) {
+    if (!_connected) {
+        return -1;
+    }
+
+    // packet id 0 is not allowed
+    _next_id = _next_id == 0xFFFF ? 1 : _next_id + 1;
+
+    uint8_t header[128];
+    size_t  topic_len = strlen(topic);
+    if (topic_len > sizeof(header) - 16) {
+        return -1;
+    }
+    size_t n = put_header(header, MQTT_PUBLISH | MQTT_QOS1, 2 + topic_len + 2 + len);
+    n += put_string(header + n, topic, topic_len);
+    header[n++] = _next_id >> 8;
+    header[n++] = _next_id & 0xFF;
+
+    // the disconnect is reported by the next poll(), not from inside publish()
+    if (!sendAll(header, n) || !sendAll(data, len)) {
+        disconnect();
+        return -1;
+    }
+    return _next_id;
+}
+
+bool SocketMqttBackend::connected() {
+    return _connected;
+}
+
+void SocketMqttBackend::poll(uint32_t timeout_ms) {
+    int64_t now = timespec_now_to_msec();
+
+    if (_lost) {
+        _lost = false;
+        if (_lost_handler) {
+            _lost_handler(MQTT_ID_ALL);
+        }
+        if (_connect_handler) {
+            _connect_handler(false);
+        }
+    }
+    if (_socket < 0) {
+        if (_host[0] != '\0' && now - _last_attempt >= MQTT_RECONNECT_INTERVAL) {
+            connect();
+        }
+        if (_socket < 0) {
+            usleep(timeout_ms * 1000);
+            return;
+        }
+    }
+
+    if (_connected && now - _last_tx >= MQTT_KEEPALIVE * 1000 / 2) {
+        uint8_t ping[2] = {MQTT_PINGREQ, 0};
+        if (!sendAll(ping, sizeof(ping))) {
+            disconnect();
+            return;
+        }
+    }
+
+    struct pollfd pfd = {_socket, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) == 1) {
+        receive();
+    }
+}
+
+#endif // __linux__
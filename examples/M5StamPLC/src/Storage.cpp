@@ -0,0 +1,74 @@
+//
+// microSD card of the StamPLC.
+//
+
+#include <Storage.hpp>
+
+static bool sd_ready = false;
+
+/**
+ * Mount the card, safe to call more than once
+ *
+ * @return false if there is no usable card
+ */
+bool storage_begin() {
+    if (!sd_ready) {
+        SPI.begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
+        sd_ready = SD.begin(SD_CS_PIN, SPI, SD_FREQUENCY);
+    }
+    return sd_ready;
+}
+
+bool storage_ready() {
+    return sd_ready;
+}
+
+/**
+ * Read a whole file into a new buffer
+ *
+ * @param path  absolute path on the card
+ * @param len   [out] file length
+ * @return buffer to be released with delete[], nullptr if the file cannot be read
+ */
+uint8_t* storage_read(const char* path, size_t* len) {
+    if (!sd_ready || !SD.exists(path)) {
+        return nullptr;
+    }
+
+    File file = SD.open(path, FILE_READ);
+    if (!file) {
+        return nullptr;
+    }
+
+    *len = file.size();
+    uint8_t* data = new uint8_t[*len];
+    if (file.read(data, *len) != *len) {
+        delete[] data;
+        data = nullptr;
+    }
+    file.close();
+    return data;
+}
+
+/**
+ * Replace a file with the given data
+ *
+ * @param path  absolute path on the card
+ * @param data
+ * @param len
+ * @return false if the file cannot be written completely
+ */
+bool storage_write(const char* path, const uint8_t* data, size_t len) {
+    if (!sd_ready) {
+        return false;
+    }
+
+    File file = SD.open(path, FILE_WRITE);
+    if (!file) {
+        return false;
+    }
+
+    bool ok = file.write(data, len) == len;
+    file.close();
+    return ok;
+}
@@ -0,0 +1,193 @@
+//
+// Multi-resolution min/max/avg history of registry points in fixed memory.
+//
+
+#include <string.h>
+#include "TrendStore.hpp"
+
+struct TrendLevel {
+    int64_t  period;          // ms
+    uint16_t capacity;
+    uint16_t offset;          // first bucket in TrendSeries::buckets
+};
+
+static constexpr TrendLevel LEVELS[TREND_LEVELS] = {
+    {1000,     60,  0},
+    {60000,    120, 60},
+    {3600000,  168, 180},
+    {86400000, 62,  348},
+};
+
+static_assert(LEVELS[TREND_LEVELS - 1].offset + LEVELS[TREND_LEVELS - 1].capacity == TREND_BUCKETS,
+              "TREND_BUCKETS does not match the levels");
+
+// floor division, times before 1970 stay in the right bucket
+static inline int64_t bucket_number(int64_t time, int64_t period) {
+    return time >= 0 ? time / period : -((-time + period - 1) / period);
+}
+
+/**
+ * @param series    storage of the tracked points
+ * @param capacity  number of series
+ */
+TrendStore::TrendStore(TrendSeries* series, uint8_t capacity) {
+    _series   = series;
+    _capacity = capacity;
+    _count    = 0;
+}
+
+/**
+ * @return period of a resolution level in ms
+ */
+int64_t TrendStore::period(uint8_t level) {
+    return level < TREND_LEVELS ? LEVELS[level].period : 0;
+}
+
+/**
+ * Keep the history of a point, call during setup
+ *
+ * @param point  registry point
+ * @return false if all series are in use
+ */
+bool TrendStore::track(uint16_t point) {
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_count == _capacity) {
+        return false;
+    }
+    TrendSeries* series = &_series[_count++];
+    memset(series, 0, sizeof(TrendSeries));
+    series->point = point;
+    return true;
+}
+
+TrendSeries* TrendStore::find(uint16_t point) {
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_series[i].point == point) {
+            return &_series[i];
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Add a sample to every resolution, points that are not tracked are ignored
+ *
+ * @param point
+ * @param value
+ * @param time_ms
+ */
+void TrendStore::add(uint16_t point, int32_t value, int64_t time_ms) {
+    std::lock_guard<std::mutex> guard(_lock);
+    TrendSeries* series = find(point);
+    if (series == nullptr) {
+        return;
+    }
+
+    for (uint8_t l = 0; l < TREND_LEVELS; l++) {
+        const TrendLevel* level  = &LEVELS[l];
+        int64_t           number = bucket_number(time_ms, level->period);
+        TrendBucket*      bucket = &series->buckets[level->offset + (uint64_t)number % level->capacity];
+
+        if (bucket->count == 0 || bucket->number != (uint32_t)number) {
+            bucket->number = number;
+            bucket->sum    = 0;
+            bucket->min    = value;
+            bucket->max    = value;
+            bucket->count  = 0;
+        }
+        bucket->sum += value;
+        bucket->min = value < bucket->min ? value : bucket->min;
+        bucket->max = value > bucket->max ? value : bucket->max;
+        bucket->count++;
+    }
+    if (time_ms > series->newest) {
+        series->newest = time_ms;
+    }
+}
+
+/**
+ * @return true if the ring of the level still holds the bucket of from
+ */
+bool TrendStore::covers(const TrendSeries* series, uint8_t level, int64_t from) {
+    const TrendLevel* l = &LEVELS[level];
+    return bucket_number(from, l->period) > bucket_number(series->newest, l->period) - l->capacity;
+}
+
+/**
+ * The coarsest level that is at least as fine as the requested step and
+ * still holds the start of the range; older ranges fall back to the finest
+ * level that still holds them.
+ */
+uint8_t TrendStore::selectLevel(const TrendSeries* series, int64_t from, int64_t step) {
+    for (int8_t l = TREND_LEVELS - 1; l >= 0; l--) {
+        if (LEVELS[l].period <= step && covers(series, l, from)) {
+            return l;
+        }
+    }
+    for (uint8_t l = 0; l < TREND_LEVELS; l++) {
+        if (covers(series, l, from)) {
+            return l;
+        }
+    }
+    return TREND_LEVELS - 1;
+}
+
+/**
+ * History of a point in at most max samples. The range is split into max
+ * steps of whole buckets of the coarsest sufficient resolution. When the
+ * range is not aligned to the buckets, it spans one bucket more and some
+ * steps merge an extra bucket, starting with the partial first one, so the
+ * result still has max samples. Steps without data are left out.
+ *
+ * @param point
+ * @param from  ms, inclusive
+ * @param to    ms, exclusive
+ * @param max   size of out
+ * @param out   [out] samples in time order
+ * @return number of samples
+ */
+uint16_t TrendStore::query(uint16_t point, int64_t from, int64_t to, uint16_t max, TrendSample* out) {
+    std::lock_guard<std::mutex> guard(_lock);
+    TrendSeries* series = find(point);
+    if (series == nullptr || max == 0 || to <= from) {
+        return 0;
+    }
+
+    int64_t           step  = (to - from + max - 1) / max;
+    const TrendLevel* level = &LEVELS[selectLevel(series, from, step)];
+
+    int64_t first = bucket_number(from, level->period);
+    int64_t last  = bucket_number(to - 1, level->period);
+    if (last - first >= level->capacity) {
+        first = last - level->capacity + 1;
+    }
+    // bucket k of the range belongs to step k * max / span
+    int64_t span = last - first + 1;
+
+    uint16_t count = 0;
+    int64_t  sum   = 0;
+    for (int64_t n = first; n <= last; n++) {
+        const TrendBucket* bucket = &series->buckets[level->offset + (uint64_t)n % level->capacity];
+        if (bucket->count == 0 || bucket->number != (uint32_t)n) {
+            continue;
+        }
+
+        int64_t index = (n - first) * max / span;
+        int64_t time  = (first + (index * span + max - 1) / max) * level->period;
+        if (count == 0 || out[count - 1].time != time) {
+            if (count == max) {
+                break;
+            }
+            out[count++] = {time, bucket->min, bucket->max, 0, 0};
+            sum          = 0;
+        }
+
+        TrendSample* sample = &out[count - 1];
+        sample->min = bucket->min < sample->min ? bucket->min : sample->min;
+        sample->max = bucket->max > sample->max ? bucket->max : sample->max;
+        sample->count += bucket->count;
+        sum += bucket->sum;
+        sample->avg = sum / sample->count;
+    }
+    return count;
+}
@@ -0,0 +1,106 @@
+//
+// CAN backend for the ESP32 TWAI controller (PWR-CAN port of the StamPLC).
+//
+// The TWAI acceptance filter can only be set when the driver is installed,
+// so setFilter() reinstalls the driver. The ESP32-S3 controller is classic
+// CAN only.
+//
+
+#ifdef ESP_PLATFORM
+
+#include <string.h>
+#include "TwaiBackend.hpp"
+
+TwaiBackend::TwaiBackend() {
+    _bitrate     = 0;
+    _filter_id   = 0;
+    _filter_mask = 0;
+    _running     = false;
+}
+
+TwaiBackend::~TwaiBackend() {
+    stop();
+}
+
+bool TwaiBackend::start() {
+    twai_general_config_t general = TWAI_GENERAL_CONFIG_DEFAULT(CAN_TX_PIN, CAN_RX_PIN, TWAI_MODE_NORMAL);
+    twai_timing_config_t  timing;
+    twai_filter_config_t  filter;
+
+    general.tx_queue_len = TWAI_QUEUE_LEN;
+    general.rx_queue_len = TWAI_QUEUE_LEN;
+
+    switch (_bitrate) {
+        case 125000:  timing = TWAI_TIMING_CONFIG_125KBITS(); break;
+        case 250000:  timing = TWAI_TIMING_CONFIG_250KBITS(); break;
+        case 500000:  timing = TWAI_TIMING_CONFIG_500KBITS(); break;
+        case 1000000: timing = TWAI_TIMING_CONFIG_1MBITS();   break;
+        default:      return false;
+    }
+
+    // single filter on the 29 bit identifier, mask bits set to 1 are ignored
+    filter.acceptance_code = _filter_id << 3;
+    filter.acceptance_mask = ~(_filter_mask << 3);
+    filter.single_filter   = true;
+
+    if (twai_driver_install(&general, &timing, &filter) != ESP_OK) {
+        return false;
+    }
+    _running = twai_start() == ESP_OK;
+    return _running;
+}
+
+void TwaiBackend::stop() {
+    if (_running) {
+        twai_stop();
+        twai_driver_uninstall();
+        _running = false;
+    }
+}
+
+/**
+ * @param bitrate  125000, 250000, 500000 or 1000000
+ * @return false if the bitrate is not supported or the driver failed
+ */
+bool TwaiBackend::begin(uint32_t bitrate) {
+    _bitrate = bitrate;
+    stop();
+    return start();
+}
+
+bool TwaiBackend::send(const CanFrame& frame, uint32_t timeout_ms) {
+    twai_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.extd             = 1;
+    msg.identifier       = frame.id;
+    msg.data_length_code = frame.len > CAN_MAX_PAYLOAD ? CAN_MAX_PAYLOAD : frame.len;
+    memcpy(msg.data, frame.data, msg.data_length_code);
+    return twai_transmit(&msg, pdMS_TO_TICKS(timeout_ms)) == ESP_OK;
+}
+
+bool TwaiBackend::receive(CanFrame* frame, uint32_t timeout_ms) {
+    twai_message_t msg;
+    if (twai_receive(&msg, pdMS_TO_TICKS(timeout_ms)) != ESP_OK || !msg.extd || msg.rtr) {
+        return false;
+    }
+    frame->id  = msg.identifier;
+    frame->len = msg.data_length_code;
+    memcpy(frame->data, msg.data, frame->len);
+    return true;
+}
+
+bool TwaiBackend::setFilter(uint32_t id, uint32_t mask) {
+    _filter_id   = id;
+    _filter_mask = mask;
+    if (!_running) {
+        return true;
+    }
+    stop();
+    return start();
+}
+
+uint8_t TwaiBackend::maxPayload() {
+    return CAN_MAX_PAYLOAD;
+}
+
+#endif // ESP_PLATFORM
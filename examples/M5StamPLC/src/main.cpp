@@ -5,24 +5,781 @@
 
 #include "Main.hpp"
 
-Sensor*   sensor;
+// scan statistics are printed every 10 seconds
+#define STATS_INTERVAL 10000
+
+// compiled PLC program on the SD card, see tools/plcc.py
+#define PLC_PROGRAM_FILE "/plc.bin"
+
+// point values are sent on CAN every CAN_PERIOD ms if changed, all of them every CAN_REFRESH ms
+#ifndef CAN_NODE
+#define CAN_NODE    1
+#endif
+#define CAN_PERIOD  100
+#define CAN_REFRESH 5000
+// int32 values on CAN, BOARD.V in mV does not fit an int16 above 32.7 V; -DCAN_WIDE=0 packs twice as many int16 values
+#ifndef CAN_WIDE
+#define CAN_WIDE    1
+#endif
+
+// points with a trend history: temperature and humidity of the first sensor
+#define TREND_POINTS 2
+
+// buzzer tone of active alarms
+#define ALARM_BUZZER_FREQ 2000
+
+// site configuration, see ConfigImage.hpp and tools/plcconf.py
+#define CONFIG_TEXT_FILE  "/config.txt"
+#define CONFIG_IMAGE_FILE "/config.bin"
+
+// telemetry batches to MQTT_URI every MQTT_PERIOD ms, unsent ones are kept on the card and drained every
+// MQTT_DRAIN_PERIOD ms at MQTT_DRAIN_RATE messages per second
+#ifndef MQTT_NODE
+#define MQTT_NODE         1
+#endif
+#define MQTT_PERIOD       10000
+#define MQTT_DRAIN_PERIOD 1000
+#define MQTT_TOPIC        "stamplc/%u/points"
+#define MQTT_SPILL_FILE   "/sd/mqtt.spl"
+#define MQTT_SPILL_SLOTS  1024
+
+// bus traffic capture (-DTRACE_RECORD) and replay (-DTRACE_REPLAY=<speed>), see lib/Trace and tools/trace.py
+#define TRACE_FILE         "/sd/trace.bin"
+#define TRACE_REPLAY_STACK 8192
+
+// binary sample log, the card is mounted at /sd, see tools/samplelog.py
+#define SAMPLE_LOG_FILE "/sd/samples.bin"
+
+// filter of the sensor values in the registry, e.g. -DSENSOR_FILTER=\"outlier:4:5,median:5\", see lib/SensorFilter
+// samples per stage of -DFILTER_BENCHMARK
+#define FILTER_BENCH_SAMPLES 100000
+
+// objects created in setup(), in static storage with -DPLC_STATIC_ALLOC
+StaticPool<Sensor, CONFIG_MAX_SENSORS> sensor_pool;
+StaticPool<M5Modbus>                   modbus_pool;
+StaticPool<M5ModbusServer>             server_pool;
+
+Sensor*   sensors[CONFIG_MAX_SENSORS];
+Sensor*   sensor;        // first sensor, carries the example alarms and trends
+uint8_t   sensor_count;
 M5Modbus* modbus;
+uint32_t  poll_interval = POLL_INTERVAL;
+
+ConfigImage     config;
+
+ShadowImage     image;
+SensorRegistry  registry;
+BoardHealth     board(&registry);
+M5ModbusServer* server;
+ScanEngine      scan_engine(&image);
+InputCapture    inputs;
+PlcProgram      program;
+ControlExecutor control;
+StaticTrendStore<TREND_POINTS> trends;
+AlarmEngine     alarms;
+uint8_t         buzzer_alarms;
+Relay           relays[RELAY_COUNT] = {Relay(0), Relay(1), Relay(2), Relay(3)};
+
+#ifdef SENSOR_FILTER
+SensorFilter filters[CONFIG_MAX_SENSORS * 2];
+#endif
+
+#ifdef MODBUS_SNIFFER
+StaticPool<BusSniffer> sniffer_pool;
+BusSniffer*            sniffer;
+#endif
+
+EventLoop events;
+
+#ifdef SAMPLE_LOG
+FileLogSink              log_sink;
+StaticPool<SampleLogger> logger_pool;
+SampleLogger*            logger;
+#endif
+
+#ifdef MQTT_URI
+EspMqttBackend            mqtt_client;
+MqttSpill                 mqtt_spill;
+StaticPool<MqttPublisher> mqtt_pool;
+MqttPublisher*            mqtt;
+MqttStats                 mqtt_last;
+#endif
+
+#ifdef TRACE_RECORD
+TraceRecorder recorder;
+#endif
+#ifdef TRACE_REPLAY
+TracePlayer player;
+#endif
+
+#ifdef CAN_BITRATE
+TwaiBackend              can_bus;
+StaticPool<CanTransport> can_pool;
+CanTransport*            can;
+int64_t                  last_can_refresh;
+#endif
+
+/**
+ * User logic, runs once per scan cycle on the process image. Runs the
+ * program loaded from the SD card, if any.
+ */
+void plc_logic(ProcessImage& pi) {
+    struct timespec now;
+    timespec_now_mono(&now);
+
+    pi.outputs = program.execute(pi.inputs, pi.outputs, pi.registers, scan_engine.getCycle());
+    control.run(pi, timespec_to_msec(&now));
+}
+
+#ifdef MODBUS_DISCOVERY
+/**
+ * Scan the bus at the common baud rates and print the responding slaves
+ */
+void discover_bus() {
+    static const uint32_t baudrates[] = {9600, 19200, 38400, 115200};
+    DiscoveredDevice      devices[DISCOVERY_MAX_DEVICES];
+    BusDiscovery          discovery(modbus);
+    uint32_t              baudrate = modbus->getBaudrate();
+    uint32_t              format   = modbus->getConfig();
+
+    int64_t  start = timespec_now_to_msec();
+    uint16_t found = discovery.scan(baudrates, sizeof(baudrates) / sizeof(baudrates[0]), devices, DISCOVERY_MAX_DEVICES);
+    Serial.printf("Bus scan finished in %lld ms, %u device(s)\n", timespec_now_to_msec() - start, found);
+
+    for (uint16_t i = 0; i < found; i++) {
+        Serial.printf("  address %3u at %6u Bd: %s\n", devices[i].address, devices[i].baudrate,
+                      devices[i].type ? devices[i].type->name : "unknown");
+    }
+    modbus->setBaudrate(baudrate, format);
+}
+#endif
+
+/**
+ * Print all registered points from one snapshot
+ */
+void print_points() {
+    static PointSnapshot points[REGISTRY_MAX_POINTS];
+    uint16_t             count = registry.snapshot(0, registry.size(), points);
+
+    for (PointHandle p = 0; p < count; p++) {
+        Serial.printf("  %-12s %8.1f %s\n", registry.getName(p), (float)points[p].value / registry.getScale(p),
+                      points[p].quality == QUALITY_GOOD ? "" : "(bad)");
+    }
+}
+
+#ifdef CAN_BITRATE
+/**
+ * Queue the points that changed since the last call (or all of them on
+ * refresh) and send them as one batch
+ */
+void publish_can(bool refresh) {
+    static PointSnapshot points[REGISTRY_MAX_POINTS];
+    static int32_t       sent[REGISTRY_MAX_POINTS];
+    static PointQuality  sent_quality[REGISTRY_MAX_POINTS];
+    uint16_t             count = registry.snapshot(0, registry.size(), points);
+
+    for (PointHandle p = 0; p < count; p++) {
+        if (points[p].quality == QUALITY_NONE) {
+            continue;
+        }
+        if (refresh || points[p].value != sent[p] || points[p].quality != sent_quality[p]) {
+            can->queue(p, points[p].value, points[p].quality == QUALITY_GOOD);
+            sent[p]         = points[p].value;
+            sent_quality[p] = points[p].quality;
+        }
+    }
+    can->flush();
+}
+#endif
+
+/**
+ * Route a response to the sensor that sent the request
+ *
+ * @param rsp
+ * @param token  request token = sensor id
+ * @param time   ms, the recorded time on replay
+ */
+void modbus_response(const ModbusMessage& rsp, uint32_t token, int64_t time) {
+    for (uint8_t i = 0; i < sensor_count && !sensors[i]->handleData(rsp, token, time); i++) {
+    }
+}
+
+void modbus_error(Error err, uint32_t token, int64_t time) {
+    for (uint8_t i = 0; i < sensor_count && !sensors[i]->handleError(err, token, time); i++) {
+    }
+}
+
+#ifdef TRACE_REPLAY
+/**
+ * Feed the recorded bus traffic to the sensors in place of the bus, with the
+ * recorded times. TRACE_REPLAY is the speed: 0 as fast as possible, 1 real
+ * time, n times faster. The same trace gives the same point updates on every
+ * run, so the printed throughput can be compared across builds.
+ */
+void replay_trace() {
+    TraceStats stats;
+    player.setPace(TRACE_REPLAY == 0 ? TRACE_FAST : TRACE_REALTIME, TRACE_REPLAY);
+    player.play([](const TraceEvent& event) {
+        uint32_t token;
+        if (event.source != TRACE_SOURCE_MODBUS || event.len <= sizeof(token)) {
+            return;
+        }
+        memcpy(&token, event.data, sizeof(token));
+        if (event.kind == TRACE_MODBUS_RESPONSE) {
+            ModbusMessage rsp;
+            rsp.add(event.data + sizeof(token), event.len - sizeof(token));
+            modbus_response(rsp, token, event.time / USEC_PER_MILLISEC);
+        } else if (event.kind == TRACE_MODBUS_ERROR) {
+            modbus_error((Error)event.data[sizeof(token)], token, event.time / USEC_PER_MILLISEC);
+        }
+    }, &stats);
+
+    Serial.printf("Replay: %u events (%lld s recorded) in %lld ms, %.0f events/s, %lld ns/event, max lag %lld ms\n",
+                  stats.events, stats.trace_usec / USEC_PER_SEC, stats.total_nsec / NSEC_PER_MILLISEC,
+                  stats.events * 1e9 / (stats.total_nsec ? stats.total_nsec : 1),
+                  stats.handler_nsec / (stats.events ? stats.events : 1), stats.max_lag_usec / USEC_PER_MILLISEC);
+}
+#endif
+
+#ifdef MQTT_URI
+/**
+ * All points with a value go into one batch per period
+ */
+void publish_mqtt() {
+    static PointSnapshot points[REGISTRY_MAX_POINTS];
+    // the esp-mqtt outbox copies every message to the heap
+    HeapAllow            allow;
+    uint16_t             count = registry.snapshot(0, registry.size(), points);
+
+    for (PointHandle p = 0; p < count; p++) {
+        if (points[p].quality != QUALITY_NONE) {
+            mqtt->queue(p, points[p].value, points[p].quality == QUALITY_GOOD);
+        }
+    }
+    mqtt->flush();
+}
+#endif
+
+/**
+ * Every value and quality change of the registry
+ */
+void point_updated(PointHandle point, int32_t value, PointQuality quality, int64_t time) {
+    alarms.evaluate(point, value, quality == QUALITY_GOOD, time);
+    if (quality == QUALITY_GOOD) {
+        trends.add(point, value, time);
+    }
+#ifdef SAMPLE_LOG
+    if (logger != nullptr) {
+        logger->log(point, value, quality, time);
+    }
+#endif
+}
+
+/**
+ * Alarm actions: the buzzer sounds while any buzzer alarm is active, relay
+ * alarms are staged for the next scan, uplink alarms are reported
+ */
+void alarm_changed(const AlarmEvent& event) {
+    if (event.actions & ALARM_ACTION_BUZZER) {
+        buzzer_alarms += event.active ? 1 : -1;
+        if (buzzer_alarms > 0) {
+            M5StamPLC.tone(ALARM_BUZZER_FREQ);
+        } else {
+            M5StamPLC.noTone();
+        }
+    }
+    if ((event.actions & ALARM_ACTION_RELAY) && event.relay < RELAY_COUNT) {
+        relays[event.relay].stage(event.active);
+    }
+    if (event.actions & ALARM_ACTION_UPLINK) {
+        static const char* types[] = {"high", "low", "rate of change", "stuck", "communication loss"};
+        HeapAllow          allow;
+        Serial.printf("Alarm %s: %s %s, value %.1f\n", event.active ? "raised" : "cleared",
+                      registry.getName(event.point), types[event.type],
+                      (float)event.value / registry.getScale(event.point));
+    }
+}
+
+/**
+ * Alarm rules of the example sensor, compiled once at startup
+ */
+void setup_alarms() {
+    PointHandle temperature = sensor->getTemperaturePoint();
+    PointHandle humidity    = sensor->getHumidityPoint();
+
+    const AlarmRule rules[] = {
+        // above 30.0 °C for 10 s, clears below 29.5 °C
+        {temperature, ALARM_HIGH, ALARM_ACTION_BUZZER | ALARM_ACTION_UPLINK, 300, 5, 10000, 0, 0},
+        {temperature, ALARM_LOW, ALARM_ACTION_UPLINK, 50, 5, 10000, 0, 0},
+        // more than 2.0 °C per minute
+        {temperature, ALARM_ROC, ALARM_ACTION_UPLINK, 20, 5, 0, 60000, 0},
+        // no answer for 15 s
+        {temperature, ALARM_COMM_LOSS, ALARM_ACTION_UPLINK, 0, 0, 15000, 0, 0},
+        // humidity frozen for 30 min
+        {humidity, ALARM_STUCK, ALARM_ACTION_UPLINK, 0, 0, 0, 1800000, 0},
+#ifdef ALARM_FAN_RELAY
+        {temperature, ALARM_HIGH, ALARM_ACTION_RELAY, 280, 10, 0, 0, ALARM_FAN_RELAY},
+#endif
+    };
+    alarms.onAlarm(alarm_changed);
+    if (!alarms.compile(rules, sizeof(rules) / sizeof(rules[0]), registry.size())) {
+        Serial.println("Alarm rules invalid");
+    }
+}
+
+/**
+ * Min/max/avg of the tracked points over the last hour, from the minute
+ * buckets
+ */
+void print_trends() {
+    static TrendSample minutes[60];
+    int64_t            now = timespec_now_to_msec();
+
+    for (PointHandle p = 0; p < registry.size(); p++) {
+        uint16_t count = trends.query(p, now - 3600000, now, 60, minutes);
+        if (count == 0) {
+            continue;
+        }
+        TrendSample hour = minutes[0];
+        int64_t     sum  = (int64_t)hour.avg * hour.count;
+        for (uint16_t i = 1; i < count; i++) {
+            hour.min = minutes[i].min < hour.min ? minutes[i].min : hour.min;
+            hour.max = minutes[i].max > hour.max ? minutes[i].max : hour.max;
+            hour.count += minutes[i].count;
+            sum += (int64_t)minutes[i].avg * minutes[i].count;
+        }
+        float scale = registry.getScale(p);
+        Serial.printf("  %-12s 1 h: min %.1f max %.1f avg %.1f\n", registry.getName(p), hour.min / scale,
+                      hour.max / scale, (float)sum / hour.count / scale);
+    }
+}
+
+/**
+ * Scan timing, sensor values and CPU utilization
+ */
+void print_stats() {
+    // diagnostics only, printf allocates for long lines
+    HeapAllow allow;
+    ScanStats stats;
+    scan_engine.getStats(&stats);
+    Serial.printf("Scan %u: avg %u us, max %u us, jitter %u us, overruns %u\n",
+                  stats.scans, (uint32_t)(stats.sum_usec / (stats.scans ? stats.scans : 1)),
+                  stats.max_usec, stats.jitter_usec, stats.overruns);
+    print_points();
+    print_trends();
+
+#ifdef TRACE_RECORD
+    recorder.flush();
+    Serial.printf("Trace: %u events recorded\n", recorder.events());
+#endif
+
+#ifdef SAMPLE_LOG
+    if (logger != nullptr) {
+        LogStats log;
+        logger->getStats(&log);
+        Serial.printf("Log: %u records, %u dropped, %.1f kB/s write rate, worst flush %u ms, %u errors\n",
+                      log.records, log.dropped, log.flush_usec ? log.bytes * 1000.0 / log.flush_usec : 0.0,
+                      log.max_flush_usec / 1000, log.errors);
+    }
+#endif
+
+#ifdef MQTT_URI
+    MqttStats mqtt_stats;
+    mqtt->getStats(&mqtt_stats);
+    Serial.printf("MQTT: %.1f msg/s, %.0f B/s, %u in flight, %u spilled, %u backlog, %u dropped, %u reconnects\n",
+                  (mqtt_stats.messages - mqtt_last.messages) * 1000.0 / STATS_INTERVAL,
+                  (mqtt_stats.bytes - mqtt_last.bytes) * 1000.0 / STATS_INTERVAL, mqtt_stats.inflight,
+                  mqtt_stats.spilled, mqtt_stats.backlog, mqtt_stats.dropped, mqtt_stats.reconnects);
+    mqtt_last = mqtt_stats;
+#endif
+
+#ifdef PLC_STATIC_ALLOC
+    HeapGuardStats heap;
+    HeapGuard::getStats(&heap);
+    Serial.printf("Heap: %u violations, %u allowed allocations (%u B), free %u B (%+d B since setup), "
+                  "lowest %u B\n", heap.violations, heap.allowed, heap.allowed_bytes, heap.free_bytes,
+                  (int32_t)(heap.free_bytes - heap.armed_free), heap.lowest_free);
+    if (heap.violations > 0) {
+        Serial.printf("  last: %u B in task %s\n", heap.last_size, heap.last_task);
+    }
+#endif
+
+    Serial.println("Events:");
+    events.printStats(&Serial);
+    Serial.println("Tasks:");
+    events.printTaskStats(&Serial);
+}
+
+/**
+ * Load the site configuration. The binary image is used as is while it
+ * matches the text, otherwise the text is compiled and the image rewritten,
+ * so only the first boot after a change pays for parsing.
+ */
+void load_config() {
+    int64_t     start = timespec_now_to_usec();
+    ConfigError error;
+    size_t      text_len  = 0;
+    size_t      image_len = 0;
+    uint8_t*    text      = storage_read(CONFIG_TEXT_FILE, &text_len);
+    uint8_t*    data      = storage_read(CONFIG_IMAGE_FILE, &image_len);
+
+    // without the text a prepared image is used alone
+    if (data != nullptr && config.load(data, image_len, &error)) {
+        if (text != nullptr && config.sourceCrc() != modbus_crc16(text, text_len)) {
+            config.unload();
+        }
+    } else if (data != nullptr) {
+        Serial.printf("%s: %s\n", CONFIG_IMAGE_FILE, error.message);
+    }
+
+    if (!config.loaded() && text != nullptr) {
+        data = ConfigImage::compile((const char*)text, text_len, &image_len, &error);
+        if (data == nullptr) {
+            Serial.printf("%s line %u: %s\n", CONFIG_TEXT_FILE, error.line, error.message);
+        } else {
+            if (!storage_write(CONFIG_IMAGE_FILE, data, image_len)) {
+                Serial.printf("%s not written\n", CONFIG_IMAGE_FILE);
+            }
+            config.load(data, image_len, &error);
+        }
+    }
+    delete[] text;
+
+    if (config.loaded()) {
+        Serial.printf("Configuration: %u sensors, %u points in %lld us\n", config.sensors(), config.points(),
+                      timespec_now_to_usec() - start);
+    } else {
+        Serial.println("No configuration, using defaults");
+    }
+}
+
+/**
+ * Serial line format of the bus section
+ */
+uint32_t config_serial(const ConfigBus* bus) {
+    static const uint32_t formats[4][3][2] = {
+        {{SERIAL_5N1, SERIAL_5N2}, {SERIAL_5E1, SERIAL_5E2}, {SERIAL_5O1, SERIAL_5O2}},
+        {{SERIAL_6N1, SERIAL_6N2}, {SERIAL_6E1, SERIAL_6E2}, {SERIAL_6O1, SERIAL_6O2}},
+        {{SERIAL_7N1, SERIAL_7N2}, {SERIAL_7E1, SERIAL_7E2}, {SERIAL_7O1, SERIAL_7O2}},
+        {{SERIAL_8N1, SERIAL_8N2}, {SERIAL_8E1, SERIAL_8E2}, {SERIAL_8O1, SERIAL_8O2}},
+    };
+    uint8_t parity = bus->parity == 'E' ? 1 : bus->parity == 'O' ? 2 : 0;
+    return formats[bus->data_bits - 5][parity][bus->stop_bits - 1];
+}
+
+/**
+ * Sensors of the configuration, or the example sensor at address 2
+ */
+void setup_sensors() {
+    if (config.loaded() && config.sensors() > 0) {
+        for (uint16_t i = 0; i < config.sensors(); i++) {
+            const ConfigSensor* s = config.sensor(i);
+            sensors[sensor_count++] = sensor_pool.create(s->id, modbus, s->address, config.string(s->name),
+                                                         config.string(s->description));
+        }
+    } else {
+        sensors[sensor_count++] = sensor_pool.create(0, modbus, 2, "", "");
+    }
+    sensor = sensors[0];
+
+    for (uint8_t i = 0; i < sensor_count; i++) {
+        sensors[i]->setShadowImage(&image);
+        sensors[i]->setRegistry(&registry);
+    }
+
+#ifdef SENSOR_FILTER
+    // alarms, trends and telemetry see the filtered values, the shadow image keeps the raw ones
+    for (uint8_t i = 0; i < sensor_count; i++) {
+        SensorFilter* f = &filters[i * 2];
+        if (!f[0].configure(SENSOR_FILTER) || !f[1].configure(SENSOR_FILTER)) {
+            Serial.println("SENSOR_FILTER invalid, values are not filtered");
+            break;
+        }
+        registry.setFilter(sensors[i]->getTemperaturePoint(), &f[0]);
+        registry.setFilter(sensors[i]->getHumidityPoint(), &f[1]);
+    }
+#endif
+
+    // further points are registered for CAN, trends and alarms by name
+    for (uint16_t i = 0; config.loaded() && i < config.points(); i++) {
+        const ConfigPoint* p = config.point(i);
+        if (registry.add(config.string(p->name), config.string(p->description), p->address, p->scale) == POINT_INVALID) {
+            Serial.printf("Registry full, %u points not added\n", config.points() - i);
+            break;
+        }
+    }
+}
+
+/**
+ * Load the PLC program from the SD card
+ */
+void load_program() {
+    size_t   len;
+    uint8_t* data = storage_read(PLC_PROGRAM_FILE, &len);
+    if (data == nullptr) {
+        Serial.println("No PLC program");
+        return;
+    }
+    if (program.load(data, len)) {
+        Serial.printf("PLC program loaded, %u instructions\n", program.size());
+    } else {
+        Serial.println("PLC program invalid");
+    }
+    delete[] data;
+}
 
 void setup() {
     // Setup PLC
     M5StamPLC.begin();
 
+#ifdef MODBUS_SNIFFER
+    // passive capture of the PWR-485 bus to Serial, nothing else runs
+    Serial.begin(115200);
+    sniffer = sniffer_pool.create(&Serial1, MODBUS_SNIFFER);
+    sniffer->begin(&Serial, RX_PIN, REDE_PIN);
+    return;
+#endif
+
+    Serial.begin(115200);
+    storage_begin();
+    load_config();
+
     // Setup modbus RTU client on Serial1
-    modbus = new M5Modbus(&Serial1, 9600);
+    if (config.loaded()) {
+        modbus = modbus_pool.create(&Serial1, config.bus()->baudrate, config_serial(config.bus()));
+        modbus->setTimeout(config.bus()->timeout);
+        poll_interval = config.bus()->poll_interval;
+    } else {
+        modbus = modbus_pool.create(&Serial1, 9600);
+    }
+    modbus->setTask(ARDUINO_RUNNING_CORE == 1 ? 0 : 1, MODBUS_TASK_PRIORITY);
     modbus->begin();
 
-    // Setup sensor
-    sensor = new Sensor(0, modbus, 2, "", "");
+#ifdef MODBUS_DISCOVERY
+    // list the slaves on the bus before the sensors start polling
+    discover_bus();
+#endif
+
+    // Setup sensors, responses arrive in the Modbus worker task
+    setup_sensors();
+    modbus->onResponse(
+        [](ModbusMessage rsp, uint32_t token) { modbus_response(rsp, token, timespec_now_to_msec()); },
+        [](Error err, uint32_t token) { modbus_error(err, token, timespec_now_to_msec()); });
+
+    // history of the sensor values at 1 s, 1 min, 1 h and 1 day resolution
+    trends.track(sensor->getTemperaturePoint());
+    trends.track(sensor->getHumidityPoint());
+    setup_alarms();
+    registry.onUpdate(point_updated);
+
+    // Setup scan, coil writes are staged and committed by the next scan
+    load_program();
+#ifdef TRACE_RECORD
+    // same clock as the registry times, so a replay looks like the live run
+    if (storage_ready() && recorder.open(TRACE_FILE, CLOCK_DOMAIN)) {
+        modbus->setRecorder(&recorder);
+    } else {
+        Serial.println("Trace not available");
+    }
+#endif
+#ifdef SAMPLE_LOG
+    // every registry update is logged, see point_updated()
+    if (storage_ready() && log_sink.open(SAMPLE_LOG_FILE)) {
+        logger = logger_pool.create(&log_sink);
+        logger->begin();
+    } else {
+        Serial.println("Sample log not available");
+    }
+#endif
+    Relay::load();
+#ifdef HEATER_RELAY
+    // heater on HEATER_RELAY keeps sensor 0 at 22.0 °C
+    control.add({0, HEATER_RELAY, 220, 20 * CONTROL_ONE, CONTROL_ONE / 10, 0, 1000, 10000, 500, 500});
+#endif
+    if (!inputs.begin()) {
+        Serial.println("Input expander interrupt not found, inputs are polled");
+    }
+    board.onAlert([](uint8_t alerts) {
+        HeapAllow allow;
+        Serial.printf("Board alert:%s%s\n", alerts & BOARD_ALERT_CURRENT ? " over-current" : "",
+                      alerts & BOARD_ALERT_TEMPERATURE ? " over-temperature" : "");
+    });
+    board.begin();
+    if (inputs.getTask() != nullptr) {
+        scan_engine.setInputCapture(&inputs);
+    }
+    image.onCoilWrite([](uint8_t coils) {
+        Relay::stageAll(coils);
+    });
+    scan_engine.begin(plc_logic);
+
+#ifdef CAN_BITRATE
+    // registry points on the PWR-CAN port, see CanTransport.hpp for the frame layout
+    if (can_bus.begin(CAN_BITRATE)) {
+        can = can_pool.create(&can_bus, CAN_NODE, CAN_WIDE);
+        can->listen(CAN_NODE_ANY);
+    } else {
+        Serial.println("CAN init failed");
+    }
+    last_can_refresh = timespec_now_to_msec();
+#endif
+
+#if defined(MODBUS_SERVER_TCP) || defined(MQTT_URI)
+    WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+    while (WiFi.status() != WL_CONNECTED) {
+        delay(500);
+    }
+#endif
+
+    // Setup modbus server
+    server = server_pool.create(&image);
+#ifdef MODBUS_SERVER_TCP
+    server->beginTCP();
+#endif
+
+#ifdef MQTT_URI
+    // the client connects and reconnects in its own task
+    char mqtt_name[MQTT_TOPIC_MAX];
+    snprintf(mqtt_name, sizeof(mqtt_name), "stamplc-%u", MQTT_NODE);
+    mqtt_client.begin(MQTT_URI, mqtt_name);
+#ifdef MQTT_BENCHMARK
+    // full batches without and with pipelining, before the publisher takes the client over
+    while (!mqtt_client.connected()) {
+        delay(100);
+    }
+    for (uint8_t window : {1, MQTT_MAX_INFLIGHT}) {
+        MqttBenchmark mqtt_bench;
+        MqttPublisher::benchmark(&mqtt_client, MQTT_BATCH_POINTS, 500, window, &mqtt_bench);
+        Serial.printf("MQTT window %u: %.0f msg/s, %.1f kB/s\n", window,
+                      mqtt_bench.messages * 1e9 / mqtt_bench.total_nsec, mqtt_bench.bytes * 1e6 / mqtt_bench.total_nsec);
+    }
+#endif
+    if (!storage_ready() || !mqtt_spill.open(MQTT_SPILL_FILE, MQTT_SPILL_SLOTS)) {
+        Serial.println("MQTT spill not available, messages are dropped while offline");
+    }
+    char mqtt_topic[MQTT_TOPIC_MAX];
+    snprintf(mqtt_topic, sizeof(mqtt_topic), MQTT_TOPIC, MQTT_NODE);
+    mqtt = mqtt_pool.create(&mqtt_client, storage_ready() ? &mqtt_spill : nullptr, mqtt_topic, MQTT_NODE);
+#endif
+
+#ifdef MODBUS_CRC_BENCHMARK
+    ModbusCrcBenchmark bench;
+    modbus_crc_benchmark(MODBUS_RTU_MAX_FRAME, 10000, &bench);
+    Serial.printf("CRC bitwise:  %lld ns/frame\n", bench.bitwise_nsec / 10000);
+    Serial.printf("CRC bytewise: %lld ns/frame\n", bench.bytewise_nsec / 10000);
+    Serial.printf("CRC sliced:   %lld ns/frame\n", bench.sliced_nsec / 10000);
+#endif
+
+#ifdef PLC_BENCHMARK
+    PlcBenchmark plc;
+    PlcProgram::benchmark(1000, 1000, &plc);
+    Serial.printf("PLC %u instructions: %.2f Minstr/s, worst scan %lld us\n", plc.instructions,
+                  (double)plc.instructions * plc.scans * 1000.0 / plc.total_nsec, plc.worst_nsec / 1000);
+#endif
+
+#ifdef SERIES_BENCHMARK
+    SeriesBenchmark series;
+    SeriesEncoder::benchmark(20000, 256, &series);
+    Serial.printf("Series %u samples: ratio %.2f, encode %.2f MB/s, decode %.2f MB/s\n", series.samples,
+                  (double)series.raw_bytes / series.compressed_bytes,
+                  series.raw_bytes * 1000.0 / series.encode_nsec, series.raw_bytes * 1000.0 / series.decode_nsec);
+#endif
+
+#ifdef ALARM_BENCHMARK
+    AlarmBenchmark alarm;
+    AlarmEngine::benchmark(10000, 500, 20000, &alarm);
+    Serial.printf("Alarms %u rules: %lld ns/sample indexed, %lld ns/sample full scan\n", alarm.rules,
+                  alarm.indexed_nsec / alarm.samples, alarm.scan_nsec / alarm.samples);
+#endif
+
+#ifdef CONFIG_BENCHMARK
+    ConfigBenchmark cfg;
+    ConfigImage::benchmark(500, &cfg);
+    Serial.printf("Config %u points: text %u B, image %u B, compile %lld us, load %lld us\n", cfg.points,
+                  cfg.text_bytes, cfg.image_bytes, cfg.compile_nsec / 1000, cfg.load_nsec / 1000);
+#endif
+
+#ifdef FILTER_BENCHMARK
+    FilterBenchmark filter;
+    SensorFilter::benchmark(FILTER_BENCH_SAMPLES, &filter);
+    Serial.printf("Filter stages: average %.0f, median %.0f, EWMA %.0f, outlier %.0f samples/s\n",
+                  filter.samples * 1e9 / filter.stage_nsec[FILTER_AVERAGE], filter.samples * 1e9 / filter.stage_nsec[FILTER_MEDIAN],
+                  filter.samples * 1e9 / filter.stage_nsec[FILTER_EWMA], filter.samples * 1e9 / filter.stage_nsec[FILTER_OUTLIER]);
+    Serial.printf("Filter %s: %.0f samples/s per sample, %.0f samples/s in blocks, %u rejected\n", FILTER_BENCH_PIPELINE,
+                  filter.samples * 1e9 / filter.update_nsec, filter.samples * 1e9 / filter.block_nsec, filter.rejected);
+#endif
+
+#if defined(CAN_BITRATE) && defined(CAN_BENCHMARK)
+    // needs a second node on the bus to acknowledge the frames
+    CanBenchmark can_bench;
+    CanTransport::benchmark(&can_bus, nullptr, 64, 100, &can_bench);
+    Serial.printf("CAN %u frames: %.0f points/s\n", can_bench.frames,
+                  (double)can_bench.points * can_bench.rounds * 1e9 / can_bench.total_nsec);
+#endif
+
+    // all periodic work runs from the event loop, loop() blocks in between
+    events.begin();
+#ifdef TRACE_REPLAY
+    // the sensors get their responses from the trace, the bus stays idle
+    if (storage_ready() && player.open(TRACE_FILE)) {
+        xTaskCreate([](void*) {
+            replay_trace();
+            vTaskDelete(nullptr);
+        }, "replay", TRACE_REPLAY_STACK, nullptr, MODBUS_TASK_PRIORITY, nullptr);
+    } else {
+        Serial.println("No trace to replay");
+    }
+#else
+    events.every("poll", poll_interval, []() {
+        for (uint8_t i = 0; i < sensor_count; i++) {
+            sensors[i]->poll();
+        }
+    });
+#endif
+    events.every("stats", STATS_INTERVAL, print_stats);
+#ifdef CAN_BITRATE
+    if (can != nullptr) {
+        events.every("can", CAN_PERIOD, []() {
+            int64_t now     = timespec_now_to_msec();
+            bool    refresh = last_can_refresh + CAN_REFRESH <= now;
+            publish_can(refresh);
+            if (refresh) {
+                last_can_refresh = now;
+            }
+        });
+    }
+#endif
+#ifdef MQTT_URI
+    events.every("mqtt", MQTT_PERIOD, publish_mqtt);
+    events.every("mqtt drain", MQTT_DRAIN_PERIOD, []() {
+        // the esp-mqtt outbox copies every message to the heap
+        HeapAllow allow;
+        mqtt->drain();
+    });
+#endif
+#ifdef LIGHT_SLEEP
+    if (!EventLoop::enableLightSleep(240, 80)) {
+        Serial.println("Light sleep not available");
+    }
+#endif
 
-    Serial.begin(115200);
     Serial.println("Setup finished");
+
+#ifdef PLC_STATIC_ALLOC
+    // the control path runs without the heap from here on, see HeapGuard.hpp
+    HeapGuard::watch(xTaskGetCurrentTaskHandle());
+    HeapGuard::watch(scan_engine.getTask());
+    if (inputs.getTask() != nullptr) {
+        HeapGuard::watch(inputs.getTask());
+    }
+    HeapGuard::watch(board.getTask());
+    HeapGuard::arm();
+#endif
 }
 
 void loop() {
-    sensor->poll();
+#ifdef MODBUS_SNIFFER
+    vTaskDelay(portMAX_DELAY);
+#endif
+    events.dispatch();
 }
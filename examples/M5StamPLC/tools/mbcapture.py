@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+"""
+Convert a BusSniffer capture (MBS1) into pcap or CSV.
+
+    mbcapture.py capture.bin capture.pcap
+    mbcapture.py capture.bin capture.csv
+
+pcap files use link type USER0 (147); in Wireshark map it to the "mbrtu"
+dissector under Preferences / Protocols / DLT_USER.
+"""
+
+import csv
+import struct
+import sys
+
+HEADER = struct.Struct("<4sIIq")
+RECORD = struct.Struct("<IBH")
+
+FLAG_CRC_OK = 0x01
+FLAG_RESPONSE = 0x02
+
+LINKTYPE_USER0 = 147
+
+
+def read_capture(path):
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, baud, config, start = HEADER.unpack_from(data, 0)
+    if magic != b"MBS1":
+        raise ValueError("%s is not a BusSniffer capture" % path)
+
+    frames = []
+    usec = start
+    pos = HEADER.size
+    while pos + RECORD.size <= len(data):
+        delta, flags, length = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        if pos + length > len(data):
+            break  # truncated last record
+        usec += delta
+        frames.append((usec, flags, data[pos:pos + length]))
+        pos += length
+    return baud, frames
+
+
+def write_pcap(path, frames):
+    with open(path, "wb") as f:
+        f.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, LINKTYPE_USER0))
+        for usec, _, frame in frames:
+            f.write(struct.pack("<IIII", usec // 1000000, usec % 1000000, len(frame), len(frame)))
+            f.write(frame)
+
+
+def write_csv(path, frames):
+    with open(path, "w", newline="") as f:
+        out = csv.writer(f)
+        out.writerow(["time_usec", "delta_usec", "address", "function", "length", "crc_ok", "response", "data"])
+        previous = frames[0][0] if frames else 0
+        for usec, flags, frame in frames:
+            out.writerow([
+                usec,
+                usec - previous,
+                frame[0] if len(frame) > 0 else "",
+                "0x%02X" % frame[1] if len(frame) > 1 else "",
+                len(frame),
+                int(bool(flags & FLAG_CRC_OK)),
+                int(bool(flags & FLAG_RESPONSE)),
+                frame.hex(" "),
+            ])
+            previous = usec
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip())
+        return 2
+
+    baud, frames = read_capture(sys.argv[1])
+    if sys.argv[2].endswith(".pcap"):
+        write_pcap(sys.argv[2], frames)
+    else:
+        write_csv(sys.argv[2], frames)
+    print("%d frames at %d Bd" % (len(frames), baud))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""
+Compile an instruction list PLC program into the PlcProgram bytecode.
+
+    plcc.py program.il plc.bin
+
+One instruction per line, ';' starts a comment:
+
+    LD   I0         ; acc = input 0
+    ANDN M5         ; acc &= !marker 5
+    PUSH
+    GT   R0 250     ; acc = register 0 > 250 (sensor 0 temperature > 25.0)
+    ANDP
+    TON  T0 2000    ; on-delay 2 s
+    ST   Q0         ; relay 0 = acc
+
+Operands: I0..7 inputs, Q0..3 relays, M0..255 markers, T0..63 timers,
+R0..63 input registers. The program ends with an implicit END.
+"""
+
+import struct
+import sys
+
+OPCODES = ["END", "LD", "LDN", "AND", "ANDN", "OR", "ORN", "NOT", "ST", "STN", "SET", "RST",
+           "PUSH", "ANDP", "ORP", "GT", "LT", "EQ", "TON"]
+AREAS = {"I": (1, 8), "Q": (2, 4), "M": (3, 256), "T": (4, 64), "R": (5, 64)}
+
+NO_OPERAND = {"END", "NOT", "PUSH", "ANDP", "ORP"}
+WITH_ARG = {"GT", "LT", "EQ", "TON"}
+MAX_INSTR = 8192
+STACK_DEPTH = 16
+
+
+class CompileError(Exception):
+    pass
+
+
+def operand(text):
+    area = text[:1].upper()
+    if area not in AREAS or not text[1:].isdigit():
+        raise CompileError("bad operand '%s'" % text)
+    code, size = AREAS[area]
+    index = int(text[1:])
+    if index >= size:
+        raise CompileError("operand '%s' out of range" % text)
+    return area, code, index
+
+
+def compile_line(tokens):
+    op = tokens[0].upper()
+    if op not in OPCODES:
+        raise CompileError("unknown instruction '%s'" % tokens[0])
+
+    if op in NO_OPERAND:
+        if len(tokens) != 1:
+            raise CompileError("%s takes no operand" % op)
+        return struct.pack("<BBHi", OPCODES.index(op), 0, 0, 0), op
+
+    expected = 3 if op in WITH_ARG else 2
+    if len(tokens) != expected:
+        raise CompileError("%s expects %d operand(s)" % (op, expected - 1))
+
+    area, code, index = operand(tokens[1])
+    if op in ("GT", "LT", "EQ") and area != "R":
+        raise CompileError("%s needs a register operand" % op)
+    if op == "TON" and area != "T":
+        raise CompileError("TON needs a timer operand")
+    if op in ("ST", "STN", "SET", "RST") and area == "I":
+        raise CompileError("inputs are read only")
+    if op not in WITH_ARG and area == "R":
+        raise CompileError("%s needs a bit operand" % op)
+
+    arg = int(tokens[2], 0) if op in WITH_ARG else 0
+    return struct.pack("<BBHi", OPCODES.index(op), code, index, arg), op
+
+
+def compile_program(lines):
+    code = []
+    depth = 0
+    for number, line in enumerate(lines, 1):
+        tokens = line.split(";", 1)[0].split()
+        if not tokens:
+            continue
+        try:
+            instr, op = compile_line(tokens)
+        except (CompileError, ValueError) as e:
+            raise CompileError("line %d: %s" % (number, e))
+        if op == "END":
+            break
+        depth += 1 if op == "PUSH" else -1 if op in ("ANDP", "ORP") else 0
+        if depth < 0 or depth > STACK_DEPTH:
+            raise CompileError("line %d: stack %s" % (number, "underflow" if depth < 0 else "overflow"))
+        code.append(instr)
+
+    code.append(struct.pack("<BBHi", 0, 0, 0, 0))
+    if len(code) > MAX_INSTR:
+        raise CompileError("program too long (%d instructions)" % len(code))
+    return b"PLC1" + struct.pack("<H", len(code)) + b"".join(code)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip())
+        return 2
+    try:
+        with open(sys.argv[1]) as f:
+            binary = compile_program(f)
+    except CompileError as e:
+        print("%s: %s" % (sys.argv[1], e), file=sys.stderr)
+        return 1
+    with open(sys.argv[2], "wb") as f:
+        f.write(binary)
+    print("%d instructions" % ((len(binary) - 6) // 8))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
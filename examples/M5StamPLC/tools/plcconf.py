@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""
+Compile a site configuration text into the ConfigImage binary (PCF1).
+
+    plcconf.py config.txt config.bin
+
+The image is the same as the one the StamPLC compiles from /config.txt, so a
+prepared config.bin can be copied to the card together with the text. The
+text format is described in include/ConfigImage.hpp.
+"""
+
+import struct
+import sys
+
+MAGIC = b"PCF1"
+VERSION = 1
+MAX_SENSORS = 16
+MAX_POINTS = 4096
+
+BUS = struct.Struct("<IBBBBII")
+LORA = struct.Struct("<B3x8s8s16s16s")
+HEADER = struct.Struct("<4sHHIHHHHIII")
+SENSOR = struct.Struct("<BBHII")
+POINT = struct.Struct("<IIHHBBH")
+HEADER_SIZE = HEADER.size + BUS.size + LORA.size
+
+
+class ConfigError(Exception):
+    pass
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def number(text, low, high):
+    # same bases as strtoul(text, NULL, 0)
+    try:
+        if text[:2].lower() == "0x":
+            value = int(text[2:], 16)
+        elif len(text) > 1 and text[0] == "0":
+            value = int(text[1:], 8)
+        else:
+            value = int(text, 10)
+    except ValueError:
+        return None
+    return value if low <= value <= high else None
+
+
+def hex_bytes(text, size):
+    try:
+        data = bytes.fromhex(text)
+    except ValueError:
+        return None
+    return data if len(data) == size and len(text) == 2 * size else None
+
+
+def tokenize(line):
+    """Split a line into the section word and its key=value pairs"""
+    pos = 0
+    end = len(line)
+
+    def skip_space():
+        nonlocal pos
+        while pos < end and line[pos] in " \t\r":
+            pos += 1
+
+    def word():
+        nonlocal pos
+        start = pos
+        while pos < end and line[pos] not in " \t\r=":
+            pos += 1
+        return line[start:pos]
+
+    skip_space()
+    if pos == end or line[pos] == "#":
+        return None, []
+    section = word()
+    pairs = []
+    while True:
+        skip_space()
+        if pos == end or line[pos] == "#":
+            return section, pairs
+        key = word()
+        if not key or pos == end or line[pos] != "=":
+            raise ConfigError("expected key=value")
+        pos += 1
+        if pos < end and line[pos] == '"':
+            close = line.find('"', pos + 1)
+            if close < 0:
+                raise ConfigError("expected key=value")
+            value = line[pos + 1:close]
+            pos = close + 1
+        else:
+            value = word()
+            if not value:
+                raise ConfigError("expected key=value")
+        pairs.append((key, value))
+
+
+class Builder:
+    def __init__(self):
+        self.bus = {"baudrate": 9600, "data_bits": 8, "parity": "N", "stop_bits": 1,
+                    "timeout": 1000, "poll": 5000}
+        self.lora = None
+        self.sensors = []
+        self.points = []
+        self.strings = bytearray(b"\0")
+
+    def string(self, text):
+        if not text:
+            return 0
+        offset = len(self.strings)
+        self.strings += text.encode() + b"\0"
+        return offset
+
+    def parse_bus(self, pairs):
+        for key, value in pairs:
+            if key == "baudrate" and number(value, 1, 921600):
+                self.bus["baudrate"] = number(value, 1, 921600)
+            elif (key == "format" and len(value) == 3 and "5" <= value[0] <= "8"
+                  and value[1] in "NEO" and value[2] in "12"):
+                self.bus.update(data_bits=int(value[0]), parity=value[1], stop_bits=int(value[2]))
+            elif key == "timeout" and number(value, 1, 60000):
+                self.bus["timeout"] = number(value, 1, 60000)
+            elif key == "poll" and number(value, 1, 86400000):
+                self.bus["poll"] = number(value, 1, 86400000)
+            else:
+                raise ConfigError("invalid bus setting")
+
+    def parse_sensor(self, pairs):
+        if len(self.sensors) == MAX_SENSORS:
+            raise ConfigError("too many sensors")
+        sensor = {"id": 0, "address": 0, "name": 0, "description": 0}
+        for key, value in pairs:
+            if key == "id" and number(value, 0, 255) is not None:
+                sensor["id"] = number(value, 0, 255)
+            elif key == "address" and number(value, 1, 247):
+                sensor["address"] = number(value, 1, 247)
+            elif key in ("name", "description"):
+                sensor[key] = self.string(value)
+            else:
+                raise ConfigError("invalid sensor setting")
+        if not sensor["address"]:
+            raise ConfigError("sensor without address")
+        if any(other["id"] == sensor["id"] for other in self.sensors):
+            raise ConfigError("duplicate sensor id")
+        self.sensors.append(sensor)
+
+    def parse_point(self, pairs):
+        if len(self.points) == MAX_POINTS:
+            raise ConfigError("too many points")
+        point = {"name": 0, "description": 0, "register": 0, "scale": 1, "address": 0, "function": 3}
+        limits = {"address": (1, 247), "function": (1, 4), "register": (0, 0xFFFF), "scale": (1, 10000)}
+        for key, value in pairs:
+            if key in ("name", "description"):
+                point[key] = self.string(value)
+            elif key in limits and number(value, *limits[key]) is not None:
+                point[key] = number(value, *limits[key])
+            else:
+                raise ConfigError("invalid point setting")
+        if not point["name"]:
+            raise ConfigError("point without name")
+        self.points.append(point)
+
+    def parse_lora(self, pairs):
+        sizes = {"dev_eui": 8, "join_eui": 8, "app_key": 16, "nwk_key": 16}
+        lora = self.lora or {key: bytes(size) for key, size in sizes.items()}
+        for key, value in pairs:
+            if key not in sizes or hex_bytes(value, sizes[key]) is None:
+                raise ConfigError("invalid lora setting")
+            lora[key] = hex_bytes(value, sizes[key])
+        self.lora = lora
+
+    def image(self, source_crc):
+        sensors = HEADER_SIZE
+        points = sensors + len(self.sensors) * SENSOR.size
+        strings = points + len(self.points) * POINT.size
+        size = strings + len(self.strings)
+
+        bus = BUS.pack(self.bus["baudrate"], self.bus["data_bits"], ord(self.bus["parity"]),
+                       self.bus["stop_bits"], 0, self.bus["timeout"], self.bus["poll"])
+        lora = self.lora or {"dev_eui": b"", "join_eui": b"", "app_key": b"", "nwk_key": b""}
+        lora = LORA.pack(1 if self.lora else 0, lora["dev_eui"], lora["join_eui"], lora["app_key"], lora["nwk_key"])
+
+        data = bytearray(HEADER.pack(MAGIC, VERSION, 0, size, source_crc, len(self.sensors), len(self.points),
+                                     0, sensors, points, strings))
+        data += bus + lora
+        for s in self.sensors:
+            data += SENSOR.pack(s["id"], s["address"], 0, s["name"], s["description"])
+        for p in self.points:
+            data += POINT.pack(p["name"], p["description"], p["register"], p["scale"], p["address"], p["function"], 0)
+        data += self.strings
+        struct.pack_into("<H", data, 6, crc16(data))
+        return bytes(data)
+
+
+def compile_config(text):
+    builder = Builder()
+    parsers = {"bus": builder.parse_bus, "sensor": builder.parse_sensor,
+               "point": builder.parse_point, "lora": builder.parse_lora}
+    for number_, line in enumerate(text.split(b"\n"), 1):
+        try:
+            section, pairs = tokenize(line.decode())
+            if section is None:
+                continue
+            if section not in parsers:
+                raise ConfigError("unknown section")
+            parsers[section](pairs)
+        except ConfigError as e:
+            raise ConfigError("line %d: %s" % (number_, e))
+    return builder.image(crc16(text))
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(__doc__.strip())
+        return 2
+
+    with open(sys.argv[1], "rb") as f:
+        text = f.read()
+    try:
+        image = compile_config(text)
+    except ConfigError as e:
+        print("%s: %s" % (sys.argv[1], e))
+        return 1
+
+    with open(sys.argv[2], "wb") as f:
+        f.write(image)
+    sensors, points = struct.unpack_from("<HH", image, 14)
+    print("%d sensors, %d points, %d bytes" % (sensors, points, len(image)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
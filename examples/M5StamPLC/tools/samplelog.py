@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""
+Dump a SampleLogger file as CSV.
+
+    samplelog.py samples.bin samples.csv
+    samplelog.py samples.bin samples.csv --from <time_ms>
+
+With --from only the index blocks are read until the group containing the
+time is found, so seeking does not scan the whole file.
+"""
+
+import csv
+import struct
+import sys
+
+SECTOR = 512
+HEADER = struct.Struct("<HBBIq")
+RECORD = struct.Struct("<IHBBi")
+
+MAGIC = 0x474C
+BLOCK_DATA = 1
+BLOCK_INDEX = 2
+
+INDEX_INTERVAL = (SECTOR - HEADER.size) // 8
+
+
+def read_block(f, number):
+    f.seek(number * SECTOR)
+    block = f.read(SECTOR)
+    if len(block) < SECTOR:
+        return None
+    magic, kind, count, seq, base = HEADER.unpack_from(block, 0)
+    if magic != MAGIC:
+        return (0, 0, 0, 0, block)  # padding after a power loss
+    return (kind, count, seq, base, block)
+
+
+def find_index(f, number):
+    """Next index block from number on, None at the end of the file"""
+    while True:
+        block = read_block(f, number)
+        if block is None:
+            return None, None
+        if block[0] == BLOCK_INDEX:
+            return number, block
+        number += 1
+
+
+def seek_block(f, time_ms):
+    """First block of the index group that may contain time_ms
+
+    Index blocks are expected after every INDEX_INTERVAL data blocks. Logs
+    written by older firmware restarted the numbering on every boot, there
+    the next index block is searched by its type.
+    """
+    first = 0
+    while True:
+        number = first + INDEX_INTERVAL
+        index = read_block(f, number)
+        if index is None:
+            return first
+        if index[0] != BLOCK_INDEX:
+            number, index = find_index(f, first)
+            if index is None:
+                return first
+        kind, count, seq, base, block = index
+        last = struct.unpack_from("<q", block, HEADER.size + (count - 1) * 8)[0]
+        if last >= time_ms:
+            return first
+        first = number + 1
+
+
+def records(f, first, time_ms):
+    number = first
+    while True:
+        block = read_block(f, number)
+        if block is None:
+            return
+        kind, count, seq, base, data = block
+        number += 1
+        if kind != BLOCK_DATA:
+            continue
+        for i in range(count):
+            offset, point, quality, _, value = RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+            if base + offset >= time_ms:
+                yield base + offset, point, quality, value
+
+
+def main():
+    args = sys.argv[1:]
+    time_ms = -(1 << 63)
+    if len(args) == 4 and args[2] == "--from":
+        time_ms = int(args[3])
+        args = args[:2]
+    if len(args) != 2:
+        print(__doc__.strip())
+        return 2
+
+    count = 0
+    with open(args[0], "rb") as f, open(args[1], "w", newline="") as out:
+        writer = csv.writer(out)
+        writer.writerow(["time_ms", "point", "quality", "value"])
+        for record in records(f, seek_block(f, time_ms), time_ms):
+            writer.writerow(record)
+            count += 1
+    print("%d records" % count)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
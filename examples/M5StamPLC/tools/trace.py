@@ -0,0 +1,127 @@
+#!/usr/bin/env python3
+"""
+Inspect or generate a trace (TRC1) for the record/replay harness.
+
+    trace.py dump trace.bin trace.csv
+    trace.py synth trace.bin [--sensors 4] [--hours 24] [--interval 5000] [--seed 1]
+
+synth writes Modbus responses of Sensor (FC 03, humidity and temperature)
+for the given number of sensors polled every interval ms, with a random walk
+and about 1 % timeouts. The same seed gives the same file, so replay
+benchmarks can be compared across builds without recorded traffic.
+"""
+
+import csv
+import random
+import struct
+import sys
+
+HEADER = b"TRC1" + struct.pack("<HH", 1, 0)
+RECORD = struct.Struct("<IBBH")
+
+SOURCES = {0: "trace", 1: "modbus", 2: "env", 3: "lora"}
+KINDS = {
+    (0, 0): "clock",
+    (1, 1): "response", (1, 2): "error",
+    (2, 1): "reading",
+    (3, 1): "uplink", (3, 2): "result",
+}
+
+MODBUS_TIMEOUT = 0xE0   # eModbus error code
+
+
+def read_trace(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:4] != b"TRC1":
+        raise ValueError("%s is not a trace" % path)
+
+    time = 0
+    pos = len(HEADER)
+    while pos + RECORD.size <= len(data):
+        delta, source, kind, length = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        if pos + length > len(data):
+            break  # truncated last record
+        payload = data[pos:pos + length]
+        pos += length
+        if source == 0 and kind == 0:
+            time = struct.unpack("<q", payload)[0]
+            continue
+        time += delta
+        yield time, source, kind, payload
+
+
+def describe(source, kind, payload):
+    if source == 1 and len(payload) >= 4:
+        token = struct.unpack_from("<I", payload)[0]
+        return "token %d: %s" % (token, payload[4:].hex(" "))
+    if source == 2 and kind == 1 and len(payload) == 16:
+        return "T %.2f H %.2f P %.1f Tb %.2f" % struct.unpack("<4f", payload)
+    if source == 3 and kind == 2 and len(payload) >= 2:
+        return "state %d: %s" % (struct.unpack_from("<h", payload)[0], payload[2:].hex(" "))
+    return payload.hex(" ")
+
+
+def dump(path, out_path):
+    with open(out_path, "w", newline="") as f:
+        out = csv.writer(f)
+        out.writerow(["time_us", "source", "kind", "length", "data"])
+        count = 0
+        for time, source, kind, payload in read_trace(path):
+            out.writerow([time, SOURCES.get(source, source), KINDS.get((source, kind), kind), len(payload),
+                          describe(source, kind, payload)])
+            count += 1
+    print("%d events" % count)
+
+
+def synth(path, sensors=4, hours=24, interval=5000, seed=1):
+    rng = random.Random(seed)
+    temperature = [220 + 10 * s for s in range(sensors)]
+    humidity = [450 for _ in range(sensors)]
+    events = 0
+
+    with open(path, "wb") as f:
+        f.write(HEADER)
+        f.write(RECORD.pack(0, 0, 0, 8) + struct.pack("<q", 1700000000 * 1000000))
+        delta = 0
+        for _ in range(hours * 3600 * 1000 // interval):
+            for s in range(sensors):
+                # responses of one poll round arrive one RTU transaction apart
+                delta += 12000
+                if rng.random() < 0.01:
+                    payload = struct.pack("<IB", s, MODBUS_TIMEOUT)
+                    kind = 2
+                else:
+                    temperature[s] += rng.choice((-1, 0, 0, 1))
+                    humidity[s] = min(1000, max(0, humidity[s] + rng.choice((-2, 0, 2))))
+                    payload = struct.pack("<IBBB", s, 2 + s, 3, 4) + struct.pack(">Hh", humidity[s], temperature[s])
+                    kind = 1
+                f.write(RECORD.pack(delta, 1, kind, len(payload)) + payload)
+                delta = 0
+                events += 1
+            delta += interval * 1000 - sensors * 12000
+    print("%d events" % events)
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) == 3 and args[0] == "dump":
+        dump(args[1], args[2])
+        return 0
+    if len(args) >= 2 and args[0] == "synth":
+        options = {"--sensors": 4, "--hours": 24, "--interval": 5000, "--seed": 1}
+        rest = args[2:]
+        for name, value in zip(rest[::2], rest[1::2]):
+            if name not in options:
+                break
+            options[name] = int(value)
+        else:
+            synth(args[1], options["--sensors"], options["--hours"], options["--interval"], options["--seed"])
+            return 0
+    print(__doc__.strip())
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,9 +1,20 @@
 #include <M5Unified.h>
 #include <M5UnitUnified.h>
 #include <M5UnitUnifiedENV.h>
+#include <EnvMath.h>
+#include <SensorFilter.h>
 
 M5Canvas canvas(&M5.Display);
 
+// filter of the displayed values, in 0.01 °C, 0.01 %RH and Pa, see lib/SensorFilter
+#ifndef ENV_FILTER
+#define ENV_FILTER "outlier:4:5,median:3,ewma:0.5"
+#endif
+
+SensorFilter temperature_filter;
+SensorFilter humidity_filter;
+SensorFilter pressure_filter;
+
 m5::unit::UnitUnified Units;
 
 // #define USING_ENV3
@@ -23,9 +34,15 @@ auto& bmp280 = unitENV4.bmp280;
 
 #endif
 
-float calculate_altitude(const float pressure, const float seaLvhPa = 1013.25f)
+/**
+ * @param filter
+ * @param value
+ * @param scale  raw units per unit of value
+ * @return filtered value
+ */
+static float filtered(SensorFilter& filter, float value, float scale)
 {
-    return 44330.f * (1.0f - pow((pressure / 100.f) / seaLvhPa, 0.1903f));
+    return filter.update((int32_t)lroundf(value * scale)) / scale;
 }
 
 void setup()
@@ -41,6 +58,22 @@ void setup()
 
     Wire.begin(pin_num_sda, pin_num_scl, 400000U);
 
+    if (!temperature_filter.configure(ENV_FILTER) || !humidity_filter.configure(ENV_FILTER) ||
+        !pressure_filter.configure(ENV_FILTER)) {
+        M5_LOGE("Invalid ENV_FILTER, values are not filtered");
+    }
+
+#ifdef ENV_MATH_BENCHMARK
+    // EnvMath against the libm formulas, see lib/EnvMath/src/EnvMath.h
+    EnvMathBenchmark bench;
+    env_math_benchmark(100000, &bench);
+    for (const EnvMathTiming& q : bench.quantities) {
+        Serial.printf("%-12s libm %5.0f ns, float %5.0f ns (error %.4f), fixed %5.0f ns (error %.4f)\n", q.name,
+                      (double)q.ref_nsec / bench.samples, (double)q.float_nsec / bench.samples, q.float_error,
+                      (double)q.fixed_nsec / bench.samples, q.fixed_error);
+    }
+#endif
+
 #if defined(USING_ENV3)
     if (!Units.add(unitENV3, Wire) || !Units.begin()) {
         M5_LOGE("Failed to begin Unit ENV3");
@@ -71,42 +104,52 @@ void loop()
     Units.wait_for_update();
 
     if (sht30.updated()) {
+        float t = filtered(temperature_filter, sht30.temperature(), 100);
+        float h = filtered(humidity_filter, sht30.humidity(), 100);
         M5.Display.setCursor(0, 0);
-        M5.Display.fillRect(0, 0, 320, 80, TFT_BLACK);
+        M5.Display.fillRect(0, 0, 320, 140, TFT_BLACK);
         M5.Display.printf(
             "\n>SHT30Temp:%.4f\n"
-            ">Humidity:%.4f",
-            sht30.temperature(), sht30.humidity());
+            ">Humidity:%.4f\n"
+            ">Dew point:%.2f\n"
+            ">Abs. humidity:%.2f\n"
+            ">Heat index:%.2f",
+            t, h, env_dew_point(t, h), env_absolute_humidity(t, h), env_heat_index(t, h));
     }
     if (qmp6988.updated()) {
-        M5.Display.setCursor(0, 80);
-        M5.Display.fillRect(0, 80, 320, 80, TFT_BLACK);
-        auto p = qmp6988.pressure();
+        M5.Display.setCursor(0, 140);
+        M5.Display.fillRect(0, 140, 320, 80, TFT_BLACK);
+        float p = filtered(pressure_filter, qmp6988.pressure(), 1);
         M5.Display.printf(
             "\n>QMP6988Temp:%.4f\n"
             ">Pressure:%.4f\n"
             ">Altitude:%.4f",
-            qmp6988.temperature(), p * 0.01f /* To hPa */, calculate_altitude(p));
+            qmp6988.temperature(), p * 0.01f /* To hPa */, env_altitude(p));
     }
 
 #elif defined(USING_ENV4)
     if (sht40.updated()) {
+        float t = filtered(temperature_filter, sht40.temperature(), 100);
+        float h = filtered(humidity_filter, sht40.humidity(), 100);
         M5.Display.setCursor(0, 0);
-        M5.Display.fillRect(0, 0, 320, 80, TFT_BLACK);
+        M5.Display.fillRect(0, 0, 320, 140, TFT_BLACK);
         M5.Display.printf(
             "\n>SHT40Temp: %.4f\n"
-            ">Humidity :%.4f",
-            sht40.temperature(), sht40.humidity());
+            ">Humidity :%.4f\n"
+            ">Dew point: %.2f\n"
+            ">Abs. humidity: %.2f\n"
+            ">Heat index: %.2f",
+            t, h, env_dew_point(t, h), env_absolute_humidity(t, h), env_heat_index(t, h));
     }
     if (bmp280.updated()) {
-        M5.Display.setCursor(0, 80);
-        M5.Display.fillRect(0, 80, 320, 80, TFT_BLACK);
-        auto p = bmp280.pressure();
+        M5.Display.setCursor(0, 140);
+        M5.Display.fillRect(0, 140, 320, 80, TFT_BLACK);
+        float p = filtered(pressure_filter, bmp280.pressure(), 1);
         M5.Display.printf(
             "\n>BMP280Temp: %.4f\n"
             ">Pressure: %.4f\n"
             ">Altitude: %.4f",
-            bmp280.temperature(), p * 0.01f /* To hPa */, calculate_altitude(p));
+            bmp280.temperature(), p * 0.01f /* To hPa */, env_altitude(p));
     }
 #endif
     delay(1000);
@@ -0,0 +1,443 @@
+//
+// Derived environmental quantities, see EnvMath.h.
+//
+// The float versions reduce the argument of log2 to [0.75, 1.5) and of exp2
+// to [-0.5, 0.5] through the exponent bits and evaluate a Chebyshev fit of
+// degree 7 and 5 there. The fixed versions do the same reduction with a
+// count of leading zeros and interpolate in a table of 256 segments.
+//
+
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "EnvMath.h"
+
+// Magnus constants over water (Sonntag 1990), dew point
+#define MAGNUS_B 17.62f
+#define MAGNUS_C 243.12f
+// saturation vapour pressure, absolute humidity
+#define VAPOUR_A 6.112f         // hPa
+#define VAPOUR_B 17.67f
+#define VAPOUR_C 243.5f
+// 18.02 g/mol / 8.314 J/(mol K) for hPa -> g/m3
+#define VAPOUR_K 216.74f
+
+#define BAROMETRIC_H 44330.0f   // m
+#define BAROMETRIC_N 0.1903f
+
+#define LN2    0.69314718f
+#define LOG2E  1.44269504f
+
+// Q24 constants of the fixed versions
+#define LOG2_10000_Q24    222930821
+#define LN2_Q24           11629080
+#define LOG2E_Q24         24204406
+#define BAROMETRIC_N_Q24  3192704
+#define MAGNUS_B_Q24      295614546
+
+#define BENCH_BATCH 64
+
+// log2(1 + i / 256) in Q24
+static const uint32_t LOG2_TABLE[257] = {
+    0x00000000, 0x0001709c, 0x0002dfca, 0x00044d8c, 0x0005b9e6, 0x000724d9, 0x00088e69, 0x0009f698,
+    0x000b5d6a, 0x000cc2e0, 0x000e26fd, 0x000f89c5, 0x0010eb39, 0x00124b5b, 0x0013aa30, 0x001507b8,
+    0x001663f7, 0x0017beef, 0x001918a1, 0x001a7112, 0x001bc842, 0x001d1e35, 0x001e72ec, 0x001fc66a,
+    0x002118b1, 0x002269c3, 0x0023b9a3, 0x00250853, 0x002655d4, 0x0027a229, 0x0028ed54, 0x002a3757,
+    0x002b8034, 0x002cc7ee, 0x002e0e86, 0x002f53fe, 0x00309858, 0x0031db96, 0x00331dba, 0x00345ec6,
+    0x00359ebc, 0x0036dd9e, 0x00381b6e, 0x0039582c, 0x003a93dd, 0x003bce80, 0x003d0818, 0x003e40a6,
+    0x003f782d, 0x0040aeaf, 0x0041e42b, 0x004318a6, 0x00444c1f, 0x00457e9a, 0x0046b017, 0x0047e098,
+    0x0049101f, 0x004a3ead, 0x004b6c44, 0x004c98e6, 0x004dc493, 0x004eef4f, 0x00501919, 0x005141f4,
+    0x005269e1, 0x005390e2, 0x0054b6f8, 0x0055dc24, 0x00570069, 0x005823c7, 0x00594640, 0x005a67d5,
+    0x005b8887, 0x005ca859, 0x005dc74b, 0x005ee55f, 0x00600296, 0x00611ef1, 0x00623a72, 0x0063551a,
+    0x00646eea, 0x006587e4, 0x0066a009, 0x0067b75a, 0x0068cdd8, 0x0069e385, 0x006af862, 0x006c0c70,
+    0x006d1fb0, 0x006e3223, 0x006f43cc, 0x007054aa, 0x007164bf, 0x0072740c, 0x00738292, 0x00749053,
+    0x00759d50, 0x0076a989, 0x0077b4ff, 0x0078bfb5, 0x0079c9ab, 0x007ad2e1, 0x007bdb5a, 0x007ce316,
+    0x007dea16, 0x007ef05b, 0x007ff5e6, 0x0080fab9, 0x0081fed4, 0x00830239, 0x008404e8, 0x008506e2,
+    0x00860828, 0x008708bc, 0x0088089e, 0x008907cf, 0x008a0650, 0x008b0422, 0x008c0146, 0x008cfdbe,
+    0x008df989, 0x008ef4a9, 0x008fef1f, 0x0090e8eb, 0x0091e20f, 0x0092da8b, 0x0093d260, 0x0094c990,
+    0x0095c01a, 0x0096b601, 0x0097ab44, 0x00989fe4, 0x009993e3, 0x009a8742, 0x009b7a00, 0x009c6c1f,
+    0x009d5da0, 0x009e4e83, 0x009f3eca, 0x00a02e74, 0x00a11d84, 0x00a20bf9, 0x00a2f9d5, 0x00a3e718,
+    0x00a4d3c2, 0x00a5bfd6, 0x00a6ab53, 0x00a7963a, 0x00a8808c, 0x00a96a4a, 0x00aa5374, 0x00ab3c0c,
+    0x00ac2411, 0x00ad0b85, 0x00adf268, 0x00aed8bc, 0x00afbe80, 0x00b0a3b5, 0x00b1885c, 0x00b26c77,
+    0x00b35004, 0x00b43306, 0x00b5157d, 0x00b5f769, 0x00b6d8cb, 0x00b7b9a4, 0x00b899f5, 0x00b979bd,
+    0x00ba58ff, 0x00bb37b9, 0x00bc15ee, 0x00bcf39d, 0x00bdd0c8, 0x00bead6e, 0x00bf8991, 0x00c06531,
+    0x00c1404f, 0x00c21aeb, 0x00c2f506, 0x00c3cea0, 0x00c4a7ba, 0x00c58055, 0x00c65872, 0x00c73010,
+    0x00c80731, 0x00c8ddd4, 0x00c9b3fb, 0x00ca89a7, 0x00cb5ed7, 0x00cc338c, 0x00cd07c7, 0x00cddb88,
+    0x00ceaed0, 0x00cf819f, 0x00d053f7, 0x00d125d7, 0x00d1f740, 0x00d2c832, 0x00d398af, 0x00d468b6,
+    0x00d53848, 0x00d60765, 0x00d6d60f, 0x00d7a446, 0x00d87209, 0x00d93f5a, 0x00da0c3a, 0x00dad8a8,
+    0x00dba4a4, 0x00dc7031, 0x00dd3b4e, 0x00de05fb, 0x00ded039, 0x00df9a09, 0x00e0636a, 0x00e12c5e,
+    0x00e1f4e5, 0x00e2bcff, 0x00e384ad, 0x00e44bf0, 0x00e512c7, 0x00e5d933, 0x00e69f35, 0x00e764cd,
+    0x00e829fb, 0x00e8eec1, 0x00e9b31e, 0x00ea7712, 0x00eb3a9f, 0x00ebfdc5, 0x00ecc083, 0x00ed82db,
+    0x00ee44cd, 0x00ef065a, 0x00efc781, 0x00f08843, 0x00f148a1, 0x00f2089b, 0x00f2c832, 0x00f38765,
+    0x00f44636, 0x00f504a4, 0x00f5c2b0, 0x00f6805a, 0x00f73da4, 0x00f7fa8c, 0x00f8b714, 0x00f9733c,
+    0x00fa2f04, 0x00faea6d, 0x00fba578, 0x00fc6023, 0x00fd1a71, 0x00fdd460, 0x00fe8df2, 0x00ff4728,
+    0x01000000,
+};
+
+// 2^(i / 256) in Q30
+static const uint32_t EXP2_TABLE[257] = {
+    0x40000000, 0x402c6be9, 0x4058f6a8, 0x4085a051, 0x40b268fa, 0x40df50b8, 0x410c57a2, 0x41397dcc,
+    0x4166c34c, 0x41942839, 0x41c1aca7, 0x41ef50ae, 0x421d1462, 0x424af7da, 0x4278fb2b, 0x42a71e6c,
+    0x42d561b4, 0x4303c518, 0x433248ae, 0x4360ec8d, 0x438fb0cb, 0x43be957f, 0x43ed9ac0, 0x441cc0a3,
+    0x444c0740, 0x447b6ead, 0x44aaf702, 0x44daa054, 0x450a6abb, 0x453a564d, 0x456a6323, 0x459a9152,
+    0x45cae0f2, 0x45fb521a, 0x462be4e2, 0x465c9961, 0x468d6fae, 0x46be67e0, 0x46ef8210, 0x4720be55,
+    0x47521cc6, 0x47839d7b, 0x47b5408c, 0x47e70611, 0x4818ee22, 0x484af8d6, 0x487d2646, 0x48af768a,
+    0x48e1e9ba, 0x49147fee, 0x4947393f, 0x497a15c4, 0x49ad1598, 0x49e038d0, 0x4a137f88, 0x4a46e9d6,
+    0x4a7a77d4, 0x4aae299b, 0x4ae1ff43, 0x4b15f8e6, 0x4b4a169c, 0x4b7e587e, 0x4bb2bea5, 0x4be7492b,
+    0x4c1bf829, 0x4c50cbb8, 0x4c85c3f1, 0x4cbae0ef, 0x4cf022ca, 0x4d25899c, 0x4d5b157e, 0x4d90c68b,
+    0x4dc69cdd, 0x4dfc988c, 0x4e32b9b4, 0x4e69006e, 0x4e9f6cd4, 0x4ed5ff00, 0x4f0cb70c, 0x4f439514,
+    0x4f7a9930, 0x4fb1c37c, 0x4fe91413, 0x50208b0e, 0x50582888, 0x508fec9c, 0x50c7d765, 0x50ffe8fe,
+    0x51382182, 0x5170810b, 0x51a907b4, 0x51e1b59a, 0x521a8ad7, 0x52538786, 0x528cabc3, 0x52c5f7aa,
+    0x52ff6b55, 0x533906e0, 0x5372ca68, 0x53acb607, 0x53e6c9da, 0x542105fd, 0x545b6a8b, 0x5495f7a1,
+    0x54d0ad5a, 0x550b8bd4, 0x55469329, 0x5581c378, 0x55bd1cdb, 0x55f89f70, 0x56344b52, 0x567020a0,
+    0x56ac1f75, 0x56e847ef, 0x57249a29, 0x57611642, 0x579dbc57, 0x57da8c83, 0x581786e6, 0x5854ab9b,
+    0x5891fac1, 0x58cf7474, 0x590d18d3, 0x594ae7fb, 0x5988e209, 0x59c7071c, 0x5a055751, 0x5a43d2c6,
+    0x5a82799a, 0x5ac14bea, 0x5b0049d4, 0x5b3f7377, 0x5b7ec8f2, 0x5bbe4a61, 0x5bfdf7e5, 0x5c3dd19c,
+    0x5c7dd7a4, 0x5cbe0a1c, 0x5cfe6923, 0x5d3ef4d7, 0x5d7fad59, 0x5dc092c7, 0x5e01a53f, 0x5e42e4e3,
+    0x5e8451d0, 0x5ec5ec26, 0x5f07b405, 0x5f49a98c, 0x5f8bccdb, 0x5fce1e12, 0x60109d51, 0x60534ab7,
+    0x60962665, 0x60d9307b, 0x611c6919, 0x615fd05e, 0x61a3666d, 0x61e72b65, 0x622b1f66, 0x626f4292,
+    0x62b39509, 0x62f816eb, 0x633cc85b, 0x6381a978, 0x63c6ba64, 0x640bfb41, 0x64516c2e, 0x64970d4f,
+    0x64dcdec3, 0x6522e0ad, 0x6569132f, 0x65af766a, 0x65f60a7f, 0x663ccf92, 0x6683c5c3, 0x66caed35,
+    0x6712460b, 0x6759d065, 0x67a18c68, 0x67e97a34, 0x683199ed, 0x6879ebb6, 0x68c26fb1, 0x690b2601,
+    0x69540ec9, 0x699d2a2c, 0x69e6784d, 0x6a2ff94f, 0x6a79ad56, 0x6ac39485, 0x6b0daeff, 0x6b57fce9,
+    0x6ba27e65, 0x6bed3399, 0x6c381ca6, 0x6c8339b2, 0x6cce8ae1, 0x6d1a1057, 0x6d65ca38, 0x6db1b8a8,
+    0x6dfddbcc, 0x6e4a33c9, 0x6e96c0c3, 0x6ee382de, 0x6f307a41, 0x6f7da710, 0x6fcb096f, 0x7018a185,
+    0x70666f76, 0x70b47368, 0x7102ad80, 0x71511de4, 0x719fc4b9, 0x71eea226, 0x723db650, 0x728d015d,
+    0x72dc8374, 0x732c3cba, 0x737c2d55, 0x73cc556d, 0x741cb528, 0x746d4cac, 0x74be1c20, 0x750f23ab,
+    0x75606374, 0x75b1dba2, 0x76038c5b, 0x765575c8, 0x76a7980f, 0x76f9f359, 0x774c87cc, 0x779f5590,
+    0x77f25cce, 0x78459dac, 0x78991854, 0x78ecccec, 0x7940bb9e, 0x7994e492, 0x79e947ef, 0x7a3de5df,
+    0x7a92be8b, 0x7ae7d21a, 0x7b3d20b6, 0x7b92aa88, 0x7be86fba, 0x7c3e7073, 0x7c94acde, 0x7ceb2523,
+    0x7d41d96e, 0x7d98c9e6, 0x7deff6b6, 0x7e476009, 0x7e9f0606, 0x7ef6e8da, 0x7f4f08ae, 0x7fa765ad,
+    0x80000000,
+};
+
+/**
+ * @param x  positive, normal
+ * @return log2(x)
+ */
+float env_log2f(float x) {
+    uint32_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    int32_t e = (int32_t)((bits >> 23) & 0xFF) - 127;
+    bits      = (bits & 0x007FFFFF) | 0x3F800000;
+
+    float m;
+    memcpy(&m, &bits, sizeof(m));
+    if (m > 1.5f) {
+        m *= 0.5f;
+        e++;
+    }
+    // log2(1 + t) = t * q(t), t in [-0.25, 0.5]
+    float t = m - 1.0f;
+    float q = 1.172318392e-01f;
+    q       = q * t - 2.406199969e-01f;
+    q       = q * t + 2.981740361e-01f;
+    q       = q * t - 3.617303950e-01f;
+    q       = q * t + 4.806416178e-01f;
+    q       = q * t - 7.213247771e-01f;
+    q       = q * t + 1.442696188e+00f;
+    return (float)e + t * q;
+}
+
+/**
+ * @param x  clamped to -126..127
+ * @return 2^x
+ */
+float env_exp2f(float x) {
+    if (x < -126.0f) {
+        x = -126.0f;
+    } else if (x > 127.0f) {
+        x = 127.0f;
+    }
+    int32_t n = (int32_t)(x + (x >= 0 ? 0.5f : -0.5f));
+    float   f = x - (float)n;
+
+    float p = 1.339086336e-03f;
+    p       = p * f + 9.676031918e-03f;
+    p       = p * f + 5.550357114e-02f;
+    p       = p * f + 2.402210749e-01f;
+    p       = p * f + 6.931471880e-01f;
+    p       = p * f + 1.000000075e+00f;
+
+    uint32_t bits = (uint32_t)(n + 127) << 23;
+    float    scale;
+    memcpy(&scale, &bits, sizeof(scale));
+    return p * scale;
+}
+
+/**
+ * @param x     positive
+ * @param frac  fraction bits of x
+ * @return log2(x) in Q24
+ */
+static int32_t log2_q24(uint32_t x, int frac) {
+    int      zeros = __builtin_clz(x);
+    uint32_t m     = x << zeros;
+    uint32_t i     = (m >> 23) & 0xFF;
+    uint32_t r     = m & 0x7FFFFF;
+    int32_t  e     = 31 - zeros - frac;
+    uint32_t d     = LOG2_TABLE[i + 1] - LOG2_TABLE[i];
+    return e * (1 << 24) + (int32_t)(LOG2_TABLE[i] + (uint32_t)(((uint64_t)d * r) >> 23));
+}
+
+/**
+ * @param y     exponent in Q24
+ * @param frac  fraction bits of the result, 2^y must fit 63 bits
+ * @return 2^y
+ */
+static uint64_t exp2_q(int32_t y, int frac) {
+    int32_t  n = y >> 24;     // floor
+    uint32_t f = y & 0xFFFFFF;
+    uint32_t i = f >> 16;
+    uint32_t r = f & 0xFFFF;
+    uint32_t d = EXP2_TABLE[i + 1] - EXP2_TABLE[i];
+    uint64_t v = EXP2_TABLE[i] + (((uint64_t)d * r) >> 16);
+
+    int shift = n + frac - 30;
+    if (shift >= 0) {
+        return v << shift;
+    }
+    return shift > -64 ? v >> -shift : 0;
+}
+
+static uint32_t isqrt(uint64_t x) {
+    uint64_t root = 0;
+    uint64_t bit  = 1ULL << 62;
+    while (bit > x) {
+        bit >>= 2;
+    }
+    while (bit != 0) {
+        if (x >= root + bit) {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+float env_altitude(float pressure, float sea_level) {
+    return BAROMETRIC_H * (1.0f - env_exp2f(BAROMETRIC_N * env_log2f(pressure / sea_level)));
+}
+
+float env_altitude_ref(float pressure, float sea_level) {
+    return BAROMETRIC_H * (1.0 - pow((double)pressure / sea_level, BAROMETRIC_N));
+}
+
+int32_t env_altitude_fixed(int32_t pressure, int32_t sea_level) {
+    if (pressure <= 0 || sea_level <= 0) {
+        return 0;
+    }
+    int32_t  l = log2_q24(pressure, 0) - log2_q24(sea_level, 0);
+    int32_t  y = ((int64_t)l * BAROMETRIC_N_Q24) >> 24;
+    uint64_t e = exp2_q(y, 30);
+    return (int32_t)(((int64_t)(BAROMETRIC_H * 100) * ((1LL << 30) - (int64_t)e)) >> 30);
+}
+
+float env_dew_point(float temperature, float humidity) {
+    float g = env_log2f(humidity * 0.01f) * LN2 + MAGNUS_B * temperature / (MAGNUS_C + temperature);
+    return MAGNUS_C * g / (MAGNUS_B - g);
+}
+
+float env_dew_point_ref(float temperature, float humidity) {
+    double g = log(humidity / 100.0) + (double)MAGNUS_B * temperature / ((double)MAGNUS_C + temperature);
+    return (double)MAGNUS_C * g / ((double)MAGNUS_B - g);
+}
+
+int32_t env_dew_point_fixed(int32_t temperature, int32_t humidity) {
+    if (humidity < 1) {
+        humidity = 1;
+    }
+    int32_t l = log2_q24(humidity, 0) - LOG2_10000_Q24;
+    int64_t g = (((int64_t)l * LN2_Q24) >> 24)
+              + ((int64_t)1762 * temperature * (1 << 24)) / (100 * ((int64_t)(MAGNUS_C * 100) + temperature));
+    return (int32_t)((int64_t)(MAGNUS_C * 100) * g / (MAGNUS_B_Q24 - g));
+}
+
+float env_absolute_humidity(float temperature, float humidity) {
+    float e = VAPOUR_A * env_exp2f(VAPOUR_B * LOG2E * temperature / (VAPOUR_C + temperature));
+    return e * humidity * (VAPOUR_K / 100.0f) / (273.15f + temperature);
+}
+
+float env_absolute_humidity_ref(float temperature, float humidity) {
+    double e = VAPOUR_A * exp((double)VAPOUR_B * temperature / ((double)VAPOUR_C + temperature));
+    return e * humidity * (VAPOUR_K / 100.0) / (273.15 + temperature);
+}
+
+int32_t env_absolute_humidity_fixed(int32_t temperature, int32_t humidity) {
+    // vapour pressure factor e^(b T / (c + T)) in Q24, at most 2^5.1
+    int64_t  z = ((int64_t)1767 * temperature * (1 << 24)) / (100 * ((int64_t)(VAPOUR_C * 100) + temperature));
+    uint64_t e = exp2_q((int32_t)((z * LOG2E_Q24) >> 24), 24);
+    // 6.112 hPa * 2.1674 * 1000 mg = 13247.1 mg, humidity and kelvin both in hundredths
+    return (int32_t)((((int64_t)e * humidity * 132471) >> 24) / (10 * (27315 + (int64_t)temperature)));
+}
+
+// NWS heat index: Steadman's simple formula, Rothfusz regression above 80 °F
+float env_heat_index(float temperature, float humidity) {
+    float t  = temperature * 1.8f + 32.0f;
+    float rh = humidity;
+    float hi = 0.5f * (t + 61.0f + (t - 68.0f) * 1.2f + rh * 0.094f);
+
+    if (hi + t >= 160.0f) {
+        float trh = t * rh;
+        hi = -42.379f + t * (2.04901523f - 6.83783e-3f * t) + rh * (10.14333127f - 5.481717e-2f * rh)
+           + trh * (-0.22475541f + 1.22874e-3f * t + 8.5282e-4f * rh - 1.99e-6f * trh);
+        if (rh < 13.0f && t >= 80.0f && t <= 112.0f) {
+            hi -= (13.0f - rh) * 0.25f * sqrtf((17.0f - fabsf(t - 95.0f)) * (1.0f / 17.0f));
+        } else if (rh > 85.0f && t >= 80.0f && t <= 87.0f) {
+            hi += (rh - 85.0f) * 0.1f * (87.0f - t) * 0.2f;
+        }
+    }
+    return (hi - 32.0f) * (1.0f / 1.8f);
+}
+
+float env_heat_index_ref(float temperature, float humidity) {
+    double t  = temperature * 9.0 / 5.0 + 32.0;
+    double rh = humidity;
+    double hi = 0.5 * (t + 61.0 + ((t - 68.0) * 1.2) + (rh * 0.094));
+
+    if ((hi + t) / 2.0 >= 80.0) {
+        hi = -42.379 + 2.04901523 * t + 10.14333127 * rh - 0.22475541 * t * rh - 0.00683783 * pow(t, 2)
+           - 0.05481717 * pow(rh, 2) + 0.00122874 * pow(t, 2) * rh + 0.00085282 * t * pow(rh, 2)
+           - 0.00000199 * pow(t, 2) * pow(rh, 2);
+        if (rh < 13.0 && t >= 80.0 && t <= 112.0) {
+            hi -= ((13.0 - rh) / 4.0) * sqrt((17.0 - fabs(t - 95.0)) / 17.0);
+        } else if (rh > 85.0 && t >= 80.0 && t <= 87.0) {
+            hi += ((rh - 85.0) / 10.0) * ((87.0 - t) / 5.0);
+        }
+    }
+    return (hi - 32.0) * 5.0 / 9.0;
+}
+
+// coefficient in Q32 times a value in Q16, result in Q16
+static inline int64_t mul_q32(int64_t c, int64_t v) {
+    return (c * v) >> 32;
+}
+
+#define Q16(x) ((int64_t)((x) * 65536.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define Q32(x) ((int64_t)((x) * 4294967296.0 + ((x) < 0 ? -0.5 : 0.5)))
+#define Q48(x) ((int64_t)((x) * 281474976710656.0 + ((x) < 0 ? -0.5 : 0.5)))
+
+int32_t env_heat_index_fixed(int32_t temperature, int32_t humidity) {
+    // °F and %RH in Q16
+    int64_t t  = (((int64_t)temperature * 9 + 16000) * 65536) / 500;
+    int64_t rh = ((int64_t)humidity << 16) / 100;
+    int64_t hi = (t + Q16(61.0) + mul_q32(Q32(1.2), t - Q16(68.0)) + mul_q32(Q32(0.094), rh)) / 2;
+
+    if (hi + t >= Q16(160.0)) {
+        // the factors of t, rh and t * rh are kept in Q32, t * rh reaches 14000
+        int64_t trh = (t * rh) >> 16;
+        int64_t ft  = Q32(2.04901523) + ((Q32(-6.83783e-3) * t) >> 16);
+        int64_t frh = Q32(10.14333127) + ((Q32(-5.481717e-2) * rh) >> 16);
+        int64_t ftr = Q32(-0.22475541) + ((Q32(1.22874e-3) * t) >> 16) + ((Q32(8.5282e-4) * rh) >> 16)
+                    + ((Q48(-1.99e-6) * trh) >> 32);
+        hi = Q16(-42.379) + ((t * ft) >> 32) + ((rh * frh) >> 32) + ((trh * ftr) >> 32);
+        if (rh < Q16(13.0) && t >= Q16(80.0) && t <= Q16(112.0)) {
+            int64_t d = t > Q16(95.0) ? t - Q16(95.0) : Q16(95.0) - t;
+            // sqrt of a Q32 value is Q16
+            int64_t s = isqrt((uint64_t)((Q16(17.0) - d) << 16) / 17);
+            hi -= (((Q16(13.0) - rh) / 4) * s) >> 16;
+        } else if (rh > Q16(85.0) && t >= Q16(80.0) && t <= Q16(87.0)) {
+            hi += (((rh - Q16(85.0)) / 10) * ((Q16(87.0) - t) / 5)) >> 16;
+        }
+    }
+    return (int32_t)(((hi - Q16(32.0)) * 500 / 9) >> 16);
+}
+
+static int64_t mono_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static float max_error(float error, float a, float b) {
+    float d = fabsf(a - b);
+    return d > error ? d : error;
+}
+
+/**
+ * Time every version of every quantity on the same random inputs from the
+ * domains of EnvMath.h, and record the largest error against the reference.
+ *
+ * @param samples  per quantity and version, rounded up to a batch of 64
+ * @param result
+ */
+void env_math_benchmark(uint32_t samples, EnvMathBenchmark* result) {
+    static const char* names[ENV_MATH_QUANTITIES] = {"altitude", "dew point", "abs humidity", "heat index"};
+
+    float    temp[BENCH_BATCH], hum[BENCH_BATCH], pres[BENCH_BATCH], sea[BENCH_BATCH];
+    int32_t  temp_i[BENCH_BATCH], hum_i[BENCH_BATCH], pres_i[BENCH_BATCH], sea_i[BENCH_BATCH];
+    float    out_ref[BENCH_BATCH], out_float[BENCH_BATCH];
+    int32_t  out_fixed[BENCH_BATCH];
+    uint32_t seed = 0x12345678;
+    volatile float sink = 0;
+
+    memset(result, 0, sizeof(*result));
+    for (int q = 0; q < ENV_MATH_QUANTITIES; q++) {
+        result->quantities[q].name = names[q];
+    }
+
+    for (uint32_t done = 0; done < samples; done += BENCH_BATCH) {
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            seed      = seed * 1103515245 + 12345;
+            temp_i[i] = -4000 + (int32_t)((seed >> 8) % 10001);
+            seed      = seed * 1103515245 + 12345;
+            hum_i[i]  = 100 + (int32_t)((seed >> 8) % 9901);
+            seed      = seed * 1103515245 + 12345;
+            pres_i[i] = 30000 + (int32_t)((seed >> 8) % 80001);
+            seed      = seed * 1103515245 + 12345;
+            sea_i[i]  = 95000 + (int32_t)((seed >> 8) % 10001);
+            temp[i]   = temp_i[i] * 0.01f;
+            hum[i]    = hum_i[i] * 0.01f;
+            pres[i]   = (float)pres_i[i];
+            sea[i]    = (float)sea_i[i];
+        }
+
+        for (int q = 0; q < ENV_MATH_QUANTITIES; q++) {
+            EnvMathTiming* r     = &result->quantities[q];
+            int64_t        start = mono_nsec();
+            for (int i = 0; i < BENCH_BATCH; i++) {
+                switch (q) {
+                    case 0: out_ref[i] = env_altitude_ref(pres[i], sea[i]); break;
+                    case 1: out_ref[i] = env_dew_point_ref(temp[i], hum[i]); break;
+                    case 2: out_ref[i] = env_absolute_humidity_ref(temp[i], hum[i]); break;
+                    default: out_ref[i] = env_heat_index_ref(temp[i], hum[i]); break;
+                }
+            }
+            int64_t ref_end = mono_nsec();
+            for (int i = 0; i < BENCH_BATCH; i++) {
+                switch (q) {
+                    case 0: out_float[i] = env_altitude(pres[i], sea[i]); break;
+                    case 1: out_float[i] = env_dew_point(temp[i], hum[i]); break;
+                    case 2: out_float[i] = env_absolute_humidity(temp[i], hum[i]); break;
+                    default: out_float[i] = env_heat_index(temp[i], hum[i]); break;
+                }
+            }
+            int64_t float_end = mono_nsec();
+            for (int i = 0; i < BENCH_BATCH; i++) {
+                switch (q) {
+                    case 0: out_fixed[i] = env_altitude_fixed(pres_i[i], sea_i[i]); break;
+                    case 1: out_fixed[i] = env_dew_point_fixed(temp_i[i], hum_i[i]); break;
+                    case 2: out_fixed[i] = env_absolute_humidity_fixed(temp_i[i], hum_i[i]); break;
+                    default: out_fixed[i] = env_heat_index_fixed(temp_i[i], hum_i[i]); break;
+                }
+            }
+            int64_t fixed_end = mono_nsec();
+
+            r->ref_nsec += ref_end - start;
+            r->float_nsec += float_end - ref_end;
+            r->fixed_nsec += fixed_end - float_end;
+
+            // fixed results are in cm, 0.01 °C and mg/m3
+            float unit = q == 2 ? 0.001f : 0.01f;
+            for (int i = 0; i < BENCH_BATCH; i++) {
+                r->float_error = max_error(r->float_error, out_float[i], out_ref[i]);
+                r->fixed_error = max_error(r->fixed_error, out_fixed[i] * unit, out_ref[i]);
+                sink           = sink + out_float[i];
+            }
+        }
+        result->samples += BENCH_BATCH;
+    }
+}
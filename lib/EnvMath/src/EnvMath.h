@@ -0,0 +1,105 @@
+//
+// Derived environmental quantities: altitude, dew point, absolute humidity
+// and heat index, without libm in the sample path.
+//
+
+#ifndef M5STACK_ENV_MATH_H
+#define M5STACK_ENV_MATH_H
+
+#include <stdint.h>
+
+/*
+ * Three versions of every quantity:
+ *
+ *   env_*_ref()    the textbook formula in double with libm, the reference
+ *   env_*()        float, log2/exp2 replaced by minimax polynomials
+ *   env_*_fixed()  integers only, log2/exp2 from 257-entry tables with
+ *                  linear interpolation, for values already kept in integer
+ *                  units (Pa, 0.01 °C, 0.01 %RH)
+ *
+ * Maximum error against the reference, measured on a dense grid of the
+ * domain (env_math_benchmark() reports the error seen on its samples):
+ *
+ *   quantity            domain                                float       fixed
+ *   altitude            300..1100 hPa, sea level 950..1050    0.01 m      0.06 m
+ *   dew point           -40..60 °C, 1..100 %RH                0.0001 °C   0.011 °C
+ *   absolute humidity   -40..60 °C, 0..100 %RH                0.0001 g/m3 0.0015 g/m3
+ *   heat index          -40..60 °C, 0..100 %RH                0.0002 °C   0.011 °C
+ *
+ * The fixed errors are mostly the truncation to the output unit. The grid
+ * check and the timing against libm on the host: pio test -e native -f test_env_math
+ *
+ * The formulas themselves are approximations of the physics: the barometric
+ * formula assumes the standard atmosphere, Magnus (Sonntag 1990 constants)
+ * is within 0.35 °C of the exact dew point, the heat index is the NWS
+ * Rothfusz regression with its low and high humidity corrections.
+ */
+
+#define ENV_SEA_LEVEL 101325        // standard pressure at sea level in Pa
+
+#define ENV_MATH_QUANTITIES 4
+
+// float log2 and exp2, absolute error 6e-7, relative error 1.1e-7
+float env_log2f(float x);
+float env_exp2f(float x);
+
+/**
+ * @param pressure   Pa
+ * @param sea_level  pressure at sea level in Pa
+ * @return altitude in m
+ */
+float env_altitude(float pressure, float sea_level = ENV_SEA_LEVEL);
+float env_altitude_ref(float pressure, float sea_level = ENV_SEA_LEVEL);
+// pressure and sea level in Pa, altitude in cm
+int32_t env_altitude_fixed(int32_t pressure, int32_t sea_level = ENV_SEA_LEVEL);
+
+/**
+ * @param temperature  °C
+ * @param humidity     %RH, above 0
+ * @return dew point in °C
+ */
+float env_dew_point(float temperature, float humidity);
+float env_dew_point_ref(float temperature, float humidity);
+// temperature in 0.01 °C, humidity in 0.01 %RH, dew point in 0.01 °C
+int32_t env_dew_point_fixed(int32_t temperature, int32_t humidity);
+
+/**
+ * @param temperature  °C
+ * @param humidity     %RH
+ * @return water vapour in g/m3
+ */
+float env_absolute_humidity(float temperature, float humidity);
+float env_absolute_humidity_ref(float temperature, float humidity);
+// temperature in 0.01 °C, humidity in 0.01 %RH, water vapour in mg/m3
+int32_t env_absolute_humidity_fixed(int32_t temperature, int32_t humidity);
+
+/**
+ * @param temperature  °C
+ * @param humidity     %RH
+ * @return apparent temperature in °C
+ */
+float env_heat_index(float temperature, float humidity);
+float env_heat_index_ref(float temperature, float humidity);
+// temperature in 0.01 °C, humidity in 0.01 %RH, heat index in 0.01 °C
+int32_t env_heat_index_fixed(int32_t temperature, int32_t humidity);
+
+/**
+ * Time and accuracy of one quantity measured by env_math_benchmark()
+ */
+typedef struct {
+    const char* name;
+    int64_t     ref_nsec;
+    int64_t     float_nsec;
+    int64_t     fixed_nsec;
+    float       float_error;      // largest difference to the reference, in the float unit
+    float       fixed_error;
+} EnvMathTiming;
+
+typedef struct {
+    uint32_t      samples;        // per quantity and version
+    EnvMathTiming quantities[ENV_MATH_QUANTITIES];
+} EnvMathBenchmark;
+
+void env_math_benchmark(uint32_t samples, EnvMathBenchmark* result);
+
+#endif // M5STACK_ENV_MATH_H
@@ -0,0 +1,383 @@
+//
+// Fixed-point filter pipeline for sensor streams, see SensorFilter.h.
+//
+// process() runs one stage over the whole block before the next one, so the
+// type dispatch happens once per stage and block and every kernel is a
+// tight loop over its own state. The recurrences are serial per stream,
+// which leaves nothing for the ESP32-S3 vector unit to do here.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "SensorFilter.h"
+
+static int64_t mono_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline int32_t round_q16(int64_t value) {
+    return (int32_t)((value + 0x8000) >> 16);
+}
+
+/**
+ * Build the pipeline from a text, e.g. "outlier:4:20,median:5,ewma:0.25":
+ *
+ *   average:<n>            moving average of n samples
+ *   median:<n>             median of n samples, n odd
+ *   ewma:<alpha>           0 < alpha <= 1
+ *   outlier:<k>[:<floor>[:<run>]]
+ *                          k mean deviations, at least floor sample units,
+ *                          run rejections in a row are a step (default
+ *                          FILTER_OUTLIER_RUN)
+ *
+ * @param spec  stages separated by commas, empty for no filtering
+ * @return false if the text is invalid, the pipeline is then empty
+ */
+bool SensorFilter::configure(const char* spec) {
+    static const char* names[FILTER_TYPES] = {"", "average", "median", "ewma", "outlier"};
+
+    clear();
+    const char* p = spec;
+    while (p != nullptr && *p != '\0') {
+        const char* colon = strchr(p, ':');
+        if (colon == nullptr) {
+            clear();
+            return false;
+        }
+
+        uint8_t type = FILTER_NONE;
+        for (uint8_t t = FILTER_AVERAGE; t < FILTER_TYPES; t++) {
+            if (strlen(names[t]) == (size_t)(colon - p) && strncmp(names[t], p, colon - p) == 0) {
+                type = t;
+            }
+        }
+
+        char*  end;
+        double value = strtod(colon + 1, &end);
+        long   floor = 0;
+        long   run   = FILTER_OUTLIER_RUN;
+        bool   empty = end == colon + 1;
+        if (type == FILTER_OUTLIER && *end == ':') {
+            const char* start = end + 1;
+            floor = strtol(start, &end, 10);
+            empty |= end == start;
+            if (*end == ':') {
+                start = end + 1;
+                run   = strtol(start, &end, 10);
+                empty |= end == start;
+            }
+        }
+        if (empty || (*end != ',' && *end != '\0')) {
+            clear();
+            return false;
+        }
+
+        int32_t param = (int32_t)value;
+        if (type == FILTER_EWMA) {
+            param = (int32_t)(value * 65536.0 + 0.5);
+        } else if (type == FILTER_OUTLIER) {
+            param = (int32_t)(value * 256.0 + 0.5);
+        }
+        if (run < 1 || run > UINT8_MAX || !add((FilterType)type, param, (int32_t)floor, (uint8_t)run)) {
+            clear();
+            return false;
+        }
+        p = end;
+        if (*p == ',' && *++p == '\0') {
+            clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Append a stage
+ *
+ * @param type
+ * @param param  window for average and median, alpha in Q16 for EWMA,
+ *               k in Q8 for outlier
+ * @param floor  outlier: smallest deviation in sample units, keeps a quiet
+ *               signal from rejecting its own noise
+ * @param run    outlier: rejections in a row taken as a step, the delay of a
+ *               real step in samples
+ * @return false if the pipeline is full or the parameters are out of range
+ */
+bool SensorFilter::add(FilterType type, int32_t param, int32_t floor, uint8_t run) {
+    if (_count >= FILTER_MAX_STAGES) {
+        return false;
+    }
+    switch (type) {
+        case FILTER_AVERAGE:
+            if (param < 1 || param > FILTER_MAX_WINDOW) {
+                return false;
+            }
+            break;
+        case FILTER_MEDIAN:
+            if (param < 1 || param > FILTER_MAX_WINDOW || param % 2 == 0) {
+                return false;
+            }
+            break;
+        case FILTER_EWMA:
+            if (param < 1 || param > 65536) {
+                return false;
+            }
+            break;
+        case FILTER_OUTLIER:
+            if (param < 1 || param > 0x7FFF || floor < 0 || run < 1) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+
+    FilterStage* s = &_stages[_count++];
+    memset(s, 0, sizeof(*s));
+    s->type   = type;
+    s->window = type == FILTER_AVERAGE || type == FILTER_MEDIAN ? param : type == FILTER_OUTLIER ? run : 0;
+    s->param  = param;
+    s->floor  = floor;
+    return true;
+}
+
+/**
+ * Remove all stages
+ */
+void SensorFilter::clear() {
+    _count    = 0;
+    _rejected = 0;
+}
+
+/**
+ * Forget the history, e.g. after a communication loss, the stages stay
+ */
+void SensorFilter::reset() {
+    for (uint8_t i = 0; i < _count; i++) {
+        FilterStage* s = &_stages[i];
+        s->count = 0;
+        s->head  = 0;
+        s->acc   = 0;
+        s->dev   = 0;
+    }
+    _rejected = 0;
+}
+
+void SensorFilter::runAverage(FilterStage* s, int32_t* data, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (s->count == s->window) {
+            s->acc -= s->ring[s->head];
+        } else {
+            s->count++;
+        }
+        s->ring[s->head] = data[i];
+        s->acc += data[i];
+        s->head = s->head + 1 == s->window ? 0 : s->head + 1;
+
+        int64_t half = s->count / 2;
+        data[i]      = (int32_t)((s->acc >= 0 ? s->acc + half : s->acc - half) / s->count);
+    }
+}
+
+/**
+ * The sorted copy of the window is updated in place: the oldest sample is
+ * overwritten by the new one, which then moves to its position.
+ */
+void SensorFilter::runMedian(FilterStage* s, int32_t* data, size_t n) {
+    int32_t* sorted = s->sorted;
+    for (size_t i = 0; i < n; i++) {
+        int32_t x = data[i];
+        int     p;
+        if (s->count == s->window) {
+            int32_t old = s->ring[s->head];
+            for (p = 0; sorted[p] != old; p++) {
+            }
+        } else {
+            p = s->count++;
+        }
+        sorted[p] = x;
+        while (p > 0 && sorted[p - 1] > x) {
+            sorted[p] = sorted[p - 1];
+            sorted[--p] = x;
+        }
+        while (p + 1 < s->count && sorted[p + 1] < x) {
+            sorted[p] = sorted[p + 1];
+            sorted[++p] = x;
+        }
+        s->ring[s->head] = x;
+        s->head          = s->head + 1 == s->window ? 0 : s->head + 1;
+
+        data[i] = sorted[(s->count - 1) / 2];
+    }
+}
+
+/**
+ * Mean in Q16, the product stays within 63 bits for samples within ±2^30
+ */
+void SensorFilter::runEwma(FilterStage* s, int32_t* data, size_t n) {
+    size_t i = 0;
+    if (s->count == 0 && n > 0) {
+        s->acc   = (int64_t)data[0] << 16;
+        s->count = 1;
+        i        = 1;
+    }
+    int64_t acc   = s->acc;
+    int64_t alpha = s->param;
+    for (; i < n; i++) {
+        acc += ((((int64_t)data[i] << 16) - acc) * alpha) >> 16;
+        data[i] = round_q16(acc);
+    }
+    s->acc = acc;
+}
+
+/**
+ * The mean and the mean absolute deviation follow the accepted samples. A
+ * sample further than k deviations from the mean is replaced by the mean;
+ * the run of the stage (FILTER_OUTLIER_RUN by default) of them in a row are
+ * a step, and the next one restarts the mean at the new level.
+ */
+void SensorFilter::runOutlier(FilterStage* s, int32_t* data, size_t n, uint32_t* rejected) {
+    int64_t floor = (int64_t)s->floor << 16;
+    for (size_t i = 0; i < n; i++) {
+        int64_t x = (int64_t)data[i] << 16;
+        int64_t d = x > s->acc ? x - s->acc : s->acc - x;
+
+        if (s->count < FILTER_OUTLIER_WARMUP) {
+            if (s->count == 0) {
+                s->acc = x;
+            } else {
+                s->acc += (x - s->acc) >> FILTER_OUTLIER_SHIFT;
+                s->dev += (d - s->dev) >> FILTER_OUTLIER_SHIFT;
+            }
+            s->count++;
+            continue;
+        }
+
+        int64_t limit = ((s->dev > floor ? s->dev : floor) * s->param) >> 8;
+        if (d > limit) {
+            if (s->head < s->window) {
+                s->head++;
+                (*rejected)++;
+                data[i] = round_q16(s->acc);
+            } else {
+                s->head = 0;
+                s->acc  = x;
+            }
+            continue;
+        }
+        s->head = 0;
+        s->acc += (x - s->acc) >> FILTER_OUTLIER_SHIFT;
+        s->dev += (d - s->dev) >> FILTER_OUTLIER_SHIFT;
+    }
+}
+
+/**
+ * @param sample
+ * @return filtered sample
+ */
+int32_t SensorFilter::update(int32_t sample) {
+    process(&sample, &sample, 1);
+    return sample;
+}
+
+/**
+ * Filter a block of consecutive samples of the stream
+ *
+ * @param in
+ * @param out  may be the same as in
+ * @param n
+ */
+void SensorFilter::process(const int32_t* in, int32_t* out, size_t n) {
+    if (out != in) {
+        memmove(out, in, n * sizeof(int32_t));
+    }
+    for (uint8_t i = 0; i < _count; i++) {
+        FilterStage* s = &_stages[i];
+        switch (s->type) {
+            case FILTER_AVERAGE: runAverage(s, out, n); break;
+            case FILTER_MEDIAN: runMedian(s, out, n); break;
+            case FILTER_EWMA: runEwma(s, out, n); break;
+            case FILTER_OUTLIER: runOutlier(s, out, n, &_rejected); break;
+        }
+    }
+}
+
+uint8_t SensorFilter::stages() {
+    return _count;
+}
+
+/**
+ * @return samples replaced by outlier stages
+ */
+uint32_t SensorFilter::rejected() {
+    return _rejected;
+}
+
+/**
+ * Seeded noisy ramp with a spike every 50 samples on average
+ */
+static void bench_signal(uint32_t* seed, int32_t* ramp, int32_t* data) {
+    for (int i = 0; i < FILTER_BENCH_BLOCK; i++) {
+        *seed   = *seed * 1103515245 + 12345;
+        *ramp   = *ramp + 1 < 2000 ? *ramp + 1 : -2000;
+        data[i] = 2000 + (*ramp < 0 ? -*ramp : *ramp) + (int32_t)((*seed >> 16) % 41) - 20;
+        if ((*seed >> 8) % 50 == 0) {
+            data[i] += 3000;
+        }
+    }
+}
+
+/**
+ * Throughput of every stage type alone and of FILTER_BENCH_PIPELINE, per
+ * sample and in blocks. Every run filters the same signal with a single
+ * filter, the stack use stays small. Samples per second = samples * 1e9 /
+ * nsec.
+ *
+ * @param samples  rounded up to a block of FILTER_BENCH_BLOCK
+ * @param result
+ */
+void SensorFilter::benchmark(uint32_t samples, FilterBenchmark* result) {
+    static const char* stages[FILTER_TYPES] = {"", "average:8", "median:5", "ewma:0.25", "outlier:4:2"};
+
+    SensorFilter     filter;
+    int32_t          in[FILTER_BENCH_BLOCK];
+    int32_t          out[FILTER_BENCH_BLOCK];
+    volatile int32_t sink = 0;
+
+    memset(result, 0, sizeof(*result));
+    // stages alone, then the pipeline per sample and in blocks
+    for (uint8_t run = 0; run < FILTER_TYPES + 2; run++) {
+        uint32_t seed = 0x12345678;
+        int32_t  ramp = 0;
+        int64_t  nsec = 0;
+
+        filter.configure(run < FILTER_TYPES ? stages[run] : FILTER_BENCH_PIPELINE);
+        for (uint32_t done = 0; done < samples; done += FILTER_BENCH_BLOCK) {
+            bench_signal(&seed, &ramp, in);
+
+            int64_t start = mono_nsec();
+            if (run == FILTER_TYPES) {
+                for (int i = 0; i < FILTER_BENCH_BLOCK; i++) {
+                    out[i] = filter.update(in[i]);
+                }
+            } else {
+                filter.process(in, out, FILTER_BENCH_BLOCK);
+            }
+            nsec += mono_nsec() - start;
+            sink = sink + out[FILTER_BENCH_BLOCK - 1];
+        }
+
+        if (run < FILTER_TYPES) {
+            result->stage_nsec[run] = nsec;
+        } else if (run == FILTER_TYPES) {
+            result->update_nsec = nsec;
+        } else {
+            result->block_nsec = nsec;
+            result->rejected   = filter.rejected();
+        }
+    }
+    result->samples = (samples + FILTER_BENCH_BLOCK - 1) / FILTER_BENCH_BLOCK * FILTER_BENCH_BLOCK;
+}
@@ -0,0 +1,94 @@
+//
+// Fixed-point filter pipeline for sensor streams.
+//
+
+#ifndef M5STACK_SENSOR_FILTER_H
+#define M5STACK_SENSOR_FILTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FILTER_MAX_STAGES 4
+#define FILTER_MAX_WINDOW 15        // samples of a moving average or median
+
+// outlier rejection: accepted samples before the first test, rejections in a
+// row taken as a step of the signal unless the spec sets its own
+#define FILTER_OUTLIER_WARMUP 4
+#define FILTER_OUTLIER_RUN    3
+// mean and deviation of the outlier stage follow the signal with alpha = 1/8
+#define FILTER_OUTLIER_SHIFT  3
+
+#define FILTER_BENCH_BLOCK 64
+
+enum FilterType : uint8_t {
+    FILTER_NONE = 0,
+    FILTER_AVERAGE,     // moving average of the last n samples
+    FILTER_MEDIAN,      // median of the last n samples, n odd
+    FILTER_EWMA,        // first order IIR low-pass, y += alpha * (x - y)
+    FILTER_OUTLIER,     // a sample further than k mean deviations from the mean is replaced by the mean
+    FILTER_TYPES
+};
+
+/**
+ * State of one stage. The size does not depend on the parameters or on the
+ * length of the stream.
+ */
+struct FilterStage {
+    uint8_t type;
+    uint8_t window;     // average, median, outlier: rejections in a row taken as a step
+    uint8_t count;      // samples in the window, outlier: accepted samples up to the warmup
+    uint8_t head;       // oldest sample in ring, outlier: rejections in a row
+    int32_t param;      // EWMA alpha in Q16, outlier k in Q8
+    int32_t floor;      // outlier: smallest deviation, in sample units
+    int64_t acc;        // average: sum of the window, EWMA and outlier: mean in Q16
+    int64_t dev;        // outlier: mean absolute deviation in Q16
+    int32_t ring[FILTER_MAX_WINDOW];       // samples in arrival order
+    int32_t sorted[FILTER_MAX_WINDOW];     // median: the same samples sorted
+};
+
+struct FilterBenchmark {
+    uint32_t samples;
+    int64_t  stage_nsec[FILTER_TYPES];     // one stage of each type alone, process() in blocks
+    int64_t  update_nsec;                  // FILTER_BENCH_PIPELINE, update() per sample
+    int64_t  block_nsec;                   // FILTER_BENCH_PIPELINE, process() in blocks
+    uint32_t rejected;                     // spikes removed by the outlier stage
+};
+
+#define FILTER_BENCH_PIPELINE "outlier:4:2,median:5,average:8,ewma:0.25"
+
+/**
+ * Up to FILTER_MAX_STAGES stages applied in order to one stream of integer
+ * samples (raw sensor units, e.g. 0.01 °C). Every stage costs O(1) memory,
+ * average and EWMA O(1) time per sample, median O(n).
+ *
+ * The default state is all zeros, an empty pipeline, and the constructor is
+ * constexpr: a global or RTC_DATA_ATTR filter needs no code at boot, so one
+ * in RTC memory keeps its history across deep sleep.
+ */
+class SensorFilter {
+    FilterStage _stages[FILTER_MAX_STAGES];
+    uint8_t     _count;
+    uint32_t    _rejected;
+
+    static void runAverage(FilterStage* s, int32_t* data, size_t n);
+    static void runMedian(FilterStage* s, int32_t* data, size_t n);
+    static void runEwma(FilterStage* s, int32_t* data, size_t n);
+    static void runOutlier(FilterStage* s, int32_t* data, size_t n, uint32_t* rejected);
+
+public:
+    constexpr SensorFilter() : _stages(), _count(0), _rejected(0) {}
+
+    bool configure(const char* spec);
+    bool add(FilterType type, int32_t param, int32_t floor = 0, uint8_t run = FILTER_OUTLIER_RUN);
+    void clear();
+    void reset();
+
+    int32_t  update(int32_t sample);
+    void     process(const int32_t* in, int32_t* out, size_t n);
+    uint8_t  stages();
+    uint32_t rejected();
+
+    static void benchmark(uint32_t samples, FilterBenchmark* result);
+};
+
+#endif // M5STACK_SENSOR_FILTER_H
@@ -0,0 +1,295 @@
+//
+// Capture and replay of sensor and bus traffic with its timing.
+//
+
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "Trace.h"
+
+#define TRACE_HEADER_SIZE 8
+
+static int64_t clock_usec(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t mono_nsec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+TraceRecorder::TraceRecorder() {
+    _file   = nullptr;
+    _clock  = CLOCK_MONOTONIC;
+    _last   = 0;
+    _events = 0;
+}
+
+TraceRecorder::~TraceRecorder() {
+    close();
+}
+
+/**
+ * Open a trace for appending, a new file gets the header. Every open starts
+ * a session with a TRACE_CLOCK record.
+ *
+ * @param path   e.g. "/sd/trace.bin"
+ * @param clock  CLOCK_REALTIME keeps the distance of sessions across deep sleep
+ */
+bool TraceRecorder::open(const char* path, clockid_t clock) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file != nullptr) {
+        fclose(_file);
+    }
+    _file = fopen(path, "ab");
+    if (_file == nullptr) {
+        return false;
+    }
+    _clock = clock;
+
+    fseek(_file, 0, SEEK_END);
+    if (ftell(_file) == 0) {
+        uint8_t header[TRACE_HEADER_SIZE] = {'T', 'R', 'C', '1', TRACE_VERSION, 0, 0, 0};
+        fwrite(header, 1, sizeof(header), _file);
+    }
+    _last = now();
+    return write(0, TRACE_SOURCE_TRACE, TRACE_CLOCK, &_last, sizeof(_last));
+}
+
+void TraceRecorder::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+bool TraceRecorder::flush() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _file != nullptr && fflush(_file) == 0;
+}
+
+int64_t TraceRecorder::now() {
+    return clock_usec(_clock);
+}
+
+bool TraceRecorder::write(uint32_t delta, uint8_t source, uint8_t kind, const void* data, uint16_t len) {
+    TraceRecord record = {delta, source, kind, len};
+    return fwrite(&record, sizeof(record), 1, _file) == 1 && (len == 0 || fwrite(data, len, 1, _file) == 1);
+}
+
+bool TraceRecorder::record(uint8_t source, uint8_t kind, const void* data, uint16_t len) {
+    return record(source, kind, nullptr, 0, data, len);
+}
+
+/**
+ * Append one event, the data is the concatenation of head and data
+ *
+ * @param source    TraceSource
+ * @param kind      TraceKind of the source
+ * @param head      e.g. the request token, may be nullptr
+ * @param head_len
+ * @param data
+ * @param len       head_len + len at most TRACE_MAX_DATA
+ * @return false if the file is not open, the event is too long or the write failed
+ */
+bool TraceRecorder::record(uint8_t source, uint8_t kind, const void* head, uint16_t head_len, const void* data,
+                           uint16_t len) {
+    if (head_len + len > TRACE_MAX_DATA) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file == nullptr) {
+        return false;
+    }
+
+    int64_t time  = now();
+    int64_t delta = time - _last;
+    if (delta < 0 || delta > UINT32_MAX) {
+        if (!write(0, TRACE_SOURCE_TRACE, TRACE_CLOCK, &time, sizeof(time))) {
+            return false;
+        }
+        delta = 0;
+    }
+    _last = time;
+
+    TraceRecord record = {(uint32_t)delta, source, kind, (uint16_t)(head_len + len)};
+    if (fwrite(&record, sizeof(record), 1, _file) != 1 || (head_len > 0 && fwrite(head, head_len, 1, _file) != 1)
+        || (len > 0 && fwrite(data, len, 1, _file) != 1)) {
+        return false;
+    }
+    _events++;
+    return true;
+}
+
+uint32_t TraceRecorder::events() {
+    return _events;
+}
+
+TracePlayer::TracePlayer() {
+    _file  = nullptr;
+    _pace  = TRACE_FAST;
+    _speed = 1.0f;
+    _time  = 0;
+    _lag   = 0;
+    rewind();
+}
+
+TracePlayer::~TracePlayer() {
+    close();
+}
+
+/**
+ * @param path
+ * @return false if the file is missing or not a trace
+ */
+bool TracePlayer::open(const char* path) {
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    close();
+    _file = fopen(path, "rb");
+    if (_file == nullptr) {
+        return false;
+    }
+    if (fread(header, sizeof(header), 1, _file) != 1 || memcmp(header, TRACE_MAGIC, 4) != 0
+        || header[4] != TRACE_VERSION) {
+        close();
+        return false;
+    }
+    rewind();
+    return true;
+}
+
+void TracePlayer::close() {
+    if (_file != nullptr) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+/**
+ * @param pace
+ * @param speed  TRACE_REALTIME only, 2 replays twice as fast as recorded
+ */
+void TracePlayer::setPace(TracePace pace, float speed) {
+    _pace       = pace;
+    _speed      = speed > 0 ? speed : 1.0f;
+    _trace_base = -1;
+}
+
+/**
+ * Read the next event. In real time pace the call returns when the event is
+ * due, relative to the first event of the session read after setPace() or
+ * rewind().
+ *
+ * @param event  [out]
+ * @return false at the end of the trace or at a truncated record
+ */
+bool TracePlayer::next(TraceEvent* event) {
+    TraceRecord record;
+
+    while (_file != nullptr && fread(&record, sizeof(record), 1, _file) == 1) {
+        if (record.len > TRACE_MAX_DATA || (record.len > 0 && fread(event->data, record.len, 1, _file) != 1)) {
+            return false;
+        }
+        if (record.source == TRACE_SOURCE_TRACE && record.kind == TRACE_CLOCK) {
+            if (record.len == sizeof(int64_t)) {
+                memcpy(&_time, event->data, sizeof(_time));
+            }
+            // sessions are paced back to back, a deep sleep in between is not waited out
+            _trace_base = -1;
+            continue;
+        }
+
+        _time += record.delta;
+        event->time   = _time;
+        event->source = record.source;
+        event->kind   = record.kind;
+        event->len    = record.len;
+
+        if (_pace == TRACE_REALTIME) {
+            int64_t wall = mono_nsec() / 1000;
+            if (_trace_base < 0) {
+                _trace_base = _time;
+                _wall_base  = wall;
+            }
+            int64_t due = _wall_base + (int64_t)((_time - _trace_base) / _speed);
+            if (due > wall) {
+                std::this_thread::sleep_for(std::chrono::microseconds(due - wall));
+            } else if (wall - due > _lag) {
+                _lag = wall - due;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Feed the rest of the trace to a handler
+ *
+ * @param handler
+ * @param stats    [out]
+ */
+void TracePlayer::play(const TraceHandler& handler, TraceStats* stats) {
+    static TraceEvent event;
+    int64_t           first = INT64_MIN;
+
+    memset(stats, 0, sizeof(*stats));
+    _lag = 0;
+
+    int64_t start = mono_nsec();
+    while (next(&event)) {
+        if (first == INT64_MIN) {
+            first = event.time;
+        }
+        int64_t t0 = mono_nsec();
+        handler(event);
+        stats->handler_nsec += mono_nsec() - t0;
+        stats->events++;
+        stats->bytes += event.len;
+        stats->trace_usec = event.time - first;
+    }
+    stats->total_nsec   = mono_nsec() - start;
+    stats->max_lag_usec = _lag;
+}
+
+/**
+ * Back to the first event
+ */
+void TracePlayer::rewind() {
+    if (_file != nullptr) {
+        fseek(_file, TRACE_HEADER_SIZE, SEEK_SET);
+    }
+    _time       = 0;
+    _trace_base = -1;
+}
+
+/**
+ * @return file position of the next record, to continue after a deep sleep
+ */
+long TracePlayer::tell() {
+    return _file != nullptr ? ftell(_file) : -1;
+}
+
+/**
+ * Continue at a position returned by tell()
+ *
+ * @param offset
+ * @param time    now() at the time of tell()
+ */
+bool TracePlayer::seek(long offset, int64_t time) {
+    _time       = time;
+    _trace_base = -1;
+    return _file != nullptr && offset >= TRACE_HEADER_SIZE && fseek(_file, offset, SEEK_SET) == 0;
+}
+
+/**
+ * @return trace time of the last event in us
+ */
+int64_t TracePlayer::now() {
+    return _time;
+}
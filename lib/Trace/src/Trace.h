@@ -0,0 +1,149 @@
+//
+// Capture and replay of sensor and bus traffic with its timing.
+//
+
+#ifndef M5STACK_TRACE_H
+#define M5STACK_TRACE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include <functional>
+#include <mutex>
+
+/*
+ * File layout, little endian:
+ *
+ *   "TRC1", uint16 version, uint16 reserved
+ *   records: TraceRecord followed by len bytes of data
+ *
+ * delta is the time since the previous record in microseconds. A TRACE_CLOCK
+ * record carries the absolute time (int64 us) and starts every recording
+ * session, so sessions appended after a reboot or a deep sleep keep their
+ * real distance. It is also written when a delta would not fit.
+ */
+#define TRACE_MAGIC     "TRC1"
+#define TRACE_VERSION   1
+#define TRACE_MAX_DATA  512
+
+enum TraceSource : uint8_t {
+    TRACE_SOURCE_TRACE = 0,
+    TRACE_SOURCE_MODBUS,
+    TRACE_SOURCE_ENV,
+    TRACE_SOURCE_LORA,
+};
+
+enum TraceKind : uint8_t {
+    TRACE_CLOCK = 0,            // int64 absolute time in us
+
+    TRACE_MODBUS_RESPONSE = 1,  // uint32 token, response frame without CRC
+    TRACE_MODBUS_ERROR,         // uint32 token, uint8 eModbus error code
+
+    TRACE_ENV_READING = 1,      // TraceEnv
+
+    TRACE_LORA_UPLINK = 1,      // uplink payload
+    TRACE_LORA_RESULT,          // int16 RadioLib state, downlink payload
+};
+
+/**
+ * One reading of the ENV unit (SHT40 + BMP280)
+ */
+struct __attribute__((packed)) TraceEnv {
+    float temperature;          // °C
+    float humidity;             // %RH
+    float pressure;             // Pa
+    float bmp_temperature;      // °C
+};
+
+struct __attribute__((packed)) TraceRecord {
+    uint32_t delta;             // us
+    uint8_t  source;
+    uint8_t  kind;
+    uint16_t len;
+};
+
+struct TraceEvent {
+    int64_t  time;              // us, clock of the recorder
+    uint8_t  source;
+    uint8_t  kind;
+    uint16_t len;
+    uint8_t  data[TRACE_MAX_DATA];
+};
+
+enum TracePace : uint8_t {
+    TRACE_FAST = 0,             // as fast as possible
+    TRACE_REALTIME,             // at the recorded timing, scaled by the speed
+};
+
+struct TraceStats {
+    uint32_t events;
+    uint64_t bytes;             // event data
+    int64_t  trace_usec;        // recorded time span
+    int64_t  total_nsec;        // wall time of the replay
+    int64_t  handler_nsec;      // spent in the handler
+    int64_t  max_lag_usec;      // real time replay: worst delay behind the schedule
+};
+
+typedef std::function<void(const TraceEvent& event)> TraceHandler;
+
+/**
+ * Appends events to a trace file. Safe to call from several tasks, e.g. the
+ * Modbus worker and the main loop.
+ */
+class TraceRecorder {
+    FILE*      _file;
+    clockid_t  _clock;
+    int64_t    _last;
+    uint32_t   _events;
+    std::mutex _mutex;
+
+    int64_t now();
+    bool    write(uint32_t delta, uint8_t source, uint8_t kind, const void* data, uint16_t len);
+
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    bool open(const char* path, clockid_t clock = CLOCK_MONOTONIC);
+    void close();
+    bool flush();
+
+    bool record(uint8_t source, uint8_t kind, const void* data, uint16_t len);
+    bool record(uint8_t source, uint8_t kind, const void* head, uint16_t head_len, const void* data, uint16_t len);
+
+    uint32_t events();
+};
+
+/**
+ * Reads a trace back in order. The event times come from the file, not from
+ * the wall clock, so consumers that take the time from the event see the
+ * same sequence on every run.
+ */
+class TracePlayer {
+    FILE*     _file;
+    TracePace _pace;
+    float     _speed;
+    int64_t   _time;            // trace time of the last record
+    int64_t   _trace_base;      // trace and wall time of the first paced event
+    int64_t   _wall_base;
+    int64_t   _lag;
+
+public:
+    TracePlayer();
+    ~TracePlayer();
+
+    bool open(const char* path);
+    void close();
+
+    void setPace(TracePace pace, float speed = 1.0f);
+
+    bool    next(TraceEvent* event);
+    void    play(const TraceHandler& handler, TraceStats* stats);
+    void    rewind();
+    long    tell();
+    bool    seek(long offset, int64_t time);
+    int64_t now();
+};
+
+#endif // M5STACK_TRACE_H
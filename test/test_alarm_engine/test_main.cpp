@@ -0,0 +1,235 @@
+//
+// AlarmEngine rule validation, limits with hysteresis, the raise delay,
+// communication loss, stuck values, rate of change against an old reference,
+// and the indexed lookup against a full scan of the rules.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+
+#include "AlarmEngine.hpp"
+
+#define POINTS 4
+
+static AlarmEngine             engine;
+static std::vector<AlarmEvent> events;
+
+static void setUpHandler() {
+    events.clear();
+    engine.onAlarm([](const AlarmEvent& event) { events.push_back(event); });
+}
+
+static void test_invalid_points() {
+    AlarmRule rule = {0xFFFF, ALARM_HIGH, ALARM_ACTION_UPLINK, 100, 5, 0, 0, 0};
+    TEST_ASSERT_FALSE(engine.compile(&rule, 1, POINTS));
+
+    rule.point = POINTS;
+    TEST_ASSERT_FALSE(engine.compile(&rule, 1, POINTS));
+
+    rule.point = POINTS - 1;
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    TEST_ASSERT_EQUAL(1, engine.size());
+}
+
+static void test_high_hysteresis() {
+    AlarmRule rule = {0, ALARM_HIGH, ALARM_ACTION_RELAY, 100, 5, 0, 0, 2};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    engine.evaluate(0, 100, true, 0);       // at the limit is not above it
+    TEST_ASSERT_EQUAL(0, events.size());
+    engine.evaluate(0, 101, true, 1000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_TRUE(events[0].active);
+    TEST_ASSERT_EQUAL(101, events[0].value);
+    TEST_ASSERT_EQUAL(ALARM_ACTION_RELAY, events[0].actions);
+    TEST_ASSERT_EQUAL(2, events[0].relay);
+    TEST_ASSERT_EQUAL(1, engine.active());
+
+    // inside the hysteresis band the alarm stays
+    engine.evaluate(0, 99, true, 2000);
+    engine.evaluate(0, 95, true, 3000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    engine.evaluate(0, 94, true, 4000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_FALSE(events[1].active);
+    TEST_ASSERT_EQUAL(0, engine.active());
+
+    // and below the limit it does not come back
+    engine.evaluate(0, 99, true, 5000);
+    TEST_ASSERT_EQUAL(2, events.size());
+}
+
+static void test_low_hysteresis() {
+    AlarmRule rule = {3, ALARM_LOW, ALARM_ACTION_BUZZER, -50, 10, 0, 0, 0};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    engine.evaluate(3, -50, true, 0);
+    engine.evaluate(3, -51, true, 1000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_TRUE(events[0].active);
+
+    engine.evaluate(3, -45, true, 2000);
+    engine.evaluate(3, -40, true, 3000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    engine.evaluate(3, -39, true, 4000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_FALSE(events[1].active);
+}
+
+// the condition must hold for delay_ms, clearing is immediate
+static void test_raise_delay() {
+    AlarmRule rule = {0, ALARM_HIGH, ALARM_ACTION_UPLINK, 100, 5, 10000, 0, 0};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    // a spike shorter than the delay
+    engine.evaluate(0, 150, true, 0);
+    engine.evaluate(0, 150, true, 9000);
+    engine.evaluate(0, 50, true, 10000);
+    engine.evaluate(0, 150, true, 11000);
+    engine.evaluate(0, 150, true, 20000);
+    TEST_ASSERT_EQUAL(0, events.size());
+
+    // the delay counts from the start of the new excursion
+    engine.evaluate(0, 150, true, 21000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_TRUE(events[0].active);
+    TEST_ASSERT_TRUE(events[0].time == 21000);
+
+    engine.evaluate(0, 90, true, 22000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_FALSE(events[1].active);
+    TEST_ASSERT_TRUE(events[1].time == 22000);
+}
+
+static void test_comm_loss() {
+    AlarmRule rules[] = {
+        {1, ALARM_COMM_LOSS, ALARM_ACTION_UPLINK, 0, 0, 0, 0, 0},
+        {1, ALARM_HIGH, ALARM_ACTION_UPLINK, 100, 5, 0, 0, 0},
+    };
+    TEST_ASSERT_TRUE(engine.compile(rules, 2, POINTS));
+    setUpHandler();
+
+    engine.evaluate(1, 20, true, 0);
+    TEST_ASSERT_EQUAL(0, events.size());
+
+    // a failed read raises, repeated failures do not raise again; the value
+    // of a failed read is not checked against the limit
+    engine.evaluate(1, 500, false, 1000);
+    engine.evaluate(1, 500, false, 2000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(0, events[0].rule);
+    TEST_ASSERT_EQUAL(ALARM_COMM_LOSS, events[0].type);
+    TEST_ASSERT_TRUE(events[0].active);
+    TEST_ASSERT_TRUE(engine.isActive(0));
+    TEST_ASSERT_FALSE(engine.isActive(1));
+
+    engine.evaluate(1, 21, true, 3000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_EQUAL(ALARM_COMM_LOSS, events[1].type);
+    TEST_ASSERT_FALSE(events[1].active);
+    TEST_ASSERT_EQUAL(0, engine.active());
+}
+
+// no change larger than 2 for a minute
+static void test_stuck() {
+    AlarmRule rule = {2, ALARM_STUCK, ALARM_ACTION_UPLINK, 2, 0, 0, 60000, 0};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    // noise within the limit does not count as a change
+    for (int64_t t = 0; t < 60000; t += 5000) {
+        engine.evaluate(2, 200 + (t / 5000) % 3, true, t);
+    }
+    TEST_ASSERT_EQUAL(0, events.size());
+    engine.evaluate(2, 201, true, 60000);
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_TRUE(events[0].active);
+
+    // a real change clears at once and restarts the window
+    engine.evaluate(2, 210, true, 65000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_FALSE(events[1].active);
+    engine.evaluate(2, 210, true, 124000);
+    TEST_ASSERT_EQUAL(2, events.size());
+    engine.evaluate(2, 210, true, 125000);
+    TEST_ASSERT_EQUAL(3, events.size());
+    TEST_ASSERT_TRUE(events[2].active);
+}
+
+// 2.0 per minute (registry units of 0.1), sampled every second
+static void test_roc_fast_samples() {
+    AlarmRule rule = {1, ALARM_ROC, ALARM_ACTION_UPLINK, 20, 5, 0, 60000, 0};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    // a step of 1 between two samples 1 s apart is 60 per minute when
+    // extrapolated, but only 1 against the minute old reference
+    engine.evaluate(1, 0, true, 0);
+    for (int64_t t = 1000; t <= 120000; t += 1000) {
+        engine.evaluate(1, t == 30000 ? 1 : t > 30000, true, t);
+    }
+    TEST_ASSERT_EQUAL(0, events.size());
+
+    // a ramp of 0.5 per second is 30.0 per minute
+    int32_t value = 1;
+    for (int64_t t = 121000; t <= 300000; t += 1000) {
+        engine.evaluate(1, value += 5, true, t);
+    }
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_TRUE(events[0].active);
+    TEST_ASSERT_TRUE(events[0].time > 121000);
+
+    // flat again, clears once the reference is past the ramp
+    for (int64_t t = 301000; t <= 500000; t += 1000) {
+        engine.evaluate(1, value, true, t);
+    }
+    TEST_ASSERT_EQUAL(2, events.size());
+    TEST_ASSERT_FALSE(events[1].active);
+    TEST_ASSERT_FALSE(engine.isActive(0));
+}
+
+// samples further apart than the window
+static void test_roc_slow_samples() {
+    AlarmRule rule = {2, ALARM_ROC, ALARM_ACTION_UPLINK, 20, 5, 0, 60000, 0};
+    TEST_ASSERT_TRUE(engine.compile(&rule, 1, POINTS));
+    setUpHandler();
+
+    engine.evaluate(2, 0, true, 0);
+    engine.evaluate(2, 30, true, 300000);     // 6 per minute over 5 minutes
+    TEST_ASSERT_EQUAL(0, events.size());
+    engine.evaluate(2, 200, true, 420000);    // 85 per minute
+    TEST_ASSERT_EQUAL(1, events.size());
+    TEST_ASSERT_EQUAL(200, events[0].value);
+}
+
+// same parameters as the ALARM_BENCHMARK build of the example
+static void test_benchmark() {
+    AlarmBenchmark bench;
+    char           message[128];
+    AlarmEngine::benchmark(10000, 500, 20000, &bench);
+    snprintf(message, sizeof(message), "%u rules, %u samples: %lld ns/sample indexed, %lld ns/sample full scan",
+             bench.rules, bench.samples, (long long)(bench.indexed_nsec / bench.samples),
+             (long long)(bench.scan_nsec / bench.samples));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(10000, bench.rules);
+    TEST_ASSERT_EQUAL(20000, bench.samples);
+    TEST_ASSERT_TRUE(bench.indexed_nsec < bench.scan_nsec);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_invalid_points);
+    RUN_TEST(test_high_hysteresis);
+    RUN_TEST(test_low_hysteresis);
+    RUN_TEST(test_raise_delay);
+    RUN_TEST(test_comm_loss);
+    RUN_TEST(test_stuck);
+    RUN_TEST(test_roc_fast_samples);
+    RUN_TEST(test_roc_slow_samples);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,176 @@
+//
+// Frame splitting and response times of the bus sniffer, on bytes as the
+// UART delivers them at its RX timeout.
+//
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+
+#include "SnifferDecoder.hpp"
+
+// 19200 Bd 8N1
+#define CHAR_USEC    573
+#define SILENCE_USEC 2006
+#define T0           1000000
+
+struct Captured {
+    SnifferRecord        record;
+    std::vector<uint8_t> bytes;
+};
+
+static std::vector<Captured> captured;
+
+static SnifferDecoder* create() {
+    captured.clear();
+    // on the heap, so that a write past the statistics is caught by the sanitizer
+    SnifferDecoder* decoder =
+        new SnifferDecoder(CHAR_USEC, SILENCE_USEC, [](const SnifferRecord& record, const uint8_t* frame) {
+            captured.push_back({record, std::vector<uint8_t>(frame, frame + record.length)});
+        });
+    decoder->begin(T0);
+    return decoder;
+}
+
+// read holding registers: request and response
+static size_t request(uint8_t* buf, uint8_t address) {
+    const uint8_t pdu[] = {0x00, 0x10, 0x00, 0x02};
+    return modbus_rtu_encode(buf, MODBUS_RTU_MAX_FRAME, address, 0x03, pdu, sizeof(pdu));
+}
+
+static size_t response(uint8_t* buf, uint8_t address) {
+    const uint8_t pdu[] = {0x04, 0x01, 0x02, 0x03, 0x04};
+    return modbus_rtu_encode(buf, MODBUS_RTU_MAX_FRAME, address, 0x03, pdu, sizeof(pdu));
+}
+
+static void test_address_out_of_range() {
+    SnifferDecoder*   decoder = create();
+    SnifferSlaveStats stats;
+    uint8_t           buf[MODBUS_RTU_MAX_FRAME];
+
+    for (uint8_t address : {250, 255, 247}) {
+        size_t len = request(buf, address);
+        decoder->receive(buf, len, T0 + 100000 * address);
+        len = response(buf, address);
+        decoder->receive(buf, len, T0 + 100000 * address + 5000 + len * CHAR_USEC);
+    }
+    TEST_ASSERT_EQUAL(6, captured.size());
+    for (const Captured& c : captured) {
+        TEST_ASSERT_TRUE(c.record.flags & SNIFFER_FLAG_CRC_OK);
+    }
+    TEST_ASSERT_TRUE(captured[1].record.flags & SNIFFER_FLAG_RESPONSE);
+    TEST_ASSERT_FALSE(decoder->getSlaveStats(250, &stats));
+    TEST_ASSERT_FALSE(decoder->getSlaveStats(255, &stats));
+    TEST_ASSERT_TRUE(decoder->getSlaveStats(247, &stats));
+    TEST_ASSERT_EQUAL(1, stats.responses);
+    TEST_ASSERT_EQUAL(5000, stats.min_usec);
+    TEST_ASSERT_EQUAL(0, decoder->getCrcErrors());
+    delete decoder;
+}
+
+// a slave answering within the RX timeout: both frames come in one read
+static void test_fast_response() {
+    SnifferDecoder*   decoder = create();
+    SnifferSlaveStats stats;
+    uint8_t           buf[2 * MODBUS_RTU_MAX_FRAME];
+
+    size_t len = request(buf, 1);
+    len += response(buf + len, 1);
+    decoder->receive(buf, len, T0 + 20000);
+
+    TEST_ASSERT_EQUAL(2, captured.size());
+    TEST_ASSERT_EQUAL(8, captured[0].bytes.size());
+    TEST_ASSERT_EQUAL(9, captured[1].bytes.size());
+    TEST_ASSERT_EQUAL(20000 - 17 * CHAR_USEC, captured[0].record.delta_usec);
+    TEST_ASSERT_EQUAL(8 * CHAR_USEC, captured[1].record.delta_usec);
+    TEST_ASSERT_EQUAL(SNIFFER_FLAG_CRC_OK | SNIFFER_FLAG_RESPONSE, captured[1].record.flags);
+    TEST_ASSERT_TRUE(decoder->getSlaveStats(1, &stats));
+    TEST_ASSERT_EQUAL(0, stats.max_usec);
+
+    // the answer after a gap shorter than t3.5, read at the next timeout
+    len = request(buf, 2);
+    decoder->receive(buf, len, T0 + 100000);
+    len = response(buf, 2);
+    decoder->receive(buf, len, T0 + 100000 + 800 + len * CHAR_USEC);
+    TEST_ASSERT_EQUAL(4, captured.size());
+    TEST_ASSERT_TRUE(decoder->getSlaveStats(2, &stats));
+    TEST_ASSERT_EQUAL(800, stats.min_usec);
+    delete decoder;
+}
+
+// several frames read at once get their own start
+static void test_buffered_frames() {
+    SnifferDecoder* decoder = create();
+    uint8_t         buf[4 * MODBUS_RTU_MAX_FRAME];
+    size_t          len = 0;
+
+    for (uint8_t address = 1; address <= 3; address++) {
+        len += request(buf + len, address);
+        len += response(buf + len, address);
+    }
+    decoder->receive(buf, len, T0 + len * CHAR_USEC);
+
+    TEST_ASSERT_EQUAL(6, captured.size());
+    TEST_ASSERT_EQUAL(0, captured[0].record.delta_usec);
+    for (size_t i = 1; i < captured.size(); i++) {
+        TEST_ASSERT_EQUAL(captured[i - 1].bytes.size() * CHAR_USEC, captured[i].record.delta_usec);
+        TEST_ASSERT_EQUAL(i % 2 == 1 ? SNIFFER_FLAG_CRC_OK | SNIFFER_FLAG_RESPONSE : SNIFFER_FLAG_CRC_OK,
+                          captured[i].record.flags);
+    }
+    TEST_ASSERT_EQUAL(6, decoder->getFrames());
+    delete decoder;
+}
+
+// a gap inside a frame shorter than t3.5 does not split it
+static void test_split_frame() {
+    SnifferDecoder* decoder = create();
+    uint8_t         buf[MODBUS_RTU_MAX_FRAME];
+
+    size_t len = response(buf, 5);
+    decoder->receive(buf, 2, T0 + 10000);
+    TEST_ASSERT_EQUAL(0, captured.size());
+    decoder->receive(buf + 2, 2, T0 + 10000 + 1500 + 2 * CHAR_USEC);
+    decoder->receive(buf + 4, len - 4, T0 + 12000 + (len - 2) * CHAR_USEC);
+
+    TEST_ASSERT_EQUAL(1, captured.size());
+    TEST_ASSERT_EQUAL(len, captured[0].bytes.size());
+    TEST_ASSERT_EQUAL(10000 - 2 * CHAR_USEC, captured[0].record.delta_usec);
+    TEST_ASSERT_EQUAL(SNIFFER_FLAG_CRC_OK, captured[0].record.flags);
+    delete decoder;
+}
+
+// noise ends at a t3.5 silence, a function code without a known layout too
+static void test_noise_and_unknown_function() {
+    SnifferDecoder* decoder = create();
+    const uint8_t   noise[] = {0x01, 0x03, 0x00};
+    const uint8_t   mei[]   = {0x0E, 0x01, 0x00};
+    uint8_t         buf[MODBUS_RTU_MAX_FRAME];
+
+    decoder->receive(noise, sizeof(noise), T0 + 10000);
+    size_t len = request(buf, 7);
+    decoder->receive(buf, len, T0 + 20000);
+    TEST_ASSERT_EQUAL(2, captured.size());
+    TEST_ASSERT_EQUAL(0, captured[0].record.flags);
+    TEST_ASSERT_EQUAL(sizeof(noise), captured[0].bytes.size());
+    TEST_ASSERT_EQUAL(SNIFFER_FLAG_CRC_OK, captured[1].record.flags);
+
+    len = modbus_rtu_encode(buf, sizeof(buf), 7, 0x2B, mei, sizeof(mei));
+    decoder->receive(buf, len, T0 + 30000);
+    TEST_ASSERT_EQUAL(2, captured.size());
+    decoder->flush();
+    TEST_ASSERT_EQUAL(3, captured.size());
+    TEST_ASSERT_EQUAL(len, captured[2].bytes.size());
+    TEST_ASSERT_EQUAL(SNIFFER_FLAG_CRC_OK, captured[2].record.flags);
+    TEST_ASSERT_EQUAL(1, decoder->getCrcErrors());
+    delete decoder;
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_address_out_of_range);
+    RUN_TEST(test_fast_response);
+    RUN_TEST(test_buffered_frames);
+    RUN_TEST(test_split_frame);
+    RUN_TEST(test_noise_and_unknown_function);
+    return UNITY_END();
+}
@@ -0,0 +1,193 @@
+//
+// CanTransport packing on an in-memory bus and over SocketCAN. The SocketCAN
+// tests need a vcan interface and are ignored without one:
+//
+//   ip link add dev vcan0 type vcan && ip link set vcan0 mtu 72 up
+//
+
+#include <unity.h>
+#include <string.h>
+#include <vector>
+
+#include "CanTransport.hpp"
+#include "SocketCanBackend.hpp"
+
+#define VCAN_INTERFACE "vcan0"
+
+/**
+ * Frames sent are received in order, the filter is applied on receive
+ */
+class MemoryBackend : public CanBackend {
+    std::vector<CanFrame> _frames;
+    size_t                _next;
+    uint32_t              _id;
+    uint32_t              _mask;
+    uint8_t               _payload;
+
+public:
+    MemoryBackend(uint8_t payload) : _next(0), _id(0), _mask(0), _payload(payload) {}
+
+    bool send(const CanFrame& frame, uint32_t) override {
+        _frames.push_back(frame);
+        return true;
+    }
+
+    bool receive(CanFrame* frame, uint32_t) override {
+        while (_next < _frames.size()) {
+            const CanFrame& f = _frames[_next++];
+            if ((f.id & _mask) == (_id & _mask)) {
+                *frame = f;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool setFilter(uint32_t id, uint32_t mask) override {
+        _id   = id;
+        _mask = mask;
+        return true;
+    }
+
+    uint8_t maxPayload() override {
+        return _payload;
+    }
+
+    size_t frames() {
+        return _frames.size();
+    }
+};
+
+struct Received {
+    uint16_t point;
+    int32_t  value;
+    bool     valid;
+};
+
+static std::vector<Received> receive_all(CanTransport* transport) {
+    std::vector<Received> points;
+    transport->poll([&points](uint8_t, uint16_t point, int32_t value, bool valid) {
+        points.push_back({point, value, valid});
+    }, 0);
+    return points;
+}
+
+static void test_pack_int16() {
+    MemoryBackend bus(CAN_MAX_PAYLOAD);
+    CanTransport  tx(&bus, 1);
+    CanTransport  rx(&bus, 2);
+    CanStats      stats;
+
+    rx.listen(1);
+    tx.queue(0, 100, true);
+    tx.queue(1, -100, true);
+    tx.queue(3, 40000, true);       // gap of one point, clamped
+    tx.queue(4, 0, false);
+    tx.queue(20, 7, true);
+    TEST_ASSERT_EQUAL(3, tx.flush());
+    TEST_ASSERT_EQUAL(3, bus.frames());
+
+    std::vector<Received> points = receive_all(&rx);
+    TEST_ASSERT_EQUAL(5, points.size());
+    TEST_ASSERT_EQUAL(3, points[2].point);
+    TEST_ASSERT_EQUAL(INT16_MAX, points[2].value);
+    TEST_ASSERT_FALSE(points[3].valid);
+    TEST_ASSERT_EQUAL(20, points[4].point);
+    TEST_ASSERT_EQUAL(7, points[4].value);
+
+    tx.getStats(&stats);
+    TEST_ASSERT_EQUAL(1, stats.tx_clamped);
+    TEST_ASSERT_EQUAL(5, stats.tx_points);
+}
+
+static void test_pack_int32() {
+    MemoryBackend bus(CANFD_MAX_PAYLOAD);
+    CanTransport  tx(&bus, 1, true);
+    CanTransport  rx(&bus, 2);
+    CanStats      stats;
+
+    rx.listen(CAN_NODE_ANY);
+    for (uint16_t p = 0; p < 20; p++) {
+        tx.queue(p, 36000 + p, true);
+    }
+    tx.queue(20, -70000, true);
+    TEST_ASSERT_EQUAL(2, tx.flush());     // 16 values per CAN FD frame
+
+    std::vector<Received> points = receive_all(&rx);
+    TEST_ASSERT_EQUAL(21, points.size());
+    for (uint16_t p = 0; p < 20; p++) {
+        TEST_ASSERT_EQUAL(p, points[p].point);
+        TEST_ASSERT_EQUAL(36000 + p, points[p].value);
+    }
+    TEST_ASSERT_EQUAL(-70000, points[20].value);
+
+    tx.getStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.tx_clamped);
+}
+
+static void test_listen_node() {
+    MemoryBackend bus(CAN_MAX_PAYLOAD);
+    CanTransport  node1(&bus, 1);
+    CanTransport  node3(&bus, 3, true);
+    CanTransport  rx(&bus, 2);
+
+    rx.listen(3);
+    node1.queue(0, 1, true);
+    node1.flush();
+    node3.queue(0, 3, true);
+    node3.flush();
+
+    std::vector<Received> points = receive_all(&rx);
+    TEST_ASSERT_EQUAL(1, points.size());
+    TEST_ASSERT_EQUAL(3, points[0].value);
+}
+
+static void test_vcan_round_trip() {
+    SocketCanBackend tx_socket;
+    SocketCanBackend rx_socket;
+    if (!tx_socket.begin(VCAN_INTERFACE, false) || !rx_socket.begin(VCAN_INTERFACE, false)) {
+        TEST_IGNORE_MESSAGE("no " VCAN_INTERFACE " interface");
+    }
+
+    CanTransport tx(&tx_socket, 1, true);
+    CanTransport rx(&rx_socket, 2);
+    rx.listen(1);
+    for (uint16_t p = 0; p < 8; p++) {
+        tx.queue(p, 33000 + p, true);
+    }
+    TEST_ASSERT_EQUAL(4, tx.flush());
+
+    std::vector<Received> points;
+    while (points.size() < 8 && rx.poll([&points](uint8_t, uint16_t point, int32_t value, bool valid) {
+        points.push_back({point, value, valid});
+    }, 100) > 0) {
+    }
+    TEST_ASSERT_EQUAL(8, points.size());
+    TEST_ASSERT_EQUAL(33007, points[7].value);
+}
+
+static void test_vcan_benchmark() {
+    SocketCanBackend tx_socket;
+    SocketCanBackend rx_socket;
+    if (!tx_socket.begin(VCAN_INTERFACE, true) || !rx_socket.begin(VCAN_INTERFACE, true)) {
+        TEST_IGNORE_MESSAGE("no CAN FD " VCAN_INTERFACE " interface");
+    }
+
+    CanBenchmark bench;
+    char         message[96];
+    CanTransport::benchmark(&tx_socket, &rx_socket, 64, 1000, &bench);
+    snprintf(message, sizeof(message), "vcan: %u frames, %.0f points/s", bench.frames,
+             (double)bench.points * bench.rounds * 1e9 / bench.total_nsec);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(bench.points * bench.rounds, bench.received);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_pack_int16);
+    RUN_TEST(test_pack_int32);
+    RUN_TEST(test_listen_node);
+    RUN_TEST(test_vcan_round_trip);
+    RUN_TEST(test_vcan_benchmark);
+    return UNITY_END();
+}
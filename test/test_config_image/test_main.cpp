@@ -0,0 +1,189 @@
+//
+// ConfigImage: a compiled text loads in place, damaged images and images
+// with settings compile() rejects are refused, and the compile and load
+// times of 500 points.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <functional>
+
+#include "ConfigImage.hpp"
+#include "ModbusFrame.h"
+
+static const char TEXT[] =
+    "# site\n"
+    "bus     baudrate=19200 format=7E2 timeout=500 poll=2000\n"
+    "sensor  id=0 address=2 name=S-0 description=\"Hall\"\n"
+    "sensor  id=1 address=5 name=S-1\n"
+    "point   name=P-1 address=3 function=4 register=0x0010 scale=10 description=\"Flow\"\n"
+    "point   name=P-2\n"
+    "lora    dev_eui=70B3D57ED0000001 join_eui=0000000000000000 "
+    "app_key=000102030405060708090A0B0C0D0E0F nwk_key=F0E0D0C0B0A090807060504030201000\n";
+
+static uint8_t* compile_text(const char* text, size_t* size) {
+    ConfigError error;
+    uint8_t*    image = ConfigImage::compile(text, strlen(text), size, &error);
+    TEST_ASSERT_NOT_NULL(image);
+    return image;
+}
+
+static void update_crc(uint8_t* image, size_t size) {
+    uint16_t crc = 0;
+    memcpy(image + offsetof(ConfigHeader, crc), &crc, sizeof(crc));
+    crc = modbus_crc16(image, size);
+    memcpy(image + offsetof(ConfigHeader, crc), &crc, sizeof(crc));
+}
+
+/**
+ * Change a compiled image and load it
+ *
+ * @param change   edits the image
+ * @param recrc    compute the CRC again, as a writer with wrong values would
+ * @param message  expected reason
+ */
+static void assert_rejected(std::function<void(uint8_t*, size_t*)> change, bool recrc, const char* message) {
+    ConfigImage config;
+    ConfigError error;
+    size_t      size;
+    uint8_t*    image = compile_text(TEXT, &size);
+
+    change(image, &size);
+    if (recrc) {
+        update_crc(image, size);
+    }
+    TEST_ASSERT_FALSE(config.load(image, size, &error));
+    TEST_ASSERT_FALSE(config.loaded());
+    TEST_ASSERT_EQUAL_STRING(message, error.message);
+}
+
+static ConfigHeader* header(uint8_t* image) {
+    return (ConfigHeader*)image;
+}
+
+static ConfigSensor* sensor(uint8_t* image, uint16_t i) {
+    return (ConfigSensor*)(image + header(image)->sensors) + i;
+}
+
+static ConfigPoint* point(uint8_t* image, uint16_t i) {
+    return (ConfigPoint*)(image + header(image)->points) + i;
+}
+
+static void test_load() {
+    ConfigImage config;
+    ConfigError error;
+    size_t      size;
+    uint8_t*    image = compile_text(TEXT, &size);
+
+    TEST_ASSERT_TRUE(config.load(image, size, &error));
+    TEST_ASSERT_NULL(error.message);
+    TEST_ASSERT_EQUAL(modbus_crc16((const uint8_t*)TEXT, strlen(TEXT)), config.sourceCrc());
+
+    const ConfigBus* bus = config.bus();
+    TEST_ASSERT_EQUAL(19200, bus->baudrate);
+    TEST_ASSERT_EQUAL(7, bus->data_bits);
+    TEST_ASSERT_EQUAL('E', bus->parity);
+    TEST_ASSERT_EQUAL(2, bus->stop_bits);
+    TEST_ASSERT_EQUAL(500, bus->timeout);
+    TEST_ASSERT_EQUAL(2000, bus->poll_interval);
+
+    TEST_ASSERT_EQUAL(2, config.sensors());
+    TEST_ASSERT_EQUAL(2, config.sensor(0)->address);
+    TEST_ASSERT_EQUAL_STRING("Hall", config.string(config.sensor(0)->description));
+    TEST_ASSERT_EQUAL_STRING("S-1", config.string(config.sensor(1)->name));
+    TEST_ASSERT_EQUAL_STRING("", config.string(config.sensor(1)->description));
+
+    TEST_ASSERT_EQUAL(2, config.points());
+    TEST_ASSERT_EQUAL_STRING("Flow", config.string(config.point(0)->description));
+    TEST_ASSERT_EQUAL(0x0010, config.point(0)->reg);
+    TEST_ASSERT_EQUAL(10, config.point(0)->scale);
+    TEST_ASSERT_EQUAL(4, config.point(0)->function);
+    TEST_ASSERT_EQUAL(3, config.point(1)->function);
+    TEST_ASSERT_EQUAL(1, config.point(1)->scale);
+
+    TEST_ASSERT_EQUAL(1, config.lora()->enabled);
+    TEST_ASSERT_EQUAL_HEX8(0x70, config.lora()->dev_eui[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x0F, config.lora()->app_key[15]);
+}
+
+static void test_compile_errors() {
+    const struct {
+        const char* text;
+        uint16_t    line;
+        const char* message;
+    } cases[] = {
+        {"bus format=9N1\n", 1, "invalid bus setting"},
+        {"bus format=8X1\n", 1, "invalid bus setting"},
+        {"bus format=8N3\n", 1, "invalid bus setting"},
+        {"bus poll=0\n", 1, "invalid bus setting"},
+        {"\nsensor id=3 address=2\nsensor id=3 address=4\n", 3, "duplicate sensor id"},
+        {"sensor id=1\n", 1, "sensor without address"},
+        {"point name=P function=5\n", 1, "invalid point setting"},
+        {"valve\n", 1, "unknown section"},
+    };
+
+    for (const auto& c : cases) {
+        ConfigError error;
+        size_t      size;
+        TEST_ASSERT_NULL(ConfigImage::compile(c.text, strlen(c.text), &size, &error));
+        TEST_ASSERT_EQUAL(c.line, error.line);
+        TEST_ASSERT_EQUAL_STRING(c.message, error.message);
+    }
+}
+
+static void test_damaged() {
+    assert_rejected([](uint8_t* image, size_t*) { image[0] = 'X'; }, true, "not a configuration image");
+    assert_rejected([](uint8_t*, size_t* size) { *size = sizeof(ConfigHeader) - 1; }, false,
+                    "not a configuration image");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->version++; }, true, "unsupported version");
+    assert_rejected([](uint8_t*, size_t* size) { (*size)--; }, false, "wrong size");
+    assert_rejected([](uint8_t* image, size_t* size) { image[*size - 2] ^= 0x01; }, false, "CRC error");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.baudrate ^= 0x100; }, false, "CRC error");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->point_count++; }, true, "invalid layout");
+    assert_rejected([](uint8_t* image, size_t* size) { image[*size - 1] = 'x'; }, true, "invalid layout");
+    assert_rejected([](uint8_t* image, size_t* size) { point(image, 1)->name = *size; }, true, "invalid string");
+}
+
+// a valid CRC over values compile() never writes
+static void test_invalid_values() {
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.data_bits = 9; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.data_bits = 4; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.parity = 'M'; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.stop_bits = 0; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.stop_bits = 3; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.poll_interval = 0; }, true,
+                    "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.baudrate = 0; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { header(image)->bus.timeout = 0; }, true, "invalid bus setting");
+    assert_rejected([](uint8_t* image, size_t*) { sensor(image, 1)->id = 0; }, true, "duplicate sensor id");
+    assert_rejected([](uint8_t* image, size_t*) { sensor(image, 0)->address = 0; }, true, "invalid sensor setting");
+    assert_rejected([](uint8_t* image, size_t*) { sensor(image, 0)->address = 248; }, true,
+                    "invalid sensor setting");
+    assert_rejected([](uint8_t* image, size_t*) { point(image, 0)->function = 0; }, true, "invalid point setting");
+    assert_rejected([](uint8_t* image, size_t*) { point(image, 0)->scale = 0; }, true, "invalid point setting");
+    assert_rejected([](uint8_t* image, size_t*) { point(image, 1)->address = 248; }, true, "invalid point setting");
+}
+
+static void test_benchmark() {
+    ConfigBenchmark bench;
+    char            message[128];
+    ConfigImage::benchmark(500, &bench);
+    snprintf(message, sizeof(message), "%u points: text %zu B, image %zu B, compile %lld us, load %lld us",
+             bench.points, bench.text_bytes, bench.image_bytes, (long long)(bench.compile_nsec / 1000),
+             (long long)(bench.load_nsec / 1000));
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(500, bench.points);
+    TEST_ASSERT_TRUE(bench.load_nsec < bench.compile_nsec);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_load);
+    RUN_TEST(test_compile_errors);
+    RUN_TEST(test_damaged);
+    RUN_TEST(test_invalid_values);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
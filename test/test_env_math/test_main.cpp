@@ -0,0 +1,82 @@
+//
+// EnvMath against libm: the error bounds documented in EnvMath.h on a grid
+// of each domain, and the benchmark of the three versions on the host.
+//
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+
+#include <EnvMath.h>
+
+#define BENCH_SAMPLES 1000000
+
+// documented bounds: float, fixed
+static const double altitude_error[]  = {0.01, 0.06};
+static const double dew_point_error[] = {0.0001, 0.011};
+static const double absolute_error[]  = {0.0001, 0.0015};
+static const double heat_error[]      = {0.0002, 0.011};
+
+static void test_altitude() {
+    double error[2] = {0, 0};
+    for (int32_t p = 30000; p <= 110000; p += 7) {
+        for (int32_t s = 95000; s <= 105000; s += 2500) {
+            double ref = env_altitude_ref(p, s);
+            error[0]   = fmax(error[0], fabs(env_altitude(p, s) - ref));
+            error[1]   = fmax(error[1], fabs(env_altitude_fixed(p, s) * 0.01 - ref));
+        }
+    }
+    TEST_ASSERT_FLOAT_WITHIN(altitude_error[0], 0.0f, error[0]);
+    TEST_ASSERT_FLOAT_WITHIN(altitude_error[1], 0.0f, error[1]);
+}
+
+static void test_humidity() {
+    double dew[2] = {0, 0}, absolute[2] = {0, 0}, heat[2] = {0, 0};
+    for (int32_t t = -4000; t <= 6000; t += 7) {
+        for (int32_t h = 0; h <= 10000; h += 13) {
+            float  tf = t * 0.01f, hf = h * 0.01f;
+            double ref;
+            if (h >= 100) {
+                ref    = env_dew_point_ref(tf, hf);
+                dew[0] = fmax(dew[0], fabs(env_dew_point(tf, hf) - ref));
+                dew[1] = fmax(dew[1], fabs(env_dew_point_fixed(t, h) * 0.01 - ref));
+            }
+            ref         = env_absolute_humidity_ref(tf, hf);
+            absolute[0] = fmax(absolute[0], fabs(env_absolute_humidity(tf, hf) - ref));
+            absolute[1] = fmax(absolute[1], fabs(env_absolute_humidity_fixed(t, h) * 0.001 - ref));
+            ref         = env_heat_index_ref(tf, hf);
+            heat[0]     = fmax(heat[0], fabs(env_heat_index(tf, hf) - ref));
+            heat[1]     = fmax(heat[1], fabs(env_heat_index_fixed(t, h) * 0.01 - ref));
+        }
+    }
+    for (uint8_t v = 0; v < 2; v++) {
+        TEST_ASSERT_FLOAT_WITHIN(dew_point_error[v], 0.0f, dew[v]);
+        TEST_ASSERT_FLOAT_WITHIN(absolute_error[v], 0.0f, absolute[v]);
+        TEST_ASSERT_FLOAT_WITHIN(heat_error[v], 0.0f, heat[v]);
+    }
+}
+
+static void test_benchmark() {
+    static const double* bounds[ENV_MATH_QUANTITIES] = {altitude_error, dew_point_error, absolute_error, heat_error};
+    EnvMathBenchmark     bench;
+    char                 message[128];
+
+    env_math_benchmark(BENCH_SAMPLES, &bench);
+    for (uint8_t q = 0; q < ENV_MATH_QUANTITIES; q++) {
+        const EnvMathTiming* t = &bench.quantities[q];
+        snprintf(message, sizeof(message), "%-12s libm %5.1f ns, float %5.1f ns, fixed %5.1f ns per sample", t->name,
+                 (double)t->ref_nsec / bench.samples, (double)t->float_nsec / bench.samples,
+                 (double)t->fixed_nsec / bench.samples);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_FLOAT_WITHIN(bounds[q][0], 0.0f, t->float_error);
+        TEST_ASSERT_FLOAT_WITHIN(bounds[q][1], 0.0f, t->fixed_error);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_altitude);
+    RUN_TEST(test_humidity);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
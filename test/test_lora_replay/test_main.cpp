@@ -0,0 +1,121 @@
+//
+// Replay of a LoRa868 trace on the host: the recorded ENV readings go
+// through the filters and the payload encoding of the node again, and every
+// uplink is compared with the recorded one. A trace from the card is replayed
+// with
+//
+//   LORA_TRACE=lora.trc pio test -e native -f test_lora_replay
+//
+
+#include <unity.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "uplink.h"
+
+#define TRACE_PATH "test_lora_replay.trc"
+#define WAKEUPS    96               // one day at 15 minutes
+
+struct ReplayResult {
+    uint32_t uplinks;
+    uint32_t mismatches;
+};
+
+static const UplinkPower power = {false, 4100, 95, -1};
+
+// what the node does on every wakeup, with a spike of the SHT40 at wakeup 40
+static void record(const char* path) {
+    TraceRecorder recorder;
+    SensorFilter  temperature, humidity, pressure;
+    uint8_t       uplink[UPLINK_MAX_SIZE];
+
+    TEST_ASSERT_TRUE(recorder.open(path, CLOCK_MONOTONIC));
+    TEST_ASSERT_TRUE(temperature.configure(ENV_FILTER) && humidity.configure(ENV_FILTER)
+                     && pressure.configure(ENV_FILTER));
+    for (uint32_t i = 0; i < WAKEUPS; i++) {
+        TraceEnv     env = {21.0f + 3.0f * sinf(i * 0.065f), 45.0f + 0.1f * (i % 7), 98200.0f + i, 21.4f};
+        UplinkValues values;
+        int16_t      state = 0;
+        if (i == 40) {
+            env.temperature = 85.0f;
+        }
+        recorder.record(TRACE_SOURCE_ENV, TRACE_ENV_READING, &env, sizeof(env));
+        uplink_values(&env, &temperature, &humidity, &pressure, &values);
+        size_t len = uplink_encode(&power, &values, uplink);
+        recorder.record(TRACE_SOURCE_LORA, TRACE_LORA_UPLINK, uplink, len);
+        recorder.record(TRACE_SOURCE_LORA, TRACE_LORA_RESULT, &state, sizeof(state));
+    }
+    recorder.close();
+}
+
+static bool replay(const char* path, const char* spec, ReplayResult* result) {
+    TracePlayer  player;
+    TraceEvent   event;
+    SensorFilter temperature, humidity, pressure;
+    uint8_t      uplink[UPLINK_MAX_SIZE];
+    size_t       len = 0;
+
+    memset(result, 0, sizeof(*result));
+    if (!player.open(path) || !temperature.configure(spec) || !humidity.configure(spec)
+        || !pressure.configure(spec)) {
+        return false;
+    }
+    while (player.next(&event)) {
+        if (event.source == TRACE_SOURCE_ENV && event.kind == TRACE_ENV_READING && event.len == sizeof(TraceEnv)) {
+            TraceEnv     env;
+            UplinkValues values;
+            memcpy(&env, event.data, sizeof(env));
+            uplink_values(&env, &temperature, &humidity, &pressure, &values);
+            len = uplink_encode(&power, &values, uplink);
+        }
+        if (event.source == TRACE_SOURCE_LORA && event.kind == TRACE_LORA_UPLINK) {
+            result->uplinks++;
+            if (event.len != len
+                || memcmp(event.data + UPLINK_ENV_OFFSET, uplink + UPLINK_ENV_OFFSET, len - UPLINK_ENV_OFFSET) != 0) {
+                result->mismatches++;
+            }
+        }
+    }
+    player.close();
+    return true;
+}
+
+static void test_replay_matches() {
+    ReplayResult result;
+    record(TRACE_PATH);
+    TEST_ASSERT_TRUE(replay(TRACE_PATH, ENV_FILTER, &result));
+    TEST_ASSERT_EQUAL(WAKEUPS, result.uplinks);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+static void test_replay_detects_changes() {
+    ReplayResult result;
+    // without the outlier stage the spike reaches the uplink
+    TEST_ASSERT_TRUE(replay(TRACE_PATH, "median:1", &result));
+    TEST_ASSERT_EQUAL(WAKEUPS, result.uplinks);
+    TEST_ASSERT_TRUE(result.mismatches > 0);
+    remove(TRACE_PATH);
+}
+
+static void test_card_trace() {
+    const char*  path = getenv("LORA_TRACE");
+    ReplayResult result;
+    char         message[64];
+    if (path == nullptr) {
+        TEST_IGNORE_MESSAGE("LORA_TRACE not set");
+    }
+    TEST_ASSERT_TRUE(replay(path, ENV_FILTER, &result));
+    snprintf(message, sizeof(message), "%u uplinks, %u differ", result.uplinks, result.mismatches);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(0, result.mismatches);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_replay_matches);
+    RUN_TEST(test_replay_detects_changes);
+    RUN_TEST(test_card_trace);
+    return UNITY_END();
+}
@@ -0,0 +1,97 @@
+//
+// RTU frame codec on the host: the CRC variants against the bit-wise loop of
+// the Modbus specification, frame decoding and the CRC benchmark.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ModbusFrame.h"
+
+#define BENCH_ROUNDS 20000
+
+static void test_crc_reference() {
+    const uint8_t request[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x01};
+
+    TEST_ASSERT_EQUAL(0x0A84, modbus_crc16_bitwise(request, sizeof(request)));
+    TEST_ASSERT_EQUAL(0x0A84, modbus_crc16_bytewise(request, sizeof(request)));
+    TEST_ASSERT_EQUAL(0x0A84, modbus_crc16(request, sizeof(request)));
+    TEST_ASSERT_EQUAL(MODBUS_CRC_INIT, modbus_crc16(request, 0));
+}
+
+// every length and alignment of the slice-by-4 loop, in one piece and in parts
+static void test_crc_variants() {
+    uint8_t  data[MODBUS_RTU_MAX_FRAME + 3];
+    uint32_t seed = 1;
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        seed    = seed * 1103515245 + 12345;
+        data[i] = seed >> 24;
+    }
+    for (size_t offset = 0; offset < 4; offset++) {
+        for (size_t len = 0; len <= MODBUS_RTU_MAX_FRAME; len++) {
+            uint16_t expected = modbus_crc16_bitwise(data + offset, len);
+            TEST_ASSERT_EQUAL(expected, modbus_crc16_bytewise(data + offset, len));
+            TEST_ASSERT_EQUAL(expected, modbus_crc16(data + offset, len));
+
+            size_t split = len / 3;
+            TEST_ASSERT_EQUAL(expected, modbus_crc16_update(modbus_crc16(data + offset, split), data + offset + split,
+                                                            len - split));
+        }
+    }
+}
+
+static void test_decode() {
+    const uint8_t  registers[] = {0x02, 0x12, 0x34};
+    uint8_t        buf[MODBUS_RTU_MAX_FRAME];
+    ModbusRtuFrame frame;
+
+    size_t len = modbus_rtu_encode(buf, sizeof(buf), 0x11, 0x03, registers, sizeof(registers));
+    TEST_ASSERT_EQUAL(7, len);
+    TEST_ASSERT_EQUAL(len, modbus_rtu_response_length(buf, 3));
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_OK, modbus_rtu_decode(buf, len, 0x11, &frame));
+    TEST_ASSERT_EQUAL(0x11, frame.address);
+    TEST_ASSERT_EQUAL(0x03, frame.function);
+    TEST_ASSERT_EQUAL(sizeof(registers), frame.pdu_len);
+    TEST_ASSERT_EQUAL_MEMORY(registers, frame.pdu, sizeof(registers));
+
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_WRONG_ADDRESS, modbus_rtu_decode(buf, len, 0x12, &frame));
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_WRONG_LENGTH, modbus_rtu_decode(buf, len - 1, 0x11, &frame));
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_TOO_SHORT, modbus_rtu_decode(buf, 3, 0x11, &frame));
+    buf[4] ^= 0x01;
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_CRC_ERROR, modbus_rtu_decode(buf, len, 0x11, &frame));
+
+    const uint8_t read[] = {0x00, 0x00, 0x00, 0x01};
+    len = modbus_rtu_encode(buf, sizeof(buf), 0x01, 0x03, read, sizeof(read));
+    TEST_ASSERT_EQUAL(8, len);
+    TEST_ASSERT_EQUAL(0x84, buf[6]);
+    TEST_ASSERT_EQUAL(0x0A, buf[7]);
+    TEST_ASSERT_EQUAL(len, modbus_rtu_request_length(buf, 2));
+    TEST_ASSERT_EQUAL(MODBUS_FRAME_OK, modbus_rtu_decode_request(buf, len, &frame));
+    TEST_ASSERT_EQUAL(0, modbus_rtu_encode(buf, 7, 0x01, 0x03, read, sizeof(read)));
+}
+
+static void test_benchmark() {
+    static const size_t lengths[] = {8, 64, MODBUS_RTU_MAX_FRAME};
+    ModbusCrcBenchmark  bench;
+    char                message[128];
+
+    for (size_t len : lengths) {
+        modbus_crc_benchmark(len, BENCH_ROUNDS, &bench);
+        TEST_ASSERT_EQUAL(len * BENCH_ROUNDS, bench.bytes);
+        snprintf(message, sizeof(message), "%3u B frames: bitwise %6.1f, bytewise %6.1f, sliced %6.1f MB/s",
+                 (unsigned)len, bench.bytes * 1e3 / bench.bitwise_nsec, bench.bytes * 1e3 / bench.bytewise_nsec,
+                 bench.bytes * 1e3 / bench.sliced_nsec);
+        TEST_MESSAGE(message);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_crc_reference);
+    RUN_TEST(test_crc_variants);
+    RUN_TEST(test_decode);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
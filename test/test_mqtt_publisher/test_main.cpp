@@ -0,0 +1,175 @@
+//
+// MqttPublisher window, lost messages and reconnects on a scripted backend,
+// and the throughput against a local broker. The broker test is ignored
+// without one:
+//
+//   mosquitto -p 1883
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+
+#include "MqttPublisher.hpp"
+#include "SocketMqttBackend.hpp"
+
+#define SPILL_FILE     "test_mqtt_publisher.spl"
+#define BROKER_HOST    "127.0.0.1"
+#define BROKER_PORT    1883
+
+/**
+ * Publishes are recorded, handlers are called by the test. With ack_inline
+ * the PUBACK is reported from inside publish(), as the esp-mqtt task can do
+ * while a publish waits for its lock.
+ */
+class ScriptedBackend : public MqttBackend {
+public:
+    std::vector<int> published;
+    bool             online     = true;
+    bool             ack_inline = false;
+    int              next_id    = 1;
+
+    int publish(const char*, const uint8_t*, size_t) override {
+        if (!online) {
+            return -1;
+        }
+        published.push_back(next_id);
+        if (ack_inline) {
+            ack(next_id);
+        }
+        return next_id++;
+    }
+
+    bool connected() override {
+        return online;
+    }
+
+    void poll(uint32_t) override {}
+
+    void ack(int id) { _ack_handler(id); }
+    void lose(int id) { _lost_handler(id); }
+
+    void setOnline(bool connected) {
+        online = connected;
+        _connect_handler(connected);
+    }
+};
+
+static void publish_batch(MqttPublisher* publisher, uint16_t points) {
+    for (uint16_t p = 0; p < points; p++) {
+        publisher->queue(p, p, true);
+    }
+    publisher->flush();
+}
+
+static void test_ack_inside_publish() {
+    ScriptedBackend backend;
+    MqttPublisher   publisher(&backend, nullptr, "test", 1);
+    MqttStats       stats;
+
+    backend.ack_inline = true;
+    for (uint8_t i = 0; i < 20; i++) {
+        publish_batch(&publisher, 10);
+    }
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(20, stats.messages);
+    TEST_ASSERT_EQUAL(20, stats.acked);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+}
+
+static void test_window() {
+    ScriptedBackend backend;
+    MqttPublisher   publisher(&backend, nullptr, "test", 1);
+    MqttStats       stats;
+
+    publisher.setWindow(2);
+    publish_batch(&publisher, 1);
+    publish_batch(&publisher, 1);
+    publish_batch(&publisher, 1);     // no room, no spill ring
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(2, stats.inflight);
+    TEST_ASSERT_EQUAL(1, stats.dropped);
+
+    backend.ack(backend.published[0]);
+    publish_batch(&publisher, 1);
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(3, stats.messages);
+    TEST_ASSERT_EQUAL(2, stats.inflight);
+}
+
+static void test_reconnect_keeps_inflight() {
+    ScriptedBackend backend;
+    MqttSpill       spill;
+    MqttStats       stats;
+
+    remove(SPILL_FILE);
+    TEST_ASSERT_TRUE(spill.open(SPILL_FILE, 16));
+    MqttPublisher publisher(&backend, &spill, "test", 1);
+
+    publish_batch(&publisher, 5);
+    publish_batch(&publisher, 5);
+    backend.setOnline(false);
+    publish_batch(&publisher, 5);     // offline: spilled
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(2, stats.inflight);
+    TEST_ASSERT_EQUAL(1, stats.spilled);
+
+    // the backend sends the two again after the reconnect, one expires
+    backend.setOnline(true);
+    backend.ack(backend.published[0]);
+    backend.lose(backend.published[1]);
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+    TEST_ASSERT_EQUAL(1, stats.acked);
+    TEST_ASSERT_EQUAL(2, stats.spilled);
+    TEST_ASSERT_EQUAL(1, stats.reconnects);
+    TEST_ASSERT_EQUAL(2, stats.backlog);
+
+    // a session-less backend loses everything in flight with the connection
+    publisher.setDrainRate(0);
+    publish_batch(&publisher, 5);
+    backend.lose(MQTT_ID_ALL);
+    publisher.drain();
+    publisher.getStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.inflight);
+    TEST_ASSERT_EQUAL(3, stats.backlog);
+
+    spill.close();
+    remove(SPILL_FILE);
+}
+
+// full batches waiting for every PUBACK and pipelined, as the MQTT_BENCHMARK build
+static void test_broker_benchmark() {
+    SocketMqttBackend backend;
+    if (!backend.begin(BROKER_HOST, BROKER_PORT, "stamplc-test")) {
+        TEST_IGNORE_MESSAGE("no MQTT broker on " BROKER_HOST ":1883");
+    }
+    // CONNACK
+    for (int i = 0; i < 100 && !backend.connected(); i++) {
+        backend.poll(10);
+    }
+    if (!backend.connected()) {
+        TEST_IGNORE_MESSAGE("MQTT broker on " BROKER_HOST ":1883 did not accept the connection");
+    }
+
+    for (uint8_t window : {1, MQTT_MAX_INFLIGHT}) {
+        MqttBenchmark bench;
+        char          message[96];
+        MqttPublisher::benchmark(&backend, MQTT_BATCH_POINTS, 500, window, &bench);
+        snprintf(message, sizeof(message), "window %u: %.0f msg/s, %.0f B/s", window,
+                 bench.messages * 1e9 / bench.total_nsec, bench.bytes * 1e9 / bench.total_nsec);
+        TEST_MESSAGE(message);
+        TEST_ASSERT_EQUAL(500, bench.messages);
+    }
+    backend.end();
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_ack_inside_publish);
+    RUN_TEST(test_window);
+    RUN_TEST(test_reconnect_keeps_inflight);
+    RUN_TEST(test_broker_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,106 @@
+//
+// PLC interpreter on the host: the example program of the README, programs
+// the loader must reject and the scan benchmark.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "PlcProgram.hpp"
+
+static std::vector<uint8_t> compile(const std::vector<PlcInstr>& code) {
+    std::vector<uint8_t> file(6 + code.size() * sizeof(PlcInstr));
+    uint16_t             count = code.size();
+
+    memcpy(file.data(), PLC_MAGIC, 4);
+    memcpy(file.data() + 4, &count, sizeof(count));
+    memcpy(file.data() + 6, code.data(), code.size() * sizeof(PlcInstr));
+    return file;
+}
+
+// relay 0 two seconds after input 0 is on and sensor 0 is above 25.0 °C
+static const std::vector<PlcInstr> example = {
+    {PLC_LD, PLC_AREA_I, 0, 0},
+    {PLC_PUSH, PLC_AREA_NONE, 0, 0},
+    {PLC_GT, PLC_AREA_R, 0, 250},
+    {PLC_ANDP, PLC_AREA_NONE, 0, 0},
+    {PLC_TON, PLC_AREA_T, 0, 2000},
+    {PLC_ST, PLC_AREA_Q, 0, 0},
+    {PLC_END, PLC_AREA_NONE, 0, 0},
+};
+
+static void test_example() {
+    PlcProgram           program;
+    uint16_t             regs[PLC_REGISTERS] = {251};
+    std::vector<uint8_t> file                = compile(example);
+
+    TEST_ASSERT_TRUE(program.load(file.data(), file.size()));
+    TEST_ASSERT_EQUAL(7, program.size());
+
+    uint8_t outputs = 0;
+    for (int scan = 0; scan < 19; scan++) {
+        outputs = program.execute(0x01, outputs, regs, 100);
+        TEST_ASSERT_EQUAL(0, outputs & 1);
+    }
+    outputs = program.execute(0x01, outputs, regs, 100);
+    TEST_ASSERT_EQUAL(1, outputs & 1);
+
+    // the temperature drops: the timer restarts
+    regs[0] = 250;
+    TEST_ASSERT_EQUAL(0, program.execute(0x01, outputs, regs, 100) & 1);
+    regs[0] = 300;
+    TEST_ASSERT_EQUAL(0, program.execute(0x01, outputs, regs, 100) & 1);
+    TEST_ASSERT_EQUAL(0, program.execute(0x00, outputs, regs, 5000) & 1);
+}
+
+static void test_reject() {
+    PlcProgram           program;
+    std::vector<uint8_t> file = compile(example);
+
+    TEST_ASSERT_TRUE(program.load(file.data(), file.size()));
+    TEST_ASSERT_FALSE(program.load(file.data(), file.size() - 1));
+    file[0] = 'X';
+    TEST_ASSERT_FALSE(program.load(file.data(), file.size()));
+
+    std::vector<std::vector<PlcInstr>> invalid = {
+        {{PLC_LD, PLC_AREA_I, 0, 0}},                                                            // no END
+        {{PLC_ST, PLC_AREA_I, 0, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                            // input written
+        {{PLC_LD, PLC_AREA_M, PLC_MARKERS, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                  // marker index
+        {{PLC_GT, PLC_AREA_R, PLC_REGISTERS, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                // register index
+        {{PLC_TON, PLC_AREA_T, 0, -1}, {PLC_END, PLC_AREA_NONE, 0, 0}},                          // preset
+        {{PLC_ANDP, PLC_AREA_NONE, 0, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                       // stack underflow
+        {{PLC_OPCODES, PLC_AREA_M, 0, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                       // opcode
+        {{PLC_END, PLC_AREA_NONE, 0, 0}, {PLC_END, PLC_AREA_NONE, 0, 0}},                        // END inside
+    };
+    std::vector<PlcInstr> deep(PLC_STACK_DEPTH + 1, {PLC_PUSH, PLC_AREA_NONE, 0, 0});
+    deep.push_back({PLC_END, PLC_AREA_NONE, 0, 0});
+    invalid.push_back(deep);
+
+    for (const std::vector<PlcInstr>& code : invalid) {
+        file = compile(code);
+        TEST_ASSERT_FALSE(program.load(file.data(), file.size()));
+    }
+    // the previous program stays loaded
+    TEST_ASSERT_EQUAL(7, program.size());
+}
+
+static void test_benchmark() {
+    PlcBenchmark bench;
+    char         message[96];
+
+    PlcProgram::benchmark(1000, 1000, &bench);
+    TEST_ASSERT_EQUAL(8001, bench.instructions);
+    snprintf(message, sizeof(message), "%u instructions: %.1f Minstr/s, worst scan %lld us", bench.instructions,
+             (double)bench.instructions * bench.scans * 1000.0 / bench.total_nsec, (long long)bench.worst_nsec / 1000);
+    TEST_MESSAGE(message);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_example);
+    RUN_TEST(test_reject);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,198 @@
+//
+// SampleLogger file format and index seek, with a restart in the middle of
+// an index group and a block cut short by a power loss, and flush() while
+// another thread keeps logging.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "SampleLogger.hpp"
+
+#define LOG_FILE   "test_sample_logger.bin"
+#define TIME_STEP  1000
+#define GROUP      (LOG_INDEX_INTERVAL + 1)
+
+struct Block {
+    LogBlockHeader header;
+    uint8_t        data[LOG_SECTOR - sizeof(LogBlockHeader)];
+};
+
+static std::vector<Block> read_file() {
+    std::vector<Block> blocks;
+    Block              block;
+    FILE*              file = fopen(LOG_FILE, "rb");
+    while (file != nullptr && fread(&block, 1, sizeof(block), file) == sizeof(block)) {
+        blocks.push_back(block);
+    }
+    if (file != nullptr) {
+        fclose(file);
+    }
+    return blocks;
+}
+
+static bool is_data(const Block& block) {
+    return block.header.magic == LOG_MAGIC && block.header.type == LOG_BLOCK_DATA;
+}
+
+// one boot of the logger, records first..last - 1
+static void log_session(uint32_t first, uint32_t last) {
+    FileLogSink sink;
+    TEST_ASSERT_TRUE(sink.open(LOG_FILE));
+
+    SampleLogger* logger = new SampleLogger(&sink);
+    logger->begin();
+    for (uint32_t i = first; i < last; i++) {
+        if (!logger->log(i % 16, i, 0, (int64_t)i * TIME_STEP)) {
+            logger->flush();
+            TEST_ASSERT_TRUE(logger->log(i % 16, i, 0, (int64_t)i * TIME_STEP));
+        }
+    }
+    logger->end();
+
+    LogStats stats;
+    logger->getStats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.errors);
+    delete logger;
+}
+
+// same search as tools/samplelog.py
+static size_t seek_block(const std::vector<Block>& blocks, int64_t time_ms) {
+    for (size_t first = 0; first + LOG_INDEX_INTERVAL < blocks.size(); first += GROUP) {
+        const Block& index = blocks[first + LOG_INDEX_INTERVAL];
+        int64_t      last;
+        memcpy(&last, &index.data[(index.header.count - 1) * sizeof(int64_t)], sizeof(last));
+        if (last >= time_ms) {
+            return first;
+        }
+    }
+    return blocks.size() / GROUP * GROUP;
+}
+
+static void test_restart() {
+    const uint32_t records = 3 * GROUP * LOG_RECORDS_PER_BLOCK;
+    remove(LOG_FILE);
+
+    log_session(0, records / 3);
+    // power loss during a write: a partial block is left at the end
+    std::vector<Block> before = read_file();
+    FILE*              file   = fopen(LOG_FILE, "ab");
+    fwrite(&before.back(), 1, 100, file);
+    fclose(file);
+    log_session(records / 3, records);
+
+    std::vector<Block> blocks = read_file();
+    TEST_ASSERT_TRUE(blocks.size() > 2 * GROUP);
+
+    std::vector<uint32_t> values;
+    int64_t               base = 0;
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const Block& block = blocks[b];
+        if (b % GROUP == LOG_INDEX_INTERVAL) {
+            TEST_ASSERT_EQUAL(LOG_BLOCK_INDEX, block.header.type);
+            TEST_ASSERT_EQUAL(b, block.header.seq);
+            TEST_ASSERT_EQUAL(LOG_INDEX_INTERVAL, block.header.count);
+            int64_t last;
+            memcpy(&last, &block.data[(LOG_INDEX_INTERVAL - 1) * sizeof(int64_t)], sizeof(last));
+            TEST_ASSERT_EQUAL(base, last);
+            continue;
+        }
+        if (!is_data(block)) {
+            continue;
+        }
+        base = block.header.base_ms;
+        // the partial block repeats the header and records of the last block
+        if (b == before.size()) {
+            continue;
+        }
+        TEST_ASSERT_EQUAL(b, block.header.seq);
+        const LogRecord* record = (const LogRecord*)block.data;
+        for (uint8_t i = 0; i < block.header.count; i++) {
+            values.push_back(record[i].value);
+        }
+    }
+
+    TEST_ASSERT_EQUAL(records, values.size());
+    for (uint32_t i = 0; i < records; i++) {
+        TEST_ASSERT_EQUAL(i, values[i]);
+    }
+}
+
+static void test_seek() {
+    std::vector<Block> blocks = read_file();
+    TEST_ASSERT_TRUE(blocks.size() > 2 * GROUP);
+
+    for (uint32_t record : {0u, 100u, 4000u, 5000u, 7000u}) {
+        int64_t time_ms = (int64_t)record * TIME_STEP;
+        size_t  first   = seek_block(blocks, time_ms);
+        TEST_ASSERT_EQUAL(0, first % GROUP);
+
+        // the group starts before the record and contains it
+        bool found = false;
+        for (size_t b = first; b < blocks.size() && b < first + GROUP && !found; b++) {
+            const LogRecord* record_ = (const LogRecord*)blocks[b].data;
+            for (uint8_t i = 0; is_data(blocks[b]) && i < blocks[b].header.count; i++) {
+                found |= blocks[b].header.base_ms + record_[i].offset_ms == time_ms;
+            }
+        }
+        TEST_ASSERT_TRUE(found);
+        TEST_ASSERT_TRUE(first == 0 || blocks[first - 1].header.base_ms < time_ms);
+    }
+    remove(LOG_FILE);
+}
+
+// flush() returns once the records logged before it are written, not when
+// the buffers are empty
+static void test_flush_while_logging() {
+    const uint32_t records = 100;
+    remove(LOG_FILE);
+
+    FileLogSink sink;
+    TEST_ASSERT_TRUE(sink.open(LOG_FILE));
+    SampleLogger logger(&sink);
+    logger.begin();
+    for (uint32_t i = 0; i < records; i++) {
+        TEST_ASSERT_TRUE(logger.log(1, i, 0, (int64_t)i * TIME_STEP));
+    }
+
+    std::atomic<bool> stop{false};
+    std::thread       writer([&logger, &stop]() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        for (uint32_t i = 0; !stop && std::chrono::steady_clock::now() < deadline; i++) {
+            logger.log(2, i, 0, (int64_t)(records + i) * TIME_STEP);
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    logger.flush();
+    auto msec  = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    stop = true;
+    writer.join();
+    TEST_ASSERT_TRUE(msec.count() < 1000);
+
+    std::vector<Block> blocks = read_file();
+    uint32_t           found  = 0;
+    for (const Block& block : blocks) {
+        const LogRecord* record = (const LogRecord*)block.data;
+        for (uint8_t i = 0; is_data(block) && i < block.header.count; i++) {
+            found += record[i].point == 1 && record[i].value == (int32_t)found;
+        }
+    }
+    TEST_ASSERT_EQUAL(records, found);
+
+    logger.end();
+    remove(LOG_FILE);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_restart);
+    RUN_TEST(test_seek);
+    RUN_TEST(test_flush_while_logging);
+    return UNITY_END();
+}
@@ -0,0 +1,112 @@
+//
+// SensorFilter on the host: parsing of the spec, the result of every stage
+// type and the throughput of SensorFilter::benchmark() in samples/s.
+//
+
+#include <unity.h>
+#include <stdio.h>
+
+#include <SensorFilter.h>
+
+#define BENCH_SAMPLES 1000000
+
+static void test_configure() {
+    SensorFilter filter;
+
+    TEST_ASSERT_TRUE(filter.configure(""));
+    TEST_ASSERT_EQUAL(0, filter.stages());
+    TEST_ASSERT_TRUE(filter.configure(FILTER_BENCH_PIPELINE));
+    TEST_ASSERT_EQUAL(4, filter.stages());
+    TEST_ASSERT_TRUE(filter.configure("outlier:4:50:1"));
+    TEST_ASSERT_EQUAL(1, filter.stages());
+
+    static const char* invalid[] = {
+        "median",  "median:",     "median:4",       "average:16",  "ewma:0",        "ewma:1.5",
+        "gauss:3", "median:3,",   "median:3,,ewma:1", "outlier:4:", "outlier:4::1", "outlier:4:50:",
+        "outlier:4:50:0", "outlier:4:-1", "average:3:2", "median:3,median:3,median:3,median:3,median:3",
+    };
+    for (const char* spec : invalid) {
+        TEST_ASSERT_FALSE_MESSAGE(filter.configure(spec), spec);
+        TEST_ASSERT_EQUAL(0, filter.stages());
+    }
+}
+
+static void test_average_median() {
+    SensorFilter  average, median;
+    const int32_t in[]      = {10, 20, 30, 40, -50, 60};
+    const int32_t means[]   = {10, 15, 20, 30, 7, 17};
+    const int32_t medians[] = {10, 10, 20, 30, 30, 40};
+
+    TEST_ASSERT_TRUE(average.configure("average:3") && median.configure("median:3"));
+    for (size_t i = 0; i < sizeof(in) / sizeof(in[0]); i++) {
+        TEST_ASSERT_EQUAL(means[i], average.update(in[i]));
+        TEST_ASSERT_EQUAL(medians[i], median.update(in[i]));
+    }
+}
+
+static void test_block_matches_update() {
+    SensorFilter sample, block;
+    int32_t      in[200], out[200];
+
+    TEST_ASSERT_TRUE(sample.configure(FILTER_BENCH_PIPELINE) && block.configure(FILTER_BENCH_PIPELINE));
+    for (int i = 0; i < 200; i++) {
+        in[i] = 1000 + (i * 37) % 23 + (i % 50 == 25 ? 5000 : 0);
+    }
+    block.process(in, out, 200);
+    for (int i = 0; i < 200; i++) {
+        TEST_ASSERT_EQUAL(out[i], sample.update(in[i]));
+    }
+    TEST_ASSERT_EQUAL(sample.rejected(), block.rejected());
+    TEST_ASSERT_TRUE(block.rejected() > 0);
+}
+
+// a spike is replaced, a step passes after the run of the stage
+static void test_outlier_run() {
+    for (uint8_t run = 1; run <= FILTER_OUTLIER_RUN; run++) {
+        SensorFilter filter;
+        char         spec[32];
+        int          i;
+
+        snprintf(spec, sizeof(spec), "outlier:4:10:%u", run);
+        TEST_ASSERT_TRUE(filter.configure(spec));
+        for (i = 0; i < 20; i++) {
+            filter.update(2000 + i % 3);
+        }
+        TEST_ASSERT_INT_WITHIN(5, 2000, filter.update(8500));
+        TEST_ASSERT_INT_WITHIN(5, 2000, filter.update(2001));
+        for (i = 0; i < run; i++) {
+            TEST_ASSERT_INT_WITHIN(5, 2000, filter.update(3000));
+        }
+        TEST_ASSERT_EQUAL(3000, filter.update(3000));
+        TEST_ASSERT_EQUAL(1 + run, filter.rejected());
+    }
+}
+
+static void test_benchmark() {
+    static const char* names[FILTER_TYPES] = {"copy", "average", "median", "EWMA", "outlier"};
+    FilterBenchmark    bench;
+    char               message[128];
+
+    SensorFilter::benchmark(BENCH_SAMPLES, &bench);
+    TEST_ASSERT_EQUAL(BENCH_SAMPLES / FILTER_BENCH_BLOCK * FILTER_BENCH_BLOCK, bench.samples);
+    for (uint8_t t = 0; t < FILTER_TYPES; t++) {
+        snprintf(message, sizeof(message), "%-8s %7.1f Msamples/s", names[t],
+                 bench.samples * 1e3 / bench.stage_nsec[t]);
+        TEST_MESSAGE(message);
+    }
+    snprintf(message, sizeof(message), "%s: update() %.1f, process() %.1f Msamples/s, %u rejected",
+             FILTER_BENCH_PIPELINE, bench.samples * 1e3 / bench.update_nsec, bench.samples * 1e3 / bench.block_nsec,
+             bench.rejected);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_TRUE(bench.rejected > 0);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_configure);
+    RUN_TEST(test_average_median);
+    RUN_TEST(test_block_matches_update);
+    RUN_TEST(test_outlier_run);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,198 @@
+//
+// SeriesEncoder / SeriesDecoder round trips: value and time extremes, full
+// and partially filled blocks decoded each on its own, truncated blocks, and
+// the compression ratio and speed of the synthetic sensor series.
+//
+
+#include <unity.h>
+#include <stdio.h>
+#include <vector>
+
+#include "SeriesCodec.hpp"
+
+struct Sample {
+    int64_t time;
+    int32_t value;
+};
+
+struct Block {
+    std::vector<uint8_t> data;
+    uint16_t             count;
+    bool                 full;        // append() refused the next sample
+};
+
+static std::vector<Block> encode(const std::vector<Sample>& samples, size_t block_size) {
+    std::vector<Block>   blocks;
+    std::vector<uint8_t> buffer(block_size);
+    SeriesEncoder        encoder(buffer.data(), block_size);
+
+    for (const Sample& sample : samples) {
+        if (!encoder.append(sample.time, sample.value)) {
+            size_t len = encoder.finish();
+            blocks.push_back({std::vector<uint8_t>(buffer.begin(), buffer.begin() + len), encoder.count(), true});
+            encoder.reset();
+            TEST_ASSERT_TRUE(encoder.append(sample.time, sample.value));
+        }
+    }
+    size_t len = encoder.finish();
+    blocks.push_back({std::vector<uint8_t>(buffer.begin(), buffer.begin() + len), encoder.count(), false});
+    return blocks;
+}
+
+static std::vector<Sample> decode(const uint8_t* block, size_t len) {
+    std::vector<Sample> samples;
+    SeriesDecoder       decoder(block, len);
+    Sample              sample;
+    while (decoder.next(&sample.time, &sample.value)) {
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+static void assert_round_trip(const std::vector<Sample>& samples, size_t block_size) {
+    std::vector<Block> blocks = encode(samples, block_size);
+    size_t             first  = 0;
+    for (const Block& block : blocks) {
+        std::vector<Sample> decoded = decode(block.data.data(), block.data.size());
+        TEST_ASSERT_EQUAL(block.count, decoded.size());
+        for (size_t i = 0; i < decoded.size(); i++) {
+            TEST_ASSERT_TRUE(decoded[i].time == samples[first + i].time);
+            TEST_ASSERT_EQUAL(samples[first + i].value, decoded[i].value);
+        }
+        first += decoded.size();
+    }
+    TEST_ASSERT_EQUAL(samples.size(), first);
+}
+
+// a sample every 5 s with a few ms of jitter and a slowly changing value
+static std::vector<Sample> sensor_series(uint32_t count) {
+    std::vector<Sample> samples;
+    int64_t             time  = 1760000000000LL;
+    int32_t             value = 215;
+    for (uint32_t i = 0; i < count; i++) {
+        time += 5000 + (int32_t)(i * 7 % 5) - 2;
+        value += i % 9 == 0 ? 1 : i % 13 == 0 ? -1 : 0;
+        samples.push_back({time, value});
+    }
+    return samples;
+}
+
+static void test_value_extremes() {
+    std::vector<Sample> samples;
+    const int32_t       values[] = {0, INT32_MAX, INT32_MIN, INT32_MAX, -1, 1, INT32_MIN, 0, 7, -8, 2047, -2048};
+    int64_t             time     = 0;
+    for (int32_t value : values) {
+        samples.push_back({time, value});
+        time += 1000;
+    }
+    assert_round_trip(samples, 256);
+}
+
+static void test_time_extremes() {
+    // deltas that overflow int32 in the header and delta-of-deltas that
+    // need the 64 bit bucket, up to a step across the whole int64 range
+    const std::vector<Sample> samples = {
+        {INT64_MIN, 1},
+        {INT64_MIN + 1, 2},
+        {-1000000000000000LL, 3},
+        {0, 4},
+        {0, 5},
+        {1, 6},
+        {5000000000LL, 7},
+        {5000000001LL, 8},
+        {INT64_MAX - 1, 9},
+        {INT64_MAX, 10},
+    };
+    assert_round_trip(samples, 256);
+
+    // only the second sample is far away
+    assert_round_trip({{0, 0}, {(int64_t)INT32_MAX + 1, 0}, {(int64_t)INT32_MAX + 2, 0}}, 64);
+    assert_round_trip({{0, 0}, {INT32_MIN, 0}, {0, 0}}, 64);
+}
+
+// the delta of a regular cadence is in the header, the second sample costs
+// one bit of time and one bit of value
+static void test_header_delta() {
+    uint8_t       block[64];
+    SeriesEncoder encoder(block, sizeof(block));
+    TEST_ASSERT_TRUE(encoder.append(1760000000000LL, 215));
+    TEST_ASSERT_TRUE(encoder.append(1760000005000LL, 215));
+    TEST_ASSERT_EQUAL(SERIES_HEADER + 1, encoder.finish());
+
+    std::vector<Sample> decoded = decode(block, SERIES_HEADER + 1);
+    TEST_ASSERT_EQUAL(2, decoded.size());
+    TEST_ASSERT_TRUE(decoded[1].time == 1760000005000LL);
+}
+
+// full blocks and the partially filled last one decode on their own, in any order
+static void test_blocks() {
+    std::vector<Sample> samples = sensor_series(2000);
+    std::vector<Block>  blocks  = encode(samples, 64);
+    TEST_ASSERT_TRUE(blocks.size() > 2);
+    TEST_ASSERT_FALSE(blocks.back().full);
+
+    std::vector<size_t> first(blocks.size());
+    for (size_t b = 1; b < blocks.size(); b++) {
+        TEST_ASSERT_TRUE(blocks[b - 1].full);
+        TEST_ASSERT_TRUE(blocks[b - 1].data.size() <= 64);
+        first[b] = first[b - 1] + blocks[b - 1].count;
+    }
+    for (size_t b = blocks.size(); b-- > 0;) {
+        std::vector<Sample> decoded = decode(blocks[b].data.data(), blocks[b].data.size());
+        TEST_ASSERT_EQUAL(blocks[b].count, decoded.size());
+        for (size_t i = 0; i < decoded.size(); i++) {
+            TEST_ASSERT_TRUE(decoded[i].time == samples[first[b] + i].time);
+            TEST_ASSERT_EQUAL(samples[first[b] + i].value, decoded[i].value);
+        }
+    }
+    TEST_ASSERT_EQUAL(samples.size(), first.back() + blocks.back().count);
+}
+
+// a block cut short decodes to a prefix of its samples, never to wrong ones
+static void test_truncated() {
+    std::vector<Sample> samples = sensor_series(300);
+    samples[100].value          = INT32_MIN;
+    samples[200].time += 100000;
+    std::vector<Block> blocks = encode(samples, 1024);
+    TEST_ASSERT_EQUAL(1, blocks.size());
+
+    const Block& block = blocks[0];
+    size_t       last  = 0;
+    for (size_t len = 0; len <= block.data.size(); len++) {
+        std::vector<Sample> decoded = decode(block.data.data(), len);
+        TEST_ASSERT_TRUE(decoded.size() >= last);
+        for (size_t i = 0; i < decoded.size(); i++) {
+            TEST_ASSERT_TRUE(decoded[i].time == samples[i].time);
+            TEST_ASSERT_EQUAL(samples[i].value, decoded[i].value);
+        }
+        last = decoded.size();
+        if (len < SERIES_HEADER) {
+            TEST_ASSERT_EQUAL(0, last);
+        }
+    }
+    TEST_ASSERT_EQUAL(samples.size(), last);
+}
+
+static void test_benchmark() {
+    SeriesBenchmark bench;
+    char            message[128];
+    SeriesEncoder::benchmark(20000, 256, &bench);
+    snprintf(message, sizeof(message), "%u samples in %u blocks: ratio %.2f, %.1f bits/sample, encode %.2f MB/s, "
+             "decode %.2f MB/s", bench.samples, bench.blocks, (double)bench.raw_bytes / bench.compressed_bytes,
+             bench.compressed_bytes * 8.0 / bench.samples, bench.raw_bytes * 1000.0 / bench.encode_nsec,
+             bench.raw_bytes * 1000.0 / bench.decode_nsec);
+    TEST_MESSAGE(message);
+    TEST_ASSERT_EQUAL(20000, bench.samples);
+    TEST_ASSERT_TRUE(bench.compressed_bytes < bench.raw_bytes);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_value_extremes);
+    RUN_TEST(test_time_extremes);
+    RUN_TEST(test_header_delta);
+    RUN_TEST(test_blocks);
+    RUN_TEST(test_truncated);
+    RUN_TEST(test_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,76 @@
+//
+// TrendStore resolution selection and bucket merging.
+//
+
+#include <unity.h>
+
+#include "TrendStore.hpp"
+
+#define START 1760000400000LL     // whole hour
+#define HOUR  3600000LL
+
+static StaticTrendStore<2> trends;
+
+static void test_track() {
+    TEST_ASSERT_TRUE(trends.track(1));
+    TEST_ASSERT_TRUE(trends.track(2));
+    TEST_ASSERT_FALSE(trends.track(3));
+
+    // one sample per second for two hours, value = second in the hour
+    for (int64_t t = START; t < START + 2 * HOUR; t += 1000) {
+        trends.add(1, (int32_t)((t - START) % HOUR / 1000), t);
+    }
+    trends.add(3, 0, START);
+}
+
+static void test_aligned_hour() {
+    TrendSample out[60];
+    uint16_t    count = trends.query(1, START + HOUR, START + 2 * HOUR, 60, out);
+
+    TEST_ASSERT_EQUAL(60, count);
+    TEST_ASSERT_EQUAL(START + HOUR, out[0].time);
+    TEST_ASSERT_EQUAL(TrendStore::period(1), out[1].time - out[0].time);
+    TEST_ASSERT_EQUAL(60, out[0].count);
+    TEST_ASSERT_EQUAL(0, out[0].min);
+    TEST_ASSERT_EQUAL(3599, out[59].max);
+}
+
+static void test_unaligned_hour() {
+    TrendSample out[60];
+    int64_t     to    = START + 2 * HOUR - 30000;
+    uint16_t    count = trends.query(1, to - HOUR, to, 60, out);
+
+    // 61 minute buckets: the partial first one is merged with the next
+    TEST_ASSERT_EQUAL(60, count);
+    TEST_ASSERT_EQUAL(START + HOUR - 60000, out[0].time);
+    TEST_ASSERT_EQUAL(120, out[0].count);
+    TEST_ASSERT_EQUAL(START + HOUR + 60000, out[1].time);
+    TEST_ASSERT_EQUAL(60, out[1].count);
+    TEST_ASSERT_EQUAL(START + 2 * HOUR - 60000, out[59].time);
+}
+
+static void test_merged_steps() {
+    TrendSample out[30];
+    uint16_t    count = trends.query(1, START + HOUR, START + 2 * HOUR, 30, out);
+
+    TEST_ASSERT_EQUAL(30, count);
+    TEST_ASSERT_EQUAL(120, out[0].count);
+    TEST_ASSERT_EQUAL(2 * TrendStore::period(1), out[1].time - out[0].time);
+    TEST_ASSERT_EQUAL(59, out[0].avg);      // seconds 0..119
+}
+
+static void test_untracked() {
+    TrendSample out[10];
+    TEST_ASSERT_EQUAL(0, trends.query(2, START, START + HOUR, 10, out));
+    TEST_ASSERT_EQUAL(0, trends.query(3, START, START + HOUR, 10, out));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_track);
+    RUN_TEST(test_aligned_hour);
+    RUN_TEST(test_unaligned_hour);
+    RUN_TEST(test_merged_steps);
+    RUN_TEST(test_untracked);
+    return UNITY_END();
+}